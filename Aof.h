@@ -0,0 +1,450 @@
+#ifndef AOF_H
+#define AOF_H
+
+/**
+ * Aof.h
+ * AOF（append only file）：每个写操作按 RESP 命令追加到日志里，两次快照之间宕机也不丢数据。
+ *
+ * 文件（和 Redis 7 的 multi part AOF 一个思路）：
+ *   appendonly.aof.manifest      当前有效的文件清单，tmp + rename 整体替换
+ *   appendonly.aof.<n>.base.db   基础数据，就是一份快照（Snapshot.h 格式）
+ *   appendonly.aof.<n>.incr.aof  base 之后的写命令（RESP），可能有好几个，按顺序重放
+ * 启动时先加载 base，再依次重放 incr；最后一个 incr 末尾写了一半的命令（宕机）会被截掉。
+ *
+ * 写入：
+ *   - KVStore 在分片锁里把每个写操作交给 Feed()，顺序就是真正执行的顺序，先攒在内存里；
+ *   - Reactor 把回复发出去之前调 Flush()：write 进文件，appendfsync always 再 fdatasync。
+ *     几个线程同时 Flush 时只有一个真正 fsync，其它的发现已经覆盖到自己的数据就直接返回（group commit）；
+ *   - everysec 由后台线程每秒 fdatasync 一次，no 交给操作系统。
+ *
+ * 重写（BGREWRITEAOF，或者比上次重写后大了一倍）：Persistence 先调 PrepareRotate() 打开新 incr、把旧 incr 刷盘，
+ * 然后 fork 子进程时在全锁下调 Rotate() 换文件、写清单（这里不 fsync 数据文件，全锁只挡一小会），
+ * 之后的写进新的 incr，放锁以后 FinishRotate() 把旧 incr 剩下的尾巴刷盘、关掉；子进程把 fork 那一刻的数据写成新的 base；成功后清单换成 新 base + 新 incr，
+ * 旧文件删掉。失败的话清单不变，旧 base + 两个 incr 照样能恢复。
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "Config.h"
+#include "KVStore.h"
+#include "Buffer.h"
+#include "OutputBuffer.h"
+#include "Reply.h"
+#include "RespParser.h"
+#include "Slice.h"
+
+using namespace std;
+
+extern KVStore* g_store;
+
+// 重放一条命令（Command.h 的 ReplayCommand），不是写命令返回 false
+typedef bool (*ReplayFn)(RespParser& parser);
+
+class Aof {
+public:
+    Aof() : enabled_(false), fd_(-1), nextFd_(-1), retiredFd_(-1), nextIncrSeq_(0), baseSeq_(0), nextSeq_(1), baseSize_(0), incrSize_(0),
+            curIncrSize_(0), rewriteBaseSize_(0), fed_(0), written_(0), synced_(0), stop_(false) {}
+
+    ~Aof() { Shutdown(); }
+
+    static bool HasManifest() {
+        struct stat st;
+        return stat(MANIFEST, &st) == 0;
+    }
+
+    bool Enabled() const { return enabled_; }
+
+    /**
+     * 启动：有 manifest 就加载 base、重放 incr（KVStore 这时应该是空的）；
+     * 没有就拿当前的数据（刚从 data.db 加载的）写一个初始 base。最后打开最后一个 incr 接着往后写。
+     */
+    void Start(ReplayFn replay) {
+        if (HasManifest()) {
+            Load(replay);
+        } else {
+            baseSeq_ = nextSeq_++;
+            uint64_t records = 0;
+            if (!g_store->WriteSnapshot(BaseName(baseSeq_), &records)) Fatal("can't write initial base");
+            incrs_.push_back(nextSeq_++);
+            baseSize_ = FileSize(BaseName(baseSeq_));
+            rewriteBaseSize_ = baseSize_;
+            if (!WriteManifest()) Fatal("can't write manifest");
+            cout << "[AOF] Created " << BaseName(baseSeq_) << " with " << records << " records" << endl;
+        }
+        fd_ = OpenIncr(incrs_.back());
+        if (fd_ < 0) Fatal("can't open " + IncrName(incrs_.back()));
+        enabled_ = true;
+        syncThread_ = thread([this]() { SyncLoop(); });
+    }
+
+    // 在分片锁里调用：这个写操作按 RESP 追加到内存缓冲区
+    void Feed(const Slice* argv, int argc) {
+        lock_guard<mutex> lock(mtx_);
+        size_t before = buf_.Bytes();
+        AddReplyArrayLen(buf_, argc);
+        for (int i = 0; i < argc; ++i) AddReplyBulk(buf_, argv[i]);
+        fed_.fetch_add(buf_.Bytes() - before, memory_order_release);
+    }
+
+    /**
+     * 回复发出去之前调用：把攒着的命令写进文件，always 的话再等它落盘。
+     * 没有新数据时只读两个原子变量，不拿锁。
+     */
+    void Flush() {
+        if (!enabled_) return;
+        bool always = g_config.appendfsync == FSYNC_ALWAYS;
+        uint64_t written = written_.load(memory_order_acquire);
+        if (written == fed_.load(memory_order_acquire) && (!always || synced_.load(memory_order_acquire) >= written)) {
+            return;
+        }
+        uint64_t target;
+        {
+            lock_guard<mutex> wlock(writeMtx_);
+            WriteOut();
+            target = written_.load(memory_order_relaxed);
+        }
+        if (always) SyncTo(target);
+    }
+
+    /**
+     * 重写前、还没拿分片锁时调用：先打开新 incr，把目前攒着的写完、落盘。
+     * 这样 Rotate() 在全锁下只剩一点点要写，不用等磁盘。打不开新文件返回 false（这次就不重写了）。
+     */
+    bool PrepareRotate() {
+        {
+            lock_guard<mutex> wlock(writeMtx_);
+            uint64_t seq = nextSeq_;
+            int fd = OpenIncr(seq);
+            if (fd < 0) return false;
+            if (nextFd_ >= 0) close(nextFd_);
+            nextFd_ = fd;
+            nextIncrSeq_ = seq;
+            nextSeq_++;
+            WriteOut();
+        }
+        if (g_config.appendfsync != FSYNC_NO) SyncTo(written_.load(memory_order_acquire));
+        return true;
+    }
+
+    /**
+     * fork 重写子进程前、拿着所有分片锁时调用：之前的写都留在旧 incr 里（写完），之后的写进 PrepareRotate 打开的 incr，
+     * 清单里加上它。旧 incr 不在这里 fdatasync，交给 FinishRotate / 下一次 SyncTo。返回新 base 的编号，失败返回 0。
+     */
+    uint64_t Rotate() {
+        lock_guard<mutex> wlock(writeMtx_);
+        if (nextFd_ < 0) return 0;
+        WriteOut();
+        retiredFd_ = fd_;
+        fd_ = nextFd_;
+        nextFd_ = -1;
+        incrs_.push_back(nextIncrSeq_);
+        curIncrSize_ = 0;
+        if (!WriteManifest()) cerr << "[AOF] Failed to update manifest" << endl;
+        return nextSeq_++;
+    }
+
+    // Rotate 之后、放掉分片锁以后调用：旧 incr 剩下的尾巴落盘（appendfsync no 就不管），然后关掉
+    void FinishRotate() {
+        if (g_config.appendfsync != FSYNC_NO) SyncTo(written_.load(memory_order_acquire));
+        lock_guard<mutex> slock(syncMtx_);
+        lock_guard<mutex> wlock(writeMtx_);
+        if (retiredFd_ >= 0) {
+            close(retiredFd_);
+            retiredFd_ = -1;
+        }
+    }
+
+    // 重写子进程结束：成功就换上新 base，删掉不再需要的文件；失败就把写了一半的 base 删掉
+    void RewriteDone(uint64_t baseSeq, bool ok) {
+        lock_guard<mutex> wlock(writeMtx_);
+        if (!ok) {
+            unlink(BaseName(baseSeq).c_str());
+            unlink((BaseName(baseSeq) + ".tmp").c_str());
+            return;
+        }
+        uint64_t oldBase = baseSeq_;
+        vector<uint64_t> oldIncrs(incrs_.begin(), incrs_.end() - 1);
+        baseSeq_ = baseSeq;
+        incrs_.erase(incrs_.begin(), incrs_.end() - 1);
+        if (!WriteManifest()) {
+            cerr << "[AOF] Failed to update manifest, keeping old files" << endl;
+            return;
+        }
+        if (oldBase) unlink(BaseName(oldBase).c_str());
+        for (uint64_t seq : oldIncrs) unlink(IncrName(seq).c_str());
+        baseSize_ = FileSize(BaseName(baseSeq_));
+        incrSize_ = curIncrSize_;
+        rewriteBaseSize_ = baseSize_ + incrSize_;
+    }
+
+    // 按 auto-aof-rewrite-percentage / min-size 判断要不要自动重写
+    bool NeedRewrite() {
+        if (!enabled_ || g_config.aof_rewrite_percentage <= 0) return false;
+        lock_guard<mutex> wlock(writeMtx_);
+        uint64_t cur = baseSize_ + incrSize_;
+        uint64_t base = rewriteBaseSize_ ? rewriteBaseSize_ : 1;
+        return cur >= g_config.aof_rewrite_min_size &&
+               cur >= base + base * g_config.aof_rewrite_percentage / 100;
+    }
+
+    static string BaseName(uint64_t seq) { return string(MANIFEST_PREFIX) + to_string(seq) + ".base.db"; }
+    static string IncrName(uint64_t seq) { return string(MANIFEST_PREFIX) + to_string(seq) + ".incr.aof"; }
+
+    // 退出前：写完、落盘、停掉后台线程
+    void Shutdown() {
+        if (!enabled_) return;
+        {
+            lock_guard<mutex> lock(stopMtx_);
+            stop_ = true;
+        }
+        stopCv_.notify_all();
+        if (syncThread_.joinable()) syncThread_.join();
+        {
+            lock_guard<mutex> wlock(writeMtx_);
+            WriteOut();
+        }
+        if (g_config.appendfsync != FSYNC_NO) {
+            if (retiredFd_ >= 0) fdatasync(retiredFd_);
+            fdatasync(fd_);
+        }
+        if (retiredFd_ >= 0) close(retiredFd_);
+        if (nextFd_ >= 0) close(nextFd_);
+        close(fd_);
+        fd_ = retiredFd_ = nextFd_ = -1;
+        enabled_ = false;
+    }
+
+private:
+    static constexpr const char* MANIFEST = "appendonly.aof.manifest";
+    static constexpr const char* MANIFEST_PREFIX = "appendonly.aof.";
+
+    bool enabled_;
+    int fd_;                 // 当前 incr 文件
+    int nextFd_;             // PrepareRotate 打开、Rotate 换上的新 incr
+    int retiredFd_;          // Rotate 换下来、还没落盘关掉的旧 incr
+    uint64_t nextIncrSeq_;   // nextFd_ 的编号
+    uint64_t baseSeq_;       // 清单里的 base，0 表示没有
+    vector<uint64_t> incrs_; // 清单里的 incr，最后一个是正在写的
+    uint64_t nextSeq_;       // 下一个文件编号
+    uint64_t baseSize_;      // 下面几个大小给自动重写用
+    uint64_t incrSize_;      // 清单里所有 incr 的总大小
+    uint64_t curIncrSize_;   // 正在写的 incr 的大小
+    uint64_t rewriteBaseSize_; // 上次重写（或启动）后 AOF 的总大小
+
+    mutex mtx_;        // 保护 buf_（Feed 在分片锁里拿它）
+    OutputBuffer buf_; // 还没 write 的命令
+    mutex writeMtx_;   // 保证 write 的顺序，也保护 writing_、三个 fd、清单和上面的大小
+    OutputBuffer writing_; // 从 buf_ 换出来正在写的（上次写失败剩下的也在这）
+    mutex syncMtx_;    // fdatasync 一次只一个（也只有拿着它才能关 retiredFd_）
+    atomic<uint64_t> fed_;     // 一共收到多少字节
+    atomic<uint64_t> written_; // 一共写进文件多少字节
+    atomic<uint64_t> synced_;  // 其中已经 fdatasync 的
+
+    thread syncThread_;
+    mutex stopMtx_;
+    condition_variable stopCv_;
+    bool stop_;
+
+    static void Fatal(const string& msg) {
+        cerr << "[AOF] " << msg << endl;
+        exit(1);
+    }
+
+    static uint64_t FileSize(const string& path) {
+        struct stat st;
+        return stat(path.c_str(), &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+    }
+
+    static int OpenIncr(uint64_t seq) {
+        return open(IncrName(seq).c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+    }
+
+    // 调用方拿着 writeMtx_：先把上次没写完的写掉，再把 buf_ 换出来写，直到写空
+    void WriteOut() {
+        while (true) {
+            if (writing_.Empty()) {
+                lock_guard<mutex> lock(mtx_);
+                swap(writing_, buf_);
+            }
+            if (writing_.Empty()) return;
+            size_t before = writing_.Bytes();
+            ssize_t n = writing_.WriteFd(fd_);
+            size_t done = before - writing_.Bytes();
+            curIncrSize_ += done;
+            incrSize_ += done;
+            written_.fetch_add(done, memory_order_release);
+            if (n < 0) {
+                // 磁盘满之类：always 下没法保证刚才的写已经落盘，只能退出；其它策略留着下轮再写
+                perror("[AOF] write");
+                if (g_config.appendfsync == FSYNC_ALWAYS) exit(1);
+                return;
+            }
+        }
+    }
+
+    // 保证前 target 字节已经落盘。别的线程的 fdatasync 已经覆盖到了就不用再做。
+    // 刚 Rotate 过的话前面一部分在旧 incr 里，先把它刷了、关掉
+    void SyncTo(uint64_t target) {
+        lock_guard<mutex> lock(syncMtx_);
+        if (synced_.load(memory_order_acquire) >= target) return;
+        uint64_t upto;
+        int fd, retired;
+        {
+            lock_guard<mutex> wlock(writeMtx_);
+            upto = written_.load(memory_order_relaxed); // 这之前 write 的都会一起刷下去
+            fd = fd_;
+            retired = retiredFd_;
+            retiredFd_ = -1;
+        }
+        // fd 在放掉 writeMtx_ 以后可能被 Rotate 换下来，但只会放进 retiredFd_，拿着 syncMtx_ 的时候没人关它
+        if (retired >= 0) {
+            int r = fdatasync(retired);
+            close(retired);
+            if (r != 0) {
+                perror("[AOF] fdatasync");
+                if (g_config.appendfsync == FSYNC_ALWAYS) exit(1);
+                return;
+            }
+        }
+        if (fdatasync(fd) != 0) {
+            perror("[AOF] fdatasync");
+            if (g_config.appendfsync == FSYNC_ALWAYS) exit(1);
+            return;
+        }
+        synced_.store(upto, memory_order_release);
+    }
+
+    // everysec：后台线程每秒 fdatasync 一次，Reactor 不用等磁盘
+    void SyncLoop() {
+        unique_lock<mutex> lock(stopMtx_);
+        while (!stop_) {
+            stopCv_.wait_for(lock, chrono::seconds(1));
+            if (stop_) break;
+            if (g_config.appendfsync != FSYNC_EVERYSEC) continue;
+            lock.unlock();
+            SyncTo(written_.load(memory_order_acquire));
+            lock.lock();
+        }
+    }
+
+    // 清单：一行一个文件，"base <n>" / "incr <n>"
+    bool WriteManifest() {
+        string tmp = string(MANIFEST) + ".tmp";
+        FILE* f = fopen(tmp.c_str(), "w");
+        if (!f) return false;
+        if (baseSeq_) fprintf(f, "base %llu\n", static_cast<unsigned long long>(baseSeq_));
+        for (uint64_t seq : incrs_) fprintf(f, "incr %llu\n", static_cast<unsigned long long>(seq));
+        bool ok = fflush(f) == 0 && fsync(fileno(f)) == 0;
+        ok = fclose(f) == 0 && ok;
+        if (!ok || rename(tmp.c_str(), MANIFEST) != 0) {
+            unlink(tmp.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    void ReadManifest() {
+        FILE* f = fopen(MANIFEST, "r");
+        if (!f) Fatal(string("can't open ") + MANIFEST);
+        char type[16];
+        unsigned long long seq;
+        while (fscanf(f, "%15s %llu", type, &seq) == 2) {
+            if (strcmp(type, "base") == 0) baseSeq_ = seq;
+            else if (strcmp(type, "incr") == 0) incrs_.push_back(seq);
+            else Fatal(string("bad manifest line: ") + type);
+            if (seq >= nextSeq_) nextSeq_ = seq + 1;
+        }
+        fclose(f);
+        if (incrs_.empty()) incrs_.push_back(nextSeq_++);
+    }
+
+    void Load(ReplayFn replay) {
+        auto start = chrono::steady_clock::now();
+        ReadManifest();
+        if (baseSeq_) {
+            string base = BaseName(baseSeq_);
+            if (FileSize(base) == 0) Fatal("missing base file " + base);
+            g_store->LoadSnapshot(base, true); // 后面还要重放 incr
+            baseSize_ = FileSize(base);
+        }
+        uint64_t commands = 0;
+        for (size_t i = 0; i < incrs_.size(); ++i) {
+            commands += Replay(IncrName(incrs_[i]), i + 1 == incrs_.size(), replay);
+        }
+        curIncrSize_ = FileSize(IncrName(incrs_.back()));
+        rewriteBaseSize_ = baseSize_ + incrSize_;
+        g_store->ResetDirty();
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        cout << "[AOF] Loaded base + " << incrs_.size() << " incr file(s), " << commands
+             << " commands replayed in " << ms << " ms" << endl;
+    }
+
+    // 重放一个 incr 文件，返回命令数。最后一个文件末尾不完整（写到一半宕机）就截掉，其它情况都算文件坏了
+    uint64_t Replay(const string& path, bool last, ReplayFn replay) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            if (errno == ENOENT && last) return 0; // 刚建好清单还没写过
+            Fatal("can't open " + path);
+        }
+        Buffer buf;
+        RespParser parser;
+        uint64_t readBytes = 0; // 从文件里读了多少
+        uint64_t valid = 0;     // 到最后一条完整命令为止的长度
+        uint64_t commands = 0;
+        bool eof = false;
+        while (true) {
+            RespParser::Result r = parser.Parse(buf);
+            if (r == RespParser::PARSE_OK) {
+                if (!replay(parser)) Fatal("unexpected command in " + path);
+                parser.Next();
+                parser.Consume(buf);
+                valid = readBytes - buf.ReadableBytes();
+                commands++;
+                continue;
+            }
+            if (r == RespParser::PARSE_ERROR) Fatal("bad format in " + path + ": " + parser.Error());
+            if (eof) break;
+            ssize_t n;
+            if (parser.WantsDirectRead()) {
+                size_t got = 0;
+                n = buf.ReadFd(fd, parser.DirectReadPtr(), parser.DirectReadLen(), &got);
+                parser.DirectReadDone(got);
+            } else {
+                buf.EnsureWritable(1024 * 1024); // 文件一次读大一点
+                n = buf.ReadFd(fd);
+            }
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                Fatal("read " + path + ": " + strerror(errno));
+            }
+            if (n == 0) eof = true;
+            readBytes += n;
+        }
+        close(fd);
+        if (valid < readBytes) {
+            if (!last) Fatal("truncated " + path);
+            cerr << "[AOF] " << path << " ends with an incomplete command, truncating "
+                 << readBytes - valid << " bytes" << endl;
+            if (truncate(path.c_str(), valid) != 0) Fatal("truncate " + path + ": " + strerror(errno));
+        }
+        incrSize_ += valid;
+        return commands;
+    }
+};
+
+extern Aof* g_aof;
+
+#endif // AOF_H
@@ -0,0 +1,95 @@
+/**
+ * Arena.h
+ * 给跳表节点用的 slab 分配器。
+ * 节点大小只跟层数有关（1~MAX_LEVEL 层），所以按层数分成若干个“尺寸档”，
+ * 每档一条空闲链表；没有空闲块时从一大块 chunk 里顺序切一段出来。
+ * 这样插入一个 key 只需要一次指针碰撞（bump），删除时挂回空闲链表复用，
+ * 不用每个节点都去调 malloc/free。
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+class NodeArena {
+public:
+    // chunkSize: 每次向系统申请的大块大小
+    explicit NodeArena(size_t chunkSize = 256 * 1024)
+        : chunkSize_(chunkSize), ptr_(nullptr), remain_(0), bytesUsed_(0) {}
+
+    ~NodeArena() {
+        for (char* c : chunks_) {
+            ::operator delete(c);
+        }
+    }
+
+    NodeArena(const NodeArena&) = delete;
+    NodeArena& operator=(const NodeArena&) = delete;
+
+    // 分配 size 字节，sizeClass 相同的块大小必须相同（空闲链表按档复用）
+    void* Allocate(size_t size, int sizeClass) {
+        if (sizeClass < static_cast<int>(freeLists_.size()) && freeLists_[sizeClass]) {
+            FreeBlock* b = freeLists_[sizeClass];
+            freeLists_[sizeClass] = b->next;
+            return b;
+        }
+        size = Align(size);
+        if (size > remain_) {
+            NewChunk(size);
+        }
+        char* p = ptr_;
+        ptr_ += size;
+        remain_ -= size;
+        bytesUsed_ += size;
+        return p;
+    }
+
+    // 还回来的块不还给系统，挂到对应档的空闲链表上等下次复用
+    void Deallocate(void* p, int sizeClass) {
+        if (sizeClass >= static_cast<int>(freeLists_.size())) {
+            freeLists_.resize(sizeClass + 1, nullptr);
+        }
+        FreeBlock* b = static_cast<FreeBlock*>(p);
+        b->next = freeLists_[sizeClass];
+        freeLists_[sizeClass] = b;
+    }
+
+    // 从系统申请的总字节数（含空闲链表里的块）
+    size_t MemoryUsage() const { return chunks_.size() * chunkSize_ + bytesBig_; }
+    // 切出去过的字节数
+    size_t BytesUsed() const { return bytesUsed_; }
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    size_t chunkSize_;
+    char* ptr_;       // 当前 chunk 里下一个可用位置
+    size_t remain_;   // 当前 chunk 还剩多少
+    size_t bytesUsed_;
+    size_t bytesBig_ = 0;
+    std::vector<char*> chunks_;
+    std::vector<FreeBlock*> freeLists_;
+
+    // 按指针大小对齐，节点里的 string/指针都是 8 字节对齐
+    static size_t Align(size_t n) {
+        const size_t a = alignof(void*);
+        return (n + a - 1) & ~(a - 1);
+    }
+
+    void NewChunk(size_t need) {
+        // 当前 chunk 剩下的尾巴直接丢掉（最多浪费一个最大节点的大小）
+        size_t sz = need > chunkSize_ ? need : chunkSize_;
+        char* c = static_cast<char*>(::operator new(sz));
+        if (sz != chunkSize_) bytesBig_ += sz - chunkSize_;
+        chunks_.push_back(c);
+        ptr_ = c;
+        remain_ = sz;
+    }
+};
+
+#endif // ARENA_H
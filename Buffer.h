@@ -0,0 +1,143 @@
+/**
+ * Buffer.h
+ * 连接的读缓冲区：一块连续内存 + 读写两个游标（参考 muduo 的 Buffer）。
+ *
+ *   +-------------------+------------------+------------------+
+ *   |  已经消费掉的部分   |  可读数据 (待解析) |  可写空间          |
+ *   +-------------------+------------------+------------------+
+ *   0             readIndex_        writeIndex_          size()
+ *
+ * - 解析只移动 readIndex_，不像 string::substr 那样每处理一行就把剩下的数据整体搬一遍；
+ * - 可写空间不够时，先看看前面消费掉的空间够不够，够就把数据挪到开头（偶尔才做一次），不够再扩容；
+ * - ReadFd 用 readv 同时读进自己的可写空间和栈上的 64KB 临时区，一次系统调用尽量读完。
+ */
+
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <sys/uio.h>
+#include "Slice.h"
+#include "Stats.h"
+
+class Buffer {
+public:
+    static const size_t INITIAL_SIZE = 16 * 1024;
+
+    explicit Buffer(size_t initialSize = INITIAL_SIZE)
+        : buffer_(initialSize), readIndex_(0), writeIndex_(0) {}
+
+    size_t ReadableBytes() const { return writeIndex_ - readIndex_; }
+    size_t WritableBytes() const { return buffer_.size() - writeIndex_; }
+
+    // 可读数据的起始位置
+    const char* Peek() const { return &buffer_[0] + readIndex_; }
+    char* BeginWrite() { return &buffer_[0] + writeIndex_; }
+
+    // 消费掉 len 字节
+    void Retrieve(size_t len) {
+        if (len < ReadableBytes()) {
+            readIndex_ += len;
+        } else {
+            RetrieveAll();
+        }
+    }
+
+    void RetrieveAll() {
+        readIndex_ = 0;
+        writeIndex_ = 0;
+    }
+
+    // 把可读区末尾的 len 字节退回去（解析器把大参数挪走后用）
+    void Unwrite(size_t len) { writeIndex_ -= len; }
+
+    void HasWritten(size_t len) { writeIndex_ += len; }
+
+    void Append(const char* data, size_t len) {
+        EnsureWritable(len);
+        memcpy(BeginWrite(), data, len);
+        writeIndex_ += len;
+    }
+
+    void Append(const Slice& s) { Append(s.data(), s.size()); }
+
+    // 保证后面至少有 len 字节可写
+    void EnsureWritable(size_t len) {
+        if (WritableBytes() >= len) return;
+        size_t readable = ReadableBytes();
+        if (readIndex_ + WritableBytes() >= len && readIndex_ >= readable) {
+            // 前面空出来的地方够用，而且要搬的数据不比空出来的多：挪到开头（压缩）
+            memmove(&buffer_[0], Peek(), readable);
+            readIndex_ = 0;
+            writeIndex_ = readable;
+        } else {
+            // 不够就扩容，顺便也把数据挪到开头
+            std::vector<char> bigger(std::max(buffer_.size() * 2, writeIndex_ - readIndex_ + len));
+            memcpy(&bigger[0], Peek(), readable);
+            buffer_.swap(bigger);
+            readIndex_ = 0;
+            writeIndex_ = readable;
+        }
+    }
+
+    /**
+     * 从 fd 读数据。direct/directLen 不为空时，最前面的 directLen 字节直接读进 direct
+     * （大参数直接落到最终的 string 里），多出来的部分再进缓冲区。
+     * 返回值和 read 一样；*directGot 是写进 direct 的字节数。
+     */
+    ssize_t ReadFd(int fd, char* direct = nullptr, size_t directLen = 0, size_t* directGot = nullptr) {
+        char extrabuf[65536];
+        struct iovec vec[3];
+        int cnt = 0;
+        if (directLen > 0) {
+            vec[cnt].iov_base = direct;
+            vec[cnt].iov_len = directLen;
+            cnt++;
+        }
+        const size_t writable = WritableBytes();
+        vec[cnt].iov_base = BeginWrite();
+        vec[cnt].iov_len = writable;
+        cnt++;
+        vec[cnt].iov_base = extrabuf;
+        vec[cnt].iov_len = sizeof(extrabuf);
+        cnt++;
+
+        CountSyscall();
+        ssize_t n = readv(fd, vec, cnt);
+        if (n <= 0) {
+            if (directGot) *directGot = 0;
+            return n;
+        }
+        size_t rest = static_cast<size_t>(n);
+        size_t got = rest < directLen ? rest : directLen;
+        if (directGot) *directGot = got;
+        rest -= got;
+        if (rest <= writable) {
+            writeIndex_ += rest;
+        } else {
+            writeIndex_ = buffer_.size();
+            Append(extrabuf, rest - writable);
+        }
+        return n;
+    }
+
+    // 缓冲区很空又很大时缩回去，避免一次大请求之后一直占着内存
+    void Shrink() {
+        if (ReadableBytes() == 0 && buffer_.size() > INITIAL_SIZE * 4) {
+            std::vector<char>(INITIAL_SIZE).swap(buffer_);
+            readIndex_ = 0;
+            writeIndex_ = 0;
+        }
+    }
+
+private:
+    std::vector<char> buffer_;
+    size_t readIndex_;
+    size_t writeIndex_;
+};
+
+#endif // BUFFER_H
@@ -0,0 +1,424 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+/**
+ * Cluster.h
+ * 多进程分片（和 Redis Cluster 一样按 hash slot 分）：key 用 CRC16 算到 16384 个 slot 里的一个（有 {tag} 只算 tag），
+ * 每个节点（一个 kv_store 进程）负责一部分 slot。客户端发到不负责这个 slot 的节点上，回 -MOVED slot host:port，
+ * 客户端按 CLUSTER SLOTS 拿到的拓扑直接连对的节点，之后就不用再跳了。
+ *
+ * 拓扑是静态配置的，没有 gossip、没有故障转移：
+ *   - 启动时 --cluster-nodes "127.0.0.1:7001=0-5460 127.0.0.1:7002=5461-10922 ..."（每个节点都给同一份），
+ *     自己是 --cluster-announce-ip + --port；
+ *   - 改归属（迁移 slot 的最后一步）用 CLUSTER SETSLOT slot NODE host:port，要在每个节点上都发一遍；
+ *   - 第一次启动和每次改过以后写进 nodes.conf（tmp + rename），重启时以它为准，不再看 --cluster-nodes。
+ *
+ * slot 迁移（源节点 A -> 目标节点 B，迁移期间两边都照常服务）：
+ *   1. B 上 CLUSTER SETSLOT slot IMPORTING A，A 上 CLUSTER SETSLOT slot MIGRATING B；
+ *   2. A 上一批批 MIGRATE B 的 key（CLUSTER GETKEYSINSLOT 或者 SCAN 拿 key），每个 key 在 A 上序列化、发给 B RESTORE、没被改过就删掉；
+ *      这期间 A 上还在的 key 照常在 A 上读写；已经搬走的 key A 回 -ASK slot B，客户端发 ASKING + 命令给 B（这一次有效，不改拓扑）；
+ *   3. 搬完在所有节点上 CLUSTER SETSLOT slot NODE B，A 之后对这个 slot 回 -MOVED。
+ * IMPORTING / MIGRATING 只在内存里，迁移到一半重启要重新设。
+ *
+ * slot 的状态是原子变量，命令执行时不拿锁读；节点表只追加不删，节点数最后发布，读者拿到的下标一定已经填好了。
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "Config.h"
+#include "Crc16.h"
+#include "Slice.h"
+
+using namespace std;
+
+class Cluster {
+public:
+    static const int SLOTS = crc16::SLOTS;
+    static const uint16_t NO_NODE = 0xFFFF;     // slot 没人负责（回 -CLUSTERDOWN）/ 不在迁移
+    static const int MAX_NODES = 1024;
+    static constexpr const char* CONFIG_PATH = "nodes.conf";
+    static const int MIGRATE_IDLE_SECONDS = 10;  // MIGRATE 缓存的连接闲置这么久就重连
+
+    struct Node {
+        string host;
+        int port;
+        string addr; // "host:port"，也当节点 id 用
+    };
+
+    Cluster() : enabled_(false), nodeCount_(0) {
+        for (int i = 0; i < SLOTS; ++i) {
+            owner_[i] = NO_NODE;
+            migrating_[i] = NO_NODE;
+            importing_[i] = NO_NODE;
+        }
+    }
+
+    /**
+     * 打开集群模式。自己是 0 号节点；有 nodes.conf 就按它来，没有就按 spec（--cluster-nodes）。
+     * spec / nodes.conf 都是一串 "host:port=slots"，slots 是逗号分开的 "start-end" 或者单个 slot，没有 slot 的节点可以不写 "="。
+     */
+    bool Init(const string& host, int port, const string& spec, string* err) {
+        enabled_ = true;
+        AddNodeLocked(host, port);
+        ifstream in(CONFIG_PATH);
+        if (in) {
+            stringstream ss;
+            ss << in.rdbuf();
+            if (!Parse(ss.str(), err)) {
+                *err = string(CONFIG_PATH) + ": " + *err;
+                return false;
+            }
+            cout << "[Cluster] Loaded topology from " << CONFIG_PATH << endl;
+        } else if (!Parse(spec, err)) {
+            *err = "--cluster-nodes: " + *err;
+            return false;
+        } else {
+            lock_guard<mutex> lock(mtx_);
+            SaveLocked(); // 下次启动不带 --cluster-nodes 也行
+        }
+        return true;
+    }
+
+    bool Enabled() const { return enabled_; }
+
+    static int KeySlot(const Slice& key) { return crc16::KeyHashSlot(key.data(), key.size()); }
+
+    uint16_t Owner(int slot) const { return owner_[slot].load(memory_order_acquire); }
+    uint16_t Migrating(int slot) const { return migrating_[slot].load(memory_order_acquire); }
+    uint16_t Importing(int slot) const { return importing_[slot].load(memory_order_acquire); }
+    bool IsSelf(uint16_t node) const { return node == 0; }
+    const Node& GetNode(uint16_t node) const { return nodes_[node]; }
+    const Node& Self() const { return nodes_[0]; }
+    int NodeCount() const { return nodeCount_.load(memory_order_acquire); }
+
+    // 按 "host:port" 找节点，没有返回 -1。不拿锁：节点表只追加，NodeCount 之前的都填好了
+    int FindNode(const string& addr) const {
+        int n = NodeCount();
+        for (int i = 0; i < n; ++i) {
+            if (nodes_[i].addr == addr) return i;
+        }
+        return -1;
+    }
+
+    // 按 "host:port" 找节点，没有就加一个。地址不对或者节点表满了返回 -1
+    int FindOrAddNode(const string& addr) {
+        string host;
+        int port;
+        if (!SplitAddr(addr, &host, &port)) return -1;
+        lock_guard<mutex> lock(mtx_);
+        return FindOrAddLocked(host, port);
+    }
+
+    // CLUSTER SETSLOT slot NODE：归属改了，这个 slot 的迁移状态也一起清掉（和 Redis 一样），写 nodes.conf
+    bool SetOwner(int slot, uint16_t node) {
+        lock_guard<mutex> lock(mtx_);
+        migrating_[slot].store(NO_NODE, memory_order_release);
+        importing_[slot].store(NO_NODE, memory_order_release);
+        owner_[slot].store(node, memory_order_release);
+        return SaveLocked();
+    }
+
+    void SetMigrating(int slot, uint16_t node) { migrating_[slot].store(node, memory_order_release); }
+    void SetImporting(int slot, uint16_t node) { importing_[slot].store(node, memory_order_release); }
+    void SetStable(int slot) {
+        migrating_[slot].store(NO_NODE, memory_order_release);
+        importing_[slot].store(NO_NODE, memory_order_release);
+    }
+
+    // 归属相同的连续 slot 合成一段（CLUSTER SLOTS / nodes.conf 用），没人负责的不算
+    struct Range {
+        int start;
+        int end;
+        uint16_t node;
+    };
+    vector<Range> Ranges() const {
+        vector<Range> ranges;
+        for (int i = 0; i < SLOTS; ++i) {
+            uint16_t n = Owner(i);
+            if (n == NO_NODE) continue;
+            if (!ranges.empty() && ranges.back().node == n && ranges.back().end == i - 1) ranges.back().end = i;
+            else ranges.push_back(Range{i, i, n});
+        }
+        return ranges;
+    }
+
+    // CLUSTER INFO
+    string Info() const {
+        int assigned = 0, mine = 0, migrating = 0, importing = 0;
+        for (int i = 0; i < SLOTS; ++i) {
+            uint16_t n = Owner(i);
+            if (n != NO_NODE) assigned++;
+            if (IsSelf(n)) mine++;
+            if (Migrating(i) != NO_NODE) migrating++;
+            if (Importing(i) != NO_NODE) importing++;
+        }
+        string s;
+        s += string("cluster_enabled:") + (enabled_ ? "1" : "0") + "\r\n";
+        s += string("cluster_state:") + (assigned == SLOTS ? "ok" : "fail") + "\r\n";
+        s += "cluster_slots_assigned:" + to_string(assigned) + "\r\n";
+        s += "cluster_slots_ok:" + to_string(assigned) + "\r\n";
+        s += "cluster_known_nodes:" + to_string(NodeCount()) + "\r\n";
+        s += "cluster_my_slots:" + to_string(mine) + "\r\n";
+        s += "cluster_migrating_slots:" + to_string(migrating) + "\r\n";
+        s += "cluster_importing_slots:" + to_string(importing) + "\r\n";
+        return s;
+    }
+
+    /**
+     * MIGRATE 用：把 req（已经编码好的一串命令）发给 host:port，读回 replies 条单行回复（+OK / -ERR ...），
+     * 第一条错误回复放进 *err 返回 false；连不上、超时也返回 false（*err 是 IOERR）。
+     * 连接每个线程缓存一条，闲置太久或者出过错就重连；用缓存的连接发送失败（对端早就关了）重连再试一次。
+     * 新连上的先看两端地址：连到的是本机的监听端口（用本机别的 IP / 主机名指向了自己），直接报错，不然自己等自己回复只能等到超时。
+     */
+    bool Transfer(const string& host, int port, int timeoutMs, const string& req, size_t replies, string* err) {
+        static thread_local MigrateLink link;
+        string addr = host + ":" + to_string(port);
+        if (link.fd >= 0 && (link.addr != addr || time(nullptr) - link.lastUse > MIGRATE_IDLE_SECONDS)) link.Close();
+        for (int attempt = 0; attempt < 2; ++attempt) {
+            bool cached = link.fd >= 0;
+            if (!cached) {
+                link.fd = ConnectWithTimeout(host, port, timeoutMs);
+                if (link.fd < 0) {
+                    *err = "IOERR error or timeout connecting to the client";
+                    return false;
+                }
+                if (ConnectedToSelf(link.fd)) {
+                    link.Close();
+                    *err = "ERR Target instance is this instance";
+                    return false;
+                }
+                link.addr = addr;
+            }
+            bool sent = SendAll(link.fd, req, timeoutMs);
+            if (!sent && cached) {
+                link.Close();
+                continue;
+            }
+            size_t got = 0;
+            string firstError;
+            if (sent) got = ReadReplies(link.fd, replies, timeoutMs, &firstError);
+            if (!sent || got < replies) {
+                link.Close();
+                *err = "IOERR error or timeout reading to target instance";
+                return false;
+            }
+            link.lastUse = time(nullptr);
+            if (!firstError.empty()) {
+                *err = "ERR Target instance replied with error: " + firstError;
+                return false;
+            }
+            return true;
+        }
+        *err = "IOERR error or timeout writing to target instance";
+        return false;
+    }
+
+private:
+    struct MigrateLink {
+        string addr;
+        int fd = -1;
+        time_t lastUse = 0;
+        ~MigrateLink() { Close(); }
+        void Close() {
+            if (fd >= 0) close(fd);
+            fd = -1;
+        }
+    };
+
+    static bool SplitAddr(const string& addr, string* host, int* port) {
+        size_t colon = addr.rfind(':');
+        if (colon == string::npos || colon == 0) return false;
+        char* end;
+        long p = strtol(addr.c_str() + colon + 1, &end, 10);
+        if (*end != '\0' || end == addr.c_str() + colon + 1 || p <= 0 || p > 65535) return false;
+        *host = addr.substr(0, colon);
+        *port = static_cast<int>(p);
+        return true;
+    }
+
+    int AddNodeLocked(const string& host, int port) {
+        int n = nodeCount_.load(memory_order_relaxed);
+        if (n >= MAX_NODES) return -1;
+        nodes_[n].host = host;
+        nodes_[n].port = port;
+        nodes_[n].addr = host + ":" + to_string(port);
+        nodeCount_.store(n + 1, memory_order_release); // 填好了再发布
+        return n;
+    }
+
+    int FindOrAddLocked(const string& host, int port) {
+        int n = nodeCount_.load(memory_order_relaxed);
+        for (int i = 0; i < n; ++i) {
+            if (nodes_[i].port == port && nodes_[i].host == host) return i;
+        }
+        return AddNodeLocked(host, port);
+    }
+
+    // "host:port=0-5460,6000 host:port=..."（空白分隔，换行也行）
+    bool Parse(const string& spec, string* err) {
+        lock_guard<mutex> lock(mtx_);
+        stringstream ss(spec);
+        string entry;
+        while (ss >> entry) {
+            size_t eq = entry.find('=');
+            string host;
+            int port;
+            if (!SplitAddr(entry.substr(0, eq), &host, &port)) {
+                *err = "bad node address '" + entry.substr(0, eq) + "'";
+                return false;
+            }
+            int node = FindOrAddLocked(host, port);
+            if (node < 0) {
+                *err = "too many nodes";
+                return false;
+            }
+            if (eq == string::npos) continue;
+            stringstream rs(entry.substr(eq + 1));
+            string range;
+            while (getline(rs, range, ',')) {
+                int start, end;
+                char tail;
+                int m = sscanf(range.c_str(), "%d-%d%c", &start, &end, &tail);
+                if (m == 1) end = start;
+                if ((m != 1 && m != 2) || start < 0 || end >= SLOTS || start > end) {
+                    *err = "bad slot range '" + range + "'";
+                    return false;
+                }
+                for (int i = start; i <= end; ++i) owner_[i].store(static_cast<uint16_t>(node), memory_order_release);
+            }
+        }
+        return true;
+    }
+
+    // 拿着 mtx_：每个节点一行，自己在第一行（没有 slot 的节点也写上，SETSLOT NODE 加进来的节点重启后还认识）
+    bool SaveLocked() {
+        vector<string> slots(NodeCount());
+        for (const Range& r : Ranges()) {
+            string& s = slots[r.node];
+            s += s.empty() ? "=" : ",";
+            s += r.start == r.end ? to_string(r.start) : to_string(r.start) + "-" + to_string(r.end);
+        }
+        string tmp = string(CONFIG_PATH) + ".tmp";
+        {
+            ofstream out(tmp, ios::trunc);
+            for (size_t i = 0; i < slots.size(); ++i) out << nodes_[i].addr << slots[i] << "\n";
+            out.flush();
+            if (!out) {
+                cerr << "[Cluster] Failed to write " << tmp << endl;
+                return false;
+            }
+        }
+        if (rename(tmp.c_str(), CONFIG_PATH) != 0) {
+            cerr << "[Cluster] Failed to rename " << tmp << ": " << strerror(errno) << endl;
+            return false;
+        }
+        return true;
+    }
+
+    // 非阻塞 connect + poll 等 timeoutMs，连上以后换回阻塞，收发都用 poll 控制超时
+    static int ConnectWithTimeout(const string& host, int port, int timeoutMs) {
+        struct addrinfo hints, *res = nullptr;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(host.c_str(), to_string(port).c_str(), &hints, &res) != 0 || !res) return -1;
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) != 0) {
+            struct pollfd p = {fd, POLLOUT, 0};
+            int soerr = 0;
+            socklen_t len = sizeof(soerr);
+            if (errno != EINPROGRESS || poll(&p, 1, timeoutMs) != 1 ||
+                getsockopt(fd, SOL_SOCKET, SO_ERROR, &soerr, &len) != 0 || soerr != 0) {
+                close(fd);
+                fd = -1;
+            }
+        }
+        freeaddrinfo(res);
+        if (fd < 0) return -1;
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        return fd;
+    }
+
+    // 对端是本机地址（连本机的 IP，内核选的源地址就是它；127.0.0.0/8 都是本机）、端口是自己监听的端口：连到的就是自己
+    static bool ConnectedToSelf(int fd) {
+        struct sockaddr_in local, peer;
+        socklen_t llen = sizeof(local), plen = sizeof(peer);
+        if (getsockname(fd, reinterpret_cast<struct sockaddr*>(&local), &llen) != 0 ||
+            getpeername(fd, reinterpret_cast<struct sockaddr*>(&peer), &plen) != 0) {
+            return false;
+        }
+        bool loopback = (ntohl(peer.sin_addr.s_addr) >> 24) == 127;
+        return ntohs(peer.sin_port) == g_config.port && (loopback || local.sin_addr.s_addr == peer.sin_addr.s_addr);
+    }
+
+    static bool SendAll(int fd, const string& s, int timeoutMs) {
+        size_t off = 0;
+        while (off < s.size()) {
+            ssize_t n = send(fd, s.data() + off, s.size() - off, MSG_NOSIGNAL);
+            if (n > 0) {
+                off += n;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                struct pollfd p = {fd, POLLOUT, 0};
+                if (poll(&p, 1, timeoutMs) == 1) continue;
+            }
+            return false;
+        }
+        return true;
+    }
+
+    // 读 want 条单行回复，返回读到了几条；每次等数据最多 timeoutMs
+    static size_t ReadReplies(int fd, size_t want, int timeoutMs, string* firstError) {
+        string buf;
+        size_t got = 0, pos = 0;
+        char chunk[4096];
+        while (got < want) {
+            size_t crlf = buf.find("\r\n", pos);
+            if (crlf != string::npos) {
+                if (buf[pos] == '-' && firstError->empty()) *firstError = buf.substr(pos + 1, crlf - pos - 1);
+                pos = crlf + 2;
+                got++;
+                continue;
+            }
+            struct pollfd p = {fd, POLLIN, 0};
+            if (poll(&p, 1, timeoutMs) != 1) break;
+            ssize_t n = recv(fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+            if (n < 0 && (errno == EAGAIN || errno == EINTR)) continue;
+            if (n <= 0) break;
+            buf.append(chunk, n);
+        }
+        return got;
+    }
+
+    bool enabled_;
+    mutex mtx_;                    // 改节点表 / 写 nodes.conf
+    Node nodes_[MAX_NODES];
+    atomic<int> nodeCount_;
+    atomic<uint16_t> owner_[SLOTS];
+    atomic<uint16_t> migrating_[SLOTS]; // 自己负责、正在迁到哪个节点
+    atomic<uint16_t> importing_[SLOTS]; // 正在从哪个节点迁进来
+};
+
+extern Cluster* g_cluster;
+
+#endif // CLUSTER_H
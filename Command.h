@@ -0,0 +1,1335 @@
+/**
+ * Command.h
+ * 命令表：一个命令一行（名字、参数个数、标志位、key 的位置、处理函数）。
+ *
+ * 分发：命令名忽略大小写算一个哈希，直接落到表里唯一的一个位置，再做一次忽略大小写的比较，
+ * 不拷贝、不转大写、不分配内存，命令再多查找代价也不变。
+ * 哈希的种子是编译期算出来的（constexpr 从 0 开始试，直到表里所有命令名两两不冲突），
+ * 所以这是一个完美哈希：不用处理冲突，加命令只需要在 kCommandTable 里加一行。
+ *
+ * 参数个数不对、类型不对（WRONGTYPE）的错误由分发统一按表生成，处理函数只管正常路径。
+ * COMMAND 命令直接把这张表吐出去。
+ */
+
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <strings.h> // strncasecmp
+#include <unistd.h>  // getpid, sysconf
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "KVStore.h"
+#include "Persistence.h"
+#include "Replication.h"
+#include "Cluster.h"
+#include "OutputBuffer.h"
+#include "Reply.h"
+#include "RespParser.h"
+#include "Slice.h"
+#include "Config.h"
+#include "Stats.h"
+
+using namespace std;
+
+extern KVStore* g_store;
+
+struct CommandDef;
+
+// 命令标志位
+enum CommandFlag {
+    CMD_WRITE    = 1 << 0, // 会修改数据
+    CMD_READONLY = 1 << 1, // 只读
+    CMD_FAST     = 1 << 2, // O(1) / O(log n)，不会卡住事件循环
+    CMD_ADMIN    = 1 << 3, // 管理命令
+    CMD_DENYOOM  = 1 << 4  // 会占用更多内存：执行前先按 maxmemory 淘汰，腾不出地方就拒绝
+};
+
+// 处理函数的返回值，错误回复由分发统一生成
+enum CommandResult {
+    C_OK = 0,
+    C_WRONGTYPE  // key 存在但类型不对
+};
+
+// 一条待执行的命令：解析阶段填好，执行阶段直接用
+struct CommandCall {
+    const CommandDef* def;                // 查表的结果，未知命令是 nullptr
+    vector<Slice> argv;                   // 指向读缓冲区（大参数指向 owned 里的 string）
+    vector<pair<size_t, string> > owned;  // 从解析器 move 过来的大参数：(第几个参数, 内容)
+    uint64_t hash;                        // 第一个 key 的哈希，预取阶段算好
+    bool handoff;                         // PSYNC：这个连接要交给复制线程，执行完这条就不再读了
+    bool asking;                          // 上一条是 ASKING（连接在执行前填）：正在迁入的 slot 这一条可以执行
+    bool setAsking;                       // 这一条就是 ASKING，连接记下来给下一条用
+
+    string* Owned(size_t i) {
+        for (auto& o : owned) {
+            if (o.first == i) return &o.second;
+        }
+        return nullptr;
+    }
+
+    // 收下解析器刚交出来的一条命令，大参数从解析器里 move 过来；def 在后面查表时填
+    void FromParser(RespParser& parser) {
+        const vector<Slice>& args = parser.Args();
+        argv.assign(args.begin(), args.end());
+        owned.clear();
+        for (size_t i = 0; i < args.size(); ++i) {
+            string* big = parser.OwnedArg(i);
+            if (big) {
+                owned.push_back(make_pair(i, std::move(*big)));
+            }
+        }
+        // owned 可能扩容搬家，全部 move 完再改 argv
+        for (auto& o : owned) argv[o.first] = Slice(o.second);
+        hash = 0;
+        handoff = false;
+        asking = false;
+        setAsking = false;
+    }
+};
+
+typedef int (*CommandProc)(CommandCall& c, OutputBuffer& out);
+
+struct CommandDef {
+    const char* name;  // 小写
+    int arity;         // 含命令名的参数个数：>0 必须正好这么多，<0 至少 -arity 个
+    uint32_t flags;    // CommandFlag 的组合
+    int firstKey;      // 第一个 key 在 argv 里的下标，没有 key 是 0
+    int lastKey;       // 最后一个 key 的下标，-1 表示一直到最后
+    int keyStep;       // key 之间隔几个参数
+    CommandProc proc;
+};
+
+// ======================= 参数解析 =======================
+
+// 参数是不是某个关键字（忽略大小写），kw 是小写或大写都行
+inline bool ArgIs(const Slice& a, const char* kw) {
+    size_t n = strlen(kw);
+    return a.size() == n && strncasecmp(a.data(), kw, n) == 0;
+}
+
+// 严格按十进制整数解析（和 Redis 一样不接受前导 0、正号、空格），溢出也算失败
+inline bool ParseInt64(const Slice& s, int64_t* v) { return StringToInt64(s.data(), s.size(), v); }
+
+// 把 EX/PX/EXAT/PXAT 的参数换成绝对过期时间（unix 毫秒）；unit 是 1000（秒）或 1（毫秒），
+// relative 表示是相对现在的时长。数不合法或者换算后溢出返回 false
+inline bool ToExpireAt(int64_t v, int64_t unit, bool relative, int64_t* when) {
+    if (v > INT64_MAX / unit || v < INT64_MIN / unit) return false;
+    v *= unit;
+    if (relative) {
+        int64_t now = MsTime();
+        if (v > INT64_MAX - now) return false;
+        v += now;
+    }
+    *when = v;
+    return true;
+}
+
+// ======================= 命令处理函数 =======================
+// 进到这里参数个数已经检查过了
+
+inline int PingCommand(CommandCall& c, OutputBuffer& out) {
+    if (c.argv.size() > 1) AddReplyBulk(out, c.argv[1]);
+    else AddReply(out, "+PONG\r\n");
+    return C_OK;
+}
+
+// SET key value [EX seconds | PX milliseconds | EXAT unix-seconds | PXAT unix-milliseconds]
+inline int SetCommand(CommandCall& c, OutputBuffer& out) {
+    int64_t expireAt = 0;
+    for (size_t i = 3; i < c.argv.size(); ++i) {
+        const Slice& opt = c.argv[i];
+        int64_t unit;
+        bool relative;
+        if (ArgIs(opt, "ex")) unit = 1000, relative = true;
+        else if (ArgIs(opt, "px")) unit = 1, relative = true;
+        else if (ArgIs(opt, "exat")) unit = 1000, relative = false;
+        else if (ArgIs(opt, "pxat")) unit = 1, relative = false;
+        else unit = 0, relative = false;
+        if (unit == 0 || expireAt != 0 || i + 1 == c.argv.size()) {
+            AddReplyError(out, "ERR syntax error");
+            return C_OK;
+        }
+        int64_t v;
+        if (!ParseInt64(c.argv[++i], &v)) {
+            AddReplyError(out, "ERR value is not an integer or out of range");
+            return C_OK;
+        }
+        if (v <= 0 || !ToExpireAt(v, unit, relative, &expireAt)) {
+            AddReplyError(out, "ERR invalid expire time in 'set' command");
+            return C_OK;
+        }
+    }
+    // 大 value 已经在自己的 string 里了，直接 move 给存储层
+    string* big = c.Owned(2);
+    if (big) g_store->Set(c.argv[1], c.hash, std::move(*big), expireAt);
+    else g_store->Set(c.argv[1], c.hash, c.argv[2], expireAt);
+    AddReply(out, "+OK\r\n");
+    return C_OK;
+}
+
+// INCR / DECR / INCRBY / DECRBY 共用
+inline int GenericIncrCommand(CommandCall& c, OutputBuffer& out, int64_t delta) {
+    int64_t v;
+    int r = g_store->IncrBy(c.argv[1], c.hash, delta, &v);
+    if (r == -1) return C_WRONGTYPE;
+    if (r == -2) AddReplyError(out, "ERR value is not an integer or out of range");
+    else if (r == -3) AddReplyError(out, "ERR increment or decrement would overflow");
+    else AddReplyInt(out, v);
+    return C_OK;
+}
+
+inline int IncrCommand(CommandCall& c, OutputBuffer& out) { return GenericIncrCommand(c, out, 1); }
+inline int DecrCommand(CommandCall& c, OutputBuffer& out) { return GenericIncrCommand(c, out, -1); }
+
+inline int IncrByCommand(CommandCall& c, OutputBuffer& out) {
+    int64_t delta;
+    if (!ParseInt64(c.argv[2], &delta)) {
+        AddReplyError(out, "ERR value is not an integer or out of range");
+        return C_OK;
+    }
+    return GenericIncrCommand(c, out, delta);
+}
+
+inline int DecrByCommand(CommandCall& c, OutputBuffer& out) {
+    int64_t delta;
+    if (!ParseInt64(c.argv[2], &delta) || delta == INT64_MIN) {
+        AddReplyError(out, "ERR value is not an integer or out of range");
+        return C_OK;
+    }
+    return GenericIncrCommand(c, out, -delta);
+}
+
+inline int GetCommand(CommandCall& c, OutputBuffer& out) {
+    string val;
+    int r = g_store->Get(c.argv[1], c.hash, &val);
+    if (r < 0) return C_WRONGTYPE;
+    if (r == 0) AddReplyNil(out); // Redis 的 nil (没找到)
+    else AddReplyBulk(out, std::move(val));
+    return C_OK;
+}
+
+// LPUSH / RPUSH key element [element ...]：一次拿锁全部插进去
+inline int GenericPushCommand(CommandCall& c, OutputBuffer& out, bool front) {
+    long long len = g_store->Push(c.argv[1], c.hash, front, &c.argv[2], c.argv.size() - 2);
+    if (len < 0) return C_WRONGTYPE;
+    AddReplyInt(out, len); // 返回列表长度
+    return C_OK;
+}
+
+inline int LPushCommand(CommandCall& c, OutputBuffer& out) { return GenericPushCommand(c, out, true); }
+inline int RPushCommand(CommandCall& c, OutputBuffer& out) { return GenericPushCommand(c, out, false); }
+
+// LPOP / RPOP key [count]：不带 count 回一个元素（空就是 nil），带 count 回数组（key 不存在是 nil 数组）
+inline int GenericPopCommand(CommandCall& c, OutputBuffer& out, bool front) {
+    if (c.argv.size() > 3) {
+        AddReplyError(out, string("ERR wrong number of arguments for '") + c.def->name + "' command");
+        return C_OK;
+    }
+    bool withCount = c.argv.size() == 3;
+    int64_t count = 1;
+    if (withCount && (!ParseInt64(c.argv[2], &count) || count < 0)) {
+        AddReplyError(out, "ERR value is out of range, must be positive");
+        return C_OK;
+    }
+    vector<string> vals;
+    int r = g_store->Pop(c.argv[1], c.hash, front, static_cast<size_t>(count), &vals);
+    if (r < 0) return C_WRONGTYPE;
+    if (!withCount) {
+        if (vals.empty()) AddReplyNil(out);
+        else AddReplyBulk(out, vals[0]);
+    } else if (r == 0) {
+        AddReplyNilArray(out);
+    } else {
+        AddReplyArrayLen(out, vals.size());
+        for (const string& v : vals) AddReplyBulk(out, v);
+    }
+    return C_OK;
+}
+
+inline int LPopCommand(CommandCall& c, OutputBuffer& out) { return GenericPopCommand(c, out, true); }
+inline int RPopCommand(CommandCall& c, OutputBuffer& out) { return GenericPopCommand(c, out, false); }
+
+inline int LLenCommand(CommandCall& c, OutputBuffer& out) {
+    long long len = g_store->LLen(c.argv[1], c.hash);
+    if (len < 0) return C_WRONGTYPE;
+    AddReplyInt(out, len);
+    return C_OK;
+}
+
+inline int LIndexCommand(CommandCall& c, OutputBuffer& out) {
+    int64_t index;
+    if (!ParseInt64(c.argv[2], &index)) {
+        AddReplyError(out, "ERR value is not an integer or out of range");
+        return C_OK;
+    }
+    string val;
+    int r = g_store->LIndex(c.argv[1], c.hash, index, &val);
+    if (r < 0) return C_WRONGTYPE;
+    if (r == 0) AddReplyNil(out);
+    else AddReplyBulk(out, std::move(val));
+    return C_OK;
+}
+
+// LRANGE key start stop：元素直接从列表节点写进输出缓冲区，不先拼成一个大 string
+inline int LRangeCommand(CommandCall& c, OutputBuffer& out) {
+    int64_t start, stop;
+    if (!ParseInt64(c.argv[2], &start) || !ParseInt64(c.argv[3], &stop)) {
+        AddReplyError(out, "ERR value is not an integer or out of range");
+        return C_OK;
+    }
+    int r = g_store->LRange(c.argv[1], c.hash, start, stop,
+                            [&out](size_t n) { AddReplyArrayLen(out, n); },
+                            [&out](const Slice& v) { AddReplyBulk(out, v); });
+    if (r < 0) return C_WRONGTYPE;
+    if (r == 0) AddReplyArrayLen(out, 0);
+    return C_OK;
+}
+
+inline int LTrimCommand(CommandCall& c, OutputBuffer& out) {
+    int64_t start, stop;
+    if (!ParseInt64(c.argv[2], &start) || !ParseInt64(c.argv[3], &stop)) {
+        AddReplyError(out, "ERR value is not an integer or out of range");
+        return C_OK;
+    }
+    if (g_store->LTrim(c.argv[1], c.hash, start, stop) < 0) return C_WRONGTYPE;
+    AddReply(out, "+OK\r\n");
+    return C_OK;
+}
+
+// DEL key [key ...]：一个 key 直接用预取阶段算好的哈希，多个 key 按分片分组批量删
+inline int DelCommand(CommandCall& c, OutputBuffer& out) {
+    if (c.argv.size() == 2) AddReplyInt(out, g_store->Del(c.argv[1], c.hash) ? 1 : 0);
+    else AddReplyInt(out, g_store->Del(&c.argv[1], c.argv.size() - 1));
+    return C_OK;
+}
+
+// MGET key [key ...]：不存在或者不是字符串的回 nil
+inline int MGetCommand(CommandCall& c, OutputBuffer& out) {
+    size_t n = c.argv.size() - 1;
+    vector<string> vals;
+    vector<char> found;
+    g_store->MGet(&c.argv[1], n, &vals, &found);
+    AddReplyArrayLen(out, n);
+    for (size_t i = 0; i < n; ++i) {
+        if (found[i]) AddReplyBulk(out, std::move(vals[i]));
+        else AddReplyNil(out);
+    }
+    return C_OK;
+}
+
+// MSET key value [key value ...]
+inline int MSetCommand(CommandCall& c, OutputBuffer& out) {
+    if (c.argv.size() % 2 == 0) {
+        AddReplyError(out, "ERR wrong number of arguments for 'mset' command");
+        return C_OK;
+    }
+    size_t n = (c.argv.size() - 1) / 2;
+    vector<Slice> keys(n), vals(n);
+    vector<string*> owned(n);
+    for (size_t i = 0; i < n; ++i) {
+        keys[i] = c.argv[1 + 2 * i];
+        vals[i] = c.argv[2 + 2 * i];
+        owned[i] = c.Owned(2 + 2 * i); // 大 value 直接 move 进存储
+    }
+    g_store->MSet(keys.data(), vals.data(), owned.data(), n);
+    AddReply(out, "+OK\r\n");
+    return C_OK;
+}
+
+// EXPIRE / PEXPIRE / EXPIREAT / PEXPIREAT 共用，区别只在单位和是不是绝对时间
+inline int GenericExpireCommand(CommandCall& c, OutputBuffer& out, int64_t unit, bool relative) {
+    int64_t v, when;
+    if (!ParseInt64(c.argv[2], &v)) {
+        AddReplyError(out, "ERR value is not an integer or out of range");
+        return C_OK;
+    }
+    if (!ToExpireAt(v, unit, relative, &when)) {
+        AddReplyError(out, string("ERR invalid expire time in '") + c.def->name + "' command");
+        return C_OK;
+    }
+    AddReplyInt(out, g_store->Expire(c.argv[1], c.hash, when));
+    return C_OK;
+}
+
+inline int ExpireCommand(CommandCall& c, OutputBuffer& out) { return GenericExpireCommand(c, out, 1000, true); }
+inline int PExpireCommand(CommandCall& c, OutputBuffer& out) { return GenericExpireCommand(c, out, 1, true); }
+inline int ExpireAtCommand(CommandCall& c, OutputBuffer& out) { return GenericExpireCommand(c, out, 1000, false); }
+inline int PExpireAtCommand(CommandCall& c, OutputBuffer& out) { return GenericExpireCommand(c, out, 1, false); }
+
+// TTL 按秒四舍五入（和 Redis 一样），-2 不存在，-1 没有过期时间
+inline int TtlCommand(CommandCall& c, OutputBuffer& out) {
+    int64_t ms = g_store->Pttl(c.argv[1], c.hash);
+    AddReplyInt(out, ms < 0 ? ms : (ms + 500) / 1000);
+    return C_OK;
+}
+
+inline int PTtlCommand(CommandCall& c, OutputBuffer& out) {
+    AddReplyInt(out, g_store->Pttl(c.argv[1], c.hash));
+    return C_OK;
+}
+
+inline int PersistCommand(CommandCall& c, OutputBuffer& out) {
+    AddReplyInt(out, g_store->Persist(c.argv[1], c.hash));
+    return C_OK;
+}
+
+// SCAN cursor [MATCH pattern] [COUNT count] [TYPE string|list]
+inline int ScanCommand(CommandCall& c, OutputBuffer& out) {
+    int64_t cursor;
+    if (!ParseInt64(c.argv[1], &cursor) || cursor < 0) {
+        AddReplyError(out, "ERR invalid cursor");
+        return C_OK;
+    }
+    KVStore::ScanFilter filter;
+    int64_t count = 10;
+    for (size_t i = 2; i < c.argv.size(); ++i) {
+        bool more = i + 1 < c.argv.size();
+        if (ArgIs(c.argv[i], "match") && more) {
+            filter.pattern = c.argv[++i];
+            if (filter.pattern == Slice("*")) filter.pattern = Slice(); // 匹配一切，不用过滤
+        } else if (ArgIs(c.argv[i], "count") && more) {
+            if (!ParseInt64(c.argv[++i], &count)) {
+                AddReplyError(out, "ERR value is not an integer or out of range");
+                return C_OK;
+            }
+            if (count < 1) {
+                AddReplyError(out, "ERR syntax error");
+                return C_OK;
+            }
+        } else if (ArgIs(c.argv[i], "type") && more) {
+            const Slice& t = c.argv[++i];
+            if (ArgIs(t, "string")) filter.type = OBJ_STRING;
+            else if (ArgIs(t, "list")) filter.type = OBJ_LIST;
+            else {
+                AddReplyError(out, "ERR unknown type name '" + t.ToString() + "'");
+                return C_OK;
+            }
+        } else {
+            AddReplyError(out, "ERR syntax error");
+            return C_OK;
+        }
+    }
+    vector<string> keys;
+    uint64_t next = g_store->Scan(static_cast<uint64_t>(cursor), filter, static_cast<size_t>(count), &keys);
+    AddReplyArrayLen(out, 2);
+    AddReplyBulk(out, to_string(next));
+    AddReplyArrayLen(out, keys.size());
+    for (const string& k : keys) AddReplyBulk(out, k);
+    return C_OK;
+}
+
+// RANGE 的区间端点，写法和 ZRANGEBYLEX 一样："[key" 闭区间，"(key" 开区间，"-" 最小，"+" 最大
+struct RangeBound {
+    Slice key;
+    bool exclusive;
+    bool min; // "-"
+    bool max; // "+"
+};
+
+inline bool ParseRangeBound(const Slice& a, RangeBound* b) {
+    b->exclusive = b->min = b->max = false;
+    if (a.size() == 1 && a[0] == '-') b->min = true;
+    else if (a.size() == 1 && a[0] == '+') b->max = true;
+    else if (a.size() >= 1 && (a[0] == '[' || a[0] == '(')) {
+        b->exclusive = a[0] == '(';
+        b->key = Slice(a.data() + 1, a.size() - 1);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const int64_t RANGE_DEFAULT_LIMIT = 100; // 不带 LIMIT 时最多返回多少个
+
+// RANGE start end [LIMIT count]：按 key 的顺序返回区间里的 key；前缀查询就是 RANGE [user: (user;
+inline int RangeCommand(CommandCall& c, OutputBuffer& out) {
+    RangeBound start, end;
+    if (!ParseRangeBound(c.argv[1], &start) || !ParseRangeBound(c.argv[2], &end)) {
+        AddReplyError(out, "ERR min or max not valid string range item");
+        return C_OK;
+    }
+    int64_t limit = RANGE_DEFAULT_LIMIT;
+    for (size_t i = 3; i < c.argv.size(); ++i) {
+        if (ArgIs(c.argv[i], "limit") && i + 1 < c.argv.size()) {
+            if (!ParseInt64(c.argv[++i], &limit) || limit < 0) {
+                AddReplyError(out, "ERR value is not an integer or out of range");
+                return C_OK;
+            }
+        } else {
+            AddReplyError(out, "ERR syntax error");
+            return C_OK;
+        }
+    }
+    vector<string> keys;
+    if (!start.max && !end.min) {
+        // "-" 就是从空串（最小的 key）开始，包含空串
+        g_store->Range(start.key, start.exclusive, end.max ? nullptr : &end.key, end.exclusive,
+                       static_cast<size_t>(limit), &keys);
+    }
+    AddReplyArrayLen(out, keys.size());
+    for (const string& k : keys) AddReplyBulk(out, k);
+    return C_OK;
+}
+
+inline int SaveCommand(CommandCall& c, OutputBuffer& out) {
+    string err;
+    if (g_persistence->Save(&err)) AddReply(out, "+OK\r\n");
+    else AddReplyError(out, err);
+    return C_OK;
+}
+
+inline int BgSaveCommand(CommandCall& c, OutputBuffer& out) {
+    string err;
+    if (g_persistence->BgSave(&err)) AddReplyStatus(out, "Background saving started");
+    else AddReplyError(out, err);
+    return C_OK;
+}
+
+inline int LastSaveCommand(CommandCall& c, OutputBuffer& out) {
+    AddReplyInt(out, g_persistence->LastSave());
+    return C_OK;
+}
+
+inline int BgRewriteAofCommand(CommandCall& c, OutputBuffer& out) {
+    string err;
+    bool scheduled = false;
+    if (!g_persistence->BgRewriteAof(&err, &scheduled)) AddReplyError(out, err);
+    else if (scheduled) AddReplyStatus(out, "Background append only file rewriting scheduled");
+    else AddReplyStatus(out, "Background append only file rewriting started");
+    return C_OK;
+}
+
+// ======================= 复制 =======================
+
+// PSYNC replid offset：从库发来的同步请求。回复由复制线程发（+FULLRESYNC / +CONTINUE），这里只标记一下，
+// Reactor 执行完这一批就把连接交给 Replication
+inline int PsyncCommand(CommandCall& c, OutputBuffer& out) {
+    if (g_repl->IsReplica()) {
+        AddReplyError(out, "ERR Replica can't accept PSYNC (chained replication is not supported)");
+        return C_OK;
+    }
+    c.handoff = true;
+    return C_OK;
+}
+
+// REPLCONF listening-port / ACK ...：握手时的配置项都不需要，直接 +OK（ACK 在复制线程里处理，不会走到这）
+inline int ReplconfCommand(CommandCall& c, OutputBuffer& out) {
+    AddReply(out, "+OK\r\n");
+    return C_OK;
+}
+
+// REPLICAOF host port | NO ONE（SLAVEOF 是老名字）
+inline int ReplicaOfCommand(CommandCall& c, OutputBuffer& out) {
+    if (ArgIs(c.argv[1], "no") && ArgIs(c.argv[2], "one")) {
+        g_repl->ReplicaOfNoOne();
+        AddReply(out, "+OK\r\n");
+        return C_OK;
+    }
+    int64_t port;
+    if (!ParseInt64(c.argv[2], &port) || port <= 0 || port > 65535) {
+        AddReplyError(out, "ERR Invalid master port");
+        return C_OK;
+    }
+    g_repl->ReplicaOf(c.argv[1].ToString(), static_cast<int>(port));
+    AddReply(out, "+OK\r\n");
+    return C_OK;
+}
+
+// ======================= 集群 =======================
+
+// ASKING：下一条命令就算 slot 不归这里、只是正在迁进来，也照样执行（收到 -ASK 的客户端发）
+inline int AskingCommand(CommandCall& c, OutputBuffer& out) {
+    if (!g_cluster->Enabled()) {
+        AddReplyError(out, "ERR This instance has cluster support disabled");
+        return C_OK;
+    }
+    c.setAsking = true;
+    AddReply(out, "+OK\r\n");
+    return C_OK;
+}
+
+inline void AddReplyNode(OutputBuffer& out, const Cluster::Node& n) {
+    AddReplyArrayLen(out, 3);
+    AddReplyBulk(out, n.host);
+    AddReplyInt(out, n.port);
+    AddReplyBulk(out, n.addr);
+}
+
+inline bool ParseSlot(const Slice& s, int* slot) {
+    int64_t v;
+    if (!ParseInt64(s, &v) || v < 0 || v >= Cluster::SLOTS) return false;
+    *slot = static_cast<int>(v);
+    return true;
+}
+
+/**
+ * CLUSTER SLOTS | KEYSLOT key | COUNTKEYSINSLOT slot | GETKEYSINSLOT slot count | INFO | MYID
+ *       | SETSLOT slot IMPORTING host:port | MIGRATING host:port | NODE host:port | STABLE
+ * SLOTS 的每一段是 [start, end, [host, port, id]]，id 就是 "host:port"（没有 gossip，不需要真正的节点 id）。
+ * COUNTKEYSINSLOT / GETKEYSINSLOT 要把所有 key 过一遍（没有 slot -> key 的索引），key 多的时候迁移用 SCAN 更好
+ */
+inline int ClusterCommand(CommandCall& c, OutputBuffer& out) {
+    if (!g_cluster->Enabled()) {
+        AddReplyError(out, "ERR This instance has cluster support disabled");
+        return C_OK;
+    }
+    const Slice& sub = c.argv[1];
+    size_t argc = c.argv.size();
+    int slot;
+    if (ArgIs(sub, "slots") && argc == 2) {
+        vector<Cluster::Range> ranges = g_cluster->Ranges();
+        AddReplyArrayLen(out, ranges.size());
+        for (const Cluster::Range& r : ranges) {
+            AddReplyArrayLen(out, 3);
+            AddReplyInt(out, r.start);
+            AddReplyInt(out, r.end);
+            AddReplyNode(out, g_cluster->GetNode(r.node));
+        }
+    } else if (ArgIs(sub, "keyslot") && argc == 3) {
+        AddReplyInt(out, Cluster::KeySlot(c.argv[2]));
+    } else if (ArgIs(sub, "countkeysinslot") && argc == 3) {
+        if (!ParseSlot(c.argv[2], &slot)) {
+            AddReplyError(out, "ERR Invalid slot");
+            return C_OK;
+        }
+        long long count = 0;
+        g_store->ForEachKey([&](const string& key) {
+            if (Cluster::KeySlot(key) == slot) count++;
+            return true;
+        });
+        AddReplyInt(out, count);
+    } else if (ArgIs(sub, "getkeysinslot") && argc == 4) {
+        int64_t max;
+        if (!ParseSlot(c.argv[2], &slot)) {
+            AddReplyError(out, "ERR Invalid slot");
+            return C_OK;
+        }
+        if (!ParseInt64(c.argv[3], &max) || max < 0) {
+            AddReplyError(out, "ERR Invalid number of keys");
+            return C_OK;
+        }
+        vector<string> keys;
+        if (max > 0) {
+            g_store->ForEachKey([&](const string& key) {
+                if (Cluster::KeySlot(key) == slot) keys.push_back(key);
+                return keys.size() < static_cast<size_t>(max);
+            });
+        }
+        AddReplyArrayLen(out, keys.size());
+        for (string& k : keys) AddReplyBulk(out, std::move(k));
+    } else if (ArgIs(sub, "info") && argc == 2) {
+        AddReplyBulk(out, g_cluster->Info());
+    } else if (ArgIs(sub, "myid") && argc == 2) {
+        AddReplyBulk(out, g_cluster->Self().addr);
+    } else if (ArgIs(sub, "setslot") && argc >= 4) {
+        if (!ParseSlot(c.argv[2], &slot)) {
+            AddReplyError(out, "ERR Invalid slot");
+            return C_OK;
+        }
+        const Slice& action = c.argv[3];
+        if (ArgIs(action, "stable") && argc == 4) {
+            g_cluster->SetStable(slot);
+            AddReply(out, "+OK\r\n");
+            return C_OK;
+        }
+        if (argc != 5 || !(ArgIs(action, "importing") || ArgIs(action, "migrating") || ArgIs(action, "node"))) {
+            AddReplyError(out, "ERR Invalid CLUSTER SETSLOT action or number of arguments. Try CLUSTER HELP");
+            return C_OK;
+        }
+        int node = g_cluster->FindOrAddNode(c.argv[4].ToString());
+        if (node < 0) {
+            AddReplyError(out, "ERR I don't know about node " + c.argv[4].ToString());
+            return C_OK;
+        }
+        uint16_t n = static_cast<uint16_t>(node);
+        if (ArgIs(action, "importing")) {
+            if (g_cluster->IsSelf(g_cluster->Owner(slot)) || g_cluster->IsSelf(n)) {
+                AddReplyError(out, "ERR I'm already the owner of hash slot " + to_string(slot));
+                return C_OK;
+            }
+            g_cluster->SetImporting(slot, n);
+        } else if (ArgIs(action, "migrating")) {
+            if (!g_cluster->IsSelf(g_cluster->Owner(slot))) {
+                AddReplyError(out, "ERR I'm not the owner of hash slot " + to_string(slot));
+                return C_OK;
+            }
+            if (g_cluster->IsSelf(n)) {
+                AddReplyError(out, "ERR I can't migrate hash slot " + to_string(slot) + " to myself");
+                return C_OK;
+            }
+            g_cluster->SetMigrating(slot, n);
+        } else if (!g_cluster->SetOwner(slot, n)) {
+            AddReplyError(out, "ERR Failed to save " + string(Cluster::CONFIG_PATH));
+            return C_OK;
+        }
+        AddReply(out, "+OK\r\n");
+    } else {
+        AddReplyError(out, "ERR Unknown subcommand or wrong number of arguments for '" + sub.ToString() + "'. Try CLUSTER HELP.");
+    }
+    return C_OK;
+}
+
+// DUMP key：值按 KVStore::DumpObject 的格式序列化（不含过期时间），不存在回 nil
+inline int DumpCommand(CommandCall& c, OutputBuffer& out) {
+    string payload;
+    if (g_store->Dump(c.argv[1], c.hash, &payload)) AddReplyBulk(out, std::move(payload));
+    else AddReplyNil(out);
+    return C_OK;
+}
+
+// RESTORE key ttl payload [REPLACE] [ABSTTL]：ttl 是毫秒，0 不过期；ABSTTL 时是 unix 毫秒
+inline int RestoreCommand(CommandCall& c, OutputBuffer& out) {
+    bool replace = false, absttl = false;
+    for (size_t i = 4; i < c.argv.size(); ++i) {
+        if (ArgIs(c.argv[i], "replace")) replace = true;
+        else if (ArgIs(c.argv[i], "absttl")) absttl = true;
+        else {
+            AddReplyError(out, "ERR syntax error");
+            return C_OK;
+        }
+    }
+    int64_t ttl, expire = 0;
+    if (!ParseInt64(c.argv[2], &ttl) || ttl < 0) {
+        AddReplyError(out, "ERR Invalid TTL value, must be >= 0");
+        return C_OK;
+    }
+    if (ttl > 0 && !ToExpireAt(ttl, 1, !absttl, &expire)) {
+        AddReplyError(out, "ERR Invalid TTL value, must be >= 0");
+        return C_OK;
+    }
+    RedisObject* obj = g_store->RestoreObject(c.argv[3], expire);
+    if (!obj) {
+        AddReplyError(out, "ERR DUMP payload version or checksum are wrong");
+        return C_OK;
+    }
+    if (!g_store->Restore(c.argv[1], c.hash, obj, c.argv[3], replace)) {
+        AddReplyError(out, "BUSYKEY Target key name already exists.");
+        return C_OK;
+    }
+    AddReply(out, "+OK\r\n");
+    return C_OK;
+}
+
+// 目标地址是不是自己（迁给自己会把 key 删掉）
+inline bool IsSelfAddress(const string& host, int64_t port) {
+    if (port != g_config.port) return false;
+    if (g_cluster->Enabled()) {
+        int node = g_cluster->FindNode(host + ":" + to_string(port));
+        if (node >= 0) return g_cluster->IsSelf(static_cast<uint16_t>(node));
+    }
+    return host == "127.0.0.1" || host == "localhost" || host == "0.0.0.0";
+}
+
+/**
+ * MIGRATE host port key|"" destination-db timeout [COPY] [REPLACE] [KEYS key [key ...]]
+ * 存在的 key 在这边序列化，和 RESTORE 一起（集群模式下每条前面加 ASKING）一次发过去，目标都回了 +OK 再删掉（COPY 不删），
+ * 发送期间被改过的 key 重发（见 KVStore::MigrateKeys）。发送不拿分片锁，但在这个 Reactor 线程里阻塞地做，每轮最多等 timeout 毫秒；
+ * 一个都不存在回 +NOKEY。只有一个库，destination-db 只能是 0
+ */
+inline int MigrateCommand(CommandCall& c, OutputBuffer& out) {
+    int64_t port, db, timeout;
+    if (!ParseInt64(c.argv[2], &port) || port <= 0 || port > 65535 || !ParseInt64(c.argv[4], &db) ||
+        !ParseInt64(c.argv[5], &timeout)) {
+        AddReplyError(out, "ERR value is not an integer or out of range");
+        return C_OK;
+    }
+    if (db != 0) {
+        AddReplyError(out, "ERR DB index is out of range");
+        return C_OK;
+    }
+    if (timeout <= 0) timeout = 1000;
+    bool copy = false, replace = false;
+    size_t firstKey = 3, numKeys = 1;
+    for (size_t i = 6; i < c.argv.size(); ++i) {
+        if (ArgIs(c.argv[i], "copy")) {
+            copy = true;
+        } else if (ArgIs(c.argv[i], "replace")) {
+            replace = true;
+        } else if (ArgIs(c.argv[i], "keys")) {
+            if (!c.argv[3].empty()) {
+                AddReplyError(out, "ERR When using MIGRATE KEYS option, the key argument must be set to the empty string");
+                return C_OK;
+            }
+            firstKey = i + 1;
+            numKeys = c.argv.size() - firstKey;
+            break;
+        } else {
+            AddReplyError(out, "ERR syntax error");
+            return C_OK;
+        }
+    }
+    string host = c.argv[1].ToString();
+    if (IsSelfAddress(host, port)) {
+        AddReplyError(out, "ERR Target instance is this instance");
+        return C_OK;
+    }
+    bool asking = g_cluster->Enabled();
+    string err;
+    long long n = g_store->MigrateKeys(&c.argv[firstKey], numKeys, copy, replace,
+        [&](const vector<Slice>& keys, const vector<string>& payloads, const vector<int64_t>& ttls, bool replaceKeys) {
+            string req;
+            Slice askingArgv[1] = {Slice("ASKING")};
+            for (size_t i = 0; i < keys.size(); ++i) {
+                if (asking) Replication::AppendCommand(&req, askingArgv, 1);
+                if (payloads[i].empty()) { // 发送期间在这边被删掉了，目标上的那份也删掉
+                    Slice argv[2] = {Slice("DEL"), keys[i]};
+                    Replication::AppendCommand(&req, argv, 2);
+                    continue;
+                }
+                string ttl = to_string(ttls[i]);
+                Slice argv[5] = {Slice("RESTORE"), keys[i], Slice(ttl), Slice(payloads[i]), Slice("REPLACE")};
+                Replication::AppendCommand(&req, argv, replaceKeys ? 5 : 4);
+            }
+            return g_cluster->Transfer(host, static_cast<int>(port), static_cast<int>(timeout), req,
+                                       keys.size() * (asking ? 2 : 1), &err);
+        });
+    if (n < 0) AddReplyError(out, err);
+    else if (n == 0) AddReplyStatus(out, "NOKEY");
+    else AddReply(out, "+OK\r\n");
+    return C_OK;
+}
+
+// 这几个要遍历命令表，定义在表后面
+inline int InfoCommand(CommandCall& c, OutputBuffer& out);
+inline int SlowlogCommand(CommandCall& c, OutputBuffer& out);
+inline int LatencyCommand(CommandCall& c, OutputBuffer& out);
+inline int CommandCommand(CommandCall& c, OutputBuffer& out);
+
+// ======================= 命令表 =======================
+// 加命令就在这里加一行
+constexpr CommandDef kCommandTable[] = {
+    // name      arity  flags                       keys      proc
+    {"ping",     -1,    CMD_FAST,                   0, 0, 0,  PingCommand},
+    {"set",      -3,    CMD_WRITE | CMD_DENYOOM,    1, 1, 1,  SetCommand},
+    {"get",       2,    CMD_READONLY | CMD_FAST,    1, 1, 1,  GetCommand},
+    {"incr",      2,    CMD_WRITE | CMD_DENYOOM | CMD_FAST, 1, 1, 1, IncrCommand},
+    {"decr",      2,    CMD_WRITE | CMD_DENYOOM | CMD_FAST, 1, 1, 1, DecrCommand},
+    {"incrby",    3,    CMD_WRITE | CMD_DENYOOM | CMD_FAST, 1, 1, 1, IncrByCommand},
+    {"decrby",    3,    CMD_WRITE | CMD_DENYOOM | CMD_FAST, 1, 1, 1, DecrByCommand},
+    {"lpush",    -3,    CMD_WRITE | CMD_DENYOOM | CMD_FAST, 1, 1, 1, LPushCommand},
+    {"rpush",    -3,    CMD_WRITE | CMD_DENYOOM | CMD_FAST, 1, 1, 1, RPushCommand},
+    {"lpop",     -2,    CMD_WRITE | CMD_FAST,       1, 1, 1,  LPopCommand},
+    {"rpop",     -2,    CMD_WRITE | CMD_FAST,       1, 1, 1,  RPopCommand},
+    {"llen",      2,    CMD_READONLY | CMD_FAST,    1, 1, 1,  LLenCommand},
+    {"lindex",    3,    CMD_READONLY,               1, 1, 1,  LIndexCommand},
+    {"lrange",    4,    CMD_READONLY,               1, 1, 1,  LRangeCommand},
+    {"ltrim",     4,    CMD_WRITE,                  1, 1, 1,  LTrimCommand},
+    {"mget",     -2,    CMD_READONLY | CMD_FAST,    1, -1, 1, MGetCommand},
+    {"mset",     -3,    CMD_WRITE | CMD_DENYOOM,    1, -1, 2, MSetCommand},
+    {"del",      -2,    CMD_WRITE,                  1, -1, 1, DelCommand},
+    {"expire",    3,    CMD_WRITE | CMD_FAST,       1, 1, 1,  ExpireCommand},
+    {"pexpire",   3,    CMD_WRITE | CMD_FAST,       1, 1, 1,  PExpireCommand},
+    {"expireat",  3,    CMD_WRITE | CMD_FAST,       1, 1, 1,  ExpireAtCommand},
+    {"pexpireat", 3,    CMD_WRITE | CMD_FAST,       1, 1, 1,  PExpireAtCommand},
+    {"ttl",       2,    CMD_READONLY | CMD_FAST,    1, 1, 1,  TtlCommand},
+    {"pttl",      2,    CMD_READONLY | CMD_FAST,    1, 1, 1,  PTtlCommand},
+    {"persist",   2,    CMD_WRITE | CMD_FAST,       1, 1, 1,  PersistCommand},
+    {"scan",     -2,    CMD_READONLY,               0, 0, 0,  ScanCommand},
+    {"range",    -3,    CMD_READONLY,               0, 0, 0,  RangeCommand},
+    {"save",      1,    CMD_ADMIN,                  0, 0, 0,  SaveCommand},
+    {"bgsave",    1,    CMD_ADMIN,                  0, 0, 0,  BgSaveCommand},
+    {"lastsave",  1,    CMD_FAST,                   0, 0, 0,  LastSaveCommand},
+    {"bgrewriteaof", 1, CMD_ADMIN,                  0, 0, 0,  BgRewriteAofCommand},
+    {"command",  -1,    CMD_ADMIN,                  0, 0, 0,  CommandCommand},
+    {"info",     -1,    CMD_ADMIN,                  0, 0, 0,  InfoCommand},
+    {"slowlog",  -2,    CMD_ADMIN,                  0, 0, 0,  SlowlogCommand},
+    {"latency",  -2,    CMD_ADMIN,                  0, 0, 0,  LatencyCommand},
+    {"psync",     3,    CMD_ADMIN,                  0, 0, 0,  PsyncCommand},
+    {"replconf", -1,    CMD_ADMIN,                  0, 0, 0,  ReplconfCommand},
+    {"replicaof", 3,    CMD_ADMIN,                  0, 0, 0,  ReplicaOfCommand},
+    {"slaveof",   3,    CMD_ADMIN,                  0, 0, 0,  ReplicaOfCommand},
+    {"asking",    1,    CMD_FAST,                   0, 0, 0,  AskingCommand},
+    {"cluster",  -2,    CMD_ADMIN,                  0, 0, 0,  ClusterCommand},
+    {"dump",      2,    CMD_READONLY,               1, 1, 1,  DumpCommand},
+    {"restore",  -4,    CMD_WRITE | CMD_DENYOOM,    1, 1, 1,  RestoreCommand},
+    {"migrate",  -6,    CMD_WRITE,                  0, 0, 0,  MigrateCommand},
+};
+
+constexpr size_t kCommandCount = sizeof(kCommandTable) / sizeof(kCommandTable[0]);
+
+// ======================= 编译期完美哈希 =======================
+// C++11 的 constexpr 函数只能有一条 return，循环都写成递归
+
+namespace cmdhash {
+
+constexpr size_t NextPow2(size_t n, size_t p = 1) { return p >= n ? p : NextPow2(n, p * 2); }
+
+// 槽位数随命令数长：n 个名字随机扔进 4n² 个槽，两两不冲突的概率约 e^(-1/8) ≈ 88%，
+// 所以几个种子之内一定能找到；每个种子的检查是 O(n²)，总量跟着命令数平方长，不会撞编译器的 constexpr 上限
+const size_t TABLE_SIZE = NextPow2(4 * kCommandCount * kCommandCount);
+const uint32_t MAX_SEED_TRIES = 64;
+const size_t MAX_NAME_LEN = 32; // 比这还长的肯定不是命令名，不用算哈希
+
+constexpr size_t Length(const char* s) { return *s ? 1 + Length(s + 1) : 0; }
+
+// | 0x20 把大写字母折成小写（命令名只有字母，其它字符折错了也没关系，最后还会比一次）
+constexpr uint32_t Step(const char* s, size_t n, uint32_t h) {
+    return n == 0 ? h : Step(s + 1, n - 1, (h ^ (static_cast<uint8_t>(s[0]) | 0x20u)) * 16777619u);
+}
+
+constexpr uint32_t Fmix3(uint32_t h) { return h ^ (h >> 16); }
+constexpr uint32_t Fmix2(uint32_t h) { return Fmix3((h ^ (h >> 13)) * 0xc2b2ae35u); }
+constexpr uint32_t Fmix(uint32_t h) { return Fmix2((h ^ (h >> 16)) * 0x85ebca6bu); }
+
+// FNV-1a + murmur3 的收尾，种子混进初值
+constexpr uint32_t Hash(const char* s, size_t n, uint32_t seed) {
+    return Fmix(Step(s, n, 2166136261u ^ (seed * 0x9e3779b9u)));
+}
+
+constexpr size_t SlotOf(size_t i, uint32_t seed) {
+    return Hash(kCommandTable[i].name, Length(kCommandTable[i].name), seed) & (TABLE_SIZE - 1);
+}
+
+// 第 i 个命令（槽位 slot）和后面的 [j, n) 都不冲突
+constexpr bool NoCollision(size_t slot, size_t j, uint32_t seed) {
+    return j >= kCommandCount || (slot != SlotOf(j, seed) && NoCollision(slot, j + 1, seed));
+}
+
+constexpr bool SeedWorks(size_t i, uint32_t seed) {
+    return i >= kCommandCount || (NoCollision(SlotOf(i, seed), i + 1, seed) && SeedWorks(i + 1, seed));
+}
+
+// 找不到返回 MAX_SEED_TRIES，由下面的 static_assert 报出来
+constexpr uint32_t FindSeed(uint32_t seed) {
+    return seed >= MAX_SEED_TRIES ? MAX_SEED_TRIES : SeedWorks(0, seed) ? seed : FindSeed(seed + 1);
+}
+
+constexpr uint32_t SEED = FindSeed(0);
+
+static_assert(SEED < MAX_SEED_TRIES, "no collision-free seed for kCommandTable (duplicate command name?)");
+static_assert(kCommandCount < 255, "command table index must fit in uint8_t");
+static_assert(kCommandCount <= ThreadStats::MAX_COMMANDS, "raise ThreadStats::MAX_COMMANDS");
+
+// 槽位 -> 命令下标 + 1（0 表示空），启动时按编译期的种子填一次
+struct SlotTable {
+    uint8_t idx[TABLE_SIZE];
+    SlotTable() {
+        memset(idx, 0, sizeof(idx));
+        for (size_t i = 0; i < kCommandCount; ++i) {
+            idx[SlotOf(i, SEED)] = static_cast<uint8_t>(i + 1);
+        }
+    }
+};
+
+} // namespace cmdhash
+
+// 按命令名查表（忽略大小写），找不到返回 nullptr
+inline const CommandDef* LookupCommand(const Slice& name) {
+    static const cmdhash::SlotTable slots;
+    if (name.size() > cmdhash::MAX_NAME_LEN) return nullptr;
+    uint32_t h = cmdhash::Hash(name.data(), name.size(), cmdhash::SEED) & (cmdhash::TABLE_SIZE - 1);
+    uint8_t i = slots.idx[h];
+    if (i == 0) return nullptr;
+    const CommandDef* d = &kCommandTable[i - 1];
+    if (strlen(d->name) != name.size() || strncasecmp(d->name, name.data(), name.size()) != 0) return nullptr;
+    return d;
+}
+
+/**
+ * 集群模式下这条命令该不该在这里执行，不该的话回重定向，返回 true。
+ * key 按命令表里的位置取，要都在同一个 slot（-CROSSSLOT），slot 归别人 -MOVED slot host:port；
+ * 归自己但正在迁出：key 都还在就照常执行，都不在了 -ASK slot 目标，一部分在一部分不在 -TRYAGAIN（等这一批迁完再试）；
+ * 正在迁入、前面带了 ASKING 的也在这里执行。
+ */
+inline bool ClusterRedirect(CommandCall& c, OutputBuffer& out) {
+    const CommandDef* d = c.def;
+    int argc = static_cast<int>(c.argv.size());
+    if (d->firstKey == 0 || argc <= d->firstKey) return false;
+    int last = d->lastKey < 0 ? argc - 1 : d->lastKey;
+    int slot = -1;
+    for (int i = d->firstKey; i <= last && i < argc; i += d->keyStep) {
+        int s = Cluster::KeySlot(c.argv[i]);
+        if (slot >= 0 && s != slot) {
+            AddReplyError(out, "CROSSSLOT Keys in request don't hash to the same slot");
+            return true;
+        }
+        slot = s;
+    }
+    uint16_t owner = g_cluster->Owner(slot);
+    if (!g_cluster->IsSelf(owner)) {
+        if (c.asking && g_cluster->Importing(slot) != Cluster::NO_NODE) return false;
+        if (owner == Cluster::NO_NODE) {
+            AddReplyError(out, "CLUSTERDOWN Hash slot not served");
+            return true;
+        }
+        AddReplyError(out, "MOVED " + to_string(slot) + " " + g_cluster->GetNode(owner).addr);
+        return true;
+    }
+    uint16_t target = g_cluster->Migrating(slot);
+    if (target == Cluster::NO_NODE) return false;
+    int missing = 0, keys = 0;
+    for (int i = d->firstKey; i <= last && i < argc; i += d->keyStep) {
+        keys++;
+        if (g_store->Pttl(c.argv[i], i == d->firstKey ? c.hash : HashKey(c.argv[i])) == -2) missing++;
+    }
+    if (missing == 0) return false;
+    if (missing < keys) {
+        AddReplyError(out, "TRYAGAIN Multiple keys request during rehashing of slot");
+        return true;
+    }
+    AddReplyError(out, "ASK " + to_string(slot) + " " + g_cluster->GetNode(target).addr);
+    return true;
+}
+
+// 执行一条命令：参数个数、类型错误、超过 maxmemory、从库上的写、集群模式下的重定向在这里按表统一回复。
+// replay：AOF 重放 / 从库重放主库的命令流，不检查只读、slot、不淘汰（主库已经淘汰过了，淘汰的结果会以 DEL 的形式过来）
+inline void ExecuteCommand(CommandCall& c, OutputBuffer& out, bool replay = false) {
+    const CommandDef* d = c.def;
+    if (!d) {
+        string cmd = c.argv[0].ToString();
+        transform(cmd.begin(), cmd.end(), cmd.begin(), ::toupper);
+        AddReplyError(out, "ERR unknown command '" + cmd + "'");
+        return;
+    }
+    int argc = static_cast<int>(c.argv.size());
+    if ((d->arity > 0 && argc != d->arity) || argc < -d->arity) {
+        AddReplyError(out, string("ERR wrong number of arguments for '") + d->name + "' command");
+        return;
+    }
+    if (!replay && g_cluster->Enabled() && ClusterRedirect(c, out)) return;
+    if (!replay && !(d->flags & CMD_ADMIN) && g_repl->Loading()) {
+        AddReplyError(out, "LOADING Redis is loading the dataset in memory");
+        return;
+    }
+    if (!replay && (d->flags & CMD_WRITE) && g_repl->IsReplica()) {
+        AddReplyError(out, "READONLY You can't write against a read only replica.");
+        return;
+    }
+    if (!replay && (d->flags & CMD_DENYOOM) && !g_store->MakeRoom(c.hash)) {
+        AddReplyError(out, "OOM command not allowed when used memory > 'maxmemory'.");
+        return;
+    }
+    if (d->proc(c, out) == C_WRONGTYPE) {
+        AddReplyError(out, "WRONGTYPE Operation against a key holding the wrong kind of value");
+    }
+}
+
+// AOF 重放 / 从库重放命令流：执行解析器里的这一条命令，回复直接丢掉，查找不做惰性过期（见 KVStore::Replaying）。
+// 不是写命令返回 false（AOF 里出现算文件坏了，复制流里的 PING 跳过）
+inline bool ReplayCommand(RespParser& parser) {
+    static CommandCall c;
+    static OutputBuffer sink;
+    c.FromParser(parser);
+    c.def = LookupCommand(c.argv[0]);
+    if (!c.def || !(c.def->flags & CMD_WRITE)) return false;
+    if (c.def->firstKey > 0 && c.argv.size() > static_cast<size_t>(c.def->firstKey)) {
+        c.hash = HashKey(c.argv[c.def->firstKey]);
+    }
+    KVStore::Replaying() = true;
+    ExecuteCommand(c, sink, true);
+    KVStore::Replaying() = false;
+    sink.Clear();
+    c.owned.clear();
+    return true;
+}
+
+// ======================= COMMAND =======================
+
+inline void AddReplyCommandInfo(OutputBuffer& out, const CommandDef& d) {
+    static const struct { uint32_t flag; const char* name; } kFlagNames[] = {
+        {CMD_WRITE, "write"}, {CMD_READONLY, "readonly"}, {CMD_FAST, "fast"}, {CMD_ADMIN, "admin"},
+        {CMD_DENYOOM, "denyoom"},
+    };
+    AddReplyArrayLen(out, 6);
+    AddReplyBulk(out, Slice(d.name));
+    AddReplyInt(out, d.arity);
+    int nflags = 0;
+    for (const auto& f : kFlagNames) {
+        if (d.flags & f.flag) nflags++;
+    }
+    AddReplyArrayLen(out, nflags);
+    for (const auto& f : kFlagNames) {
+        if (d.flags & f.flag) AddReplyStatus(out, f.name);
+    }
+    AddReplyInt(out, d.firstKey);
+    AddReplyInt(out, d.lastKey);
+    AddReplyInt(out, d.keyStep);
+}
+
+// COMMAND / COMMAND COUNT / COMMAND INFO name [name ...]
+inline int CommandCommand(CommandCall& c, OutputBuffer& out) {
+    if (c.argv.size() == 1) {
+        AddReplyArrayLen(out, kCommandCount);
+        for (size_t i = 0; i < kCommandCount; ++i) AddReplyCommandInfo(out, kCommandTable[i]);
+        return C_OK;
+    }
+    const Slice& sub = c.argv[1];
+    if (sub.size() == 5 && strncasecmp(sub.data(), "COUNT", 5) == 0) {
+        AddReplyInt(out, kCommandCount);
+    } else if (sub.size() == 4 && strncasecmp(sub.data(), "INFO", 4) == 0) {
+        AddReplyArrayLen(out, c.argv.size() - 2);
+        for (size_t i = 2; i < c.argv.size(); ++i) {
+            const CommandDef* d = LookupCommand(c.argv[i]);
+            if (d) AddReplyCommandInfo(out, *d);
+            else AddReplyArrayLen(out, -1);
+        }
+    } else {
+        AddReplyError(out, "ERR unknown subcommand '" + sub.ToString() + "'. Try COMMAND, COMMAND COUNT, COMMAND INFO.");
+    }
+    return C_OK;
+}
+
+// ======================= INFO =======================
+
+inline void InfoLine(string& info, const char* name, const string& value) {
+    info += name;
+    info += ':';
+    info += value;
+    info += "\r\n";
+}
+
+inline void InfoLine(string& info, const char* name, uint64_t value) { InfoLine(info, name, to_string(value)); }
+
+inline string InfoDouble(double v) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.2f", v);
+    return buf;
+}
+
+// 进程实际占的物理内存（/proc/self/statm 第二列是页数）
+inline uint64_t ResidentMemory() {
+    FILE* f = fopen("/proc/self/statm", "r");
+    if (!f) return 0;
+    unsigned long long size = 0, resident = 0;
+    int n = fscanf(f, "%llu %llu", &size, &resident);
+    fclose(f);
+    return n == 2 ? resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE)) : 0;
+}
+
+inline const char* MaxmemoryPolicyName(MaxmemoryPolicy p) {
+    switch (p) {
+    case MAXMEMORY_ALLKEYS_LRU: return "allkeys-lru";
+    case MAXMEMORY_ALLKEYS_LFU: return "allkeys-lfu";
+    case MAXMEMORY_VOLATILE_TTL: return "volatile-ttl";
+    default: return "noeviction";
+    }
+}
+
+/**
+ * INFO [section ...]：和 Redis 一样按节输出 "# Section" + 若干行 "name:value"。
+ * 不带参数 / default：server clients memory persistence stats replication io cluster keyspace；
+ * all / everything 再加上 commandstats（每条命令的调用次数、总耗时）和 latencystats（每条命令的 p50 / p99 / p99.9）。
+ * 不认识的 section 回空串。计数器都是各线程的加起来，读的时候才汇总，所以 INFO 本身不算便宜，别每条命令都调
+ */
+inline int InfoCommand(CommandCall& c, OutputBuffer& out) {
+    static const char* kDefault[] = {"server", "clients", "memory", "persistence", "stats", "replication", "io",
+                                     "cluster", "keyspace"};
+    vector<string> sections;
+    bool everything = false;
+    for (size_t i = 1; i < c.argv.size(); ++i) {
+        string s = c.argv[i].ToString();
+        transform(s.begin(), s.end(), s.begin(), ::tolower);
+        if (s == "all" || s == "everything") everything = true;
+        else if (s == "default") sections.insert(sections.end(), begin(kDefault), end(kDefault));
+        else sections.push_back(s);
+    }
+    if (c.argv.size() == 1 || everything) {
+        sections.assign(begin(kDefault), end(kDefault));
+        if (everything) {
+            sections.push_back("commandstats");
+            sections.push_back("latencystats");
+        }
+    }
+    auto want = [&](const char* name) { return find(sections.begin(), sections.end(), name) != sections.end(); };
+
+    StatsRegistry& reg = StatsRegistry::Instance();
+    vector<uint64_t> st = reg.Snapshot();
+    double usPerTick = CycleClock::NsPerTick() / 1000;
+    uint64_t commands = 0;
+    for (size_t i = 0; i < kCommandCount; ++i) commands += st[ThreadStats::CmdCalls(static_cast<int>(i))];
+
+    string info;
+    if (want("server")) {
+        uint64_t uptime = time(nullptr) - reg.StartTime();
+        info += "# Server\r\n";
+        InfoLine(info, "process_id", static_cast<uint64_t>(getpid()));
+        InfoLine(info, "tcp_port", static_cast<uint64_t>(g_config.port));
+        InfoLine(info, "uptime_in_seconds", uptime);
+        InfoLine(info, "uptime_in_days", uptime / 86400);
+    }
+    if (want("clients")) {
+        if (!info.empty()) info += "\r\n";
+        info += "# Clients\r\n";
+        InfoLine(info, "connected_clients", st[STAT_ACCEPTED] - st[STAT_CLOSED]);
+    }
+    if (want("memory")) {
+        if (!info.empty()) info += "\r\n";
+        info += "# Memory\r\n";
+        InfoLine(info, "used_memory", g_store->UsedMemory());
+        InfoLine(info, "used_memory_rss", ResidentMemory());
+        InfoLine(info, "maxmemory", g_config.maxmemory);
+        InfoLine(info, "maxmemory_policy", MaxmemoryPolicyName(g_config.maxmemory_policy));
+    }
+    if (want("persistence")) {
+        uint64_t changes;
+        bool bgsave, rewrite, lastOk;
+        g_persistence->GetInfo(&changes, &bgsave, &rewrite, &lastOk);
+        if (!info.empty()) info += "\r\n";
+        info += "# Persistence\r\n";
+        InfoLine(info, "rdb_changes_since_last_save", changes);
+        InfoLine(info, "rdb_bgsave_in_progress", bgsave);
+        InfoLine(info, "rdb_last_save_time", static_cast<uint64_t>(g_persistence->LastSave()));
+        InfoLine(info, "rdb_last_bgsave_status", lastOk ? "ok" : "err");
+        InfoLine(info, "aof_enabled", g_config.appendonly);
+        InfoLine(info, "aof_rewrite_in_progress", rewrite);
+    }
+    if (want("stats")) {
+        double ops, inKbps, outKbps;
+        reg.Instantaneous(&ops, &inKbps, &outKbps);
+        if (!info.empty()) info += "\r\n";
+        info += "# Stats\r\n";
+        InfoLine(info, "total_connections_received", st[STAT_ACCEPTED]);
+        InfoLine(info, "total_commands_processed", commands);
+        InfoLine(info, "instantaneous_ops_per_sec", static_cast<uint64_t>(ops + 0.5));
+        InfoLine(info, "total_net_input_bytes", st[STAT_NET_INPUT]);
+        InfoLine(info, "total_net_output_bytes", st[STAT_NET_OUTPUT]);
+        InfoLine(info, "instantaneous_input_kbps", InfoDouble(inKbps));
+        InfoLine(info, "instantaneous_output_kbps", InfoDouble(outKbps));
+        InfoLine(info, "evicted_keys", g_store->EvictedKeys());
+        InfoLine(info, "slowlog_len", SlowLog::Instance().Len());
+        // 事件循环：转了几圈、其中几圈是带着事件醒的（剩下的是 500ms 超时）、一共多少事件、醒着干活的总时间
+        InfoLine(info, "eventloop_cycles", st[STAT_LOOP_CYCLES]);
+        InfoLine(info, "eventloop_wakeups", st[STAT_LOOP_WAKEUPS]);
+        InfoLine(info, "eventloop_events", st[STAT_LOOP_EVENTS]);
+        InfoLine(info, "eventloop_events_per_wakeup",
+                 InfoDouble(st[STAT_LOOP_WAKEUPS] ? double(st[STAT_LOOP_EVENTS]) / st[STAT_LOOP_WAKEUPS] : 0));
+        InfoLine(info, "eventloop_duration_sum", static_cast<uint64_t>(st[STAT_LOOP_BUSY] * usPerTick));
+    }
+    if (want("replication")) {
+        if (!info.empty()) info += "\r\n";
+        info += "# Replication\r\n";
+        g_repl->Info(&info);
+    }
+    if (want("io")) {
+        if (!info.empty()) info += "\r\n";
+        info += "# IO\r\n";
+        InfoLine(info, "io_backend", g_config.io_backend == IO_BACKEND_IO_URING ? "io_uring" : "epoll");
+        InfoLine(info, "io_threads", static_cast<uint64_t>(g_config.threads));
+        InfoLine(info, "io_syscalls", st[STAT_SYSCALLS]);
+    }
+    if (want("cluster")) {
+        if (!info.empty()) info += "\r\n";
+        info += "# Cluster\r\n";
+        InfoLine(info, "cluster_enabled", g_cluster->Enabled());
+    }
+    if (want("keyspace")) {
+        uint64_t keys, expires;
+        g_store->KeyCount(&keys, &expires);
+        if (!info.empty()) info += "\r\n";
+        info += "# Keyspace\r\n";
+        if (keys > 0) info += "db0:keys=" + to_string(keys) + ",expires=" + to_string(expires) + "\r\n";
+    }
+    // 没调用过的命令不输出（和 Redis 一样）
+    if (want("commandstats")) {
+        if (!info.empty()) info += "\r\n";
+        info += "# Commandstats\r\n";
+        for (size_t i = 0; i < kCommandCount; ++i) {
+            int cmd = static_cast<int>(i);
+            uint64_t calls = st[ThreadStats::CmdCalls(cmd)];
+            if (calls == 0) continue;
+            double usec = st[ThreadStats::CmdTicks(cmd)] * usPerTick;
+            info += string("cmdstat_") + kCommandTable[i].name + ":calls=" + to_string(calls) +
+                    ",usec=" + to_string(static_cast<uint64_t>(usec)) + ",usec_per_call=" + InfoDouble(usec / calls) +
+                    "\r\n";
+        }
+    }
+    if (want("latencystats")) {
+        if (!info.empty()) info += "\r\n";
+        info += "# Latencystats\r\n";
+        LatencyHistogram h;
+        char buf[160];
+        for (size_t i = 0; i < kCommandCount; ++i) {
+            int cmd = static_cast<int>(i);
+            if (st[ThreadStats::CmdCalls(cmd)] == 0) continue;
+            h.Reset();
+            for (size_t b = 0; b < LatencyHistogram::BUCKETS; ++b) h.AddToBucket(b, st[ThreadStats::CmdBucket(cmd, b)]);
+            snprintf(buf, sizeof(buf), "latency_percentiles_usec_%s:p50=%.3f,p99=%.3f,p99.9=%.3f\r\n",
+                     kCommandTable[i].name, h.Percentile(50) * usPerTick, h.Percentile(99) * usPerTick,
+                     h.Percentile(99.9) * usPerTick);
+            info += buf;
+        }
+    }
+    AddReplyBulk(out, std::move(info));
+    return C_OK;
+}
+
+// ======================= SLOWLOG / LATENCY =======================
+
+// SLOWLOG GET [count] / LEN / RESET / HELP。GET 默认最新的 10 条，count 为 -1 全要；
+// 每条是 [id, unix 时间, 微秒, [参数...]]（Redis 4.0 之前的格式，没有客户端地址和名字）
+inline int SlowlogCommand(CommandCall& c, OutputBuffer& out) {
+    const Slice& sub = c.argv[1];
+    SlowLog& log = SlowLog::Instance();
+    if (ArgIs(sub, "get") && c.argv.size() <= 3) {
+        int64_t count = 10;
+        if (c.argv.size() == 3 && (!ParseInt64(c.argv[2], &count) || count < -1)) {
+            AddReplyError(out, "ERR count should be greater than or equal to -1");
+            return C_OK;
+        }
+        vector<SlowLogEntry> entries = log.Get(count < 0 ? SIZE_MAX : static_cast<size_t>(count));
+        AddReplyArrayLen(out, entries.size());
+        for (const SlowLogEntry& e : entries) {
+            AddReplyArrayLen(out, 4);
+            AddReplyInt(out, e.id);
+            AddReplyInt(out, e.time);
+            AddReplyInt(out, e.duration);
+            AddReplyArrayLen(out, e.args.size());
+            for (const string& a : e.args) AddReplyBulk(out, Slice(a));
+        }
+    } else if (ArgIs(sub, "len") && c.argv.size() == 2) {
+        AddReplyInt(out, log.Len());
+    } else if (ArgIs(sub, "reset") && c.argv.size() == 2) {
+        log.Reset();
+        AddReply(out, "+OK\r\n");
+    } else if (ArgIs(sub, "help") && c.argv.size() == 2) {
+        static const char* kHelp[] = {
+            "SLOWLOG <subcommand> [<arg> [value] [opt] ...]. Subcommands are:",
+            "GET [<count>]",
+            "    Return top <count> entries from the slowlog (default: 10, -1 mean all).",
+            "    Entries are made of: id, timestamp, time in microseconds, arguments array.",
+            "LEN",
+            "    Return the length of the slowlog.",
+            "RESET",
+            "    Reset the slowlog.",
+        };
+        AddReplyArrayLen(out, sizeof(kHelp) / sizeof(kHelp[0]));
+        for (const char* h : kHelp) AddReplyStatus(out, h);
+    } else {
+        AddReplyError(out, "ERR unknown subcommand or wrong number of arguments for '" + sub.ToString() +
+                               "'. Try SLOWLOG HELP.");
+    }
+    return C_OK;
+}
+
+// LATENCY RESET：把 INFO commandstats / latencystats 的计数清零（记基线，不碰各线程的计数器），回清掉了几条命令的统计。
+// LATENCY HELP
+inline int LatencyCommand(CommandCall& c, OutputBuffer& out) {
+    const Slice& sub = c.argv[1];
+    if (ArgIs(sub, "reset") && c.argv.size() == 2) {
+        vector<uint64_t> st = StatsRegistry::Instance().Snapshot();
+        long long n = 0;
+        for (size_t i = 0; i < kCommandCount; ++i) n += st[ThreadStats::CmdCalls(static_cast<int>(i))] > 0;
+        StatsRegistry::Instance().ResetCommandStats();
+        AddReplyInt(out, n);
+    } else if (ArgIs(sub, "help") && c.argv.size() == 2) {
+        static const char* kHelp[] = {
+            "LATENCY <subcommand> [<arg> [value] [opt] ...]. Subcommands are:",
+            "RESET",
+            "    Reset the per-command call counts and latency histograms shown by",
+            "    INFO commandstats / INFO latencystats. Returns the number of commands reset.",
+        };
+        AddReplyArrayLen(out, sizeof(kHelp) / sizeof(kHelp[0]));
+        for (const char* h : kHelp) AddReplyStatus(out, h);
+    } else {
+        AddReplyError(out, "ERR unknown subcommand or wrong number of arguments for '" + sub.ToString() +
+                               "'. Try LATENCY HELP.");
+    }
+    return C_OK;
+}
+
+#endif // COMMAND_H
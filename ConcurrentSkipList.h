@@ -0,0 +1,444 @@
+/**
+ * ConcurrentSkipList.h
+ * 无锁并发跳表：读完全不加锁，插入/删除用 CAS 完成。
+ * 参考《The Art of Multiprocessor Programming》里的 LockFreeSkipList：
+ *   - 每层的 next 指针最低位当“删除标记”（marked pointer）；
+ *   - 删除分两步：先从上到下把节点每层的 next 打上标记（逻辑删除，level 0 打上标记的那一刻算删除成功），
+ *     再由 find() 顺路用 CAS 把打了标记的节点从每一层摘掉（物理删除）；
+ *   - 摘掉的节点交给 Epoch.h 的 EBR 延迟释放，正在读它的线程不会踩到野指针。
+ *
+ * 使用约定：结构本身的插入/删除可以多线程同时做；
+ * 但“同一个 key 的 value 覆盖”和“删除这个 key”之间的先后由调用方保证
+ * （KVStore 里写操作按分片加锁，所以满足），读者永远不需要加锁。
+ */
+
+#ifndef CONCURRENT_SKIPLIST_H
+#define CONCURRENT_SKIPLIST_H
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <new>
+#include <functional>
+#include <thread>
+#include "Epoch.h"
+
+template <typename K, typename V>
+struct CSkipNode {
+    K key;
+    std::atomic<V> value;
+    int level;
+    // 插入线程和删除线程各持有一份“所有权”，最后放手的那个负责 Retire
+    std::atomic<int> owners;
+    // next 数组内联在节点后面，最低位是删除标记
+    std::atomic<uintptr_t> next[1];
+
+    CSkipNode(const K& k, const V& v, int lvl) : key(k), value(v), level(lvl), owners(2) {}
+
+    static size_t AllocSize(int level) {
+        return sizeof(CSkipNode) + sizeof(std::atomic<uintptr_t>) * (level - 1);
+    }
+};
+
+template <typename K, typename V>
+class ConcurrentSkipList {
+public:
+    typedef CSkipNode<K, V> Node;
+
+    ConcurrentSkipList() : maxLevel_(1), tailValid_(false) {
+        head_ = newNode(K(), V(), MAX_LEVEL);
+        head_->owners.store(1);
+    }
+
+    // 析构时不会再有并发访问：还挂在链上的节点直接释放，
+    // 已经摘掉的节点在 EpochManager 的退休链表里，由它负责释放
+    ~ConcurrentSkipList() {
+        Node* curr = head_;
+        while (curr) {
+            uintptr_t raw = curr->next[0].load(std::memory_order_relaxed);
+            if (!IsMarked(raw)) {
+                Node* next = Ptr(raw);
+                freeNode(curr);
+                curr = next;
+            } else {
+                curr = Ptr(raw);
+            }
+        }
+    }
+
+    ConcurrentSkipList(const ConcurrentSkipList&) = delete;
+    ConcurrentSkipList& operator=(const ConcurrentSkipList&) = delete;
+
+    /**
+     * 插入或更新。key 已存在时原子地替换 value，旧值通过 old_out 交给调用方处理。
+     * 返回 true 表示是覆盖（old_out 有效），false 表示新插入。
+     */
+    bool insert(const K& key, const V& value, V* old_out = nullptr) {
+        Node* node = nullptr;
+        return insertImpl(key, value, old_out, &node);
+    }
+
+    // 插入并返回 key 所在的节点（KVStore 的哈希索引要记住它）
+    Node* insertNode(const K& key, const V& value) {
+        Node* node = nullptr;
+        insertImpl(key, value, nullptr, &node);
+        return node;
+    }
+
+    /**
+     * 批量加载用：按 key 从小到大依次追加，调用方保证 key 比表里现有的都大，
+     * 而且期间没有别的线程在写（启动加载时）。不比较 key、不用 CAS，直接挂到每一层末尾。
+     */
+    Node* appendNode(const K& key, const V& value) {
+        if (!tailValid_.load(std::memory_order_relaxed)) {
+            Node* curr = head_;
+            for (int i = MAX_LEVEL - 1; i >= 0; i--) {
+                Node* next = Ptr(curr->next[i].load(std::memory_order_acquire));
+                while (next) {
+                    curr = next;
+                    next = Ptr(curr->next[i].load(std::memory_order_acquire));
+                }
+                tail_[i] = curr;
+            }
+            tailValid_.store(true, std::memory_order_relaxed);
+        }
+        int top = randomLevel();
+        Node* node = newNode(key, value, top);
+        for (int i = 0; i < top; i++) {
+            tail_[i]->next[i].store(reinterpret_cast<uintptr_t>(node), std::memory_order_release);
+            tail_[i] = node;
+        }
+        raiseMaxLevel(top);
+        releaseOwner(node); // 和 insert 一样，插入方放掉自己那份所有权
+        return node;
+    }
+
+    /**
+     * 查找数据（wait-free，不修改任何指针）
+     * 如果找到了返回 true，并把值赋给 value_out
+     */
+    // key 可以是 K，也可以是能和 K 比较大小的类型（比如 Slice），省一次拷贝
+    template <typename Key>
+    bool search(const Key& key, V& value_out) {
+        EpochGuard guard;
+        Node* pred = head_;
+        Node* curr = nullptr;
+        for (int i = maxLevel_.load(std::memory_order_acquire) - 1; i >= 0; i--) {
+            curr = Ptr(pred->next[i].load(std::memory_order_acquire));
+            while (curr) {
+                uintptr_t succ = curr->next[i].load(std::memory_order_acquire);
+                if (IsMarked(succ)) {      // 已经被逻辑删除，跳过
+                    curr = Ptr(succ);
+                    continue;
+                }
+                if (curr->key < key) {
+                    pred = curr;
+                    curr = Ptr(succ);
+                } else {
+                    break;
+                }
+            }
+        }
+        if (curr && curr->key == key) {
+            value_out = curr->value.load(std::memory_order_acquire);
+            return true;
+        }
+        return false;
+    }
+
+    static const size_t BATCH = 16; // searchBatch 一轮同时走几个 key
+
+    /**
+     * 批量查找：每 BATCH 个 key 齐头并进，每个 key 每次往前走一步并预取下一步要看的节点，
+     * 语义和一个个调 search 一样（见 SkipList::searchBatch）
+     */
+    template <typename Key>
+    void searchBatch(const Key* keys, size_t n, V* values, bool* found) {
+        EpochGuard guard;
+        int top = maxLevel_.load(std::memory_order_acquire) - 1;
+        for (size_t base = 0; base < n; base += BATCH) {
+            size_t m = n - base < BATCH ? n - base : BATCH;
+            Node* pred[BATCH];
+            Node* curr[BATCH];
+            int lvl[BATCH];
+            for (size_t j = 0; j < m; ++j) {
+                pred[j] = head_;
+                lvl[j] = top;
+                curr[j] = Ptr(head_->next[top].load(std::memory_order_acquire));
+                found[base + j] = false;
+                __builtin_prefetch(curr[j]);
+            }
+            size_t active = m;
+            while (active) {
+                for (size_t j = 0; j < m; ++j) {
+                    if (lvl[j] < 0) continue;
+                    const Key& key = keys[base + j];
+                    Node* c = curr[j];
+                    if (c) {
+                        uintptr_t succ = c->next[lvl[j]].load(std::memory_order_acquire);
+                        if (IsMarked(succ)) {
+                            curr[j] = Ptr(succ); // 已经被逻辑删除，跳过
+                        } else if (c->key < key) {
+                            pred[j] = c;
+                            curr[j] = Ptr(succ);
+                        } else {
+                            c = nullptr; // 这一层到头了
+                        }
+                    }
+                    if (!c) {
+                        if (--lvl[j] < 0) {
+                            Node* hit = curr[j];
+                            if (hit && hit->key == key) {
+                                values[base + j] = hit->value.load(std::memory_order_acquire);
+                                found[base + j] = true;
+                            }
+                            active--;
+                            continue;
+                        }
+                        curr[j] = Ptr(pred[j]->next[lvl[j]].load(std::memory_order_acquire));
+                    }
+                    __builtin_prefetch(curr[j]);
+                }
+            }
+        }
+    }
+
+    /**
+     * 有序遍历其中一段：从第一个 >= from（exclusive 时是 > from）的节点开始往后走（跳过已经逻辑删除的），
+     * 每个节点调一次 func(key, value)，func 返回 false 就停下。语义和 SkipList::scan 一样
+     */
+    template <typename Key, typename F>
+    void scan(const Key& from, bool exclusive, F func) {
+        EpochGuard guard;
+        Node* pred = head_;
+        Node* curr = nullptr;
+        for (int i = maxLevel_.load(std::memory_order_acquire) - 1; i >= 0; i--) {
+            curr = Ptr(pred->next[i].load(std::memory_order_acquire));
+            while (curr) {
+                uintptr_t succ = curr->next[i].load(std::memory_order_acquire);
+                if (IsMarked(succ)) {
+                    curr = Ptr(succ);
+                    continue;
+                }
+                if (curr->key < from) {
+                    pred = curr;
+                    curr = Ptr(succ);
+                } else {
+                    break;
+                }
+            }
+        }
+        while (curr) {
+            uintptr_t succ = curr->next[0].load(std::memory_order_acquire);
+            if (!IsMarked(succ) && !(exclusive && curr->key == from)) {
+                V v = curr->value.load(std::memory_order_acquire);
+                if (!func(curr->key, v)) return;
+            }
+            curr = Ptr(succ);
+        }
+    }
+
+    /**
+     * 删除数据：先逻辑删除（打标记），再物理摘除，最后交给 EBR 释放。
+     * 被删节点的 value 通过 old_out 交给调用方。
+     */
+    bool remove(const K& key, V* old_out = nullptr) {
+        tailValid_.store(false, std::memory_order_relaxed);
+        EpochGuard guard;
+        Node* preds[MAX_LEVEL];
+        Node* succs[MAX_LEVEL];
+
+        if (!find(key, preds, succs)) return false;
+        Node* node = succs[0];
+
+        // 1. 从最高层往下给 next 打标记（level 0 除外）
+        for (int i = node->level - 1; i >= 1; i--) {
+            uintptr_t raw = node->next[i].load();
+            while (!IsMarked(raw)) {
+                node->next[i].compare_exchange_weak(raw, raw | 1);
+            }
+        }
+        // 2. 给 level 0 打标记：谁打成功谁就是删除者
+        uintptr_t raw = node->next[0].load();
+        while (true) {
+            if (IsMarked(raw)) return false; // 被别人抢先删了
+            if (node->next[0].compare_exchange_strong(raw, raw | 1)) break;
+        }
+        if (old_out) *old_out = node->value.load();
+        // 3. 物理摘除
+        find(key, preds, succs);
+        releaseOwner(node);
+        return true;
+    }
+
+    /**
+     * 遍历所有节点（跳过已经逻辑删除的）
+     * 并发写的时候遍历到的是一个“模糊快照”，持久化时调用方会先挡住写者
+     */
+    void traverse(std::function<void(K&, V&)> func) {
+        EpochGuard guard;
+        Node* curr = Ptr(head_->next[0].load(std::memory_order_acquire));
+        while (curr) {
+            uintptr_t succ = curr->next[0].load(std::memory_order_acquire);
+            if (!IsMarked(succ)) {
+                V v = curr->value.load(std::memory_order_acquire);
+                func(curr->key, v);
+            }
+            curr = Ptr(succ);
+        }
+    }
+
+private:
+    static const int MAX_LEVEL = 16;
+
+    Node* head_;
+    std::atomic<int> maxLevel_; // 目前用到的最高层数，只增不减，读的时候从这层开始
+    Node* tail_[MAX_LEVEL];        // appendNode 用：每一层的最后一个节点
+    std::atomic<bool> tailValid_;  // insert / remove 之后 tail_ 就不可信了
+
+    static bool IsMarked(uintptr_t p) { return (p & 1) != 0; }
+    static Node* Ptr(uintptr_t p) { return reinterpret_cast<Node*>(p & ~static_cast<uintptr_t>(1)); }
+
+    /**
+     * 找到每一层 key 的前驱和后继，顺手把路上打了标记的节点摘掉。
+     * 返回 level 0 的后继是不是就是 key。
+     */
+    bool find(const K& key, Node** preds, Node** succs) {
+    retry:
+        Node* pred = head_;
+        for (int i = MAX_LEVEL - 1; i >= 0; i--) {
+            Node* curr = Ptr(pred->next[i].load());
+            while (curr) {
+                uintptr_t succ = curr->next[i].load();
+                // curr 在这一层被标记了：把它摘掉
+                while (IsMarked(succ)) {
+                    uintptr_t expected = reinterpret_cast<uintptr_t>(curr);
+                    if (!pred->next[i].compare_exchange_strong(expected, succ & ~static_cast<uintptr_t>(1))) {
+                        goto retry; // pred 变了（被删了或者插进来新节点），从头再来
+                    }
+                    curr = Ptr(succ);
+                    if (!curr) break;
+                    succ = curr->next[i].load();
+                }
+                if (!curr) break;
+                if (curr->key < key) {
+                    pred = curr;
+                    curr = Ptr(succ);
+                } else {
+                    break;
+                }
+            }
+            preds[i] = pred;
+            succs[i] = curr;
+        }
+        return succs[0] && succs[0]->key == key;
+    }
+
+    // 把 node 挂到第 i 层；node 已经被删除时返回 false
+    bool linkLevel(Node* node, int i, const K& key, Node** preds, Node** succs) {
+        while (true) {
+            uintptr_t raw = node->next[i].load();
+            if (IsMarked(raw)) return false;
+            uintptr_t want = reinterpret_cast<uintptr_t>(succs[i]);
+            if (raw != want && !node->next[i].compare_exchange_strong(raw, want)) {
+                return false; // 只可能是被打了标记
+            }
+            uintptr_t expected = want;
+            if (preds[i]->next[i].compare_exchange_strong(expected, reinterpret_cast<uintptr_t>(node))) {
+                return true;
+            }
+            // 前驱变了，重新定位
+            find(key, preds, succs);
+            if (IsMarked(node->next[0].load())) return false;
+        }
+    }
+
+    bool insertImpl(const K& key, const V& value, V* old_out, Node** node_out) {
+        tailValid_.store(false, std::memory_order_relaxed);
+        EpochGuard guard;
+        Node* preds[MAX_LEVEL];
+        Node* succs[MAX_LEVEL];
+        int top = randomLevel();
+
+        while (true) {
+            if (find(key, preds, succs)) {
+                V old = succs[0]->value.exchange(value);
+                if (old_out) *old_out = old;
+                *node_out = succs[0];
+                return true;
+            }
+
+            Node* node = newNode(key, value, top);
+            for (int i = 0; i < top; i++) {
+                node->next[i].store(reinterpret_cast<uintptr_t>(succs[i]), std::memory_order_relaxed);
+            }
+            // level 0 挂上去的那一刻就算插入成功（线性化点）
+            uintptr_t expected = reinterpret_cast<uintptr_t>(succs[0]);
+            if (!preds[0]->next[0].compare_exchange_strong(expected, reinterpret_cast<uintptr_t>(node))) {
+                freeNode(node); // 还没发布出去，直接释放
+                continue;
+            }
+            raiseMaxLevel(top);
+
+            // 再一层层往上挂；中途被别人删了就不再往上挂
+            for (int i = 1; i < top; i++) {
+                if (!linkLevel(node, i, key, preds, succs)) break;
+            }
+            // 挂的过程中可能被标记删除了：再 find 一遍保证它从每一层都被摘掉
+            if (IsMarked(node->next[0].load())) {
+                find(key, preds, succs);
+            }
+            *node_out = node;
+            releaseOwner(node);
+            return false;
+        }
+    }
+
+    void releaseOwner(Node* node) {
+        if (node->owners.fetch_sub(1) == 1) {
+            EpochManager::Instance().Retire(node, &ConcurrentSkipList::deleteNode);
+        }
+    }
+
+    void raiseMaxLevel(int level) {
+        int cur = maxLevel_.load();
+        while (cur < level && !maxLevel_.compare_exchange_weak(cur, level)) {}
+    }
+
+    static Node* newNode(const K& key, const V& value, int level) {
+        void* mem = ::operator new(Node::AllocSize(level));
+        Node* node = new (mem) Node(key, value, level);
+        for (int i = 0; i < level; i++) {
+            new (&node->next[i]) std::atomic<uintptr_t>(0);
+        }
+        return node;
+    }
+
+    static void freeNode(Node* node) {
+        node->~Node();
+        ::operator delete(node);
+    }
+
+    static void deleteNode(void* p) { freeNode(static_cast<Node*>(p)); }
+
+    // 每个线程自己的 xorshift 状态，抛硬币不需要同步
+    static int randomLevel() {
+        static thread_local unsigned int seed = 0;
+        if (seed == 0) {
+            seed = static_cast<unsigned int>(time(nullptr)) ^
+                   static_cast<unsigned int>(std::hash<std::thread::id>()(std::this_thread::get_id()));
+            if (seed == 0) seed = 2463534242u;
+        }
+        int lvl = 1;
+        while (lvl < MAX_LEVEL) {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            if ((seed % 2) == 0) break;
+            lvl++;
+        }
+        return lvl;
+    }
+};
+
+#endif // CONCURRENT_SKIPLIST_H
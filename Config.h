@@ -0,0 +1,68 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * Config.h
+ * 服务器的启动参数都收在这里，main() 解析命令行后填进 g_config，
+ * 其它模块（Reactor / Connection / KVStore）直接读这个全局配置。
+ */
+
+// save <seconds> <changes>：距离上次保存超过 seconds 秒且至少改了 changes 次，就自动 BGSAVE
+struct SaveParam {
+    int seconds;
+    int changes;
+};
+
+// appendfsync：AOF 什么时候 fsync
+enum FsyncPolicy {
+    FSYNC_ALWAYS,   // 每轮事件循环回复发出去之前（group commit）
+    FSYNC_EVERYSEC, // 后台线程每秒一次
+    FSYNC_NO        // 不管，交给操作系统
+};
+
+// maxmemory-policy：内存超过 maxmemory 以后写命令怎么办
+enum MaxmemoryPolicy {
+    MAXMEMORY_NOEVICTION,  // 不淘汰，写命令直接报 OOM
+    MAXMEMORY_ALLKEYS_LRU, // 在所有 key 里淘汰最久没访问的（抽样近似）
+    MAXMEMORY_ALLKEYS_LFU, // 在所有 key 里淘汰访问最少的（抽样近似）
+    MAXMEMORY_VOLATILE_TTL // 在带过期时间的 key 里淘汰最快过期的
+};
+
+// 网络 I/O 用哪个后端
+enum IoBackend {
+    IO_BACKEND_EPOLL,   // 就绪模型：epoll_wait + 每个连接 readv / writev
+    IO_BACKEND_IO_URING // 完成模型：multishot accept / recv + 批量 sendmsg，内核不支持时退回 epoll
+};
+
+struct ServerConfig {
+    int port = 8080;       // 监听端口
+    int threads = 1;       // Reactor 线程数，--threads N
+    IoBackend io_backend = IO_BACKEND_EPOLL; // --io-backend epoll|io_uring
+    size_t output_hwm = 64 * 1024 * 1024; // 单个连接待发送数据的高水位（字节），超过就先不读这个连接，--output-hwm
+    // 自动保存策略，--save "3600 1 300 100"，--save "" 关掉；默认和 Redis 一样
+    std::vector<SaveParam> save_params = {{3600, 1}, {300, 100}, {60, 10000}};
+    bool appendonly = false;                  // 开 AOF，--appendonly yes|no
+    FsyncPolicy appendfsync = FSYNC_EVERYSEC; // --appendfsync always|everysec|no
+    int aof_rewrite_percentage = 100;         // AOF 比上次重写后大了这么多（%）就自动重写
+    size_t aof_rewrite_min_size = 64 * 1024 * 1024; // 但至少要有这么大
+    size_t maxmemory = 0;                     // 数据最多占多少内存（字节），0 不限制，--maxmemory 100mb
+    MaxmemoryPolicy maxmemory_policy = MAXMEMORY_NOEVICTION; // --maxmemory-policy
+    int maxmemory_samples = 5;                // 每次淘汰抽几个 key 比较，越大越准越慢，--maxmemory-samples
+    long long slowlog_log_slower_than = 10000; // 执行超过这么多微秒的命令记进 SLOWLOG，0 全记，负数不记
+    size_t slowlog_max_len = 128;             // SLOWLOG 最多留多少条，--slowlog-max-len
+    std::string replicaof;                    // 启动就当从库："host port"，--replicaof
+    size_t repl_backlog_size = 1024 * 1024;   // 复制积压环多大，断线期间落下的写不超过这么多就能部分同步，--repl-backlog-size
+    size_t repl_output_limit = 256 * 1024 * 1024; // 一个从库攒着没发出去的数据超过这么多就断开它，--repl-output-limit
+    int repl_timeout = 60;                    // 主从之间多少秒没消息算断了，--repl-timeout
+    bool cluster_enabled = false;             // 集群模式（按 hash slot 分片，不归自己的 key 回 -MOVED），--cluster-enabled yes|no
+    std::string cluster_nodes;                // 初始拓扑 "host:port=0-5460 host:port=5461-16383"，--cluster-nodes
+    std::string cluster_announce_ip = "127.0.0.1"; // 自己在拓扑里的地址（端口就是 --port），--cluster-announce-ip
+};
+
+extern ServerConfig g_config;
+
+#endif
@@ -4,107 +4,103 @@
 #include <iostream>
 #include <string>
 #include <vector>
-#include <map>
-#include <sstream>
 #include <unistd.h> // read, write, close
 #include "KVStore.h"
+#include "Command.h"
+#include "Reply.h"
+#include "Buffer.h"
+#include "OutputBuffer.h"
+#include "RespParser.h"
+#include "Slice.h"
+#include "Config.h"
+#include "TimingWheel.h"
 #include <ctime>
 #include <algorithm>
 
 using namespace std;
 
-extern KVStore g_store;
+extern KVStore* g_store;
 
-class Connection{
+/**
+ * 一个客户端连接：读缓冲区 + 解析 + 执行 + 写缓冲区。
+ * 不关心底下是 epoll 还是 io_uring：
+ *   - 就绪模型（epoll）：能读了调 Read()（直接 readv 进缓冲区），能写了调 Flush()（writev）；
+ *   - 完成模型（io_uring）：内核读好的数据用 Feed() 交进来，要发的数据用 GatherOutput() 拿 iovec，
+ *     发完了用 OutputSent() 告诉它发了多少。
+ * 两种模型下 Process() / WantRead() 等都一样，系统调用都在 Reactor 里。
+ * 继承 TimerNode：Reactor 的时间轮直接把连接挂在链表上，不用另外分配定时器
+ */
+class Connection : public TimerNode {
 
 
 private:
+    static const size_t MAX_BATCH = 128; // 一批最多执行多少条，超过的下一批再说
+
     int fd_;
-    string readBuffer_;
+    Buffer readBuffer_;    // 连续的读缓冲区，解析器在上面挪游标，不再 substr
+    OutputBuffer writeBuffer_; // 待发送的回复，一批命令的回复攒在一起 writev
+    RespParser parser_;
     time_t last_active_time_;
+    uint32_t events_;      // 当前在 epoll 里注册的事件，由 Reactor 维护
+    bool readPaused_;      // 待发送数据超过高水位，暂停读这个连接
+    bool blocked_;         // 上次 Process 因为高水位停下了，读缓冲区里还有没执行的命令
+    vector<CommandCall> batch_; // 复用的批处理数组，里面的 vector 容量一直留着，不用每批重新分配
+    bool handedOff_;       // 执行了 PSYNC：这个连接要交给复制线程，不再执行后面的命令
+    vector<string> handoffArgs_; // PSYNC 的参数（replid offset）
+    bool asking_;          // 上一条命令是 ASKING，只对紧跟着的下一条有效
+
+    // 解析器刚交出来的一条命令收进 batch_[idx]
+    void AddToBatch(size_t idx) {
+        if (batch_.size() <= idx) batch_.resize(idx + 1);
+        CommandCall& bc = batch_[idx];
+        bc.FromParser(parser_);
+        bc.def = LookupCommand(bc.argv[0]);
+    }
 
-    enum State {
-        STATE_REQ_NUM,  // 状态 A: 读参数个数 (*3)
-        STATE_ARG_LEN,  // 状态 B: 读参数长度 ($3)
-        STATE_ARG_DATA  // 状态 C: 读参数数据 (SET)
-    };
-
-    State state_ = STATE_REQ_NUM; // 当前状态，默认是 A
-    std::vector<string> args_; // 存解析出来的参数 (如 {"SET", "key", "val"})
-    int expectedArgs_ = 0;     // 还要读几个参数？ (对应 *3)
-    int expectedLen_ = 0;      // 当前参数的长度是多少？ (对应 $3)
-
-    // 【新版】业务逻辑：处理解析好的参数列表，返回符合 RESP 格式的字符串
-    string process_command(const vector<string>& args) {
-        if (args.empty()) return "";
-
-        string cmd = args[0];
-        transform(cmd.begin(), cmd.end(), cmd.begin(), ::toupper);
-        //处理 SET 命令
-        if (cmd == "SET") {
-            if (args.size() < 3) {
-                return "-ERR wrong number of arguments for 'set' command\r\n";
+    /**
+     * 执行一批命令：
+     *   1. 预取：每条带 key 的命令先算好哈希，把哈希索引里要探测的位置拉进缓存，
+     *      几十个 cache miss 叠在一起等，而不是执行一条等一个；
+     *   2. 执行：按顺序查表分发，直接用算好的哈希，回复依次追加到 writeBuffer_。
+     * 每条命令前后各读一次 CycleClock（上一条的结束就是下一条的开始），耗时记进本线程的统计，
+     * 超过阈值的再记一条 SLOWLOG。预取的时间摊在第一条命令头上。
+     */
+    void ExecuteBatch(size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            CommandCall& c = batch_[i];
+            if (c.def && c.def->firstKey > 0 && c.argv.size() > static_cast<size_t>(c.def->firstKey)) {
+                c.hash = g_store->Prefetch(c.argv[c.def->firstKey]);
             }
-            string key = args[1];
-            string value = args[2];
-            
-            g_store.Set(key, value);
-            return "+OK\r\n"; // 告诉客户端：成功了
         }
-        
-        //处理 GET 命令
-        else if (cmd == "GET") {
-            if (args.size() < 2) {
-                return "-ERR wrong number of arguments for 'get' command\r\n";
-            }
-            string key = args[1];
-            string val = g_store.Get(key);
-            
-            if (val == "") {
-                return "$-1\r\n"; // Redis 的 nil (没找到)
-            } else {
-                // 拼凑 Bulk String 格式: $长度\r\n内容\r\n
-                return "$" + to_string(val.size()) + "\r\n" + val + "\r\n";
+        ThreadStats& stats = LocalStats();
+        SlowLog& slowlog = SlowLog::Instance();
+        uint64_t start = CycleClock::Now();
+        for (size_t i = 0; i < n; ++i) {
+            CommandCall& c = batch_[i];
+            c.asking = asking_;
+            ExecuteCommand(c, writeBuffer_);
+            asking_ = c.setAsking;
+            uint64_t end = CycleClock::Now();
+            if (c.def) {
+                stats.RecordCommand(static_cast<int>(c.def - kCommandTable), end - start);
+                if (slowlog.IsSlow(end - start)) slowlog.Add(c.argv.data(), c.argv.size(), end - start);
             }
-        }
-
-        //处理 PING 命令
-        else if (cmd == "PING") {
-            return "+PONG\r\n";
-        }
-        //LPUSH 
-        // ... 在 process_command 里 ...
-        else if (cmd == "LPUSH") {
-            if (args.size() < 3) return "-ERR wrong number of arguments for 'lpush' command\r\n";
-            
-            // 1. 获取返回值
-            int len = g_store.LPush(args[1], args[2]);
-            
-            // 2. 判断结果
-            if (len == -1) {
-                // 类型不对，报 Redis 标准错误
-                return "-WRONGTYPE Operation against a key holding the wrong kind of value\r\n";
-            } else {
-                // 成功，返回列表长度
-                return ":" + to_string(len) + "\r\n";
+            start = end;
+            // 没被 move 走的大参数（比如很长的 key）别一直占着内存
+            if (!batch_[i].owned.empty()) batch_[i].owned.clear();
+            if (c.handoff) {
+                // 后面的命令（从库在等回复，正常不会有）不执行了
+                handedOff_ = true;
+                handoffArgs_.clear();
+                for (size_t j = 1; j < c.argv.size(); ++j) handoffArgs_.push_back(c.argv[j].ToString());
+                break;
             }
         }
-
-        //LRANGE
-        else if (cmd == "LRANGE") {
-            if (args.size() < 4) return "-ERR wrong number of arguments for 'lrange' command\r\n";
-            // args[1] 是 key，暂时忽略 args[2]和[3] (start/stop)
-            return g_store.LRange(args[1]);
-        }
-        //未知命令
-        else {
-            return "-ERR unknown command '" + cmd + "'\r\n";
-        }
     }
 
 
 public:
-    explicit Connection(int fd):fd_(fd){
+    explicit Connection(int fd):fd_(fd), events_(0), readPaused_(false), blocked_(false), handedOff_(false), asking_(false){
         last_active_time_ = time(nullptr);
     };
     ~Connection()
@@ -115,90 +111,141 @@ public:
         }
     }
     int GetFd() const { return fd_; }
+
+    // 读 socket：正在收大参数时，数据先直接读进参数自己的 string，多出来的再进缓冲区
     ssize_t Read()
     {
-        char buff[1024]={0};
-        ssize_t n=read(fd_,buff,sizeof(buff));
+        ssize_t n;
+        if (parser_.WantsDirectRead()) {
+            size_t got = 0;
+            n = readBuffer_.ReadFd(fd_, parser_.DirectReadPtr(), parser_.DirectReadLen(), &got);
+            parser_.DirectReadDone(got);
+        } else {
+            n = readBuffer_.ReadFd(fd_);
+        }
         if(n>0)
         {
-            readBuffer_+=buff;
             last_active_time_ = time(nullptr);
+            CountStat(STAT_NET_INPUT, n);
         }
         return n;
     }
     time_t GetLastActiveTime() const { return last_active_time_; }
-    void Process() {
-        // 循环检查：只要 buffer 里有\r\n，就说明有一句完整指令
-            while (true) {
-        // ===================================================
-        // 状态 A: 读取参数个数 (*3)
-        // ===================================================
-        if (state_ == STATE_REQ_NUM) {
-            size_t pos = readBuffer_.find("\r\n");
-            if (pos == string::npos) break; // 没读完一行，等下次
-
-            string line = readBuffer_.substr(0, pos);
-            readBuffer_ = readBuffer_.substr(pos + 2);
-
-            if (line.empty() || line[0] != '*') continue; // 容错
-
-            expectedArgs_ = stoi(line.substr(1));
-            args_.clear(); 
-            
-            state_ = STATE_ARG_LEN; // 去读下一行的长度
-        }
-        
-        // ===================================================
-        // 状态 B: 读取参数长度 ($3)
-        // ===================================================
-        else if (state_ == STATE_ARG_LEN) {
-            size_t pos = readBuffer_.find("\r\n");
-            if (pos == string::npos) break; // 没读完一行，等下次
-
-            string line = readBuffer_.substr(0, pos);
-            readBuffer_ = readBuffer_.substr(pos + 2);
-
-            if (line.empty() || line[0] != '$') continue; // 容错
-
-            expectedLen_ = stoi(line.substr(1));
-            
-            state_ = STATE_ARG_DATA; // 去读具体数据
+
+    // 完成模型：内核已经读好的数据交进来（拷一次）。正在收大参数时先填大参数自己的 string
+    void Feed(const char* data, size_t n) {
+        CountStat(STAT_NET_INPUT, n);
+        while (n > 0 && parser_.WantsDirectRead()) {
+            size_t m = min(n, parser_.DirectReadLen());
+            memcpy(parser_.DirectReadPtr(), data, m);
+            parser_.DirectReadDone(m);
+            data += m;
+            n -= m;
         }
-        
-        // ===================================================
-        // 状态 C: 读取参数内容 (SET / key / value)
-        // ===================================================
-        else if (state_ == STATE_ARG_DATA) {
-            // +2 是因为数据后面还有 \r\n
-            if (readBuffer_.size() < expectedLen_ + 2) {
-                break; 
+        if (n > 0) readBuffer_.Append(data, n);
+        last_active_time_ = time(nullptr);
+    }
+
+    /**
+     * 把缓冲区里完整的命令都执行掉，回复只追加到写缓冲区，由 Reactor 统一 Flush。
+     * pipeline 的命令按批处理：先把读缓冲区里凑齐的命令（最多 MAX_BATCH 条）都解析出来，
+     * 整批预取、执行，最后一起从读缓冲区里删掉。
+     * 待发送数据超过高水位就先停下（按批检查，是个软限制），剩下的命令留在读缓冲区里，等回复发出去再接着执行。
+     * 返回 false 表示协议错误，调用方应该关掉连接。
+     */
+    bool Process() {
+        blocked_ = false;
+        while (!handedOff_) {
+            if (writeBuffer_.Bytes() >= g_config.output_hwm) {
+                blocked_ = true;
+                break;
+            }
+            // 1. 解析：凑一批
+            size_t n = 0;
+            RespParser::Result r = RespParser::PARSE_AGAIN;
+            while (n < MAX_BATCH) {
+                r = parser_.Parse(readBuffer_);
+                if (r != RespParser::PARSE_OK) break;
+                AddToBatch(n++);
+                parser_.Next();
             }
+            // 2. 执行 + 从读缓冲区里删掉
+            ExecuteBatch(n);
+            parser_.Consume(readBuffer_);
+
+            if (r == RespParser::PARSE_ERROR) {
+                // 错误原因接在前面命令的回复后面，由 Reactor 尽量发出去再断开
+                AddReplyError(writeBuffer_, "ERR " + parser_.Error());
+                return false;
+            }
+            if (n < MAX_BATCH) break; // 缓冲区里没有完整的命令了
+        }
+        readBuffer_.Shrink();
+        return true;
+    }
+
+    // 把写缓冲区尽量发出去（一次 writev）。返回 false 表示连接出错
+    bool Flush() {
+        if (writeBuffer_.Empty()) return true;
+        ssize_t n = writeBuffer_.WriteFd(fd_);
+        if (n < 0) return false;
+        if (n > 0) {
+            last_active_time_ = time(nullptr);
+            CountStat(STAT_NET_OUTPUT, n);
+        }
+        return true;
+    }
+
+    // 完成模型：要发的数据（最多 max 块），发出去之前地址一直有效，期间可以继续往后追加回复
+    int GatherOutput(struct iovec* vec, int max) const { return writeBuffer_.Gather(vec, max); }
+
+    void OutputSent(size_t n) {
+        writeBuffer_.Consume(n);
+        if (n > 0) {
+            last_active_time_ = time(nullptr);
+            CountStat(STAT_NET_OUTPUT, n);
+        }
+    }
 
-            // 截取数据
-            string data = readBuffer_.substr(0, expectedLen_);
-            readBuffer_ = readBuffer_.substr(expectedLen_ + 2); // 删掉数据和\r\n
-
-            args_.push_back(data);
-            expectedArgs_--;
-
-                if (expectedArgs_ == 0) 
-                    {
-                // 凑齐了！执行命令
-                string response = process_command(args_); // 你的业务函数
-                send(fd_, response.c_str(), response.size(), 0);
-                
-                state_ = STATE_REQ_NUM; // 重置回状态 A
-                    } 
-                else 
-                    {
-                // 还没齐，继续去读下一个参数的长度
-                state_ = STATE_ARG_LEN; 
-                    }
-                }
+    bool HasPendingOutput() const { return !writeBuffer_.Empty(); }
+    bool Blocked() const { return blocked_; }
+
+    // 是否应该继续读这个连接：超过高水位就暂停，降到一半以下才恢复（留点余量，避免来回切换）
+    bool WantRead() {
+        size_t pending = writeBuffer_.Bytes();
+        if (readPaused_) {
+            if (pending <= g_config.output_hwm / 2) readPaused_ = false;
+        } else if (pending >= g_config.output_hwm) {
+            readPaused_ = true;
+        }
+        return !readPaused_;
+    }
+
+    // PSYNC 之后由 Reactor 交给 Replication：剩下的回复拿走，fd 也拿走（析构时不 close）
+    bool HandedOff() const { return handedOff_; }
+    const vector<string>& HandoffArgs() const { return handoffArgs_; }
+    string TakeOutput() {
+        string s;
+        struct iovec vec[64];
+        while (!writeBuffer_.Empty()) {
+            int cnt = writeBuffer_.Gather(vec, 64);
+            size_t n = 0;
+            for (int i = 0; i < cnt; ++i) {
+                s.append(static_cast<const char*>(vec[i].iov_base), vec[i].iov_len);
+                n += vec[i].iov_len;
             }
+            writeBuffer_.Consume(n);
         }
-    
+        return s;
+    }
+    int ReleaseFd() {
+        int fd = fd_;
+        fd_ = -1;
+        return fd;
+    }
 
+    uint32_t Events() const { return events_; }
+    void SetEvents(uint32_t ev) { events_ = ev; }
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,56 @@
+/**
+ * Crc16.h
+ * CRC16（XMODEM：多项式 0x1021，初值 0），和 Redis Cluster 算 hash slot 用的是同一个，
+ * 所以同一个 key 在这里和在 Redis 里落在同一个 slot 上，现成的集群客户端可以直接用。
+ *
+ * KeyHashSlot：key 里有 "{...}"（第一个 '{' 和它后面第一个 '}' 之间非空）就只算括号里面的部分（hash tag），
+ * 这样 "user:{42}:name" 和 "user:{42}:age" 一定在同一个 slot 上，可以一起 MGET / MSET。
+ * 服务端和 benchmark 都用它。
+ */
+
+#ifndef CRC16_H
+#define CRC16_H
+
+#include <cstdint>
+#include <cstddef>
+
+namespace crc16 {
+
+const int SLOTS = 16384; // 2 的幂，取 CRC16 的低 14 位
+
+// 按字节查表
+struct Table {
+    uint16_t t[256];
+    Table() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint16_t c = static_cast<uint16_t>(i << 8);
+            for (int k = 0; k < 8; ++k) c = (c & 0x8000) ? static_cast<uint16_t>((c << 1) ^ 0x1021) : static_cast<uint16_t>(c << 1);
+            t[i] = c;
+        }
+    }
+};
+
+inline uint16_t Crc16(const char* p, size_t n) {
+    static const Table table;
+    uint16_t crc = 0;
+    for (size_t i = 0; i < n; ++i) {
+        crc = static_cast<uint16_t>((crc << 8) ^ table.t[((crc >> 8) ^ static_cast<uint8_t>(p[i])) & 0xff]);
+    }
+    return crc;
+}
+
+inline int KeyHashSlot(const char* key, size_t n) {
+    size_t open = 0;
+    while (open < n && key[open] != '{') open++;
+    if (open < n) {
+        size_t close = open + 1;
+        while (close < n && key[close] != '}') close++;
+        // "{}" 或者没有 '}'：整个 key 都算
+        if (close < n && close > open + 1) return Crc16(key + open + 1, close - open - 1) & (SLOTS - 1);
+    }
+    return Crc16(key, n) & (SLOTS - 1);
+}
+
+} // namespace crc16
+
+#endif // CRC16_H
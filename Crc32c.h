@@ -0,0 +1,74 @@
+/**
+ * Crc32c.h
+ * CRC32C（Castagnoli 多项式，和 iSCSI / ext4 / LevelDB 用的是同一个）。
+ * CPU 支持 SSE4.2 时用 crc32 指令一次算 8 字节，否则查表；运行时检测一次，编译时不用加 -msse4.2。
+ */
+
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+namespace crc32c {
+
+// 按字节查表的软件实现
+struct Table {
+    uint32_t t[256];
+    Table() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? (c >> 1) ^ 0x82F63B78u : (c >> 1);
+            t[i] = c;
+        }
+    }
+};
+
+inline uint32_t ExtendSw(uint32_t crc, const char* p, size_t n) {
+    static const Table table;
+    crc = ~crc;
+    for (size_t i = 0; i < n; ++i) {
+        crc = table.t[(crc ^ static_cast<uint8_t>(p[i])) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+inline uint32_t ExtendHw(uint32_t crc, const char* p, size_t n) {
+    uint64_t c = ~crc & 0xffffffffu;
+    while (n >= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        c = _mm_crc32_u64(c, w);
+        p += 8;
+        n -= 8;
+    }
+    uint32_t c32 = static_cast<uint32_t>(c);
+    while (n > 0) {
+        c32 = _mm_crc32_u8(c32, static_cast<uint8_t>(*p));
+        ++p;
+        --n;
+    }
+    return ~c32;
+}
+#endif
+
+// 在 crc 的基础上接着算 [p, p+n)，crc 初值传 0
+inline uint32_t Extend(uint32_t crc, const char* p, size_t n) {
+#if defined(__x86_64__)
+    static const bool hw = __builtin_cpu_supports("sse4.2");
+    if (hw) return ExtendHw(crc, p, n);
+#endif
+    return ExtendSw(crc, p, n);
+}
+
+inline uint32_t Value(const char* p, size_t n) { return Extend(0, p, n); }
+
+} // namespace crc32c
+
+#endif // CRC32C_H
@@ -0,0 +1,145 @@
+/**
+ * Epoch.h
+ * 基于 epoch 的内存回收（EBR, Epoch-Based Reclamation）。
+ * 无锁结构里删掉的节点不能马上 free：别的线程可能正拿着它的指针在读。
+ * 做法：
+ *   1. 读写无锁结构前先 EpochGuard 进入临界区，记下当前全局 epoch；
+ *   2. 删除的节点先 Retire()，挂到“在第 e 个 epoch 退休”的链表上；
+ *   3. 只有所有活跃线程都看到了 e+1，全局 epoch 才能推进到 e+2，
+ *      这时第 e 个 epoch 退休的节点一定没人再引用了，可以真正释放。
+ */
+
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+
+class EpochManager {
+public:
+    typedef void (*Deleter)(void*);
+
+    static EpochManager& Instance() {
+        static EpochManager inst;
+        return inst;
+    }
+
+    // 进入临界区：把自己的本地 epoch 设成全局 epoch（带 ACTIVE 标记）
+    void Enter() {
+        ThreadRecord* rec = Local();
+        if (rec->depth++ > 0) return; // 允许嵌套
+        uint64_t e;
+        do {
+            e = globalEpoch_.load(std::memory_order_relaxed);
+            rec->epoch.store(e | ACTIVE, std::memory_order_relaxed);
+            // 必须保证“宣布自己活跃”先于后面对共享结构的任何读取
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            // 宣布之前全局 epoch 可能已经被推走了，那就按新的再宣布一次
+        } while (globalEpoch_.load(std::memory_order_relaxed) != e);
+    }
+
+    void Exit() {
+        ThreadRecord* rec = Local();
+        if (--rec->depth > 0) return;
+        rec->epoch.store(0, std::memory_order_release);
+    }
+
+    // 节点已经从结构里摘掉了，等所有可能看见它的读者离开后再释放
+    void Retire(void* p, Deleter d) {
+        ThreadRecord* rec = Local();
+        uint64_t e = globalEpoch_.load(std::memory_order_acquire);
+        rec->limbo[e % 3].push_back(Garbage{p, d});
+        if (++rec->retired % RETIRE_BATCH == 0) {
+            TryAdvance();
+            Reclaim(rec);
+        }
+    }
+
+private:
+    static const uint64_t ACTIVE = 1ull << 63;
+    static const int MAX_THREADS = 256;
+    static const int RETIRE_BATCH = 64;
+
+    struct Garbage {
+        void* ptr;
+        Deleter del;
+    };
+
+    // 每个线程一条记录，按 cache line 对齐避免伪共享
+    struct alignas(64) ThreadRecord {
+        std::atomic<uint64_t> epoch;     // 0 = 不在临界区
+        std::atomic<bool> used;
+        int depth = 0;
+        uint64_t retired = 0;
+        std::vector<Garbage> limbo[3];  // 按 epoch % 3 分桶
+        ThreadRecord() : epoch(0), used(false) {}
+    };
+
+    std::atomic<uint64_t> globalEpoch_;
+    ThreadRecord records_[MAX_THREADS];
+    std::atomic<int> recordCount_;
+
+    EpochManager() : globalEpoch_(0), recordCount_(0) {}
+
+    // 进程退出时所有线程都停了，剩下的垃圾直接释放
+    ~EpochManager() {
+        for (int i = 0; i < recordCount_.load(); ++i) {
+            for (int b = 0; b < 3; ++b) {
+                FreeAll(records_[i].limbo[b]);
+            }
+        }
+    }
+
+    ThreadRecord* Local() {
+        static thread_local ThreadRecord* rec = nullptr;
+        if (rec) return rec;
+        // 找一个没人用的槽（线程退出后槽位不回收，够用了）
+        for (int i = 0; i < MAX_THREADS; ++i) {
+            bool expected = false;
+            if (records_[i].used.compare_exchange_strong(expected, true)) {
+                int n = recordCount_.load();
+                while (n < i + 1 && !recordCount_.compare_exchange_weak(n, i + 1)) {}
+                rec = &records_[i];
+                return rec;
+            }
+        }
+        abort(); // 超过 MAX_THREADS 个线程用无锁结构
+    }
+
+    // 所有活跃线程都已经进入当前 epoch，就把全局 epoch 往前推一格
+    void TryAdvance() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint64_t e = globalEpoch_.load(std::memory_order_acquire);
+        int n = recordCount_.load(std::memory_order_acquire);
+        for (int i = 0; i < n; ++i) {
+            uint64_t le = records_[i].epoch.load(std::memory_order_acquire);
+            if ((le & ACTIVE) && (le & ~ACTIVE) != e) return;
+        }
+        globalEpoch_.compare_exchange_strong(e, e + 1);
+    }
+
+    // 当前全局 epoch 是 g，那么 g-2 及更早退休的东西已经安全。
+    // g-2 和 g+1 落在同一个桶里，这个桶里不可能有比 g-2 更新的东西
+    void Reclaim(ThreadRecord* rec) {
+        uint64_t g = globalEpoch_.load(std::memory_order_acquire);
+        FreeAll(rec->limbo[(g + 1) % 3]);
+    }
+
+    static void FreeAll(std::vector<Garbage>& v) {
+        for (const Garbage& g : v) g.del(g.ptr);
+        v.clear();
+    }
+};
+
+// RAII：作用域内都在 epoch 临界区里
+class EpochGuard {
+public:
+    EpochGuard() { EpochManager::Instance().Enter(); }
+    ~EpochGuard() { EpochManager::Instance().Exit(); }
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+};
+
+#endif // EPOCH_H
@@ -4,6 +4,7 @@
 #include <sys/epoll.h> // Epoll 的核心库
 #include <unistd.h>   
 #include <vector>      
+#include "Stats.h"
 
 class Epoller {
 private:
@@ -29,15 +30,28 @@ public:
         struct epoll_event ev = {0};
         ev.data.fd=fd;
         ev.events=events;
+        CountSyscall();
         return 0==epoll_ctl(epollFd_,EPOLL_CTL_ADD,fd,&ev);
     }
+    // 修改已经注册的 fd 要监听的事件（比如写满时加上 EPOLLOUT）
+    bool ModFd(int fd,uint32_t events)
+    {
+        if(fd<0) return false;
+        struct epoll_event ev = {0};
+        ev.data.fd=fd;
+        ev.events=events;
+        CountSyscall();
+        return 0==epoll_ctl(epollFd_,EPOLL_CTL_MOD,fd,&ev);
+    }
     bool DelFd(int fd)
     {
         if(fd<0) return false;
+        CountSyscall();
         return 0 == epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
     }
     int Wait(int timeoutMs)
     {
+        CountSyscall();
         return epoll_wait(epollFd_,&events_[0],static_cast<int>(events_.size()),timeoutMs);
     }
     int GetEventFd(size_t i) const{
@@ -0,0 +1,388 @@
+/**
+ * HashIndex.h
+ * 给 KVStore 做点查用的开放寻址哈希表，结构参考 Google 的 SwissTable（absl::flat_hash_map）：
+ *   - 一个 slot 只存一个指针（指向跳表节点，key/value 都在节点里），不重复存 key；
+ *   - 另有一个控制字节数组 ctrl_：空 / 已删除 / 或者哈希值的低 7 位（H2）；
+ *   - 16 个 slot 一组，用 SSE2 一条指令把一组 16 个控制字节和 H2 比一遍，
+ *     只有 H2 撞上的 slot 才去真正比较 key，绝大部分不命中的位置连节点都不用碰。
+ * 跳表负责有序遍历和快照，这张表只负责“key -> 节点”的 O(1) 定位，两边由 KVStore 保证同步。
+ */
+
+#ifndef HASH_INDEX_H
+#define HASH_INDEX_H
+
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <new>
+#include <atomic>
+#include "Slice.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// 64 位乘法混合：128 位乘积的高低两半异或
+inline uint64_t HashMix(uint64_t a, uint64_t b) {
+    __uint128_t r = static_cast<__uint128_t>(a) * b;
+    return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+}
+
+// key 的哈希函数（wyhash 风格，一次吃 8 字节）。分片路由和哈希索引共用这一个值
+inline uint64_t HashKey(const char* p, size_t len) {
+    const uint64_t k0 = 0xa0761d6478bd642full;
+    const uint64_t k1 = 0xe7037ed1a0b428dbull;
+    uint64_t h = k0 ^ (len * k1);
+    while (len >= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        h = HashMix(h ^ w, k1);
+        p += 8;
+        len -= 8;
+    }
+    if (len > 0) {
+        uint64_t w = 0;
+        memcpy(&w, p, len);
+        h = HashMix(h ^ w, k0);
+    }
+    return HashMix(h, k1 ^ 0x8ebc6af09c88c6e3ull);
+}
+
+inline uint64_t HashKey(const Slice& key) { return HashKey(key.data(), key.size()); }
+
+/**
+ * HashIndex: Node 需要有一个 key 成员（std::string），查找时直接拿 Slice 比较，不用先拷成 string
+ */
+template <typename Node>
+class HashIndex {
+public:
+    HashIndex()
+        : ctrl_(nullptr), slots_(nullptr), capacity_(0), size_(0), tombstones_(0), growthLeft_(0),
+          hintCtrl_(nullptr), hintSlots_(nullptr), hintMask_(0) {
+        Resize(GROUP);
+    }
+
+    ~HashIndex() { Release(); }
+
+    HashIndex(const HashIndex&) = delete;
+    HashIndex& operator=(const HashIndex&) = delete;
+
+    size_t Size() const { return size_; }
+    size_t Capacity() const { return capacity_; }
+    // 表本身占用的字节数（控制字节 + 指针数组）
+    size_t MemoryUsage() const { return capacity_ * (1 + sizeof(Node*)); }
+
+    // 查找 key，找不到返回 nullptr
+    Node* Find(const Slice& key, uint64_t hash) const {
+        size_t mask = capacity_ / GROUP - 1;
+        size_t g = H1(hash) & mask;
+        int8_t h2 = H2(hash);
+        for (size_t step = 1; ; ++step) {
+            const int8_t* ctrl = ctrl_ + g * GROUP;
+            uint32_t bits = Match(ctrl, h2);
+            while (bits) {
+                int i = __builtin_ctz(bits);
+                Node* n = slots_[g * GROUP + i];
+                if (Slice(n->key) == key) return n;
+                bits &= bits - 1;
+            }
+            // 组里还有空位，说明当初插入时探测在这里就停了，后面不可能有这个 key
+            if (Match(ctrl, EMPTY)) return nullptr;
+            g = (g + step) & mask; // 按组做三角数探测
+        }
+    }
+
+    static const size_t BATCH = 16; // FindBatch 一轮同时查几个
+
+    /**
+     * 批量查找（MGET 用）：out[i] = Find(keys[i], hashes[i])。
+     * 一个一个查的话，每个 key 都要先等控制字节 / slot 的 cache miss，再等节点（里面的 key）的 cache miss，
+     * 两次都是串行等。这里每 BATCH 个一轮，分阶段齐头并进（group prefetch）：
+     *   1. 所有 key 的第一组控制字节和 slot 一起预取；
+     *   2. 在第一组里匹配 H2，把候选节点一起预取；
+     *   3. 比较 key。第一组里没找到、组又是满的（要接着探测）的很少见，走普通的 Find。
+     * 这样一轮里 BATCH 个 key 的 miss 是叠在一起等的。
+     */
+    void FindBatch(const Slice* keys, const uint64_t* hashes, size_t n, Node** out) const {
+        size_t mask = capacity_ / GROUP - 1;
+        for (size_t base = 0; base < n; base += BATCH) {
+            size_t m = n - base < BATCH ? n - base : BATCH;
+            const Slice* k = keys + base;
+            const uint64_t* h = hashes + base;
+            for (size_t j = 0; j < m; ++j) Prefetch(h[j]);
+            uint32_t bits[BATCH];
+            for (size_t j = 0; j < m; ++j) {
+                size_t g = H1(h[j]) & mask;
+                bits[j] = Match(ctrl_ + g * GROUP, H2(h[j]));
+                if (bits[j]) __builtin_prefetch(slots_[g * GROUP + __builtin_ctz(bits[j])]);
+            }
+            for (size_t j = 0; j < m; ++j) {
+                size_t g = H1(h[j]) & mask;
+                Node* found = nullptr;
+                for (uint32_t b = bits[j]; b; b &= b - 1) {
+                    Node* node = slots_[g * GROUP + __builtin_ctz(b)];
+                    if (Slice(node->key) == k[j]) {
+                        found = node;
+                        break;
+                    }
+                }
+                if (!found && !Match(ctrl_ + g * GROUP, EMPTY)) found = Find(k[j], h[j]);
+                out[base + j] = found;
+            }
+        }
+    }
+
+    // 预留能放下 n 个元素的容量（批量加载前调一次，省掉中途一次次扩容）
+    void Reserve(size_t n) {
+        size_t need = GROUP;
+        while (need - need / 8 < n + size_) need *= 2;
+        if (need > capacity_) Resize(need);
+    }
+
+    /**
+     * 把 hash 要探测的第一组控制字节和 slot 提前拉进缓存（pipeline 批量执行时用，不改任何状态）。
+     * 不用拿锁：地址按 Resize 发布的 hint 算，和扩容撞上时可能是旧表 / 三个值不配套，
+     * 预取一个过时（甚至已经释放）的地址不会出错，只是白取一次。
+     */
+    void Prefetch(uint64_t hash) const {
+        const int8_t* ctrl = hintCtrl_.load(std::memory_order_relaxed);
+        Node* const* slots = hintSlots_.load(std::memory_order_relaxed);
+        size_t g = H1(hash) & hintMask_.load(std::memory_order_relaxed);
+        __builtin_prefetch(ctrl + g * GROUP);
+        // 一组 16 个指针是 128 字节，占两条 cache line
+        __builtin_prefetch(slots + g * GROUP);
+        __builtin_prefetch(slots + g * GROUP + GROUP / 2);
+    }
+
+    // 插入一个新节点（调用方保证 key 不存在）
+    void Insert(Node* node, uint64_t hash) {
+        if (growthLeft_ == 0) Grow();
+        size_t pos = FindFree(hash);
+        if (ctrl_[pos] == DELETED) tombstones_--;
+        else growthLeft_--;
+        ctrl_[pos] = H2(hash);
+        slots_[pos] = node;
+        size_++;
+    }
+
+    // 删除 key，返回被删的节点（找不到返回 nullptr）
+    Node* Erase(const Slice& key, uint64_t hash) {
+        size_t mask = capacity_ / GROUP - 1;
+        size_t g = H1(hash) & mask;
+        int8_t h2 = H2(hash);
+        for (size_t step = 1; ; ++step) {
+            int8_t* ctrl = ctrl_ + g * GROUP;
+            uint32_t bits = Match(ctrl, h2);
+            while (bits) {
+                int i = __builtin_ctz(bits);
+                Node* n = slots_[g * GROUP + i];
+                if (Slice(n->key) == key) {
+                    // 组里有空位的话，直接置空也不会打断别人的探测链
+                    if (Match(ctrl, EMPTY)) {
+                        ctrl[i] = EMPTY;
+                        growthLeft_++;
+                    } else {
+                        ctrl[i] = DELETED;
+                        tombstones_++;
+                    }
+                    size_--;
+                    return n;
+                }
+                bits &= bits - 1;
+            }
+            if (Match(ctrl, EMPTY)) return nullptr;
+            g = (g + step) & mask;
+        }
+    }
+
+    /**
+     * SCAN 用：把主组（H1 & 组掩码，也就是探测的起点）是 cursor 的元素都交给 f，返回下一个游标，回到 0 表示走完了。
+     * 游标是组号按反向二进制加一（和 Redis 的 dictScan 一样）：扩容时一个组拆成的两个新组在这个顺序里挨着，
+     * 已经走过的组拆出来的还算走过，所以从头到尾都在的元素至少交出去一次，中间扩容也不漏（可能重复）。
+     * 开放寻址下主组是 g 的元素只会在从 g 开始的探测序列上、第一个带 EMPTY 的组之前（删除只留 DELETED），顺着找就全了；
+     * 路上别的主组的元素要重算哈希才分得出来，一次调用的开销是一条探测链。f 里不能改这张表。
+     */
+    template <typename F>
+    uint64_t Scan(uint64_t cursor, F f) const {
+        size_t mask = capacity_ / GROUP - 1;
+        size_t home = static_cast<size_t>(cursor) & mask;
+        size_t g = home;
+        for (size_t step = 1; step <= mask + 1; ++step) {
+            const int8_t* ctrl = ctrl_ + g * GROUP;
+            uint32_t bits = ~MatchFree(ctrl) & 0xffff;
+            while (bits) {
+                Node* n = slots_[g * GROUP + __builtin_ctz(bits)];
+                bits &= bits - 1;
+                if ((H1(HashKey(n->key)) & mask) == home) f(n);
+            }
+            if (Match(ctrl, EMPTY)) break;
+            g = (g + step) & mask;
+        }
+        uint64_t v = cursor | ~static_cast<uint64_t>(mask);
+        v = ReverseBits(ReverseBits(v) + 1);
+        return v;
+    }
+
+    /**
+     * 随机取最多 n 个不重复的元素放进 out，返回实际取到的个数（淘汰抽样用）。
+     * 每一个都单独抽：用 rnd 往下推出来的新随机数挑 slot，空的就换一个再抽，最多 SAMPLE_PROBES 次，
+     * 这样抽到的元素均匀分散在整张表里，不会都挤在同一组、偏向组里靠前的 slot。
+     * 表很空（删多了不缩容）老抽不中的时候，从最后一次抽的位置往后最多扫 SAMPLE_PROBES 组，拿碰到的第一个；
+     * 还没有就宁可少取几个，也不把整张表扫一遍。
+     */
+    size_t Sample(uint64_t rnd, Node** out, size_t n) const {
+        if (size_ == 0) return 0;
+        size_t got = 0;
+        for (size_t k = 0; k < n; ++k) {
+            Node* node = nullptr;
+            size_t slot = 0;
+            for (int probe = 0; probe < SAMPLE_PROBES && !node; ++probe) {
+                slot = static_cast<size_t>(SplitMix(&rnd)) & (capacity_ - 1);
+                if (ctrl_[slot] >= 0) node = slots_[slot];
+            }
+            if (!node) node = NextOccupied(slot);
+            if (!node) continue;
+            bool dup = false;
+            for (size_t i = 0; i < got && !dup; ++i) dup = out[i] == node;
+            if (!dup) out[got++] = node;
+        }
+        return got;
+    }
+
+private:
+    static const size_t GROUP = 16;
+    static const int8_t EMPTY = -128;  // 0b10000000
+    static const int8_t DELETED = -2;  // 0b11111110
+    // 满的 slot 控制字节是 0~127（H2），最高位为 0
+
+    int8_t* ctrl_;
+    Node** slots_;
+    size_t capacity_;   // slot 总数，2 的幂且是 GROUP 的倍数
+    size_t size_;
+    size_t tombstones_;
+    size_t growthLeft_; // 还能再用掉多少个空位（最大负载 7/8）
+    // 给不拿锁的 Prefetch 看的 ctrl_ / slots_ / 组掩码，Resize 里更新
+    std::atomic<int8_t*> hintCtrl_;
+    std::atomic<Node**> hintSlots_;
+    std::atomic<size_t> hintMask_;
+
+    static const int SAMPLE_PROBES = 4;
+
+    // 从 slot 开始往后（最多 SAMPLE_PROBES 组）第一个有元素的 slot，没有返回 nullptr
+    Node* NextOccupied(size_t slot) const {
+        size_t g = slot / GROUP;
+        size_t mask = capacity_ / GROUP - 1;
+        uint32_t bits = ~MatchFree(ctrl_ + g * GROUP) & 0xffff & (0xffffu << (slot % GROUP));
+        for (int i = 0; i < SAMPLE_PROBES; ++i) {
+            if (bits) return slots_[g * GROUP + __builtin_ctz(bits)];
+            g = (g + 1) & mask;
+            bits = ~MatchFree(ctrl_ + g * GROUP) & 0xffff;
+        }
+        return nullptr;
+    }
+
+    static uint64_t ReverseBits(uint64_t v) {
+        v = ((v >> 1) & 0x5555555555555555ULL) | ((v & 0x5555555555555555ULL) << 1);
+        v = ((v >> 2) & 0x3333333333333333ULL) | ((v & 0x3333333333333333ULL) << 2);
+        v = ((v >> 4) & 0x0f0f0f0f0f0f0f0fULL) | ((v & 0x0f0f0f0f0f0f0f0fULL) << 4);
+        v = ((v >> 8) & 0x00ff00ff00ff00ffULL) | ((v & 0x00ff00ff00ff00ffULL) << 8);
+        v = ((v >> 16) & 0x0000ffff0000ffffULL) | ((v & 0x0000ffff0000ffffULL) << 16);
+        return (v >> 32) | (v << 32);
+    }
+
+    // splitmix64：一个种子推出一串互相独立的随机数
+    static uint64_t SplitMix(uint64_t* state) {
+        uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    static size_t H1(uint64_t hash) { return static_cast<size_t>(hash >> 7); }
+    static int8_t H2(uint64_t hash) { return static_cast<int8_t>(hash & 0x7f); }
+
+    // 一组 16 个控制字节里，哪些等于 b（返回 16 位掩码）
+    static uint32_t Match(const int8_t* ctrl, int8_t b) {
+#ifdef __SSE2__
+        __m128i group = _mm_load_si128(reinterpret_cast<const __m128i*>(ctrl));
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(b))));
+#else
+        uint32_t bits = 0;
+        for (size_t i = 0; i < GROUP; ++i) {
+            if (ctrl[i] == b) bits |= 1u << i;
+        }
+        return bits;
+#endif
+    }
+
+    // 空的或者已删除的 slot（控制字节最高位为 1）
+    static uint32_t MatchFree(const int8_t* ctrl) {
+#ifdef __SSE2__
+        __m128i group = _mm_load_si128(reinterpret_cast<const __m128i*>(ctrl));
+        return static_cast<uint32_t>(_mm_movemask_epi8(group));
+#else
+        uint32_t bits = 0;
+        for (size_t i = 0; i < GROUP; ++i) {
+            if (ctrl[i] < 0) bits |= 1u << i;
+        }
+        return bits;
+#endif
+    }
+
+    size_t FindFree(uint64_t hash) const {
+        size_t mask = capacity_ / GROUP - 1;
+        size_t g = H1(hash) & mask;
+        for (size_t step = 1; ; ++step) {
+            uint32_t bits = MatchFree(ctrl_ + g * GROUP);
+            if (bits) return g * GROUP + __builtin_ctz(bits);
+            g = (g + step) & mask;
+        }
+    }
+
+    // 墓碑太多就原地重建，否则扩容一倍
+    void Grow() {
+        if (tombstones_ > capacity_ / 4) Resize(capacity_);
+        else Resize(capacity_ * 2);
+    }
+
+    void Resize(size_t newCap) {
+        int8_t* oldCtrl = ctrl_;
+        Node** oldSlots = slots_;
+        size_t oldCap = capacity_;
+
+        // 控制字节按 16 字节对齐，SSE2 才能用对齐加载
+        void* mem = nullptr;
+        if (posix_memalign(&mem, GROUP, newCap) != 0) throw std::bad_alloc();
+        ctrl_ = static_cast<int8_t*>(mem);
+        memset(ctrl_, EMPTY, newCap);
+        slots_ = static_cast<Node**>(malloc(newCap * sizeof(Node*)));
+        if (!slots_) throw std::bad_alloc();
+        capacity_ = newCap;
+        tombstones_ = 0;
+        growthLeft_ = newCap - newCap / 8 - size_;
+
+        for (size_t i = 0; i < oldCap; ++i) {
+            if (oldCtrl[i] >= 0) {
+                Node* n = oldSlots[i];
+                uint64_t hash = HashKey(n->key);
+                size_t pos = FindFree(hash);
+                ctrl_[pos] = H2(hash);
+                slots_[pos] = n;
+            }
+        }
+        hintCtrl_.store(ctrl_, std::memory_order_relaxed);
+        hintSlots_.store(slots_, std::memory_order_relaxed);
+        hintMask_.store(capacity_ / GROUP - 1, std::memory_order_relaxed);
+        free(oldCtrl);
+        free(oldSlots);
+    }
+
+    void Release() {
+        free(ctrl_);
+        free(slots_);
+        ctrl_ = nullptr;
+        slots_ = nullptr;
+    }
+};
+
+#endif // HASH_INDEX_H
@@ -0,0 +1,118 @@
+/**
+ * Histogram.h
+ * HDR 风格的延迟直方图：按 2 的幂分段，每段再等分成 2^SubBits 个桶（对数 + 线性），
+ * 相对误差不超过 1/2^SubBits。Histogram 是 SubBits = 7（128 个桶一段，误差 < 1%，从 1 到 2^63 七千多个桶），
+ * 服务端每条命令一个的那种用更粗的段（Stats.h），记一次就是算个下标 +1，不分配内存。
+ *
+ *   [0, 256)          每个值一个桶
+ *   [256, 512)        每 2 个值一个桶
+ *   [512, 1024)       每 4 个值一个桶
+ *   ...
+ *
+ * 取百分位时报桶里的最大值（和 HdrHistogram 的 highestEquivalentValue 一样，宁可报大不报小），
+ * 再用真实的 max 封顶。单位由调用方决定（benchmark 里是纳秒）。
+ */
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+template <int SubBits>
+class BasicHistogram {
+public:
+    static const int SUB_BITS = SubBits;
+    static const uint64_t SUB_COUNT = 1ULL << SUB_BITS;
+    static const size_t BUCKETS = 2 * SUB_COUNT + (63 - SUB_BITS) * SUB_COUNT;
+
+    BasicHistogram() : counts_(static_cast<size_t>(BUCKETS), 0), count_(0), sum_(0), min_(UINT64_MAX), max_(0) {}
+
+    void Record(uint64_t v) {
+        counts_[Index(v)]++;
+        count_++;
+        sum_ += v;
+        if (v < min_) min_ = v;
+        if (v > max_) max_ = v;
+    }
+
+    void Merge(const BasicHistogram& o) {
+        for (size_t i = 0; i < BUCKETS; ++i) counts_[i] += o.counts_[i];
+        count_ += o.count_;
+        sum_ += o.sum_;
+        if (o.min_ < min_) min_ = o.min_;
+        if (o.max_ > max_) max_ = o.max_;
+    }
+
+    // 直接往第 i 个桶里加 n 个（计数在别处按桶攒着的，读的时候灌进来算百分位）。
+    // 不知道具体的值，min / max 按桶的上界算，Mean() 也是按上界估的
+    void AddToBucket(size_t i, uint64_t n) {
+        if (n == 0) return;
+        uint64_t v = HighestEquivalent(i);
+        counts_[i] += n;
+        count_ += n;
+        sum_ += v * n;
+        if (v < min_) min_ = v;
+        if (v > max_) max_ = v;
+    }
+
+    void Reset() {
+        std::fill(counts_.begin(), counts_.end(), 0);
+        count_ = 0;
+        sum_ = 0;
+        min_ = UINT64_MAX;
+        max_ = 0;
+    }
+
+    // p 是 0 ~ 100，比如 99.9
+    uint64_t Percentile(double p) const {
+        if (count_ == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(p / 100.0 * count_ + 0.5);
+        if (rank < 1) rank = 1;
+        if (rank > count_) rank = count_;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKETS; ++i) {
+            seen += counts_[i];
+            if (seen >= rank) {
+                uint64_t v = HighestEquivalent(i);
+                return v < max_ ? v : max_;
+            }
+        }
+        return max_;
+    }
+
+    uint64_t Count() const { return count_; }
+    uint64_t Max() const { return max_; }
+    uint64_t Min() const { return count_ ? min_ : 0; }
+    double Mean() const { return count_ ? static_cast<double>(sum_) / count_ : 0; }
+
+    // 值落在哪个桶
+    static size_t Index(uint64_t v) {
+        if (v < 2 * SUB_COUNT) return static_cast<size_t>(v);
+        int msb = 63 - __builtin_clzll(v);
+        int shift = msb - SUB_BITS;
+        return static_cast<size_t>(2 * SUB_COUNT + (shift - 1) * SUB_COUNT + ((v >> shift) - SUB_COUNT));
+    }
+
+    // 桶 i 里最大的那个值
+    static uint64_t HighestEquivalent(size_t i) {
+        if (i < 2 * SUB_COUNT) return i;
+        int shift = static_cast<int>((i - 2 * SUB_COUNT) / SUB_COUNT) + 1;
+        uint64_t m = (i - 2 * SUB_COUNT) % SUB_COUNT + SUB_COUNT;
+        if (m + 1 == 2 * SUB_COUNT && shift + SUB_BITS + 1 >= 64) return UINT64_MAX;
+        return ((m + 1) << shift) - 1;
+    }
+
+private:
+    std::vector<uint64_t> counts_;
+    uint64_t count_;
+    uint64_t sum_;
+    uint64_t min_;
+    uint64_t max_;
+};
+
+typedef BasicHistogram<7> Histogram;
+
+#endif // HISTOGRAM_H
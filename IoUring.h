@@ -0,0 +1,298 @@
+/**
+ * IoUring.h
+ * 和 Epoller 同一个角色的 io_uring 封装：Epoller 告诉你“哪个 fd 能读写了”，这里是“哪个操作做完了”。
+ * 直接用 io_uring_setup / io_uring_enter / io_uring_register 三个系统调用 + mmap，不依赖 liburing。
+ *
+ * Reactor 用到的几样：
+ *   - multishot accept：提交一次，之后每来一个连接出一个完成事件；
+ *   - multishot recv + provided buffer ring：每个连接只提交一次 recv，内核从注册好的缓冲区环里挑一块放数据，
+ *     完成事件里带着是哪一块（bid），用完还回环里；
+ *   - sendmsg：一个连接一次带一串 iovec 发出去，一轮里所有连接的发送攒在一起，随下一次 io_uring_enter 一起提交。
+ * 一轮事件循环通常只有一次 io_uring_enter（提交 + 等完成事件），epoll 是 epoll_wait + 每个连接各自 readv / writev。
+ *
+ * 需要 6.1 以上的内核（SINGLE_ISSUER + DEFER_TASKRUN）：完成事件只在这个线程调 io_uring_enter 时处理，
+ * 不会在别的时候被软中断打断。老内核 / 被禁用时 Init 失败，Reactor 退回 epoll。
+ */
+
+#ifndef IO_URING_H
+#define IO_URING_H
+
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <atomic>
+#include <ctime>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+// linux/io_uring.h 会带进 linux/fs.h，里面的 BLOCK_SIZE 宏和 snapshot::BLOCK_SIZE 撞名
+#undef BLOCK_SIZE
+#include "Stats.h"
+
+class IoUring {
+public:
+    IoUring() : fd_(-1), ring_(nullptr), ringSize_(0), sqes_(nullptr), sqesSize_(0), sqTail_(0), toSubmit_(0),
+                bufRing_(nullptr), bufRingSize_(0), bufs_(nullptr), bufCount_(0), bufSize_(0), bufGroup_(0) {}
+
+    ~IoUring() { Close(); }
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    /**
+     * 建 ring（先不启用：SINGLE_ISSUER 的 ring 只能由启用它的线程提交，启用放到事件循环的线程里做 Enable()）。
+     * entries 是提交队列大小，完成队列开 4 倍（multishot 一次提交会出很多完成事件）。
+     */
+    bool Init(unsigned entries) {
+        struct io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        p.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN | IORING_SETUP_R_DISABLED |
+                  IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL;
+        p.cq_entries = entries * 4;
+        fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+        if (fd_ < 0) return false;
+        if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_EXT_ARG)) {
+            Close();
+            return false;
+        }
+
+        // SINGLE_MMAP：提交队列和完成队列在同一块映射里
+        ringSize_ = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+        size_t cqSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+        if (cqSize > ringSize_) ringSize_ = cqSize;
+        ring_ = static_cast<char*>(mmap(nullptr, ringSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                        fd_, IORING_OFF_SQ_RING));
+        if (ring_ == MAP_FAILED) {
+            ring_ = nullptr;
+            Close();
+            return false;
+        }
+        sqesSize_ = p.sq_entries * sizeof(struct io_uring_sqe);
+        sqes_ = static_cast<struct io_uring_sqe*>(mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE,
+                                                      MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES));
+        if (sqes_ == MAP_FAILED) {
+            sqes_ = nullptr;
+            Close();
+            return false;
+        }
+
+        sqHead_ = reinterpret_cast<std::atomic<uint32_t>*>(ring_ + p.sq_off.head);
+        sqTailK_ = reinterpret_cast<std::atomic<uint32_t>*>(ring_ + p.sq_off.tail);
+        sqMask_ = *reinterpret_cast<uint32_t*>(ring_ + p.sq_off.ring_mask);
+        sqEntries_ = p.sq_entries;
+        sqArray_ = reinterpret_cast<uint32_t*>(ring_ + p.sq_off.array);
+        cqHead_ = reinterpret_cast<std::atomic<uint32_t>*>(ring_ + p.cq_off.head);
+        cqTail_ = reinterpret_cast<std::atomic<uint32_t>*>(ring_ + p.cq_off.tail);
+        cqMask_ = *reinterpret_cast<uint32_t*>(ring_ + p.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<struct io_uring_cqe*>(ring_ + p.cq_off.cqes);
+        // 提交队列的 array 直接做成恒等映射：第 i 个槽位就用第 i 个 sqe
+        for (uint32_t i = 0; i < sqEntries_; ++i) sqArray_[i] = i;
+        sqTail_ = sqTailK_->load(std::memory_order_relaxed);
+        return true;
+    }
+
+    // 在要跑事件循环的线程里调：从此以后只有这个线程能提交
+    bool Enable() {
+        return Register(IORING_REGISTER_ENABLE_RINGS, nullptr, 0) == 0;
+    }
+
+    /**
+     * 注册 provided buffer ring：count 块（2 的幂）、每块 size 字节，编号 0 .. count-1，组号 group。
+     * multishot recv 从这里挑缓冲区放数据。
+     */
+    bool SetupBuffers(uint16_t group, unsigned count, unsigned size) {
+        bufRingSize_ = count * sizeof(struct io_uring_buf);
+        void* ring = mmap(nullptr, bufRingSize_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ring == MAP_FAILED) return false;
+        bufRing_ = static_cast<struct io_uring_buf_ring*>(ring);
+        bufs_ = static_cast<char*>(malloc(static_cast<size_t>(count) * size));
+        if (!bufs_) return false;
+        bufCount_ = count;
+        bufSize_ = size;
+        bufGroup_ = group;
+
+        struct io_uring_buf_reg reg;
+        memset(&reg, 0, sizeof(reg));
+        reg.ring_addr = reinterpret_cast<uint64_t>(bufRing_);
+        reg.ring_entries = count;
+        reg.bgid = group;
+        if (Register(IORING_REGISTER_PBUF_RING, &reg, 1) != 0) return false;
+
+        bufTail_ = 0;
+        for (unsigned i = 0; i < count; ++i) PutBuffer(static_cast<uint16_t>(i));
+        PublishBuffers();
+        return true;
+    }
+
+    uint16_t BufferGroup() const { return bufGroup_; }
+    const char* BufferAt(uint16_t bid) const { return bufs_ + static_cast<size_t>(bid) * bufSize_; }
+
+    // 数据拷走了，把这块还回环里，内核马上可以再用
+    void RecycleBuffer(uint16_t bid) {
+        PutBuffer(bid);
+        PublishBuffers();
+    }
+
+    // ---------------- 提交 ----------------
+
+    // 拿一个空的 sqe；提交队列满了先把攒着的提交掉
+    struct io_uring_sqe* GetSqe() {
+        if (sqTail_ - sqHead_->load(std::memory_order_acquire) >= sqEntries_) {
+            Enter(0, 0, nullptr);
+        }
+        struct io_uring_sqe* sqe = &sqes_[sqTail_ & sqMask_];
+        memset(sqe, 0, sizeof(*sqe));
+        sqTail_++;
+        toSubmit_++;
+        return sqe;
+    }
+
+    void PrepAcceptMultishot(int fd, uint64_t userData) {
+        struct io_uring_sqe* sqe = GetSqe();
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = fd;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_CLOEXEC;
+        sqe->user_data = userData;
+    }
+
+    void PrepRecvMultishot(int fd, uint64_t userData) {
+        struct io_uring_sqe* sqe = GetSqe();
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = fd;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = bufGroup_;
+        sqe->user_data = userData;
+    }
+
+    // msg 在完成之前必须一直有效
+    void PrepSendmsg(int fd, const struct msghdr* msg, uint64_t userData) {
+        struct io_uring_sqe* sqe = GetSqe();
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(msg);
+        sqe->len = 1;
+        sqe->msg_flags = MSG_NOSIGNAL;
+        sqe->user_data = userData;
+    }
+
+    // 取消 user_data 是 target 的那个请求（multishot 的会再出一个不带 F_MORE 的完成事件）
+    void PrepCancel(uint64_t target, uint64_t userData) {
+        struct io_uring_sqe* sqe = GetSqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = target;
+        sqe->user_data = userData;
+    }
+
+    /**
+     * 提交攒着的 sqe，并且等到至少有一个完成事件（最多等 timeoutMs 毫秒）。
+     * 完成队列里已经有东西就不等。返回 io_uring_enter 的结果，超时是 -ETIME。
+     */
+    int SubmitAndWait(int timeoutMs) {
+        if (cqTail_->load(std::memory_order_acquire) != cqHead_->load(std::memory_order_relaxed)) {
+            return toSubmit_ ? Enter(0, IORING_ENTER_GETEVENTS, nullptr) : 0;
+        }
+        struct __kernel_timespec ts;
+        ts.tv_sec = timeoutMs / 1000;
+        ts.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000000;
+        return Enter(1, IORING_ENTER_GETEVENTS, &ts);
+    }
+
+    // 把完成队列里现有的事件都交给 f(const io_uring_cqe&)，f 里可以接着 Prep（下一次 SubmitAndWait 一起提交）
+    template <typename F>
+    unsigned ForEachCqe(F f) {
+        uint32_t head = cqHead_->load(std::memory_order_relaxed);
+        uint32_t tail = cqTail_->load(std::memory_order_acquire);
+        unsigned n = 0;
+        while (head != tail) {
+            f(cqes_[head & cqMask_]);
+            head++;
+            n++;
+            // 处理一个放一个：f 里的 GetSqe 可能 Enter，内核要看到完成队列有空位
+            cqHead_->store(head, std::memory_order_release);
+        }
+        return n;
+    }
+
+private:
+    int fd_;
+    char* ring_;          // 提交队列 + 完成队列的映射
+    size_t ringSize_;
+    struct io_uring_sqe* sqes_;
+    size_t sqesSize_;
+    std::atomic<uint32_t>* sqHead_;
+    std::atomic<uint32_t>* sqTailK_;
+    uint32_t* sqArray_;
+    uint32_t sqMask_;
+    uint32_t sqEntries_;
+    uint32_t sqTail_;     // 自己这边的尾巴，Enter 之前才写给内核
+    uint32_t toSubmit_;
+    std::atomic<uint32_t>* cqHead_;
+    std::atomic<uint32_t>* cqTail_;
+    uint32_t cqMask_;
+    struct io_uring_cqe* cqes_;
+
+    struct io_uring_buf_ring* bufRing_;
+    size_t bufRingSize_;
+    char* bufs_;
+    unsigned bufCount_;
+    unsigned bufSize_;
+    uint16_t bufGroup_;
+    uint16_t bufTail_;
+
+    int Register(unsigned op, void* arg, unsigned n) {
+        return static_cast<int>(syscall(__NR_io_uring_register, fd_, op, arg, n));
+    }
+
+    int Enter(unsigned waitNr, unsigned flags, struct __kernel_timespec* ts) {
+        sqTailK_->store(sqTail_, std::memory_order_release);
+        unsigned submit = toSubmit_;
+        toSubmit_ = 0;
+        struct io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        void* argp = nullptr;
+        size_t argsz = 0;
+        if (ts) {
+            arg.ts = reinterpret_cast<uint64_t>(ts);
+            flags |= IORING_ENTER_EXT_ARG;
+            argp = &arg;
+            argsz = sizeof(arg);
+        }
+        CountSyscall();
+        int r = static_cast<int>(syscall(__NR_io_uring_enter, fd_, submit, waitNr, flags, argp, argsz));
+        return r < 0 ? -errno : r;
+    }
+
+    void PutBuffer(uint16_t bid) {
+        // 不用 bufRing_->bufs：头文件里的柔性数组前面垫了个空 struct，C++ 里空 struct 占 1 字节，bufs 会整体错后 8 字节
+        struct io_uring_buf* b = reinterpret_cast<struct io_uring_buf*>(bufRing_) + (bufTail_ & (bufCount_ - 1));
+        b->addr = reinterpret_cast<uint64_t>(bufs_ + static_cast<size_t>(bid) * bufSize_);
+        b->len = bufSize_;
+        b->bid = bid;
+        bufTail_++;
+    }
+
+    void PublishBuffers() {
+        reinterpret_cast<std::atomic<uint16_t>*>(&bufRing_->tail)->store(bufTail_, std::memory_order_release);
+    }
+
+    void Close() {
+        if (sqes_) munmap(sqes_, sqesSize_);
+        if (ring_) munmap(ring_, ringSize_);
+        if (fd_ >= 0) close(fd_);
+        if (bufRing_) munmap(bufRing_, bufRingSize_);
+        free(bufs_);
+        sqes_ = nullptr;
+        ring_ = nullptr;
+        fd_ = -1;
+        bufRing_ = nullptr;
+        bufs_ = nullptr;
+    }
+};
+
+#endif // IO_URING_H
@@ -2,131 +2,1276 @@
 #define KVSTORE_H
 
 #include "SkipList.h"
+#include "HashIndex.h"
+#include "Slice.h"
+#include "Snapshot.h"
+#include "Object.h"
+#include "Config.h"
+#include "StringMatch.h"
+#ifdef KV_CONCURRENT_SKIPLIST
+#include "ConcurrentSkipList.h"
+#include "Epoch.h"
+#endif
 #include <string>
 #include <vector>
+#include <unordered_set>
+#include <algorithm>
 #include <iostream>
 #include <fstream>
-
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <chrono>
+#include <unistd.h> // fork
 
 using namespace std;
 
-enum ObjType {
-    OBJ_STRING = 0,
-    OBJ_LIST   = 1
-};
+// 编译期选择索引实现：默认是普通跳表（分片锁保护），
+// 打开 KV_CONCURRENT_SKIPLIST（cmake -DKV_LOCKFREE=ON）后换成无锁跳表，GET 不再拿分片锁
+#ifdef KV_CONCURRENT_SKIPLIST
+typedef ConcurrentSkipList<string, RedisObject*> KeyIndex;
+#else
+typedef SkipList<string, RedisObject*> KeyIndex;
+#endif
 
-struct RedisObject {
-    ObjType type;
-    void* ptr;
-    RedisObject(ObjType t, void* p) : type(t), ptr(p) {}
-    ~RedisObject() {
-        if (type == OBJ_STRING) delete (string*)ptr;
-        else if (type == OBJ_LIST) delete (vector<string>*)ptr;
-    }
-};
+// 写操作的下游（AOF / 复制）：在分片锁里按真正执行的顺序收到每一个写操作，参数是等价的命令，
+// shard 是这个 key 所在的分片（同一个分片的写按顺序来，不同分片的写碰的是不同的 key，谁先谁后都一样）
+typedef void (*FeedFn)(int shard, const Slice* argv, int argc);
 
+/**
+ * KVStore: 数据按 key 的哈希拆成多个分片（Shard），每个分片一把锁一棵跳表。
+ * 多 Reactor 模式下分片数 = 线程数，不同线程访问不同分片时互不干扰，
+ * 只有恰好落到同一分片的请求才会抢锁。单线程模式下只有一个分片，锁永远不竞争。
+ */
 class KVStore {
 public:
-    explicit KVStore(const string& filename) : filename_(filename) {
-        LoadFromFile();
+    // load = false：不读快照文件（数据从 AOF 加载）；filename 为空：纯内存，退出时也不保存（engine_bench 用）
+    explicit KVStore(const string& filename, int shards = 1, bool load = true)
+        : filename_(filename), dirty_(0), feed_(nullptr), maxmemory_(0), policy_(MAXMEMORY_NOEVICTION),
+          samples_(5), evicted_(0) {
+        if (shards < 1) shards = 1;
+        for (int i = 0; i < shards; ++i) {
+            shards_.push_back(new Shard(i));
+        }
+        if (load) LoadFromFile(filename_);
+        dirty_ = 0; // 加载进来的不算改动
     }
 
     ~KVStore() {
         SaveToFile();
         // 退出时，SkipList 析构会删节点，但我们需要先删节点里的 RedisObject
         auto free_func = [](string& key, RedisObject*& val) {
-            delete val;
+            DestroyObject(val);
         };
-        data_.traverse(free_func);
+        for (Shard* shard : shards_) {
+            shard->data.traverse(free_func);
+            delete shard;
+        }
     }
 
-    void Set(const string& key, const string& value) {
-        // 1. 查旧删旧
-        RedisObject* old_obj = nullptr;
-        if (data_.search(key, old_obj)) {
-            delete old_obj;
-        }
-        // 2. 立新
-        string* str_ptr = new string(value);
-        RedisObject* new_obj = new RedisObject(OBJ_STRING, str_ptr);
-        data_.insert(key, new_obj);
+    /**
+     * pipeline 批量执行的第一步：先把这批命令的 key 都算好哈希、把哈希索引里对应的位置预取进缓存，
+     * 真正执行时把返回的哈希传给下面带 h 参数的接口，不用再算一遍，访存也基本都能命中缓存。
+     * 不拿分片锁（HashIndex::Prefetch 和扩容撞上也没事），不然每条命令都要拿两次锁。
+     */
+    uint64_t Prefetch(const Slice& key) {
+        uint64_t h = HashKey(key);
+        // 无锁读的版本 GET 不走哈希索引，只算哈希
+#ifndef KV_CONCURRENT_SKIPLIST
+        ShardFor(h).index.Prefetch(h);
+#endif
+        return h;
     }
 
-    string Get(const string& key) {
+    // key / value 都是指向读缓冲区的 Slice，只在真正落到存储里时拷贝一次
+    // expireAt：过期时间（unix 毫秒），0 表示不过期（SET 不带 EX/PX 时原来的过期时间也一起清掉）
+    void Set(const Slice& key, const Slice& value) { Set(key, HashKey(key), value); }
+    void Set(const Slice& key, uint64_t h, const Slice& value, int64_t expireAt = 0) {
+        SetObject(key, h, CreateStringObject(value.data(), value.size(), expireAt, SharedIntegersAllowed()));
+    }
+
+    // 大 value 已经在一个 string 里了（协议层直接读进来的），move 进来，不再拷贝
+    void Set(const Slice& key, string&& value) { Set(key, HashKey(key), std::move(value)); }
+    void Set(const Slice& key, uint64_t h, string&& value, int64_t expireAt = 0) {
+        SetObject(key, h, CreateStringObject(std::move(value), expireAt, SharedIntegersAllowed()));
+    }
+
+    // 下面带 h 的接口：h 必须是 HashKey(key)（一般是 Prefetch 返回的）
+    // 1 找到了（值拷进 out），0 不存在，-1 类型不对
+    int Get(const Slice& key, string* out) { return Get(key, HashKey(key), out); }
+    int Get(const Slice& key, uint64_t h, string* out) {
+        Shard& shard = ShardFor(h);
+#ifdef KV_CONCURRENT_SKIPLIST
+        // 无锁读：不拿分片锁（哈希索引只给写者用），直接查无锁跳表，
+        // 靠 epoch 保证读到的对象不会被写者释放
+        EpochGuard guard;
         RedisObject* obj = nullptr;
-        if (data_.search(key, obj)) {
-            if (obj->type == OBJ_STRING) {
-                return *(string*)(obj->ptr);
+        shard.data.search(key, obj);
+        if (obj && IsExpired(obj, MsTime())) {
+            // 过期了：拿锁走一遍普通查找，顺手删掉
+            lock_guard<mutex> lock(shard.mtx);
+            LookupNode(shard, key, h);
+            return 0;
+        }
+#else
+        lock_guard<mutex> lock(shard.mtx);
+        RedisObject* obj = Lookup(shard, key, h);
+#endif
+        if (!obj) return 0;
+        if (obj->type != OBJ_STRING) return -1;
+        Touch(obj);
+        char buf[21];
+        Slice val = ObjectSlice(obj, buf);
+        out->assign(val.data(), val.size());
+        return 1;
+    }
+
+    // 删除 key：哈希索引和跳表两边一起删，返回是否真的删掉了（已经过期的不算）
+    bool Del(const Slice& key) { return Del(key, HashKey(key)); }
+    bool Del(const Slice& key, uint64_t h) {
+        Shard& shard = ShardFor(h);
+        lock_guard<mutex> lock(shard.mtx);
+        IndexNode* node = LookupNode(shard, key, h);
+        if (!node) return false;
+        DeleteNode(shard, node, h);
+        return true;
+    }
+
+    /**
+     * 多 key 的读写（MGET / MSET / DEL k1 k2 ...）：先算好所有 key 的哈希、按分片分组，每个分片只拿一次锁，
+     * 组里的 key 批量查（HashIndex::FindBatch / searchBatch），cache miss 叠在一起等，不是一个 key 等一次。
+     */
+
+    // MGET：found[i] 表示第 i 个 key 有没有值（不存在、不是字符串都算没有，和 Redis 一样回 nil），有的话值在 vals[i]
+    void MGet(const Slice* keys, size_t n, vector<string>* vals, vector<char>* found) {
+        vals->assign(n, string());
+        found->assign(n, 0);
+        KeyBatch b;
+        GroupByShard(keys, n, &b);
+        vector<Slice> sk(n);
+        vector<uint64_t> sh(n);
+        vector<RedisObject*> objs(n);
+        vector<char> expired(n);
+#ifdef KV_CONCURRENT_SKIPLIST
+        unique_ptr<bool[]> hit(new bool[n]);
+#else
+        vector<IndexNode*> nodes(n);
+#endif
+        int64_t now = MsTime();
+        for (size_t si = 0; si < shards_.size(); ++si) {
+            size_t begin = b.start[si], m = b.start[si + 1] - begin;
+            if (m == 0) continue;
+            for (size_t j = 0; j < m; ++j) {
+                sk[j] = keys[b.order[begin + j]];
+                sh[j] = b.hashes[b.order[begin + j]];
+            }
+            Shard& shard = *shards_[si];
+#ifdef KV_CONCURRENT_SKIPLIST
+            // 和 Get 一样不拿锁，直接批量查无锁跳表
+            EpochGuard guard;
+            shard.data.searchBatch(sk.data(), m, objs.data(), hit.get());
+            for (size_t j = 0; j < m; ++j) {
+                if (!hit[j]) objs[j] = nullptr;
+            }
+#else
+            lock_guard<mutex> lock(shard.mtx);
+            shard.index.FindBatch(sk.data(), sh.data(), m, nodes.data());
+            for (size_t j = 0; j < m; ++j) objs[j] = nodes[j] ? static_cast<RedisObject*>(nodes[j]->value) : nullptr;
+#endif
+            bool anyExpired = false;
+            for (size_t j = 0; j < m; ++j) {
+                RedisObject* obj = objs[j];
+                expired[j] = obj && IsExpired(obj, now);
+                if (!obj || expired[j]) {
+                    anyExpired |= expired[j];
+                    continue;
+                }
+                if (obj->type != OBJ_STRING) continue;
+                Touch(obj);
+                size_t i = b.order[begin + j];
+                char buf[21];
+                Slice val = ObjectSlice(obj, buf);
+                (*vals)[i].assign(val.data(), val.size());
+                (*found)[i] = 1;
+            }
+            if (anyExpired) {
+                // 惰性删除放到最后、按 key 重新查一遍再删：同一个 key 可能在 MGET 里出现好几次，
+                // 删掉以后 objs 里别的位置就指向释放了的对象了
+#ifdef KV_CONCURRENT_SKIPLIST
+                lock_guard<mutex> lock(shard.mtx);
+#endif
+                for (size_t j = 0; j < m; ++j) {
+                    if (expired[j]) LookupNode(shard, sk[j], sh[j]);
+                }
             }
         }
-        return "";
     }
 
-    // 修改前：void LPush(...)
-    // 修改后：int LPush(...)
-    int LPush(const string& key, const string& value) {
-        
-        RedisObject* obj = nullptr;
+    /**
+     * MSET：owned[i] 不为空时值从它 move 过来（协议层读进来的大参数），否则拷 vals[i]。
+     * 涉及的分片按编号从小到大一起锁上再写（和 ForkLocked 一个顺序，不会死锁），
+     * 别的命令看到的要么是全写之前、要么是全写之后，和 Redis 的 MSET 一样是原子的。
+     */
+    void MSet(const Slice* keys, const Slice* vals, string* const* owned, size_t n) {
+        vector<RedisObject*> objs(n);
+        for (size_t i = 0; i < n; ++i) {
+            objs[i] = owned[i] ? CreateStringObject(std::move(*owned[i]), 0, SharedIntegersAllowed())
+                               : CreateStringObject(vals[i].data(), vals[i].size(), 0, SharedIntegersAllowed());
+        }
+        KeyBatch b;
+        GroupByShard(keys, n, &b);
+        LockShards(b);
+        for (size_t si = 0; si < shards_.size(); ++si) {
+            size_t begin = b.start[si], end = b.start[si + 1];
+            if (begin == end) continue;
+            Shard& shard = *shards_[si];
+            for (size_t j = begin; j < end; ++j) shard.index.Prefetch(b.hashes[b.order[j]]);
+            // 组内保持原来的顺序，同一个 key 写了两次的话后面的生效
+            for (size_t j = begin; j < end; ++j) {
+                size_t i = b.order[j];
+                SetObjectLocked(shard, keys[i], b.hashes[i], objs[i]);
+            }
+        }
+        UnlockShards(b);
+    }
 
-        // 1. 查找
-        if (data_.search(key, obj)) {
-            // 找到了，但类型不对，返回错误码 -1
+    // DEL k1 k2 ...：返回真正删掉了几个
+    long long Del(const Slice* keys, size_t n) {
+        KeyBatch b;
+        GroupByShard(keys, n, &b);
+        long long deleted = 0;
+        for (size_t si = 0; si < shards_.size(); ++si) {
+            size_t begin = b.start[si], end = b.start[si + 1];
+            if (begin == end) continue;
+            Shard& shard = *shards_[si];
+            lock_guard<mutex> lock(shard.mtx);
+            for (size_t j = begin; j < end; ++j) shard.index.Prefetch(b.hashes[b.order[j]]);
+            for (size_t j = begin; j < end; ++j) {
+                size_t i = b.order[j];
+                IndexNode* node = LookupNode(shard, keys[i], b.hashes[i]);
+                if (!node) continue;
+                DeleteNode(shard, node, b.hashes[i]);
+                deleted++;
+            }
+        }
+        return deleted;
+    }
+
+    /**
+     * INCRBY：key 不存在当作 0，结果放进 *result，过期时间保留。
+     * 返回 1 成功，-1 类型不对，-2 原来的值不是整数，-3 溢出。
+     * 已经是 INT 编码的直接在对象里加（不分配、不转字符串）；结果落在共享整数范围里的换成共享对象。
+     */
+    int IncrBy(const Slice& key, uint64_t h, int64_t delta, int64_t* result) {
+        Shard& shard = ShardFor(h);
+        lock_guard<mutex> lock(shard.mtx);
+        IndexNode* node = LookupNode(shard, key, h);
+        RedisObject* obj = node ? static_cast<RedisObject*>(node->value) : nullptr;
+        int64_t v = 0, expire = 0;
+        if (obj) {
+            if (obj->type != OBJ_STRING) return -1;
+            if (obj->encoding == OBJ_ENCODING_INT) {
+                v = ObjectIntValue(obj);
+            } else {
+                char buf[21];
+                Slice s = ObjectSlice(obj, buf);
+                if (!StringToInt64(s.data(), s.size(), &v)) return -2;
+            }
+            expire = GetExpire(obj);
+        }
+        if ((delta > 0 && v > INT64_MAX - delta) || (delta < 0 && v < INT64_MIN - delta)) return -3;
+        v += delta;
+        *result = v;
+        bool shared = SharedIntegersAllowed() && !expire && v >= 0 && v < OBJ_SHARED_INTEGERS;
+        if (obj && obj->encoding == OBJ_ENCODING_INT && !(obj->flags & OBJ_FLAG_SHARED) && !shared) {
+            SetObjectIntValue(obj, v);
+            Touch(obj);
+            dirty_.fetch_add(1, memory_order_relaxed);
+            FeedSet(shard, key, obj);
+        } else {
+            SetObjectLocked(shard, key, h, CreateIntObject(v, expire, SharedIntegersAllowed()));
+        }
+        return 1;
+    }
+
+    // 设置过期时间（unix 毫秒）：1 设上了，0 key 不存在。时间已经过了就直接删掉（也返回 1）
+    int Expire(const Slice& key, uint64_t h, int64_t when) {
+        Shard& shard = ShardFor(h);
+        lock_guard<mutex> lock(shard.mtx);
+        IndexNode* node = LookupNode(shard, key, h);
+        if (!node) return 0;
+        if (when <= MsTime()) {
+            DeleteNode(shard, node, h);
+            return 1;
+        }
+        RedisObject* obj = node->value;
+        if (obj->flags & OBJ_FLAG_EXPIRE) {
+            if (GetExpire(obj) == 0) shard.expires.Insert(node, h);
+            SetExpire(obj, when);
+        } else {
+            // 对象头前面没有放过期时间的地方（或者是共享对象）：换一个带的对象头，值直接转过去
+            RedisObject* withExpire = CloneWithExpire(obj, when);
+            node->value = withExpire;
+            shard.expires.Insert(node, h);
+            shard.used += ObjectBytes(withExpire) - ObjectBytes(obj);
+            FreeShell(obj);
+        }
+        dirty_.fetch_add(1, memory_order_relaxed);
+        if (feed_) {
+            string ms = to_string(when);
+            Slice argv[3] = {Slice("PEXPIREAT"), key, Slice(ms)};
+            feed_(shard.id, argv, 3);
+        }
+        return 1;
+    }
+
+    // 剩余存活时间（毫秒）：-2 key 不存在，-1 没有过期时间
+    int64_t Pttl(const Slice& key, uint64_t h) {
+        Shard& shard = ShardFor(h);
+        lock_guard<mutex> lock(shard.mtx);
+        IndexNode* node = LookupNode(shard, key, h);
+        if (!node) return -2;
+        int64_t when = GetExpire(node->value);
+        if (when == 0) return -1;
+        int64_t left = when - MsTime();
+        return left > 0 ? left : 0;
+    }
+
+    // 去掉过期时间：1 去掉了，0 key 不存在或者本来就不过期
+    int Persist(const Slice& key, uint64_t h) {
+        Shard& shard = ShardFor(h);
+        lock_guard<mutex> lock(shard.mtx);
+        IndexNode* node = LookupNode(shard, key, h);
+        if (!node) return 0;
+        RedisObject* obj = node->value;
+        if (GetExpire(obj) == 0) return 0;
+        shard.expires.Erase(key, h);
+        SetExpire(obj, 0);
+        dirty_.fetch_add(1, memory_order_relaxed);
+        if (feed_) {
+            Slice argv[2] = {Slice("PERSIST"), key};
+            feed_(shard.id, argv, 2);
+        }
+        return 1;
+    }
+
+    static const size_t ACTIVE_EXPIRE_SAMPLES = 20; // 每轮看多少个带过期时间的 key
+    static const size_t ACTIVE_EXPIRE_GROUPS = 400; // 每轮最多走多少组（表很空时一轮的上限）
+
+    /**
+     * 主动过期：顺着分片自己的游标走 expires（和 SCAN 一样一组组走，游标存在 Shard 里，下次接着走），
+     * 每轮看 ACTIVE_EXPIRE_SAMPLES 个 key 或者 ACTIVE_EXPIRE_GROUPS 组，过期的删掉；
+     * 看过的里面超过 10% 已经过期，说明这个分片里过期的还多，接着走，直到用完 budgetUs。
+     * 不用随机抽样：表不缩容，删到很空以后随机抽老是抽到空位，剩下的几个 key 可能很久都抽不中；
+     * 游标走一圈每个 key 都会看到。每轮只拿一小会儿锁，轮与轮之间别的请求可以插进来，
+     * 所以一大批 key 同时过期也不会卡住请求。不再被访问的 key 靠这里回收内存。返回删了多少个。
+     */
+    size_t ActiveExpireCycle(int shardIdx, int64_t budgetUs) {
+        Shard& shard = *shards_[shardIdx];
+        auto deadline = chrono::steady_clock::now() + chrono::microseconds(budgetUs);
+        size_t total = 0;
+        vector<IndexNode*> dead;
+        while (true) {
+            size_t sampled = 0;
+            dead.clear();
+            {
+                lock_guard<mutex> lock(shard.mtx);
+                int64_t now = MsTime();
+                uint64_t cursor = shard.expireCursor;
+                for (size_t groups = 0; groups < ACTIVE_EXPIRE_GROUPS && sampled < ACTIVE_EXPIRE_SAMPLES; ++groups) {
+                    // Scan 里不能改表，过期的先记下来
+                    cursor = shard.expires.Scan(cursor, [&](IndexNode* node) {
+                        sampled++;
+                        if (IsExpired(node->value, now)) dead.push_back(node);
+                    });
+                    if (cursor == 0) break; // 走完一圈，下一轮从头开始
+                }
+                shard.expireCursor = cursor;
+                for (IndexNode* node : dead) DeleteNode(shard, node, HashKey(node->key));
+            }
+            total += dead.size();
+            if (dead.size() * 10 <= sampled) break;
+            if (chrono::steady_clock::now() >= deadline) break;
+        }
+        return total;
+    }
+
+    /**
+     * LPUSH / RPUSH：vals 依次插到列表头上 / 尾巴上（LPUSH l a b c 之后是 c b a），key 不存在就新建一个列表。
+     * 返回插入后的长度，-1 类型不对。
+     */
+    long long Push(const Slice& key, uint64_t h, bool front, const Slice* vals, size_t n) {
+        Shard& shard = ShardFor(h);
+        lock_guard<mutex> lock(shard.mtx);
+        RedisObject* obj = Lookup(shard, key, h);
+        if (obj) {
             if (obj->type != OBJ_LIST) return -1;
+            Touch(obj);
         } else {
-            // 没找到 -> 新建 List
-            vector<string>* vec = new vector<string>();
-            obj = new RedisObject(OBJ_LIST, vec);
-            data_.insert(key, obj);
+            obj = CreateListObject(new QuickList());
+            InitObjectLru(obj, policy_ == MAXMEMORY_ALLKEYS_LFU);
+            shard.index.Insert(shard.data.insertNode(key.ToString(), obj), h);
+            shard.used += KeyBytes(key.size()) + ObjectBytes(obj);
+        }
+        QuickList* list = static_cast<QuickList*>(obj->ptr);
+        size_t before = ObjectBytes(obj);
+        for (size_t i = 0; i < n; ++i) {
+            if (front) list->PushFront(vals[i]);
+            else list->PushBack(vals[i]);
         }
+        shard.used += ObjectBytes(obj) - before;
+        dirty_.fetch_add(1, memory_order_relaxed);
+        if (feed_) {
+            vector<Slice> argv;
+            argv.reserve(n + 2);
+            argv.push_back(Slice(front ? "LPUSH" : "RPUSH"));
+            argv.push_back(key);
+            argv.insert(argv.end(), vals, vals + n);
+            feed_(shard.id, argv.data(), static_cast<int>(argv.size()));
+        }
+        return static_cast<long long>(list->Size());
+    }
 
-        // 2. 此时 obj 肯定是对的
-        vector<string>* vec = (vector<string>*)(obj->ptr);
-        vec->push_back(value);
-        
-        // 3. 返回列表当前的长度
-        return vec->size();
+    /**
+     * LPOP / RPOP：从头上 / 尾巴上最多弹出 count 个，依次追加到 out。
+     * 返回 1 key 存在，0 不存在，-1 类型不对。弹空了 key 也一起删掉（和 Redis 一样，没有空列表）。
+     */
+    int Pop(const Slice& key, uint64_t h, bool front, size_t count, vector<string>* out) {
+        Shard& shard = ShardFor(h);
+        lock_guard<mutex> lock(shard.mtx);
+        IndexNode* node = LookupNode(shard, key, h);
+        if (!node) return 0;
+        RedisObject* obj = node->value;
+        if (obj->type != OBJ_LIST) return -1;
+        QuickList* list = static_cast<QuickList*>(obj->ptr);
+        if (count > list->Size()) count = list->Size();
+        if (count == 0) return 1;
+        size_t before = ObjectBytes(obj);
+        auto take = [out](const Slice& v) { out->push_back(v.ToString()); };
+        for (size_t i = 0; i < count; ++i) {
+            if (front) list->PopFront(take);
+            else list->PopBack(take);
+        }
+        shard.used += ObjectBytes(obj) - before;
+        dirty_.fetch_add(1, memory_order_relaxed);
+        if (feed_) {
+            string n = to_string(count);
+            Slice argv[3] = {Slice(front ? "LPOP" : "RPOP"), key, Slice(n)};
+            feed_(shard.id, argv, 3);
+        }
+        // 重放上面那条 LPOP / RPOP 一样会删掉这个 key，不用再记 DEL
+        if (list->Size() == 0) DeleteNode(shard, node, h, false);
+        else Touch(obj);
+        return 1;
+    }
+
+    // LLEN：-1 类型不对，key 不存在是 0
+    long long LLen(const Slice& key, uint64_t h) {
+        Shard& shard = ShardFor(h);
+        lock_guard<mutex> lock(shard.mtx);
+        RedisObject* obj = Lookup(shard, key, h);
+        if (!obj) return 0;
+        if (obj->type != OBJ_LIST) return -1;
+        return static_cast<long long>(static_cast<QuickList*>(obj->ptr)->Size());
+    }
+
+    // LINDEX：index 可以是负数（-1 是最后一个）。1 找到了，0 key 不存在或者越界，-1 类型不对
+    int LIndex(const Slice& key, uint64_t h, long long index, string* out) {
+        Shard& shard = ShardFor(h);
+        lock_guard<mutex> lock(shard.mtx);
+        RedisObject* obj = Lookup(shard, key, h);
+        if (!obj) return 0;
+        if (obj->type != OBJ_LIST) return -1;
+        Touch(obj);
+        QuickList* list = static_cast<QuickList*>(obj->ptr);
+        long long len = static_cast<long long>(list->Size());
+        if (index < 0) index += len;
+        if (index < 0 || index >= len) return 0;
+        Slice v = list->At(static_cast<size_t>(index));
+        out->assign(v.data(), v.size());
+        return 1;
+    }
+
+    /**
+     * LRANGE：start / stop 的含义和 Redis 一样（闭区间，负数从尾巴数，越界的截掉）。
+     * 拿着分片锁先调 onLen(元素个数)，再对每个元素调 onItem(Slice)，Slice 直接指向列表节点里的数据，
+     * 调用方把它写进输出缓冲区，中间不拼 string。返回 1，key 不存在返回 0（不调回调），-1 类型不对。
+     */
+    template <typename OnLen, typename OnItem>
+    int LRange(const Slice& key, uint64_t h, long long start, long long stop, OnLen onLen, OnItem onItem) {
+        Shard& shard = ShardFor(h);
+        lock_guard<mutex> lock(shard.mtx);
+        RedisObject* obj = Lookup(shard, key, h);
+        if (!obj) return 0;
+        if (obj->type != OBJ_LIST) return -1;
+        Touch(obj);
+        QuickList* list = static_cast<QuickList*>(obj->ptr);
+        size_t from, n;
+        ListRange(list->Size(), start, stop, &from, &n);
+        onLen(n);
+        list->ForRange(from, n, onItem);
+        return 1;
     }
-    string LRange(const string& key) {
-        RedisObject* obj = nullptr;
-        if (!data_.search(key, obj)) return "*0\r\n";
-        if (obj->type != OBJ_LIST) return "-ERR WRONGTYPE\r\n";
 
-        vector<string>* vec = (vector<string>*)(obj->ptr);
-        string res = "*" + to_string(vec->size()) + "\r\n";
-        for (const string& s : *vec) {
-            res += "$" + to_string(s.size()) + "\r\n" + s + "\r\n";
+    // LTRIM：只留下 [start, stop]（含义同 LRANGE），一个都不剩就删掉 key。1 成功（key 不存在也算），-1 类型不对
+    int LTrim(const Slice& key, uint64_t h, long long start, long long stop) {
+        Shard& shard = ShardFor(h);
+        lock_guard<mutex> lock(shard.mtx);
+        IndexNode* node = LookupNode(shard, key, h);
+        if (!node) return 1;
+        RedisObject* obj = node->value;
+        if (obj->type != OBJ_LIST) return -1;
+        QuickList* list = static_cast<QuickList*>(obj->ptr);
+        size_t from, n;
+        ListRange(list->Size(), start, stop, &from, &n);
+        size_t before = ObjectBytes(obj);
+        list->DelBack(list->Size() - from - n);
+        list->DelFront(from);
+        shard.used += ObjectBytes(obj) - before;
+        dirty_.fetch_add(1, memory_order_relaxed);
+        if (feed_) {
+            string a = to_string(start), b = to_string(stop);
+            Slice argv[4] = {Slice("LTRIM"), key, Slice(a), Slice(b)};
+            feed_(shard.id, argv, 4);
         }
-        return res;
+        if (list->Size() == 0) DeleteNode(shard, node, h, false);
+        else Touch(obj);
+        return 1;
     }
 
-private:
-    SkipList<string, RedisObject*> data_;
-    string filename_;
-    
+    // SCAN 的过滤条件：pattern 为空不过滤；type 是 OBJ_STRING / OBJ_LIST，-1 不过滤
+    struct ScanFilter {
+        Slice pattern;
+        int type;
+        ScanFilter() : type(-1) {}
+    };
 
-    void SaveToFile() {
-        ofstream outfile(filename_);
-        if (!outfile.is_open()) return;
-        int count = 0;
+    /**
+     * SCAN：从 cursor 接着往下走，大约看 count 个 key（过期的、过滤掉的也算）就停，符合条件的放进 keys，
+     * 返回下一次的游标，0 表示全部走完了。
+     *
+     * 游标自己说明了位置，服务器不用记任何东西：游标 = 组游标 × 分片数 + 第几个分片，
+     * 组游标是这个分片的哈希索引按反向二进制走到的组（HashIndex::Scan，和 Redis 的 dictScan 一样）。
+     * 所以游标多久以后再用都行，重启以后、在从库上（分片数一样）也能接着用；任何数字都是合法游标。
+     * 代价也和 Redis 一样：从头到尾都在的 key 至少返回一次，中间扩容过的话可能重复；顺序是哈希顺序。
+     * 按 key 的顺序遍历、按前缀 O(logN) 定位用 RANGE。
+     * 一次一个主组地走（一条探测链），连续走过 count * 10 个空组也停，表很空的时候每次调用的开销也有上限。
+     */
+    uint64_t Scan(uint64_t cursor, const ScanFilter& filter, size_t count, vector<string>* keys) {
+        size_t shards = shards_.size();
+        size_t idx = static_cast<size_t>(cursor % shards);
+        uint64_t v = cursor / shards;
+        string prefix = GlobPrefix(filter.pattern);
+        bool literal = !filter.pattern.empty() && prefix.size() == filter.pattern.size(); // 没有通配符
+        if (count == 0) count = 1;
+        size_t emptyLeft = count * 10;
+        int64_t now = MsTime();
+        while (idx < shards && count > 0 && emptyLeft > 0) {
+            Shard& shard = *shards_[idx];
+            {
+                lock_guard<mutex> lock(shard.mtx);
+                do {
+                    size_t seen = 0;
+                    v = shard.index.Scan(v, [&](IndexNode* node) {
+                        seen++;
+                        const string& key = node->key;
+                        RedisObject* obj = node->value;
+                        if (IsExpired(obj, now)) return;
+                        if (filter.type >= 0 && obj->type != filter.type) return;
+                        if (!filter.pattern.empty()) {
+                            if (!Slice(key).starts_with(prefix)) return;
+                            if (literal ? Slice(key) != filter.pattern : !StringMatch(filter.pattern, key)) return;
+                        }
+                        keys->push_back(key);
+                    });
+                    if (seen == 0) emptyLeft--;
+                    count = count > seen ? count - seen : 0;
+                } while (v != 0 && count > 0 && emptyLeft > 0);
+            }
+            if (v != 0) break;
+            idx++; // 这个分片走完了，下一个分片从组游标 0 开始
+        }
+        return idx < shards ? v * shards + idx : 0;
+    }
+
+    /**
+     * RANGE：按 key 的顺序返回落在 [start, end] 里的前 limit 个 key。
+     * startEx / endEx 表示开区间，end 为 nullptr 表示没有上界（start 为空串、不是开区间就是从最小的开始）。
+     * key 按哈希分在各个分片里，每个分片各自有序：每个分片 O(logN) 定位到 start，最多取 limit 个，再和前面分片的结果归并。
+     * 已经凑够 limit 个以后，后面的分片碰到比第 limit 个还大的 key 就停，一次调用最多看 分片数 × limit 个 key。
+     * 翻页：下一次用 "(" + 这次最后一个 key 当 start。
+     */
+    void Range(const Slice& start, bool startEx, const Slice* end, bool endEx, size_t limit, vector<string>* keys) {
+        keys->clear();
+        if (limit == 0) return;
+        int64_t now = MsTime();
+        vector<string> part, merged;
+        for (Shard* shard : shards_) {
+            part.clear();
+            {
+                lock_guard<mutex> lock(shard->mtx);
+                shard->data.scan(start, startEx, [&](const string& key, RedisObject* obj) {
+                    if (end) {
+                        int c = Slice(key).compare(*end);
+                        if (c > 0 || (c == 0 && endEx)) return false;
+                    }
+                    if (keys->size() == limit && !(Slice(key) < Slice(keys->back()))) return false;
+                    if (IsExpired(obj, now)) return true;
+                    part.push_back(key);
+                    return part.size() < limit;
+                });
+            }
+            merged.clear();
+            merged.reserve(keys->size() + part.size());
+            std::merge(make_move_iterator(keys->begin()), make_move_iterator(keys->end()),
+                       make_move_iterator(part.begin()), make_move_iterator(part.end()), back_inserter(merged));
+            if (merged.size() > limit) merged.resize(limit);
+            keys->swap(merged);
+        }
+    }
+
+    int ShardCount() const { return static_cast<int>(shards_.size()); }
+
+    /**
+     * maxmemory：每个分片各管 bytes / 分片数（key 按哈希均匀分到各分片），淘汰只在本分片里做，不用跨分片拿锁。
+     * 启动加载完以后再设，加载过程中不淘汰。
+     */
+    void SetMaxmemory(size_t bytes, MaxmemoryPolicy policy, int samples) {
+        maxmemory_ = bytes;
+        policy_ = policy;
+        samples_ = samples < 1 ? 1 : (samples > MAX_SAMPLES ? MAX_SAMPLES : samples);
+    }
+
+    /**
+     * 会占用更多内存的写命令执行之前调用（h 是它第一个 key 的哈希）：这个分片超过了自己那一份 maxmemory，
+     * 就按策略抽样淘汰，直到降下来。一次最多淘汰 MAX_EVICT_PER_CALL 个，开销有上限，没淘汰完的留给下一个写命令。
+     * 返回 false 表示腾不出地方（noeviction，或者没有能淘汰的 key），这个写命令应该回 OOM 错误。
+     */
+    bool MakeRoom(uint64_t h) {
+        if (maxmemory_ == 0) return true;
+        Shard& shard = ShardFor(h);
+        size_t limit = maxmemory_ / shards_.size();
+        lock_guard<mutex> lock(shard.mtx);
+        for (int i = 0; ShardMemory(shard) > limit; ++i) {
+            if (policy_ == MAXMEMORY_NOEVICTION) return false;
+            if (i == MAX_EVICT_PER_CALL) return true;
+            IndexNode* victim = PickVictim(shard);
+            if (!victim) return false;
+            DeleteNode(shard, victim, HashKey(victim->key));
+            evicted_.fetch_add(1, memory_order_relaxed);
+        }
+        return true;
+    }
+
+    // 所有分片的估算内存（key、值、哈希索引）加起来
+    size_t UsedMemory() {
+        size_t total = 0;
+        for (Shard* shard : shards_) {
+            lock_guard<mutex> lock(shard->mtx);
+            total += ShardMemory(*shard);
+        }
+        return total;
+    }
+
+    // key 总数和其中带过期时间的个数（INFO keyspace 用，已经过期还没删的也算）
+    void KeyCount(uint64_t* keys, uint64_t* expires) {
+        *keys = *expires = 0;
+        for (Shard* shard : shards_) {
+            lock_guard<mutex> lock(shard->mtx);
+            *keys += shard->index.Size();
+            *expires += shard->expires.Size();
+        }
+    }
+
+    uint64_t EvictedKeys() const { return evicted_.load(memory_order_relaxed); }
+
+    // 启动以来一共改了多少次（save 策略用：和上次保存时的值比）
+    uint64_t Dirty() const { return dirty_.load(memory_order_relaxed); }
+    void ResetDirty() { dirty_ = 0; }
+
+    // 加载一个快照文件（AOF 的 base 也是这个格式），文件坏了直接退出进程。
+    // keepExpired：后面还要接着重放命令（AOF 的 incr、主库的命令流），已经过期的也留着，
+    // 不然后面一条 PERSIST 就落空了；过期的由流里的 DEL 或者之后的主动过期删
+    void LoadSnapshot(const string& path, bool keepExpired = false) { LoadFromFile(path, keepExpired); }
+
+    // 当前线程在重放 AOF / 主库的命令流：查找时不做惰性过期（和 Redis 加载时一样）。
+    // 流里的命令当时是在 key 还没过期时执行的，重放时过没过期由流里后面的 DEL 说了算
+    static bool& Replaying() {
+        static thread_local bool replaying = false;
+        return replaying;
+    }
+
+    // 清空所有 key（从库全量同步前），不记 AOF / 复制流
+    void Clear() {
+        for (Shard* shard : shards_) {
+            lock_guard<mutex> lock(shard->mtx);
+            vector<string> keys;
+            shard->data.traverse([&](const string& key, RedisObject*) { keys.push_back(key); });
+            for (const string& key : keys) {
+                uint64_t h = HashKey(key);
+                IndexNode* node = shard->index.Find(key, h);
+                if (node) DeleteNode(*shard, node, h, false);
+            }
+        }
+    }
+
+    /**
+     * DUMP / RESTORE / MIGRATE 传的值：类型(1) | 内容 | CRC32C(4)。
+     * 内容和快照记录一样：字符串是 len | val，列表是 count | (len | item) * count（len / count 都是 varint）。
+     * 过期时间不在里面，RESTORE 单独带。
+     */
+    static void DumpObject(const RedisObject* obj, string* out) {
+        out->clear();
+        if (obj->type == OBJ_STRING) {
+            char buf[21];
+            out->push_back(static_cast<char>(snapshot::REC_STRING));
+            snapshot::PutLengthPrefixed(*out, ObjectSlice(obj, buf));
+        } else {
+            const QuickList& list = *static_cast<const QuickList*>(obj->ptr);
+            out->push_back(static_cast<char>(snapshot::REC_LIST));
+            snapshot::PutVarint(*out, list.Size());
+            for (const Slice& item : list) snapshot::PutLengthPrefixed(*out, item);
+        }
+        snapshot::PutFixed32(*out, crc32c::Value(out->data(), out->size()));
+    }
+
+    // 解 DumpObject 的结果，格式不对 / 校验和对不上返回 nullptr
+    RedisObject* RestoreObject(const Slice& payload, int64_t expire) const {
+        if (payload.size() < 5) return nullptr;
+        const char* p = payload.data();
+        const char* limit = p + payload.size() - 4;
+        if (snapshot::DecodeFixed32(limit) != crc32c::Value(p, limit - p)) return nullptr;
+        uint8_t type = static_cast<uint8_t>(*p++);
+        if (type == snapshot::REC_STRING) {
+            Slice val;
+            p = snapshot::GetLengthPrefixed(p, limit, &val);
+            if (!p || p != limit) return nullptr;
+            return CreateStringObject(val.data(), val.size(), expire, SharedIntegersAllowed());
+        }
+        if (type != snapshot::REC_LIST) return nullptr;
+        uint64_t count;
+        p = snapshot::GetVarint(p, limit, &count);
+        if (!p || count == 0) return nullptr;
+        QuickList* list = new QuickList();
+        for (uint64_t i = 0; i < count && p; ++i) {
+            Slice item;
+            p = snapshot::GetLengthPrefixed(p, limit, &item);
+            if (p) list->PushBack(item);
+        }
+        if (!p || p != limit) {
+            delete list;
+            return nullptr;
+        }
+        return CreateListObject(list, expire);
+    }
+
+    // DUMP：1 找到了（序列化好的值在 out），0 不存在
+    int Dump(const Slice& key, uint64_t h, string* out) {
+        Shard& shard = ShardFor(h);
+        lock_guard<mutex> lock(shard.mtx);
+        RedisObject* obj = Lookup(shard, key, h);
+        if (!obj) return 0;
+        DumpObject(obj, out);
+        return 1;
+    }
+
+    /**
+     * RESTORE：obj 是 RestoreObject 解出来的，交给这里（没用上就释放）。
+     * 0 key 已经存在、没给 replace；1 写进去了（过期时间已经过了的话不写，replace 时把原来的删掉）。
+     * 记成 RESTORE key 绝对过期时间 payload REPLACE ABSTTL，重放的结果和这里一样
+     */
+    int Restore(const Slice& key, uint64_t h, RedisObject* obj, const Slice& payload, bool replace) {
+        Shard& shard = ShardFor(h);
+        lock_guard<mutex> lock(shard.mtx);
+        IndexNode* node = LookupNode(shard, key, h);
+        if (node && !replace) {
+            FreeObject(obj);
+            return 0;
+        }
+        int64_t expire = GetExpire(obj);
+        if (expire && expire <= MsTime()) {
+            if (node) DeleteNode(shard, node, h);
+            FreeObject(obj);
+            return 1;
+        }
+        SetObjectLocked(shard, key, h, obj, false);
+        if (feed_) {
+            string ms = to_string(expire);
+            Slice argv[6] = {Slice("RESTORE"), key, Slice(ms), payload, Slice("REPLACE"), Slice("ABSTTL")};
+            feed_(shard.id, argv, 6);
+        }
+        return 1;
+    }
+
+    /**
+     * MIGRATE：keys 里现在存在的 key 序列化好，交给 transfer(names, payloads, ttls, replace) 发给目标节点
+     * （ttls 是剩余毫秒数，0 不过期；payload 是空串表示这个 key 在源节点上已经没了，让目标也删掉）。
+     * transfer 返回 false 就返回 -1，否则返回迁了几个（0 就是一个都不存在）；copy 发完就结束，不删。
+     *
+     * 分片锁只在序列化和检查的时候拿（按编号从小到大，和 MSET 一样），发送期间不拿，这几个分片上别的命令照常执行。
+     * 发完再锁上，发送期间没被改过的 key 才删掉（记成 DEL）；改过的重新序列化、用 REPLACE 再发一轮（目标上已经有一份旧的了），
+     * 被删掉的让目标也删掉。连着 MIGRATE_UNLOCKED_ROUNDS 轮都有 key 在被改，最后一轮拿着锁发，保证能结束。
+     */
+    template <typename F>
+    long long MigrateKeys(const Slice* keys, size_t n, bool copy, bool replace, F transfer) {
+        KeyBatch b;
+        GroupByShard(keys, n, &b);
+        vector<uint32_t> pending; // 这一轮要发的 key 的下标
+        vector<string> payloads;
+        vector<int64_t> expires;  // 序列化时的过期时间（绝对毫秒），检查有没有被改过要用
+        LockShards(b);
+        {
+            unordered_set<IndexNode*> seen; // 同一个 key 写了两遍只发一次，不然第二条 RESTORE 会 BUSYKEY
+            for (size_t j = 0; j < n; ++j) {
+                uint32_t i = b.order[j];
+                IndexNode* node = LookupNode(*shards_[ShardIndex(b.hashes[i])], keys[i], b.hashes[i]);
+                if (!node || !seen.insert(node).second) continue;
+                pending.push_back(i);
+                payloads.emplace_back();
+                DumpObject(node->value, &payloads.back());
+                expires.push_back(GetExpire(node->value));
+            }
+        }
+        UnlockShards(b);
+        long long result = static_cast<long long>(pending.size());
+        bool locked = false;
+        vector<Slice> names;
+        vector<int64_t> ttls;
+        vector<uint32_t> next;
+        vector<string> nextPayloads;
+        vector<int64_t> nextExpires;
+        for (int round = 0; !pending.empty(); ++round) {
+            names.clear();
+            ttls.clear();
+            int64_t now = MsTime();
+            for (size_t k = 0; k < pending.size(); ++k) {
+                names.push_back(keys[pending[k]]);
+                ttls.push_back(expires[k] ? max<int64_t>(expires[k] - now, 1) : 0);
+            }
+            if (!transfer(names, payloads, ttls, replace || round > 0)) {
+                if (locked) UnlockShards(b);
+                return -1;
+            }
+            if (copy) break;
+            if (!locked) LockShards(b);
+            next.clear();
+            nextPayloads.clear();
+            nextExpires.clear();
+            for (size_t k = 0; k < pending.size(); ++k) {
+                uint32_t i = pending[k];
+                Shard& shard = *shards_[ShardIndex(b.hashes[i])];
+                IndexNode* node = LookupNode(shard, keys[i], b.hashes[i]);
+                if (!node) {
+                    if (payloads[k].empty()) continue; // 发的就是删除
+                    next.push_back(i);
+                    nextPayloads.emplace_back();
+                    nextExpires.push_back(0);
+                    continue;
+                }
+                string cur;
+                DumpObject(node->value, &cur);
+                int64_t expire = GetExpire(node->value);
+                if (cur == payloads[k] && expire == expires[k]) {
+                    DeleteNode(shard, node, b.hashes[i]);
+                    continue;
+                }
+                next.push_back(i);
+                nextPayloads.push_back(std::move(cur));
+                nextExpires.push_back(expire);
+            }
+            locked = !next.empty() && round + 1 >= MIGRATE_UNLOCKED_ROUNDS;
+            if (!locked) UnlockShards(b);
+            pending.swap(next);
+            payloads.swap(nextPayloads);
+            expires.swap(nextExpires);
+        }
+        return result;
+    }
+
+    // 按分片依次看所有没过期的 key（一次只锁一个分片），f(key) 返回 false 就停。O(N)，只给 CLUSTER 的管理命令用
+    template <typename F>
+    void ForEachKey(F f) {
+        int64_t now = MsTime();
+        bool more = true;
+        for (Shard* shard : shards_) {
+            lock_guard<mutex> lock(shard->mtx);
+            shard->data.scan(Slice(), false, [&](const string& key, RedisObject* obj) {
+                if (IsExpired(obj, now)) return true;
+                more = f(key);
+                return more;
+            });
+            if (!more) break;
+        }
+    }
+
+    // 启动加载完以后再设，加载过程中的写不用再记一遍
+    void SetFeed(FeedFn feed) { feed_ = feed; }
+
+    /**
+     * 把所有分片写成快照文件（tmp + rename），不打日志，records 返回写了多少条。
+     * 前台 SAVE、BGSAVE 的子进程、AOF 重写的子进程（写 base 文件）都走这里。
+     */
+    bool WriteSnapshot(uint64_t* records) { return WriteSnapshot(filename_, records); }
+    bool WriteSnapshot(const string& path, uint64_t* records) {
+        SnapshotWriter writer(path);
+        if (!writer.Open()) return false;
+        bool ok = true;
+        int64_t now = MsTime();
         auto save_func = [&](const string& key, RedisObject* val) {
+            if (!ok || IsExpired(val, now)) return; // 已经过期、还没来得及删的不写
             if (val->type == OBJ_STRING) {
-                outfile << "0 " << key << " " << *(string*)val->ptr << "\n";
+                char buf[21];
+                ok = writer.AddString(key, ObjectSlice(val, buf), GetExpire(val));
             } else if (val->type == OBJ_LIST) {
+                ok = writer.AddList(key, *static_cast<QuickList*>(val->ptr), GetExpire(val));
+            }
+        };
+        for (Shard* shard : shards_) {
+            lock_guard<mutex> lock(shard->mtx);
+            shard->data.traverse(save_func);
+        }
+        if (!ok || !writer.Finish()) return false;
+        if (records) *records = writer.Records();
+        return true;
+    }
+
+    /**
+     * fork 一个子进程（BGSAVE 用）。fork 时拿着所有分片锁：
+     * 子进程里只剩调用 fork 的这一个线程，要是别的线程正拿着某个分片锁、跳表改到一半，
+     * 子进程看到的就是一个半截的结构，锁也永远解不开。拿全锁保证子进程拿到的是一个一致的内存镜像，
+     * 之后父子各自把锁放掉（子进程里锁的主人就是自己这个线程）。
+     * 拿锁期间所有写都会等着，这段时间就是 fork 本身的耗时（主要是复制页表）。
+     * atCut 在拿着全锁、fork 之前调用，这一刻之前和之后的写操作正好一刀切开（AOF 重写在这里换 incr 文件），
+     * 返回 false 就不 fork 了，返回 -1。
+     */
+    template <typename F>
+    pid_t ForkLocked(F atCut) {
+        for (Shard* shard : shards_) shard->mtx.lock();
+        pid_t pid = atCut() ? fork() : -1;
+        for (Shard* shard : shards_) shard->mtx.unlock();
+        return pid;
+    }
+
+private:
+    typedef KeyIndex::Node IndexNode;
+
+    // data 是有序的跳表（遍历、快照用），index 是 key -> 跳表节点的哈希索引（点查用）。
+    // expires 只放带过期时间的 key（主动过期从这里抽样，不用在所有 key 里大海捞针）。
+    // 三者的增删都在 mtx 保护下一起做；并发模式下 GET 直接读无锁跳表，不碰 index
+    // used 是这个分片里 key 和值的估算内存（不含两张哈希索引，那个现算），也在 mtx 下改
+    struct Shard {
+        KeyIndex data;
+        HashIndex<IndexNode> index;
+        HashIndex<IndexNode> expires;
+        mutex mtx;
+        atomic<size_t> used;
+        int id; // 第几个分片（FeedFn 要）
+        uint64_t expireCursor; // 主动过期走到 expires 的哪一组了
+        explicit Shard(int i) : used(0), id(i), expireCursor(0) {}
+    };
+
+    static const int MIGRATE_UNLOCKED_ROUNDS = 3; // MIGRATE 不拿锁发送最多几轮，之后拿着锁发
+    static const int MAX_EVICT_PER_CALL = 32; // 一个写命令最多替别人淘汰多少个 key
+    static const int MAX_SAMPLES = 64;        // maxmemory-samples 的上限
+
+    vector<Shard*> shards_;
+    string filename_;
+    atomic<uint64_t> dirty_; // 写操作计数，见 Dirty()
+    FeedFn feed_;            // AOF / 复制，都没开是 nullptr
+    size_t maxmemory_;       // 0 不限制
+    MaxmemoryPolicy policy_;
+    int samples_;
+    atomic<uint64_t> evicted_; // 一共淘汰了多少个 key
+
+    // 被替换掉的对象：普通模式直接删；无锁模式下可能还有读者拿着，交给 EBR 延迟释放
+    static void FreeObject(RedisObject* obj) {
+        if (obj->flags & OBJ_FLAG_SHARED) return;
+#ifdef KV_CONCURRENT_SKIPLIST
+        EpochManager::Instance().Retire(obj, &DeleteObject);
+#else
+        DestroyObject(obj);
+#endif
+    }
+
+    // 只释放对象头（值已经挂到新的对象头上了），无锁模式下同样要等读者走完
+    static void FreeShell(RedisObject* obj) {
+        if (obj->flags & OBJ_FLAG_SHARED) return;
+#ifdef KV_CONCURRENT_SKIPLIST
+        EpochManager::Instance().Retire(obj, &DeleteShell);
+#else
+        FreeObjectShell(obj);
+#endif
+    }
+
+    static void DeleteObject(void* p) { DestroyObject(static_cast<RedisObject*>(p)); }
+    static void DeleteShell(void* p) { FreeObjectShell(static_cast<RedisObject*>(p)); }
+
+    // 一个 key 本身大概占多少：跳表节点（p=1/2 升层，平均 2 层，比节点里自带的 1 个多 1 个指针）+ key 超出短字符串优化的部分 + 哈希索引的那一格另算
+    static size_t KeyBytes(size_t len) {
+        return sizeof(IndexNode) + sizeof(void*) + (len > 15 ? len + 1 : 0);
+    }
+
+    // 分片现在的内存：key 和值 + 两张哈希索引
+    static size_t ShardMemory(const Shard& shard) {
+        return shard.used.load(memory_order_relaxed) + shard.index.MemoryUsage() + shard.expires.MemoryUsage();
+    }
+
+    // 共享整数对象没有自己的 lru 字段，要按 LRU / LFU 淘汰的时候不用
+    bool SharedIntegersAllowed() const {
+        return policy_ != MAXMEMORY_ALLKEYS_LRU && policy_ != MAXMEMORY_ALLKEYS_LFU;
+    }
+
+    // 读写到一个 key：只有 LRU / LFU 淘汰用得上访问信息，别的策略不去写它（无锁读也就不用写共享的 cache line）
+    void Touch(RedisObject* obj) {
+        if (policy_ == MAXMEMORY_ALLKEYS_LRU || policy_ == MAXMEMORY_ALLKEYS_LFU) {
+            TouchObject(obj, policy_ == MAXMEMORY_ALLKEYS_LFU, NextRandom());
+        }
+    }
+
+    /**
+     * 抽样选一个要淘汰的 key：从 index（allkeys-*）或 expires（volatile-ttl）里随机抽 samples_ 个，
+     * 挑最久没访问 / 访问最少 / 最快过期的那个。和 Redis 一样是近似的，抽得越多越接近精确的 LRU / LFU。
+     */
+    IndexNode* PickVictim(Shard& shard) {
+        HashIndex<IndexNode>& from = policy_ == MAXMEMORY_VOLATILE_TTL ? shard.expires : shard.index;
+        IndexNode* cand[MAX_SAMPLES];
+        size_t n = from.Sample(NextRandom(), cand, samples_);
+        IndexNode* best = nullptr;
+        uint64_t bestScore = 0; // 越大越该淘汰
+        for (size_t i = 0; i < n; ++i) {
+            RedisObject* obj = cand[i]->value;
+            uint64_t score;
+            if (policy_ == MAXMEMORY_ALLKEYS_LRU) score = ObjectIdleTime(obj);
+            else if (policy_ == MAXMEMORY_ALLKEYS_LFU) score = 255 - LfuDecrAndReturn(obj);
+            else score = UINT64_MAX - static_cast<uint64_t>(GetExpire(obj));
+            if (!best || score > bestScore) {
+                best = cand[i];
+                bestScore = score;
+            }
+        }
+        return best;
+    }
+
+    // 按 LRANGE / LTRIM 的规则把 [start, stop] 换成 [from, from + n)，空区间 n = 0
+    static void ListRange(size_t size, long long start, long long stop, size_t* from, size_t* n) {
+        long long len = static_cast<long long>(size);
+        if (start < 0) start += len;
+        if (stop < 0) stop += len;
+        if (start < 0) start = 0;
+        if (stop >= len) stop = len - 1;
+        if (start > stop) {
+            *from = 0;
+            *n = 0;
+            return;
+        }
+        *from = static_cast<size_t>(start);
+        *n = static_cast<size_t>(stop - start + 1);
+    }
+
+    // 主动过期抽样用的随机数（xorshift），每个线程一份
+    static uint64_t NextRandom() {
+        static thread_local uint64_t x = 0x9e3779b97f4a7c15ull ^ reinterpret_cast<uintptr_t>(&x);
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        return x;
+    }
+
+    // 按 key 的哈希路由到分片：用高 32 位，低位留给哈希索引自己用
+    size_t ShardIndex(uint64_t h) const { return (h >> 32) % shards_.size(); }
+    Shard& ShardFor(uint64_t h) { return *shards_[ShardIndex(h)]; }
+
+    // 多 key 命令按分片分好的组：第 s 个分片的 key 是 order[start[s] .. start[s+1])，组内保持原来的先后
+    struct KeyBatch {
+        vector<uint64_t> hashes; // 每个 key 的哈希
+        vector<uint32_t> order;  // key 的下标，按分片排好
+        vector<uint32_t> start;  // 分片数 + 1 个
+    };
+
+    // 计数排序：一遍数、一遍放，稳定
+    void GroupByShard(const Slice* keys, size_t n, KeyBatch* b) const {
+        size_t shards = shards_.size();
+        b->hashes.resize(n);
+        b->order.resize(n);
+        b->start.assign(shards + 1, 0);
+        for (size_t i = 0; i < n; ++i) {
+            b->hashes[i] = HashKey(keys[i]);
+            b->start[ShardIndex(b->hashes[i]) + 1]++;
+        }
+        for (size_t s = 0; s < shards; ++s) b->start[s + 1] += b->start[s];
+        vector<uint32_t> pos(b->start.begin(), b->start.end() - 1);
+        for (size_t i = 0; i < n; ++i) b->order[pos[ShardIndex(b->hashes[i])]++] = static_cast<uint32_t>(i);
+    }
+
+    // 把 b 涉及的分片按编号从小到大锁上 / 放开（和 ForkLocked、MSET 一个顺序，不会死锁）
+    void LockShards(const KeyBatch& b) {
+        for (size_t si = 0; si < shards_.size(); ++si) {
+            if (b.start[si + 1] > b.start[si]) shards_[si]->mtx.lock();
+        }
+    }
+
+    void UnlockShards(const KeyBatch& b) {
+        for (size_t si = 0; si < shards_.size(); ++si) {
+            if (b.start[si + 1] > b.start[si]) shards_[si]->mtx.unlock();
+        }
+    }
+
+    // SET 只做一次哈希查找：key 已存在就原地把 value 换掉，不存在才去跳表里插新节点
+    void SetObject(const Slice& key, uint64_t h, RedisObject* new_obj) {
+        Shard& shard = ShardFor(h);
+        lock_guard<mutex> lock(shard.mtx);
+        SetObjectLocked(shard, key, h, new_obj);
+    }
+
+    // 调用方拿着分片锁。feed = false：调用方自己记（RESTORE 记的是 RESTORE 不是 SET）
+    void SetObjectLocked(Shard& shard, const Slice& key, uint64_t h, RedisObject* new_obj, bool feed = true) {
+        int64_t expire = GetExpire(new_obj);
+        InitObjectLru(new_obj, policy_ == MAXMEMORY_ALLKEYS_LFU);
+        IndexNode* node = shard.index.Find(key, h);
+        if (node) {
+            RedisObject* old_obj = node->value;
+            node->value = new_obj;
+            int64_t old_expire = GetExpire(old_obj);
+            if (old_expire && !expire) shard.expires.Erase(key, h);
+            else if (!old_expire && expire) shard.expires.Insert(node, h);
+            shard.used += ObjectBytes(new_obj) - ObjectBytes(old_obj);
+            // 新对象挂上去以后再释放旧的，无锁读者最多读到旧对象
+            FreeObject(old_obj);
+        } else {
+            node = shard.data.insertNode(key.ToString(), new_obj);
+            shard.index.Insert(node, h);
+            if (expire) shard.expires.Insert(node, h);
+            shard.used += KeyBytes(key.size()) + ObjectBytes(new_obj);
+        }
+        dirty_.fetch_add(1, memory_order_relaxed);
+        if (feed) FeedSet(shard, key, new_obj);
+    }
+
+    // 把字符串 key 的当前值记成一条 SET。过期时间记成绝对时间，重放的时候不会因为重启晚了而“续命”
+    void FeedSet(Shard& shard, const Slice& key, const RedisObject* obj) {
+        if (!feed_) return;
+        char buf[21];
+        Slice val = ObjectSlice(obj, buf);
+        int64_t expire = GetExpire(obj);
+        if (expire) {
+            string ms = to_string(expire);
+            Slice argv[5] = {Slice("SET"), key, val, Slice("PXAT"), Slice(ms)};
+            feed_(shard.id, argv, 5);
+        } else {
+            Slice argv[3] = {Slice("SET"), key, val};
+            feed_(shard.id, argv, 3);
+        }
+    }
+
+    // 点查：走哈希索引，调用方已经拿着分片锁。碰到过期的 key 顺手删掉（惰性过期），当作不存在；重放时不管过期
+    IndexNode* LookupNode(Shard& shard, const Slice& key, uint64_t h) {
+        IndexNode* node = shard.index.Find(key, h);
+        if (node && !Replaying() && IsExpired(node->value, MsTime())) {
+            DeleteNode(shard, node, h);
+            return nullptr;
+        }
+        return node;
+    }
+
+    RedisObject* Lookup(Shard& shard, const Slice& key, uint64_t h) {
+        IndexNode* node = LookupNode(shard, key, h);
+        return node ? static_cast<RedisObject*>(node->value) : nullptr;
+    }
+
+    // 删掉一个节点：哈希索引、过期索引、跳表三边一起删，调用方拿着分片锁。
+    // feed = false：调用方已经记了一条重放时同样会删掉这个 key 的命令（比如把列表弹空的 LPOP）
+    void DeleteNode(Shard& shard, IndexNode* node, uint64_t h, bool feed = true) {
+        RedisObject* obj = node->value;
+        Slice key(node->key);
+        shard.index.Erase(key, h);
+        if (GetExpire(obj)) shard.expires.Erase(key, h);
+        shard.used -= KeyBytes(key.size()) + ObjectBytes(obj);
+        if (feed_ && feed) {
+            Slice argv[2] = {Slice("DEL"), key};
+            feed_(shard.id, argv, 2);
+        }
+        shard.data.remove(node->key);
+        FreeObject(obj);
+        dirty_.fetch_add(1, memory_order_relaxed);
+    }
+
+
+    // 退出时的前台保存
+    void SaveToFile() {
+        if (filename_.empty()) return;
+        uint64_t records = 0;
+        if (!WriteSnapshot(&records)) {
+            cerr << "[KVStore] Failed to save snapshot, old file kept." << endl;
+            return;
+        }
+        cout << "[KVStore] Saved " << records << " records to disk." << endl;
+    }
 
-                vector<string>* vec = (vector<string>*)val->ptr;
-                outfile << "1 " << key << " " << vec->size();
-                for (const auto& s : *vec) outfile << " " << s;
-                outfile << "\n";
+    /**
+     * 加载快照：mmap 整个文件，一条条记录直接建到分片里。
+     * 同一个分片的记录在文件里是按 key 排好序的（分片数没变的情况下），
+     * 这时直接挂到跳表末尾（appendNode，不用查找），哈希索引也提前按总记录数扩好容量。
+     * 不是二进制快照的话按老的文本格式读（迁移用，下次保存就变成新格式了）。
+     * 快照损坏时直接退出：不能带着半份数据启动，退出时再保存就把原文件覆盖了。
+     */
+    void LoadFromFile(const string& path, bool keepExpired = false) {
+        SnapshotReader reader;
+        SnapshotReader::OpenResult r = reader.Open(path);
+        if (r == SnapshotReader::OPEN_NOT_FOUND) return;
+        if (r == SnapshotReader::OPEN_NOT_SNAPSHOT) {
+            LoadTextFile(path);
+            return;
+        }
+        if (r == SnapshotReader::OPEN_CORRUPT) {
+            cerr << "[KVStore] Bad snapshot " << path << ": " << reader.Error() << endl;
+            exit(1);
+        }
+
+        for (Shard* shard : shards_) {
+            shard->index.Reserve(reader.Records() / shards_.size() + reader.Records() / 16 + 16);
+        }
+        vector<IndexNode*> last(shards_.size(), nullptr); // 每个分片最后追加的节点
+        uint64_t count = 0;
+        int64_t now = MsTime();
+        SnapshotRecord rec;
+        while (reader.Next(&rec)) {
+            if (!keepExpired && rec.expire != 0 && rec.expire <= now) continue; // 停机期间过期了
+            RedisObject* obj;
+            if (rec.type == snapshot::REC_STRING) {
+                obj = CreateStringObject(rec.value.data(), rec.value.size(), rec.expire, SharedIntegersAllowed());
+            } else {
+                QuickList* list = new QuickList();
+                for (const Slice& item : rec.items) list->PushBack(item);
+                obj = CreateListObject(list, rec.expire);
+            }
+            uint64_t h = HashKey(rec.key);
+            size_t si = (h >> 32) % shards_.size();
+            Shard& shard = *shards_[si];
+            if (!last[si] || Slice(last[si]->key) < rec.key) {
+                // 比这个分片里已有的 key 都大：直接追加（从库全量同步时 Reactor 还在跑，所以也要拿锁）
+                lock_guard<mutex> lock(shard.mtx);
+                InitObjectLru(obj, policy_ == MAXMEMORY_ALLKEYS_LFU);
+                last[si] = shard.data.appendNode(rec.key.ToString(), obj);
+                shard.index.Insert(last[si], h);
+                if (rec.expire) shard.expires.Insert(last[si], h);
+                shard.used += KeyBytes(rec.key.size()) + ObjectBytes(obj);
+            } else {
+                // 乱序（分片数变了）：走普通插入
+                SetObject(rec.key, h, obj);
             }
             count++;
-        };
-        data_.traverse(save_func);
-        outfile.close();
-        cout << "[KVStore] Saved " << count << " records to disk." << endl;
+        }
+        if (!reader.Error().empty()) {
+            cerr << "[KVStore] Bad snapshot " << path << ": " << reader.Error() << endl;
+            exit(1);
+        }
+        cout << "[KVStore] Loaded " << count << " records from disk." << endl;
     }
 
-    void LoadFromFile() {
-        ifstream infile(filename_);
+    // 老的文本格式："type key value"，一行一条
+    void LoadTextFile(const string& path) {
+        ifstream infile(path);
         if (!infile.is_open()) return;
         int count = 0;
         int type;
@@ -141,17 +1286,17 @@ private:
                 int size;
                 infile >> size;
                 string val;
-                // 先建个空的占位
-                // 更好的办法是直接调 LPush，虽然效率低点(每次都search)但代码复用高
+                // 文件里是从头到尾的顺序，逐个 RPUSH 回去
                 for (int i = 0; i < size; ++i) {
                     infile >> val;
-                    LPush(key, val);
+                    Slice v(val);
+                    Push(key, HashKey(key), false, &v, 1);
                 }
             }
             count++;
         }
         infile.close();
-        cout << "[KVStore] Loaded " << count << " records from disk." << endl;
+        cout << "[KVStore] Loaded " << count << " records from old text file." << endl;
     }
 };
 
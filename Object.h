@@ -0,0 +1,354 @@
+/**
+ * Object.h
+ * 存储层的值对象 RedisObject：分配 / 释放、编码、过期时间、LRU / LFU 访问信息、内存估算。
+ *
+ * 对象头固定 16 字节：
+ *   type | flags | encoding | len | lru(32) | ptr
+ * 带过期时间的 key 在同一块内存里、对象头前面多 8 字节放过期时间（unix 毫秒），
+ * 不带的一个字节都不多占；flags 里的 OBJ_FLAG_EXPIRE 表示有这 8 字节。
+ *
+ *   [expire(8)] [type flags encoding len lru] [ptr 或者 EMBSTR 的内容 ...]
+ *               ^ RedisObject* 指向这里
+ *
+ * 字符串有三种编码（和 Redis 一样）：
+ *   - INT：能原样转回去的整数，值直接放在 ptr 这 8 字节里，没有额外分配；
+ *     0 ~ OBJ_SHARED_INTEGERS-1 还有一份全局共享的对象，key 直接指过去，连对象头都不用分配；
+ *   - EMBSTR：不超过 OBJ_EMBSTR_MAX 字节的短字符串，内容从 ptr 的位置开始、和对象头在同一次分配里；
+ *   - RAW：ptr 指向一个 std::string（大 value，协议层读进来的 string 直接 move 进来，不再拷贝）。
+ * 列表只有一种编码 QUICKLIST：ptr 指向一个 QuickList（QuickList.h）。
+ *
+ * 所以对象只能用 CreateXxxObject / DestroyObject 分配和释放，不能直接 new / delete。
+ */
+
+#ifndef OBJECT_H
+#define OBJECT_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <chrono>
+#include <time.h> // clock_gettime
+#include <new>
+#include <string>
+#include <vector>
+#include <cstddef> // offsetof
+#include "Slice.h"
+#include "QuickList.h"
+
+using namespace std;
+
+enum ObjType {
+    OBJ_STRING = 0,
+    OBJ_LIST   = 1
+};
+
+enum ObjEncoding {
+    OBJ_ENCODING_RAW    = 0, // ptr 指向堆上的 std::string
+    OBJ_ENCODING_EMBSTR = 1, // 短字符串，内容从 ptr 的位置开始，长度在 len 里
+    OBJ_ENCODING_INT    = 2, // 整数，直接存在 ptr 里
+    OBJ_ENCODING_QUICKLIST = 3 // 列表，ptr 指向 QuickList
+};
+
+enum ObjFlag {
+    OBJ_FLAG_EXPIRE = 1 << 0, // 对象头前面有 8 字节过期时间
+    OBJ_FLAG_SHARED = 1 << 1  // 全局共享的小整数，不释放，也不记访问信息
+};
+
+const size_t OBJ_EMBSTR_MAX = 48;          // 对象头 8 字节 + 48 字节内容正好是 glibc 64 字节的块
+const int64_t OBJ_SHARED_INTEGERS = 10000; // 共享 [0, 10000) 的整数对象
+
+struct RedisObject {
+    uint8_t type;      // ObjType
+    uint8_t flags;     // ObjFlag 的组合
+    uint8_t encoding;  // ObjEncoding
+    uint8_t len;       // EMBSTR 的长度
+    // allkeys-lfu 时是 16 位“上次衰减的分钟数” + 8 位对数计数器（和 Redis 一样），
+    // 其它情况是最近一次访问的时间（LruClock，毫秒）。单独一个 32 位字，无锁读者更新它不会碰到别的字段
+    uint32_t lru;
+    void* ptr;
+};
+static_assert(sizeof(RedisObject) == 16, "RedisObject should stay 16 bytes");
+
+// 当前时间（unix 毫秒），过期时间都和它比
+inline int64_t MsTime() {
+    return chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// ======================= 分配 / 释放 =======================
+
+// EMBSTR 的内容（紧跟在 lru 后面，占掉 ptr 的位置，可以更长）
+inline char* EmbstrData(RedisObject* o) { return reinterpret_cast<char*>(o) + offsetof(RedisObject, ptr); }
+inline const char* EmbstrData(const RedisObject* o) {
+    return reinterpret_cast<const char*>(o) + offsetof(RedisObject, ptr);
+}
+
+// 对象头 + 内容一共分配多少（不含过期时间那 8 字节）
+inline size_t EmbstrAllocSize(size_t len) {
+    size_t n = offsetof(RedisObject, ptr) + len;
+    return n < sizeof(RedisObject) ? sizeof(RedisObject) : n;
+}
+
+// 分配一个对象：expire 不为 0 就在前面多分配 8 字节放过期时间；body 是对象头 + 内容的大小
+inline RedisObject* AllocObject(ObjType type, ObjEncoding encoding, size_t body, int64_t expire) {
+    size_t prefix = expire ? sizeof(int64_t) : 0;
+    char* mem = static_cast<char*>(malloc(prefix + body));
+    if (!mem) throw bad_alloc();
+    if (prefix) *reinterpret_cast<int64_t*>(mem) = expire;
+    RedisObject* o = reinterpret_cast<RedisObject*>(mem + prefix);
+    o->type = static_cast<uint8_t>(type);
+    o->flags = prefix ? OBJ_FLAG_EXPIRE : 0;
+    o->encoding = static_cast<uint8_t>(encoding);
+    o->len = 0;
+    o->lru = 0;
+    o->ptr = nullptr;
+    return o;
+}
+
+// ptr 指向堆上容器的对象（RAW 字符串）；之后想加过期时间又没有那 8 字节的，得换一个对象头（见 KVStore::Expire）
+inline RedisObject* CreateObject(ObjType type, void* ptr, int64_t expire = 0) {
+    RedisObject* o = AllocObject(type, OBJ_ENCODING_RAW, sizeof(RedisObject), expire);
+    o->ptr = ptr;
+    return o;
+}
+
+inline RedisObject* CreateListObject(QuickList* list, int64_t expire = 0) {
+    RedisObject* o = AllocObject(OBJ_LIST, OBJ_ENCODING_QUICKLIST, sizeof(RedisObject), expire);
+    o->ptr = list;
+    return o;
+}
+
+// 0 ~ OBJ_SHARED_INTEGERS-1 的共享对象，第一次用的时候建好，进程退出前一直在
+inline RedisObject* SharedInteger(int64_t v) {
+    struct Pool {
+        RedisObject objs[OBJ_SHARED_INTEGERS];
+        Pool() {
+            for (int64_t i = 0; i < OBJ_SHARED_INTEGERS; ++i) {
+                RedisObject& o = objs[i];
+                o.type = OBJ_STRING;
+                o.flags = OBJ_FLAG_SHARED;
+                o.encoding = OBJ_ENCODING_INT;
+                o.len = 0;
+                o.lru = 0;
+                o.ptr = reinterpret_cast<void*>(static_cast<intptr_t>(i));
+            }
+        }
+    };
+    static Pool pool;
+    return &pool.objs[v];
+}
+
+// 整数对象：shared 表示可以用共享对象（带过期时间、或者要记 LRU / LFU 的时候不行，那两样是每个 key 自己的）
+inline RedisObject* CreateIntObject(int64_t v, int64_t expire, bool shared) {
+    if (shared && !expire && v >= 0 && v < OBJ_SHARED_INTEGERS) return SharedInteger(v);
+    RedisObject* o = AllocObject(OBJ_STRING, OBJ_ENCODING_INT, sizeof(RedisObject), expire);
+    o->ptr = reinterpret_cast<void*>(static_cast<intptr_t>(v));
+    return o;
+}
+
+inline RedisObject* CreateEmbstrObject(const char* p, size_t len, int64_t expire) {
+    RedisObject* o = AllocObject(OBJ_STRING, OBJ_ENCODING_EMBSTR, EmbstrAllocSize(len), expire);
+    o->len = static_cast<uint8_t>(len);
+    memcpy(EmbstrData(o), p, len);
+    return o;
+}
+
+// 十进制整数，而且必须是规范写法（没有多余的 0、没有正号、没有 "-0"），这样转回字符串和原来一模一样。
+// 溢出也算失败
+inline bool StringToInt64(const char* p, size_t len, int64_t* v) {
+    if (len == 0 || len > 20) return false;
+    const char* end = p + len;
+    bool neg = false;
+    if (*p == '-') {
+        neg = true;
+        if (++p == end) return false;
+    }
+    if (*p == '0') {
+        if (p + 1 != end || neg) return false;
+        *v = 0;
+        return true;
+    }
+    uint64_t r = 0;
+    for (; p < end; ++p) {
+        if (*p < '0' || *p > '9') return false;
+        uint64_t d = static_cast<uint64_t>(*p - '0');
+        if (r > (UINT64_MAX - d) / 10) return false;
+        r = r * 10 + d;
+    }
+    if (neg) {
+        if (r > static_cast<uint64_t>(INT64_MAX) + 1) return false;
+        *v = static_cast<int64_t>(0 - r);
+    } else {
+        if (r > static_cast<uint64_t>(INT64_MAX)) return false;
+        *v = static_cast<int64_t>(r);
+    }
+    return true;
+}
+
+// 整数转十进制，buf 至少 21 字节，返回长度
+inline size_t Int64ToChars(int64_t v, char* buf) {
+    char tmp[21];
+    uint64_t u = v < 0 ? 0 - static_cast<uint64_t>(v) : static_cast<uint64_t>(v);
+    size_t n = 0;
+    do {
+        tmp[n++] = static_cast<char>('0' + u % 10);
+        u /= 10;
+    } while (u);
+    size_t len = 0;
+    if (v < 0) buf[len++] = '-';
+    while (n) buf[len++] = tmp[--n];
+    return len;
+}
+
+// 字符串对象：整数用 INT（小的用共享对象），短的用 EMBSTR，长的才单独分配一个 string
+inline RedisObject* CreateStringObject(const char* p, size_t len, int64_t expire, bool shared) {
+    int64_t v;
+    if (StringToInt64(p, len, &v)) return CreateIntObject(v, expire, shared);
+    if (len <= OBJ_EMBSTR_MAX) return CreateEmbstrObject(p, len, expire);
+    return CreateObject(OBJ_STRING, new string(p, len), expire);
+}
+
+// 大 value 已经在一个 string 里了：够长的直接 move 进来
+inline RedisObject* CreateStringObject(string&& s, int64_t expire, bool shared) {
+    if (s.size() <= OBJ_EMBSTR_MAX) return CreateStringObject(s.data(), s.size(), expire, shared);
+    return CreateObject(OBJ_STRING, new string(std::move(s)), expire);
+}
+
+// INT 编码的值。INCR 会原地改，无锁读者同时在读，所以用原子操作
+inline int64_t ObjectIntValue(const RedisObject* o) {
+    return static_cast<int64_t>(reinterpret_cast<intptr_t>(__atomic_load_n(&o->ptr, __ATOMIC_RELAXED)));
+}
+
+inline void SetObjectIntValue(RedisObject* o, int64_t v) {
+    __atomic_store_n(&o->ptr, reinterpret_cast<void*>(static_cast<intptr_t>(v)), __ATOMIC_RELAXED);
+}
+
+// 字符串对象的内容；INT 编码的先格式化到 buf（至少 21 字节）里
+inline Slice ObjectSlice(const RedisObject* o, char* buf) {
+    if (o->encoding == OBJ_ENCODING_INT) return Slice(buf, Int64ToChars(ObjectIntValue(o), buf));
+    if (o->encoding == OBJ_ENCODING_EMBSTR) return Slice(EmbstrData(o), o->len);
+    return Slice(*static_cast<const string*>(o->ptr));
+}
+
+// 换一个带过期时间的对象头：值转到新对象上（EMBSTR 是拷一份），旧的只剩对象头，用 FreeObjectShell 释放
+inline RedisObject* CloneWithExpire(const RedisObject* o, int64_t expire) {
+    RedisObject* n;
+    if (o->encoding == OBJ_ENCODING_EMBSTR) {
+        n = CreateEmbstrObject(EmbstrData(o), o->len, expire);
+    } else {
+        n = AllocObject(static_cast<ObjType>(o->type), static_cast<ObjEncoding>(o->encoding), sizeof(RedisObject), expire);
+        n->ptr = __atomic_load_n(&o->ptr, __ATOMIC_RELAXED);
+    }
+    n->lru = o->lru;
+    return n;
+}
+
+// 只释放对象头（值已经交给别的对象头了）；共享对象不释放
+inline void FreeObjectShell(RedisObject* o) {
+    if (o->flags & OBJ_FLAG_SHARED) return;
+    char* mem = reinterpret_cast<char*>(o);
+    if (o->flags & OBJ_FLAG_EXPIRE) mem -= sizeof(int64_t);
+    free(mem);
+}
+
+inline void DestroyObject(RedisObject* o) {
+    if (o->encoding == OBJ_ENCODING_RAW) delete static_cast<string*>(o->ptr);
+    else if (o->encoding == OBJ_ENCODING_QUICKLIST) delete static_cast<QuickList*>(o->ptr);
+    FreeObjectShell(o);
+}
+
+// ======================= 过期时间 =======================
+// 无锁模式下读者不拿锁读过期时间，读写都用 relaxed 原子操作，读到的不是旧值就是新值
+
+inline int64_t GetExpire(const RedisObject* o) {
+    if (!(o->flags & OBJ_FLAG_EXPIRE)) return 0;
+    return __atomic_load_n(reinterpret_cast<const int64_t*>(o) - 1, __ATOMIC_RELAXED);
+}
+
+// 只能对 CreateObject 时带了过期时间的对象用；0 表示去掉过期时间（那 8 字节留着，下次再设不用换对象头）
+inline void SetExpire(RedisObject* o, int64_t when) {
+    __atomic_store_n(reinterpret_cast<int64_t*>(o) - 1, when, __ATOMIC_RELAXED);
+}
+
+inline bool IsExpired(const RedisObject* o, int64_t now) {
+    int64_t when = GetExpire(o);
+    return when != 0 && when <= now;
+}
+
+// ======================= LRU / LFU =======================
+
+const uint32_t LFU_INIT_VAL = 5;    // 新 key 的计数，免得刚写进来就被淘汰
+const uint32_t LFU_LOG_FACTOR = 10; // 计数器越大越难再加一：255 大约对应一百万次访问
+const uint32_t LFU_DECAY_TIME = 1;  // 每空闲这么多分钟计数减一
+
+// LRU 时钟：毫秒，32 位回绕（49 天一圈，空闲时间按无符号减法算，回绕了也对）。
+// 用 COARSE 时钟，读一次只要几纳秒，精度几毫秒足够比较谁更久没被访问
+inline uint32_t LruClock() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return static_cast<uint32_t>(static_cast<uint64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000);
+}
+
+// 空闲了多少毫秒
+inline uint32_t ObjectIdleTime(const RedisObject* o) {
+    return LruClock() - __atomic_load_n(&o->lru, __ATOMIC_RELAXED);
+}
+
+inline uint32_t LfuTimeInMinutes() { return static_cast<uint32_t>(time(nullptr) / 60) & 0xffff; }
+
+// 按空闲的分钟数衰减以后的计数（不写回）
+inline uint32_t LfuDecrAndReturn(const RedisObject* o) {
+    uint32_t lru = __atomic_load_n(&o->lru, __ATOMIC_RELAXED);
+    uint32_t ldt = lru >> 8;
+    uint32_t counter = lru & 0xff;
+    uint32_t now = LfuTimeInMinutes();
+    uint32_t elapsed = now >= ldt ? now - ldt : 0xffff - ldt + now;
+    uint32_t periods = elapsed / LFU_DECAY_TIME;
+    return periods > counter ? 0 : counter - periods;
+}
+
+// 对数计数：计数器越大，加一的概率越小。rnd 是一个均匀的随机数
+inline uint32_t LfuLogIncr(uint32_t counter, uint64_t rnd) {
+    if (counter == 255) return counter;
+    double r = static_cast<double>(rnd >> 11) / static_cast<double>(1ull << 53);
+    double base = counter > LFU_INIT_VAL ? counter - LFU_INIT_VAL : 0;
+    double p = 1.0 / (base * LFU_LOG_FACTOR + 1);
+    return r < p ? counter + 1 : counter;
+}
+
+// 新对象的 lru 字段
+inline uint32_t InitialLru(bool lfu) { return lfu ? (LfuTimeInMinutes() << 8) | LFU_INIT_VAL : LruClock(); }
+
+inline void InitObjectLru(RedisObject* o, bool lfu) {
+    if (!(o->flags & OBJ_FLAG_SHARED)) o->lru = InitialLru(lfu);
+}
+
+// 访问了一次：lfu 时衰减再加一，否则记下现在的时间（共享对象不记，见 CreateIntObject）
+inline void TouchObject(RedisObject* o, bool lfu, uint64_t rnd) {
+    if (o->flags & OBJ_FLAG_SHARED) return;
+    uint32_t v = lfu ? (LfuTimeInMinutes() << 8) | LfuLogIncr(LfuDecrAndReturn(o), rnd) : LruClock();
+    __atomic_store_n(&o->lru, v, __ATOMIC_RELAXED);
+}
+
+// ======================= 内存估算 =======================
+// 字符串按长度估算，不看 capacity：加和减用的是同一个算法，累计值不会越算越偏。
+// 列表按 QuickList 实际分配的算，KVStore 在每次改列表的前后各取一次、只加差值
+
+// 一个 string 占多少：对象本身，超过短字符串优化（15 字节）的再加堆上那一块
+inline size_t StringBytes(size_t len) { return sizeof(string) + (len > 15 ? len + 1 : 0); }
+
+inline size_t ObjectBytes(const RedisObject* o) {
+    if (o->flags & OBJ_FLAG_SHARED) return 0;
+    size_t prefix = (o->flags & OBJ_FLAG_EXPIRE) ? sizeof(int64_t) : 0;
+    if (o->encoding == OBJ_ENCODING_EMBSTR) return prefix + EmbstrAllocSize(o->len);
+    size_t n = sizeof(RedisObject) + prefix;
+    if (o->encoding == OBJ_ENCODING_INT) return n;
+    if (o->type == OBJ_STRING) {
+        n += StringBytes(static_cast<const string*>(o->ptr)->size());
+    } else if (o->type == OBJ_LIST) {
+        n += static_cast<const QuickList*>(o->ptr)->Bytes(); // 列表自己记着，O(1)
+    }
+    return n;
+}
+
+#endif // OBJECT_H
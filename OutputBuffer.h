@@ -0,0 +1,153 @@
+/**
+ * OutputBuffer.h
+ * 连接的写缓冲区：一串内存块（iovec 链），发的时候一次 writev 把能发的都交给内核。
+ *
+ *   chunks_:  [ 16KB 小块 | 16KB 小块 | 大 value（整个 move 进来） | 16KB 小块 ]
+ *                ^ headOffset_（第一块已经发出去的部分）
+ *
+ * - 小回复（+OK、:1、$3\r\nfoo\r\n ...）往最后一个小块里追加，几十条回复合成一次 writev；
+ * - 大 value 不再拷进缓冲区，直接 move 成单独的一块，writev 时和前后的小块拼在一起发；
+ * - socket 写满（EAGAIN）时剩下的数据留在这里，等 EPOLLOUT 再接着发，回复不会丢。
+ */
+
+#ifndef OUTPUT_BUFFER_H
+#define OUTPUT_BUFFER_H
+
+#include <deque>
+#include <string>
+#include <cerrno>
+#include <sys/uio.h>
+#include "Slice.h"
+#include "Stats.h"
+
+class OutputBuffer {
+public:
+    static const size_t CHUNK_SIZE = 16 * 1024; // 小块的容量
+    static const size_t BIG_REPLY = 16 * 1024;  // 超过这个长度的数据单独成块
+    static const int MAX_IOV = 64;              // 一次 writev 最多带多少块
+
+    OutputBuffer() : headOffset_(0), bytes_(0) {}
+
+    // 还没发出去的字节数
+    size_t Bytes() const { return bytes_; }
+    bool Empty() const { return bytes_ == 0; }
+
+    // 丢掉所有数据（AOF 重放时回复没人要）
+    void Clear() {
+        chunks_.clear();
+        headOffset_ = 0;
+        bytes_ = 0;
+    }
+
+    void Append(const char* data, size_t len) {
+        if (len == 0) return;
+        if (len >= BIG_REPLY) {
+            chunks_.push_back(Chunk());
+            chunks_.back().data.assign(data, len);
+            chunks_.back().sealed = true;
+        } else {
+            std::string& tail = Tail(len);
+            tail.append(data, len);
+        }
+        bytes_ += len;
+    }
+
+    void Append(const Slice& s) { Append(s.data(), s.size()); }
+
+    // 大字符串直接 move 成一块，省掉一次拷贝
+    void Append(std::string&& s) {
+        if (s.size() < BIG_REPLY) {
+            Append(s.data(), s.size());
+            return;
+        }
+        bytes_ += s.size();
+        chunks_.push_back(Chunk());
+        chunks_.back().data.swap(s);
+        chunks_.back().sealed = true;
+    }
+
+    /**
+     * 待发送的数据填进 vec（最多 max 块），返回块数，数据不动，发出去以后调 Consume。
+     * 在 Consume 之前这些块的地址一直有效：小块预留了 CHUNK_SIZE 的容量，往后追加不会搬家，
+     * 所以 io_uring 的发送还没完成时照样可以往后追加回复。
+     */
+    int Gather(struct iovec* vec, int max) const {
+        int cnt = 0;
+        for (size_t i = 0; i < chunks_.size() && cnt < max; ++i) {
+            const std::string& d = chunks_[i].data;
+            size_t off = (i == 0) ? headOffset_ : 0;
+            vec[cnt].iov_base = const_cast<char*>(d.data()) + off;
+            vec[cnt].iov_len = d.size() - off;
+            cnt++;
+        }
+        return cnt;
+    }
+
+    // 前 n 个字节已经发出去了
+    void Consume(size_t n) {
+        bytes_ -= n;
+        while (n > 0) {
+            Chunk& c = chunks_.front();
+            size_t left = c.data.size() - headOffset_;
+            if (n < left) {
+                headOffset_ += n;
+                return;
+            }
+            n -= left;
+            headOffset_ = 0;
+            if (!c.sealed && spare_.capacity() == 0) {
+                c.data.clear();
+                spare_.swap(c.data);
+            }
+            chunks_.pop_front();
+        }
+    }
+
+    /**
+     * 把缓冲区里的数据尽量写进 fd（写到 EAGAIN 或者写完为止）。
+     * 返回这次写出去的字节数；出错（对端关闭等）返回 -1。
+     */
+    ssize_t WriteFd(int fd) {
+        ssize_t total = 0;
+        while (bytes_ > 0) {
+            struct iovec vec[MAX_IOV];
+            int cnt = Gather(vec, MAX_IOV);
+            CountSyscall();
+            ssize_t n = writev(fd, vec, cnt);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break; // socket 写满了，等 EPOLLOUT
+                return -1;
+            }
+            total += n;
+            Consume(static_cast<size_t>(n));
+        }
+        return total;
+    }
+
+private:
+    struct Chunk {
+        std::string data;
+        bool sealed = false; // 大 value 单独的一块，不能再往后追加
+    };
+
+    std::deque<Chunk> chunks_;
+    size_t headOffset_;  // 第一块已经发出去的字节数
+    size_t bytes_;
+    std::string spare_;  // 发完的小块留一个复用，省得每轮都 malloc
+
+    // 能装下 len 字节的末尾小块，没有就新开一块
+    std::string& Tail(size_t len) {
+        if (!chunks_.empty()) {
+            Chunk& c = chunks_.back();
+            if (!c.sealed && c.data.size() + len <= CHUNK_SIZE) return c.data;
+        }
+        chunks_.push_back(Chunk());
+        std::string& d = chunks_.back().data;
+        if (spare_.capacity() > 0) d.swap(spare_);
+        else d.reserve(CHUNK_SIZE);
+        return d;
+    }
+};
+
+#endif // OUTPUT_BUFFER_H
@@ -0,0 +1,321 @@
+#ifndef PERSISTENCE_H
+#define PERSISTENCE_H
+
+/**
+ * Persistence.h
+ * 后台快照（BGSAVE）和 AOF 重写（BGREWRITEAOF）：fork 一个子进程写文件，Reactor 照常处理请求。
+ * 子进程拿到的是 fork 那一刻的内存镜像，之后父进程改到哪一页，内核才复制哪一页（copy-on-write），
+ * 所以写快照期间不用停服务，也不用一直拿着分片锁。
+ *
+ * 触发方式：
+ *   - BGSAVE 命令；
+ *   - save <seconds> <changes> 策略（g_config.save_params），0 号 Reactor 每轮循环调一次 Cron() 检查；
+ *   - SAVE 命令是前台保存，会卡住执行它的线程，和 Redis 一样留着备用。
+ * 写完以后子进程把记录数和自己的 Private_Dirty（也就是被 COW 复制出来的页）通过管道交给父进程，
+ * 父进程在 Cron() 里 waitpid 收尸的时候打日志；fork 本身的耗时在 fork 返回时就记下了。
+ *
+ * AOF 重写的子进程也是写一份快照（新的 base 文件），区别只在 fork 那一刻要让 Aof 换一个 incr 文件
+ * （拿锁前 Aof::PrepareRotate 开新文件、旧文件落盘，全锁下 Aof::Rotate 换上，放锁后 Aof::FinishRotate 收尾），
+ * 结束后交给 Aof::RewriteDone 换清单。同一时间只有一个子进程：BGSAVE 期间来的 BGREWRITEAOF 先记下，等它结束再做。
+ *
+ * 从库全量同步要的快照也在这里 fork（Replication::WantSnapshot），fork 那一刻通知 Replication 开始给从库攒命令，
+ * 写完交给 Replication::SnapshotDone 发给从库。
+ */
+
+#include <iostream>
+#include <string>
+#include <mutex>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <csignal>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "Config.h"
+#include "KVStore.h"
+#include "Aof.h"
+#include "Replication.h"
+
+using namespace std;
+
+extern KVStore* g_store;
+
+class Persistence {
+public:
+    static const int RETRY_DELAY = 5; // 上次 BGSAVE 失败了，至少隔几秒再按策略重试
+
+    Persistence()
+        : child_(-1), childType_(CHILD_SAVE), pipe_(-1), rewriteSeq_(0), rewriteScheduled_(false),
+          lastSave_(time(nullptr)), lastTry_(0), dirtyAtSave_(0), dirtyAtFork_(0), lastOk_(true) {}
+
+    // BGSAVE：失败时 err 里是回给客户端的错误
+    bool BgSave(string* err) {
+        lock_guard<mutex> lock(mtx_);
+        if (child_ != -1 && childType_ == CHILD_REWRITE) {
+            *err = "ERR An AOF log rewriting in progress: can't BGSAVE right now";
+            return false;
+        }
+        return StartChild(CHILD_SAVE, err);
+    }
+
+    // BGREWRITEAOF：正在 BGSAVE 的话先记下，*scheduled = true
+    bool BgRewriteAof(string* err, bool* scheduled) {
+        lock_guard<mutex> lock(mtx_);
+        if (!g_aof->Enabled()) {
+            *err = "ERR AOF is disabled, start the server with --appendonly yes";
+            return false;
+        }
+        if (child_ != -1) {
+            if (childType_ == CHILD_REWRITE) {
+                *err = "ERR Background append only file rewriting already in progress";
+                return false;
+            }
+            rewriteScheduled_ = true;
+            *scheduled = true;
+            return true;
+        }
+        return StartChild(CHILD_REWRITE, err);
+    }
+
+    // SAVE：在当前线程里直接写
+    bool Save(string* err) {
+        lock_guard<mutex> lock(mtx_);
+        if (child_ != -1) {
+            *err = "ERR Background save already in progress";
+            return false;
+        }
+        uint64_t dirty = g_store->Dirty();
+        if (!g_store->WriteSnapshot(nullptr)) {
+            lastOk_ = false;
+            *err = "ERR failed to write snapshot";
+            return false;
+        }
+        Saved(dirty);
+        return true;
+    }
+
+    time_t LastSave() {
+        lock_guard<mutex> lock(mtx_);
+        return lastSave_;
+    }
+
+    // INFO persistence 用：上次保存以来改了多少次、有没有 BGSAVE / 重写在跑、上次 BGSAVE 成没成功
+    void GetInfo(uint64_t* changes, bool* bgsave, bool* rewrite, bool* lastOk) {
+        lock_guard<mutex> lock(mtx_);
+        *changes = g_store->Dirty() - dirtyAtSave_;
+        *bgsave = child_ != -1 && childType_ == CHILD_SAVE;
+        *rewrite = child_ != -1 && childType_ == CHILD_REWRITE;
+        *lastOk = lastOk_;
+    }
+
+    // 0 号 Reactor 每轮循环调一次：收子进程，或者按 save 策略 / AOF 大小发起 BGSAVE / 重写
+    void Cron() {
+        lock_guard<mutex> lock(mtx_);
+        if (child_ != -1) {
+            CheckChild();
+            return;
+        }
+        string err;
+        if (g_repl->TakeAofRewriteRequest()) rewriteScheduled_ = true; // 从库全量同步加载完了，AOF 里还是旧数据
+        if (g_repl->WantSnapshot()) {
+            if (!StartChild(CHILD_REPL, &err)) cerr << "[Persistence] " << err << endl;
+            return;
+        }
+        if (rewriteScheduled_ || g_aof->NeedRewrite()) {
+            rewriteScheduled_ = false;
+            if (!StartChild(CHILD_REWRITE, &err)) cerr << "[Persistence] " << err << endl;
+            return;
+        }
+        time_t now = time(nullptr);
+        uint64_t changes = g_store->Dirty() - dirtyAtSave_;
+        for (const SaveParam& sp : g_config.save_params) {
+            if (changes >= static_cast<uint64_t>(sp.changes) && now - lastSave_ >= sp.seconds &&
+                (lastOk_ || now - lastTry_ >= RETRY_DELAY)) {
+                cout << "[Persistence] " << sp.changes << " changes in " << sp.seconds
+                     << " seconds. Saving..." << endl;
+                if (!StartChild(CHILD_SAVE, &err)) cerr << "[Persistence] " << err << endl;
+                break;
+            }
+        }
+    }
+
+    // 退出前调用：还在写的子进程直接杀掉，接下来的前台保存会覆盖它的临时文件
+    void Shutdown() {
+        lock_guard<mutex> lock(mtx_);
+        if (child_ == -1) return;
+        kill(child_, SIGKILL);
+        waitpid(child_, nullptr, 0);
+        if (childType_ == CHILD_REWRITE) g_aof->RewriteDone(rewriteSeq_, false);
+        if (childType_ == CHILD_REPL) unlink(Replication::SNAPSHOT_PATH);
+        close(pipe_);
+        child_ = -1;
+        pipe_ = -1;
+    }
+
+private:
+    // 子进程通过管道交回来的结果
+    struct ChildReport {
+        int ok;
+        uint64_t records;
+        uint64_t cowBytes;
+    };
+
+    enum ChildType {
+        CHILD_SAVE,    // BGSAVE
+        CHILD_REWRITE, // BGREWRITEAOF
+        CHILD_REPL     // 给从库全量同步写快照
+    };
+
+    mutex mtx_;          // 命令可能在任意 Reactor 线程上执行，Cron 在 0 号线程上
+    pid_t child_;        // 正在写文件的子进程，没有是 -1
+    ChildType childType_;
+    int pipe_;           // 子进程结果的读端
+    uint64_t rewriteSeq_;    // 重写子进程正在写的 base 编号
+    bool rewriteScheduled_;  // BGSAVE 期间收到了 BGREWRITEAOF
+    time_t lastSave_;    // 上次成功保存的时间（LASTSAVE）
+    time_t lastTry_;     // 上次发起 BGSAVE 的时间
+    uint64_t dirtyAtSave_; // 上次成功保存时 g_store->Dirty() 的值
+    uint64_t dirtyAtFork_; // 当前这个子进程 fork 时的值，成功后变成 dirtyAtSave_
+    bool lastOk_;
+
+    bool StartChild(ChildType type, string* err) {
+        if (child_ != -1) {
+            *err = "ERR Background save already in progress";
+            return false;
+        }
+        int fds[2];
+        if (pipe(fds) != 0) {
+            *err = string("ERR pipe: ") + strerror(errno);
+            return false;
+        }
+        // 旧 incr 在拿全锁之前先落盘，全锁下只换文件
+        if (type == CHILD_REWRITE && !g_aof->PrepareRotate()) {
+            close(fds[0]);
+            close(fds[1]);
+            *err = "ERR can't open a new AOF incr file";
+            return false;
+        }
+        uint64_t dirty = g_store->Dirty();
+        uint64_t seq = 0;
+        if (type == CHILD_SAVE) lastTry_ = time(nullptr);
+        auto start = chrono::steady_clock::now();
+        // 重写：在全锁下换 incr 文件，fork 那一刻之前的写都在旧文件里，之后的都在新文件里
+        // 复制：在全锁下记下复制偏移量，fork 之后的写都进从库的命令流
+        pid_t pid = g_store->ForkLocked([&]() {
+            if (type == CHILD_SAVE) return true;
+            if (type == CHILD_REPL) {
+                g_repl->SnapshotForked();
+                return true;
+            }
+            seq = g_aof->Rotate();
+            return seq != 0;
+        });
+        if (pid == 0) {
+            close(fds[0]);
+            RunChild(fds[1], type == CHILD_SAVE   ? string()
+                             : type == CHILD_REPL ? string(Replication::SNAPSHOT_PATH)
+                                                  : Aof::BaseName(seq));
+        }
+        long long forkUsec = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+        if (type == CHILD_REWRITE) g_aof->FinishRotate();
+        close(fds[1]);
+        if (pid < 0) {
+            close(fds[0]);
+            if (type == CHILD_SAVE) lastOk_ = false;
+            if (type == CHILD_REPL) g_repl->SnapshotDone(false);
+            if (type == CHILD_REWRITE && seq == 0) *err = "ERR can't open a new AOF incr file";
+            else *err = string("ERR fork: ") + strerror(errno);
+            return false;
+        }
+        child_ = pid;
+        childType_ = type;
+        pipe_ = fds[0];
+        if (type == CHILD_SAVE) dirtyAtFork_ = dirty;
+        else rewriteSeq_ = seq;
+        cout << "[Persistence] Background " << ChildName(type) << " started by pid " << pid << ", fork took " << forkUsec / 1000.0 << " ms" << endl;
+        return true;
+    }
+
+    // 子进程：写快照（path 为空就是 data.db）、统计 COW、交结果，然后直接 _exit（不跑析构，不碰父进程的 socket）
+    static void RunChild(int fd, const string& path) {
+        ChildReport rep;
+        memset(&rep, 0, sizeof(rep));
+        uint64_t records = 0;
+        bool ok = path.empty() ? g_store->WriteSnapshot(&records) : g_store->WriteSnapshot(path, &records);
+        if (ok) {
+            rep.ok = 1;
+            rep.records = records;
+        }
+        rep.cowBytes = PrivateDirtyBytes();
+        ssize_t n = write(fd, &rep, sizeof(rep));
+        (void)n;
+        _exit(rep.ok ? 0 : 1);
+    }
+
+    // 子进程自己独占的脏页：fork 以后父子任何一方写过的页都会复制一份，这就是 COW 的开销
+    static uint64_t PrivateDirtyBytes() {
+        FILE* f = fopen("/proc/self/smaps_rollup", "r");
+        if (!f) f = fopen("/proc/self/smaps", "r"); // 老内核没有 smaps_rollup，逐段加起来
+        if (!f) return 0;
+        uint64_t total = 0;
+        char line[256];
+        while (fgets(line, sizeof(line), f)) {
+            unsigned long long kb;
+            if (sscanf(line, "Private_Dirty: %llu kB", &kb) == 1) total += kb * 1024;
+        }
+        fclose(f);
+        return total;
+    }
+
+    void CheckChild() {
+        int status = 0;
+        pid_t r = waitpid(child_, &status, WNOHANG);
+        if (r == 0) return; // 还在写
+        ChildReport rep;
+        memset(&rep, 0, sizeof(rep));
+        // 子进程退出前已经写完了，不会阻塞
+        bool got = read(pipe_, &rep, sizeof(rep)) == static_cast<ssize_t>(sizeof(rep));
+        close(pipe_);
+        pipe_ = -1;
+        child_ = -1;
+        bool ok = r > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0 && got && rep.ok;
+        const char* what = ChildName(childType_);
+        if (childType_ == CHILD_SAVE) {
+            if (ok) Saved(dirtyAtFork_);
+            else lastOk_ = false;
+        } else if (childType_ == CHILD_REPL) {
+            g_repl->SnapshotDone(ok);
+        } else {
+            g_aof->RewriteDone(rewriteSeq_, ok);
+        }
+        if (ok) {
+            long page = sysconf(_SC_PAGESIZE);
+            cout << "[Persistence] Background " << what << " terminated with success: " << rep.records
+                 << " records, " << rep.cowBytes / (1024 * 1024) << " MB of memory used by copy-on-write ("
+                 << rep.cowBytes / page << " pages)" << endl;
+        } else {
+            cerr << "[Persistence] Background " << what << " error" << endl;
+        }
+    }
+
+    static const char* ChildName(ChildType type) {
+        switch (type) {
+        case CHILD_SAVE: return "saving";
+        case CHILD_REWRITE: return "append only file rewriting";
+        default: return "saving for replication";
+        }
+    }
+
+    void Saved(uint64_t dirty) {
+        lastSave_ = time(nullptr);
+        dirtyAtSave_ = dirty;
+        lastOk_ = true;
+    }
+};
+
+extern Persistence* g_persistence;
+
+#endif // PERSISTENCE_H
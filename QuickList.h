@@ -0,0 +1,361 @@
+/**
+ * QuickList.h
+ * 列表的存储：双向链表，每个节点是一块紧凑的缓冲区，里面连续放着若干个元素（和 Redis 的 quicklist + listpack 一个思路）。
+ *
+ * 节点缓冲区里元素挨着放，每个元素前后各带一个长度：
+ *   [varint len] [data] [反着写的 varint len]
+ * 前面那个长度用来往后走，后面那个从元素末尾往前读，用来往前走（弹出尾部元素）。
+ * 有效数据是缓冲区里的 [begin, end)，两头都可以留空位：往头上插就用 begin 前面的空位，往尾巴上插就用 end 后面的，
+ * 所以两头的 push / pop 都是 O(1)（空位不够时最多搬一个节点，节点大小有上限）。
+ *
+ * 一个节点最多 NODE_BYTES 字节，满了就在那一头新开一个节点；比它还大的元素自己独占一个节点。
+ * 相比 vector<string>：一个小元素只多 2 个字节的长度，没有每个元素一个 string 对象 + 一次 malloc；
+ * 按下标找元素时整个节点按 count 跳过，只在最后一个节点里逐个走。
+ *
+ * 不加锁，调用方（KVStore）拿着分片锁用。
+ */
+
+#ifndef QUICKLIST_H
+#define QUICKLIST_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include "Slice.h"
+
+class QuickList {
+public:
+    static const uint32_t NODE_BYTES = 8 * 1024; // 一个节点最多装多少字节的元素
+    static const uint32_t NODE_MIN_CAP = 64;     // 新节点至少分配这么多
+
+    struct Node {
+        Node* prev;
+        Node* next;
+        char* buf;
+        uint32_t cap;   // buf 的大小
+        uint32_t begin; // 有效数据 [begin, end)
+        uint32_t end;
+        uint32_t count; // 这个节点里几个元素
+        uint32_t Used() const { return end - begin; }
+    };
+
+    QuickList() : head_(nullptr), tail_(nullptr), len_(0), nodes_(0), bytes_(0) {}
+    ~QuickList() { Clear(); }
+
+    QuickList(const QuickList&) = delete;
+    QuickList& operator=(const QuickList&) = delete;
+
+    size_t Size() const { return len_; }
+
+    // 一共占了多少内存：自己 + 节点头 + 节点缓冲区（按实际分配的容量算）
+    size_t Bytes() const { return sizeof(QuickList) + nodes_ * sizeof(Node) + bytes_; }
+
+    void PushFront(const Slice& v) {
+        size_t sz = EntrySize(v.size());
+        Node* n = head_;
+        if (!n || (n->Used() + sz > NODE_BYTES && n->count > 0)) n = InsertNode(nullptr, head_);
+        MakeRoom(n, sz, true);
+        n->begin -= sz;
+        PutEntry(n->buf + n->begin, v);
+        n->count++;
+        len_++;
+    }
+
+    void PushBack(const Slice& v) {
+        size_t sz = EntrySize(v.size());
+        Node* n = tail_;
+        if (!n || (n->Used() + sz > NODE_BYTES && n->count > 0)) n = InsertNode(tail_, nullptr);
+        MakeRoom(n, sz, false);
+        PutEntry(n->buf + n->end, v);
+        n->end += sz;
+        n->count++;
+        len_++;
+    }
+
+    // 弹出头 / 尾的元素：先把值交给 f(Slice)（指向节点内部，节点马上可能被释放，f 里要拷走），空列表返回 false
+    template <typename F>
+    bool PopFront(F f) {
+        if (!head_) return false;
+        Node* n = head_;
+        uint32_t len;
+        const char* p = GetVarint(n->buf + n->begin, &len);
+        f(Slice(p, len));
+        n->begin += EntrySize(len);
+        EntryRemoved(n);
+        return true;
+    }
+
+    template <typename F>
+    bool PopBack(F f) {
+        if (!tail_) return false;
+        Node* n = tail_;
+        const char* start;
+        uint32_t len = GetBackLen(n->buf + n->end, &start);
+        f(Slice(start + VarintLen(len), len));
+        n->end = static_cast<uint32_t>(start - n->buf);
+        EntryRemoved(n);
+        return true;
+    }
+
+    // 第 i 个元素（0 <= i < Size()），指向节点内部，下一次修改之前有效
+    Slice At(size_t i) const {
+        size_t off;
+        Node* n = Locate(i, &off);
+        const char* p = n->buf + n->begin;
+        while (off--) p = SkipEntry(p);
+        uint32_t len;
+        p = GetVarint(p, &len);
+        return Slice(p, len);
+    }
+
+    // 从第 start 个开始顺序交出 count 个元素给 f(Slice)：只定位一次，之后一路往后走
+    template <typename F>
+    void ForRange(size_t start, size_t count, F f) const {
+        if (count == 0) return;
+        size_t off;
+        Node* n = Locate(start, &off);
+        const char* p = n->buf + n->begin;
+        while (off--) p = SkipEntry(p);
+        while (true) {
+            const char* end = n->buf + n->end;
+            while (p < end) {
+                uint32_t len;
+                const char* d = GetVarint(p, &len);
+                f(Slice(d, len));
+                if (--count == 0) return;
+                p = d + len + VarintLen(len);
+            }
+            n = n->next;
+            p = n->buf + n->begin;
+        }
+    }
+
+    // 从头上删掉 k 个元素：整节点的直接释放，只有最后一个节点要逐个走
+    void DelFront(size_t k) {
+        if (k >= len_) {
+            Clear();
+            return;
+        }
+        while (k >= head_->count) {
+            k -= head_->count;
+            len_ -= head_->count;
+            FreeNode(head_);
+        }
+        Node* n = head_;
+        const char* p = n->buf + n->begin;
+        for (size_t i = 0; i < k; ++i) p = SkipEntry(p);
+        n->begin = static_cast<uint32_t>(p - n->buf);
+        n->count -= k;
+        len_ -= k;
+    }
+
+    // 从尾巴上删掉 k 个元素
+    void DelBack(size_t k) {
+        if (k >= len_) {
+            Clear();
+            return;
+        }
+        while (k >= tail_->count) {
+            k -= tail_->count;
+            len_ -= tail_->count;
+            FreeNode(tail_);
+        }
+        Node* n = tail_;
+        const char* p = n->buf + n->end;
+        for (size_t i = 0; i < k; ++i) GetBackLen(p, &p);
+        n->end = static_cast<uint32_t>(p - n->buf);
+        n->count -= k;
+        len_ -= k;
+    }
+
+    void Clear() {
+        while (head_) FreeNode(head_);
+        len_ = 0;
+    }
+
+    // 顺序遍历（快照用）：for (Slice s : list)
+    class const_iterator {
+    public:
+        const_iterator(const Node* n, const char* p) : n_(n), p_(p) {}
+        Slice operator*() const {
+            uint32_t len;
+            const char* d = GetVarint(p_, &len);
+            return Slice(d, len);
+        }
+        const_iterator& operator++() {
+            p_ = SkipEntry(p_);
+            if (p_ == n_->buf + n_->end) {
+                n_ = n_->next;
+                p_ = n_ ? n_->buf + n_->begin : nullptr;
+            }
+            return *this;
+        }
+        bool operator!=(const const_iterator& o) const { return p_ != o.p_; }
+    private:
+        const Node* n_;
+        const char* p_;
+    };
+    const_iterator begin() const { return const_iterator(head_, head_ ? head_->buf + head_->begin : nullptr); }
+    const_iterator end() const { return const_iterator(nullptr, nullptr); }
+    size_t size() const { return len_; }
+
+private:
+    Node* head_;
+    Node* tail_;
+    size_t len_;    // 元素个数
+    size_t nodes_;  // 节点个数
+    size_t bytes_;  // 所有节点缓冲区的容量之和
+
+    // ---------------- 元素编码 ----------------
+
+    static size_t VarintLen(uint32_t v) {
+        size_t n = 1;
+        while (v >= 128) {
+            v >>= 7;
+            n++;
+        }
+        return n;
+    }
+
+    static size_t EntrySize(size_t len) { return len + 2 * VarintLen(static_cast<uint32_t>(len)); }
+
+    static char* PutVarint(char* p, uint32_t v) {
+        while (v >= 128) {
+            *p++ = static_cast<char>(v | 128);
+            v >>= 7;
+        }
+        *p++ = static_cast<char>(v);
+        return p;
+    }
+
+    static const char* GetVarint(const char* p, uint32_t* v) {
+        uint32_t r = 0;
+        for (int shift = 0;; shift += 7) {
+            uint8_t b = static_cast<uint8_t>(*p++);
+            r |= static_cast<uint32_t>(b & 127) << shift;
+            if (!(b & 128)) break;
+        }
+        *v = r;
+        return p;
+    }
+
+    // 元素末尾的长度是把 varint 的字节倒过来放的：从 end 往前读就是正常的 varint 顺序
+    static uint32_t GetBackLen(const char* end, const char** start) {
+        uint32_t r = 0;
+        const char* p = end;
+        for (int shift = 0;; shift += 7) {
+            uint8_t b = static_cast<uint8_t>(*--p);
+            r |= static_cast<uint32_t>(b & 127) << shift;
+            if (!(b & 128)) break;
+        }
+        *start = p - r - VarintLen(r);
+        return r;
+    }
+
+    static void PutEntry(char* p, const Slice& v) {
+        uint32_t len = static_cast<uint32_t>(v.size());
+        char tmp[5];
+        size_t n = PutVarint(tmp, len) - tmp;
+        memcpy(p, tmp, n);
+        p += n;
+        memcpy(p, v.data(), v.size());
+        p += v.size();
+        for (size_t i = 0; i < n; ++i) p[i] = tmp[n - 1 - i];
+    }
+
+    static const char* SkipEntry(const char* p) {
+        uint32_t len;
+        p = GetVarint(p, &len);
+        return p + len + VarintLen(len);
+    }
+
+    // ---------------- 节点 ----------------
+
+    // 找第 i 个元素在哪个节点、是节点里的第几个：从离得近的那一头按 count 整节点跳
+    Node* Locate(size_t i, size_t* off) const {
+        Node* n;
+        if (i < len_ / 2) {
+            n = head_;
+            while (i >= n->count) {
+                i -= n->count;
+                n = n->next;
+            }
+        } else {
+            size_t back = len_ - 1 - i; // 从尾巴数第几个
+            n = tail_;
+            while (back >= n->count) {
+                back -= n->count;
+                n = n->prev;
+            }
+            i = n->count - 1 - back;
+        }
+        *off = i;
+        return n;
+    }
+
+    // 在 prev 和 next 之间插一个空节点
+    Node* InsertNode(Node* prev, Node* next) {
+        Node* n = static_cast<Node*>(malloc(sizeof(Node)));
+        if (!n) throw std::bad_alloc();
+        n->buf = nullptr;
+        n->cap = n->begin = n->end = n->count = 0;
+        n->prev = prev;
+        n->next = next;
+        if (prev) prev->next = n;
+        else head_ = n;
+        if (next) next->prev = n;
+        else tail_ = n;
+        nodes_++;
+        return n;
+    }
+
+    void FreeNode(Node* n) {
+        if (n->prev) n->prev->next = n->next;
+        else head_ = n->next;
+        if (n->next) n->next->prev = n->prev;
+        else tail_ = n->prev;
+        bytes_ -= n->cap;
+        nodes_--;
+        free(n->buf);
+        free(n);
+    }
+
+    void EntryRemoved(Node* n) {
+        n->count--;
+        len_--;
+        if (n->count == 0) FreeNode(n);
+    }
+
+    /**
+     * 保证 front ? begin 前面 : end 后面 至少有 need 字节空位。
+     * 总空位够就把数据挪到另一头；不够就换一块更大的缓冲区（翻倍，到 NODE_BYTES 为止），
+     * 数据放到远离插入方向的那一头，后面连着往这头插都不用再挪。
+     */
+    void MakeRoom(Node* n, size_t need, bool front) {
+        if (front ? n->begin >= need : n->cap - n->end >= need) return;
+        uint32_t used = n->Used();
+        size_t cap = n->cap;
+        if (cap - used < need) {
+            cap = cap * 2 < NODE_BYTES ? cap * 2 : NODE_BYTES;
+            if (cap < NODE_MIN_CAP) cap = NODE_MIN_CAP;
+            if (cap < used + need) cap = used + need;
+        }
+        uint32_t begin = front ? static_cast<uint32_t>(cap - used) : 0;
+        if (cap == n->cap) {
+            memmove(n->buf + begin, n->buf + n->begin, used);
+        } else {
+            char* buf = static_cast<char*>(malloc(cap));
+            if (!buf) throw std::bad_alloc();
+            if (used) memcpy(buf + begin, n->buf + n->begin, used);
+            free(n->buf);
+            bytes_ += cap - n->cap;
+            n->buf = buf;
+            n->cap = static_cast<uint32_t>(cap);
+        }
+        n->begin = begin;
+        n->end = begin + used;
+    }
+};
+
+#endif // QUICKLIST_H
@@ -0,0 +1,548 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+/**
+ * Reactor.h
+ * 一个 Reactor = 一个线程 + 一个 Epoller（或者 IoUring）+ 一个监听 socket + 一张连接表 + 一个空闲超时的时间轮。
+ * 多 Reactor 模式下每个线程都用 SO_REUSEPORT 绑同一个端口，
+ * 由内核把新连接均匀分给各个监听 socket，线程之间不共享任何网络状态。
+ *
+ * 两种 I/O 后端（--io-backend）：
+ *   - epoll：等“能读 / 能写”，然后自己 accept / readv / writev；
+ *   - io_uring：一个监听 socket 提交一次 multishot accept，一个连接提交一次 multishot recv，
+ *     数据由内核读进 provided buffer，完成事件到了交给 Connection::Feed；
+ *     回复攒一轮，所有连接的 sendmsg 随下一次 io_uring_enter 一起提交，一轮循环一般只有一次系统调用。
+ * 解析、执行、高水位、空闲超时、AOF 先于回复落盘这些逻辑两边共用。
+ */
+
+#include <iostream>
+#include <cstring>      // memset
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <unistd.h>     // close
+#include <fcntl.h>      // fcntl, O_NONBLOCK
+#include <sys/socket.h> // socket, bind, listen, accept
+#include <netinet/in.h> // sockaddr_in
+#include <arpa/inet.h>  // htons
+#include <netinet/tcp.h>
+#include "Epoller.h"
+#include "IoUring.h"
+#include "Connection.h"
+#include "Persistence.h"
+#include "Replication.h"
+#include "TimingWheel.h"
+
+using namespace std;
+
+extern atomic<bool> stop_server;
+
+inline void set_nodelay(int sock) {
+    int opt = 1;
+    CountSyscall();
+    // 禁用 Nagle 算法，有数据立刻发，不等待
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+}
+// 工具函数：把 Socket 设置为“非阻塞”
+inline void set_nonblocking(int sock) {
+    CountSyscall(2);
+    int opts = fcntl(sock, F_GETFL);
+    if (opts < 0) {
+        perror("fcntl(F_GETFL)");
+        return;
+    }
+    opts = opts | O_NONBLOCK;
+    if (fcntl(sock, F_SETFL, opts) < 0) {
+        perror("fcntl(F_SETFL)");
+        return;
+    }
+}
+
+/**
+ * io_uring 模式下的连接：多记几个正在进行的操作。
+ * 连接要关的时候不能马上 delete：内核可能还拿着 iov 在发、还会为这个 fd 出 recv 的完成事件，
+ * 等 recv 和 send 都结束了再 delete（那时才 close，fd 号也不会被新连接复用）。
+ */
+struct UringConnection : public Connection {
+    static const int MAX_IOV = 64;
+
+    bool recvArmed = false;   // multishot recv 还在（还没收到不带 F_MORE 的完成事件）
+    bool cancelSent = false;  // 已经请求取消 recv（高水位暂停读 / 要关了）
+    bool sending = false;     // 有一个 sendmsg 还没完成，msg / iov 不能动
+    bool closing = false;     // 要关了，等 recv / send 都结束
+    bool flushOnClose = false; // 关之前把剩下的回复发完（协议错误时把错误原因发出去）
+    bool queued = false;      // 已经在 pending_ 里了
+    struct msghdr msg;
+    struct iovec iov[MAX_IOV];
+
+    explicit UringConnection(int fd) : Connection(fd) { memset(&msg, 0, sizeof(msg)); }
+};
+
+class Reactor {
+public:
+    static const int TIMEOUT = 10; // 空闲连接超时时间（秒）
+    static const int EXPIRE_CYCLE_MS = 100;          // 主动过期多久跑一次
+    static const int EXPIRE_CYCLE_BUDGET_US = 1000;  // 每次每个分片最多花多少时间
+    static const unsigned RING_ENTRIES = 4096;       // io_uring 提交队列大小
+    static const unsigned RECV_BUFFERS = 256;        // provided buffer 块数（2 的幂）
+    static const unsigned RECV_BUFFER_SIZE = 16 * 1024; // 每块大小
+
+    Reactor(int id, int port) : id_(id), port_(port), listenFd_(-1), uring_(false), wheel_(TIMEOUT) {}
+
+    ~Reactor() {
+        for (Connection* conn : conns_) {
+            if (uring_) delete static_cast<UringConnection*>(conn);
+            else delete conn;
+        }
+        if (listenFd_ != -1) close(listenFd_);
+    }
+
+    // 这个内核能不能用 io_uring 后端（建一个小 ring 试试），main 里决定要不要退回 epoll
+    static bool UringSupported() {
+        IoUring ring;
+        return ring.Init(8) && ring.SetupBuffers(0, 8, 4096);
+    }
+
+    // 创建自己的监听 socket：SO_REUSEPORT 让多个线程可以 bind 同一个端口
+    bool Listen() {
+        listenFd_ = socket(AF_INET, SOCK_STREAM, 0);
+        if (listenFd_ < 0) {
+            perror("socket");
+            return false;
+        }
+
+        // 端口复用
+        int opt = 1;
+        setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+        setsockopt(listenFd_, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
+
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = INADDR_ANY;
+        address.sin_port = htons(port_);
+
+        if (::bind(listenFd_, (struct sockaddr*)&address, sizeof(address)) < 0) {
+            perror("bind");
+            return false;
+        }
+        if (listen(listenFd_, 511) < 0) {
+            perror("listen");
+            return false;
+        }
+        if (g_config.io_backend == IO_BACKEND_IO_URING) {
+            // io_uring 模式下 socket 保持阻塞：非阻塞的 fd 内核会直接回 EAGAIN，而不是等它就绪了再做
+            if (!ring_.Init(RING_ENTRIES) || !ring_.SetupBuffers(0, RECV_BUFFERS, RECV_BUFFER_SIZE)) {
+                perror("io_uring");
+                return false;
+            }
+            uring_ = true;
+            return true;
+        }
+        // 非阻塞：一次可读事件里循环 accept 到 EAGAIN
+        set_nonblocking(listenFd_);
+        // 监控EPOLLIN
+        return epoller_.AddFd(listenFd_, EPOLLIN);
+    }
+
+    // =====================================================================
+    // 事件循环 (Event Loop)，每个线程跑一个
+    // =====================================================================
+    void Loop() {
+        if (uring_) {
+            LoopUring();
+            return;
+        }
+        while (!stop_server) {
+            // nfds: 返回有多少个 socket 有事发生了
+            // 没有事件也至少 500ms 醒一次，跑下面的定时任务（时间轮、主动过期、持久化）
+            int nfds = epoller_.Wait(500);
+            uint64_t woke = CycleClock::Now();
+
+            // 遍历所有有事的 Socket
+            for (int i = 0; i < nfds; ++i) {
+                int fd = epoller_.GetEventFd(i);
+                // 情况 A: 如果是 listenFd_ 有事，说明有新的客户
+                if (fd == listenFd_) {
+                    HandleAccept();
+                }
+                else {
+                    uint32_t ev = epoller_.GetEvents(i);
+                    // 情况 B: socket 又能写了，把上次没发完的回复接着发
+                    if (ev & EPOLLOUT) {
+                        HandleWrite(fd);
+                    }
+                    // 情况 C: 如果是其他 fd 有事，说明有数据
+                    if (ev & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+                        HandleRead(fd);
+                    }
+                }
+            }
+            // 这一轮所有连接的回复统一发出去，每个连接一次 writev
+            FlushPending();
+            KickIdle();
+            ActiveExpire();
+            // 后台任务（save 策略、AOF 自动重写、收子进程）只在 0 号线程上跑
+            if (id_ == 0) g_persistence->Cron();
+            g_repl->Wake();
+            EndCycle(nfds, woke);
+        }
+    }
+
+private:
+    int id_;
+    int port_;
+    int listenFd_;
+    bool uring_;                  // 用 io_uring 后端
+    Epoller epoller_;
+    IoUring ring_;
+    vector<Connection*> conns_;   // 本线程自己的连接表，直接按 fd 下标，没有的是 nullptr；不和别的线程共享
+    vector<int> pending_;         // 这一轮有新回复要发的连接
+    TimingWheel wheel_;           // 空闲超时
+    chrono::steady_clock::time_point lastExpire_; // 上次主动过期的时间
+    chrono::steady_clock::time_point lastSample_; // 上次给 INFO 的瞬时值采样的时间（只有 0 号线程用）
+
+    void HandleAccept() {
+        while (true) {
+            struct sockaddr_in client_addr;
+            socklen_t client_len = sizeof(client_addr);
+            CountSyscall();
+            int client_sock = accept(listenFd_, (struct sockaddr*)&client_addr, &client_len);
+            if (client_sock < 0) break; // EAGAIN：这一批连接接完了
+
+            // 关键：把新来的 client_sock 设为非阻塞
+            set_nonblocking(client_sock);
+            set_nodelay(client_sock);
+
+            // 关键：把新来的 client_sock 也拉进 Epoll 群里监控
+            epoller_.AddFd(client_sock, EPOLLIN);
+            Connection* conn = new Connection(client_sock);
+            CountStat(STAT_ACCEPTED);
+            conn->SetEvents(EPOLLIN);
+            if (static_cast<size_t>(client_sock) >= conns_.size()) conns_.resize(client_sock + 1, nullptr);
+            conns_[client_sock] = conn;
+            wheel_.Touch(conn, conn->GetLastActiveTime());
+        }
+    }
+
+    Connection* GetConn(int fd) const {
+        return static_cast<size_t>(fd) < conns_.size() ? conns_[fd] : nullptr;
+    }
+
+    void HandleRead(int sockfd) {
+        Connection* cur = GetConn(sockfd);
+        if (!cur) return;
+        ssize_t n = cur->Read();
+        if (n > 0) {
+            wheel_.Touch(cur, cur->GetLastActiveTime());
+            // 协议错误：把错误信息（连同前面命令的回复）尽量发出去，再断开
+            if (!cur->Process()) {
+                g_aof->Flush();
+                cur->Flush();
+                CloseConn(cur);
+                return;
+            }
+            if (cur->HandedOff()) {
+                HandOff(cur);
+                return;
+            }
+            // 回复先攒着，等这一轮事件处理完再统一发
+            if (cur->HasPendingOutput() || cur->Blocked()) pending_.push_back(sockfd);
+        } else if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+            // 假唤醒或者被信号打断，下次再读
+        } else {
+            // n == 0 表示客户端断开了连接，n < 0 表示出错
+            CloseConn(cur);
+        }
+    }
+
+    // EPOLLOUT：接着发
+    void HandleWrite(int sockfd) {
+        Connection* conn = GetConn(sockfd);
+        if (!conn) return;
+        if (!Drain(conn)) {
+            CloseConn(conn);
+            return;
+        }
+        if (conn->HandedOff()) {
+            HandOff(conn);
+            return;
+        }
+        UpdateEvents(conn);
+    }
+
+    void FlushPending() {
+        for (int fd : pending_) {
+            Connection* conn = GetConn(fd);
+            if (!conn) continue; // 这一轮里已经被关掉了
+            if (!Drain(conn)) {
+                CloseConn(conn);
+                continue;
+            }
+            if (conn->HandedOff()) {
+                HandOff(conn);
+                continue;
+            }
+            UpdateEvents(conn);
+        }
+        pending_.clear();
+    }
+
+    // 把回复发出去；发得差不多了，之前因为高水位没执行的命令接着执行，直到写满或者执行完。
+    // 回复发出去之前先把 AOF 写掉（always 还要落盘），客户端看到 OK 的写一定已经在日志里了
+    bool Drain(Connection* conn) {
+        while (true) {
+            g_aof->Flush();
+            if (!conn->Flush()) return false;
+            wheel_.Touch(conn, conn->GetLastActiveTime()); // 发出去了也算活动（慢慢收大回复的客户端不踢）
+            if (!conn->Blocked() || !conn->WantRead()) return true;
+            if (!conn->Process()) {
+                g_aof->Flush();
+                conn->Flush();
+                return false;
+            }
+        }
+    }
+
+    // 根据连接的状态调整 epoll 事件：没发完就关注 EPOLLOUT，超过高水位就先不关注 EPOLLIN
+    void UpdateEvents(Connection* conn) {
+        uint32_t want = 0;
+        if (conn->WantRead()) want |= EPOLLIN;
+        if (conn->HasPendingOutput()) want |= EPOLLOUT;
+        if (want != conn->Events()) {
+            epoller_.ModFd(conn->GetFd(), want);
+            conn->SetEvents(want);
+        }
+    }
+
+    void CloseConn(Connection* conn) {
+        if (uring_) {
+            BeginClose(static_cast<UringConnection*>(conn), false);
+            return;
+        }
+        int fd = conn->GetFd();
+        wheel_.Remove(conn);
+        //从 Epoll 群里踢出去
+        epoller_.DelFd(fd);
+        conns_[fd] = nullptr;
+        //关闭 Socket（析构函数会自动 close）
+        CountSyscall();
+        CountStat(STAT_CLOSED);
+        delete conn;
+    }
+
+    // PSYNC：连接从 Reactor 上摘下来（不 close），没发完的回复连同 fd 一起交给复制线程
+    void HandOff(Connection* conn) {
+        int fd = conn->GetFd();
+        if (!uring_) {
+            wheel_.Remove(conn);
+            epoller_.DelFd(fd);
+        }
+        conns_[fd] = nullptr;
+        string pending = conn->TakeOutput();
+        const vector<string>& args = conn->HandoffArgs();
+        string replid = args.size() > 0 ? args[0] : "", offset = args.size() > 1 ? args[1] : "";
+        conn->ReleaseFd();
+        delete conn;
+        CountStat(STAT_CLOSED);
+        g_repl->AttachReplica(fd, std::move(pending), replid, offset);
+    }
+
+    // =====================================================================
+    // io_uring 后端
+    // user_data = fd << 8 | 操作类型，完成事件按它找回连接
+    // =====================================================================
+    enum UringOp { OP_ACCEPT = 1, OP_RECV, OP_SEND, OP_CANCEL };
+
+    static uint64_t UserData(int fd, UringOp op) { return static_cast<uint64_t>(fd) << 8 | op; }
+
+    void LoopUring() {
+        if (!ring_.Enable()) {
+            perror("io_uring enable");
+            stop_server = true;
+            return;
+        }
+        ring_.PrepAcceptMultishot(listenFd_, UserData(listenFd_, OP_ACCEPT));
+        while (!stop_server) {
+            // 提交上一轮攒下的 recv / send / cancel，顺便等完成事件；没事也至少 500ms 醒一次跑定时任务
+            ring_.SubmitAndWait(500);
+            uint64_t woke = CycleClock::Now();
+            unsigned n = ring_.ForEachCqe([this](const struct io_uring_cqe& cqe) { HandleCqe(cqe); });
+            KickIdle();
+            ActiveExpire();
+            if (id_ == 0) g_persistence->Cron();
+            g_repl->Wake();
+            FlushPendingUring();
+            EndCycle(static_cast<int>(n), woke);
+        }
+    }
+
+    void HandleCqe(const struct io_uring_cqe& cqe) {
+        int fd = static_cast<int>(cqe.user_data >> 8);
+        UringOp op = static_cast<UringOp>(cqe.user_data & 0xff);
+        bool more = cqe.flags & IORING_CQE_F_MORE;
+        if (op == OP_ACCEPT) {
+            if (cqe.res >= 0) AcceptUring(cqe.res);
+            // multishot accept 停了（出错 / 队列溢出）就重新提交一个
+            if (!more) ring_.PrepAcceptMultishot(listenFd_, cqe.user_data);
+            return;
+        }
+        if (op == OP_CANCEL) return;
+        UringConnection* conn = static_cast<UringConnection*>(GetConn(fd));
+        if (!conn) return;
+
+        if (op == OP_RECV) {
+            if (!more) {
+                conn->recvArmed = false;
+                conn->cancelSent = false;
+            }
+            if (cqe.res > 0) {
+                uint16_t bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                if (!conn->closing) conn->Feed(ring_.BufferAt(bid), static_cast<size_t>(cqe.res));
+                ring_.RecycleBuffer(bid);
+                if (!conn->closing) {
+                    wheel_.Touch(conn, conn->GetLastActiveTime());
+                    if (!conn->Process() || conn->HandedOff()) BeginClose(conn, true);
+                }
+            } else if (cqe.res != -ENOBUFS && cqe.res != -ECANCELED) {
+                // 0：对端关了；其它：出错。ENOBUFS（缓冲区暂时用完了）/ ECANCELED（我们自己取消的）之后重新提交
+                BeginClose(conn, false);
+            }
+        } else if (op == OP_SEND) {
+            conn->sending = false;
+            if (cqe.res <= 0) {
+                conn->flushOnClose = false;
+                BeginClose(conn, false);
+            } else {
+                conn->OutputSent(static_cast<size_t>(cqe.res));
+                if (!conn->closing) {
+                    wheel_.Touch(conn, conn->GetLastActiveTime()); // 发出去了也算活动
+                    // 之前因为高水位停下的命令接着执行
+                    if (conn->Blocked() && conn->WantRead() && !conn->Process()) BeginClose(conn, true);
+                }
+            }
+        }
+        Queue(conn);
+    }
+
+    void AcceptUring(int fd) {
+        set_nodelay(fd);
+        UringConnection* conn = new UringConnection(fd);
+        CountStat(STAT_ACCEPTED);
+        if (static_cast<size_t>(fd) >= conns_.size()) conns_.resize(fd + 1, nullptr);
+        conns_[fd] = conn;
+        wheel_.Touch(conn, conn->GetLastActiveTime());
+        ring_.PrepRecvMultishot(fd, UserData(fd, OP_RECV));
+        conn->recvArmed = true;
+    }
+
+    // 这一轮要看一眼的连接（发回复、重新提交 recv、暂停读、关掉）
+    void Queue(UringConnection* conn) {
+        if (conn->queued) return;
+        conn->queued = true;
+        pending_.push_back(conn->GetFd());
+    }
+
+    /**
+     * 这一轮的收尾：先把 AOF 写掉（和 epoll 一样，回复发出去之前写命令一定已经在日志里了），
+     * 再给每个有回复的连接准备一个 sendmsg；这些 sqe 都攒着，下一次 SubmitAndWait 一起提交。
+     * 顺便按高水位暂停 / 恢复 recv，把收尾完的连接 delete 掉。
+     */
+    void FlushPendingUring() {
+        if (pending_.empty()) return;
+        g_aof->Flush();
+        for (int fd : pending_) {
+            UringConnection* conn = static_cast<UringConnection*>(GetConn(fd));
+            if (!conn) continue;
+            conn->queued = false;
+            bool send = !conn->closing || conn->flushOnClose;
+            if (send && !conn->sending && conn->HasPendingOutput()) {
+                int cnt = conn->GatherOutput(conn->iov, UringConnection::MAX_IOV);
+                conn->msg.msg_iov = conn->iov;
+                conn->msg.msg_iovlen = cnt;
+                ring_.PrepSendmsg(fd, &conn->msg, UserData(fd, OP_SEND));
+                conn->sending = true;
+            }
+            if (conn->closing) {
+                if (conn->recvArmed && !conn->cancelSent) CancelRecv(conn);
+                if (!conn->recvArmed && !conn->sending) DestroyUring(conn);
+                continue;
+            }
+            bool want = conn->WantRead();
+            if (want && !conn->recvArmed) {
+                ring_.PrepRecvMultishot(fd, UserData(fd, OP_RECV));
+                conn->recvArmed = true;
+            } else if (!want && conn->recvArmed && !conn->cancelSent) {
+                CancelRecv(conn); // 超过高水位：先不收了，降下来再重新提交
+            }
+        }
+        pending_.clear();
+    }
+
+    void CancelRecv(UringConnection* conn) {
+        ring_.PrepCancel(UserData(conn->GetFd(), OP_RECV), UserData(conn->GetFd(), OP_CANCEL));
+        conn->cancelSent = true;
+    }
+
+    // 开始关连接：flush 为 true 时剩下的回复先发完。真正的 delete 等 recv / send 都结束
+    void BeginClose(UringConnection* conn, bool flush) {
+        if (conn->closing) return;
+        conn->closing = true;
+        conn->flushOnClose = flush;
+        wheel_.Remove(conn);
+        if (!flush && conn->sending) {
+            ring_.PrepCancel(UserData(conn->GetFd(), OP_SEND), UserData(conn->GetFd(), OP_CANCEL));
+        }
+        Queue(conn);
+    }
+
+    void DestroyUring(UringConnection* conn) {
+        if (conn->HandedOff()) { // recv / send 都结束了，fd 可以交出去了
+            HandOff(conn);
+            return;
+        }
+        conns_[conn->GetFd()] = nullptr;
+        CountSyscall(); // close
+        CountStat(STAT_CLOSED);
+        delete conn;
+    }
+
+    // 一圈事件循环结束：events 是这一圈处理的就绪 / 完成事件数，woke 是 wait 返回的时刻。
+    // 0 号线程顺便每 100ms 给 INFO 的瞬时值（ops/sec、kbps）采一次样
+    void EndCycle(int events, uint64_t woke) {
+        ThreadStats& stats = LocalStats();
+        stats.Add(STAT_LOOP_CYCLES, 1);
+        if (events > 0) {
+            stats.Add(STAT_LOOP_WAKEUPS, 1);
+            stats.Add(STAT_LOOP_EVENTS, events);
+        }
+        stats.Add(STAT_LOOP_BUSY, CycleClock::Now() - woke);
+        if (id_ != 0) return;
+        auto now = chrono::steady_clock::now();
+        if (now - lastSample_ < chrono::milliseconds(static_cast<int>(StatsRegistry::SAMPLE_INTERVAL_MS))) return;
+        lastSample_ = now;
+        StatsRegistry::Instance().Sample(static_cast<int>(kCommandCount));
+    }
+
+    // 主动过期：每个线程负责 id_、id_ + 线程数、... 这几个分片，各自限时，不会连着卡住请求太久。
+    // 最多隔 500ms（epoll 超时）跑一次，忙的时候每 100ms 一次
+    void ActiveExpire() {
+        auto now = chrono::steady_clock::now();
+        if (now - lastExpire_ < chrono::milliseconds(EXPIRE_CYCLE_MS)) return;
+        lastExpire_ = now;
+        for (int s = id_; s < g_store->ShardCount(); s += g_config.threads) {
+            g_store->ActiveExpireCycle(s, EXPIRE_CYCLE_BUDGET_US);
+        }
+    }
+
+    // 时间轮转到当前这一秒，只碰这一秒到期的连接：(当前时间 - 最后活跃时间) 超过 TIMEOUT 秒就踢掉
+    void KickIdle() {
+        wheel_.Advance(time(nullptr), [this](TimerNode* n) {
+            //cout << "[Timeout] Kicking client: " << static_cast<Connection*>(n)->GetFd() << endl;
+            CloseConn(static_cast<Connection*>(n));
+        });
+    }
+};
+
+#endif
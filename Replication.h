@@ -0,0 +1,908 @@
+#ifndef REPLICATION_H
+#define REPLICATION_H
+
+/**
+ * Replication.h
+ * 主从复制（异步，和 Redis 的 PSYNC 一个思路）。从库只读，用来分担读请求。
+ *
+ * 主库：
+ *   - KVStore 在分片锁里把每个写操作交给 Feed()（和 AOF 同一个入口，已经是“效果”：SET 带绝对过期时间、过期删除记成 DEL），
+ *     编码成 RESP 先追加到这个分片自己的暂存区（只拿暂存区的小锁，不同分片的写互不等待）；
+ *     复制线程被叫醒后（分片锁外）把各暂存区搬进复制积压环（backlog，固定大小，--repl-backlog-size）和每个从库自己的输出缓冲区。
+ *     每个 key 只在一个分片里，同一分片的写在暂存区里保持执行顺序，所以流里同一个 key 的写顺序和主库一致，
+ *     不同分片的写谁先谁后都一样（每条命令只碰一个 key）。整条流的字节数就是复制偏移量（master_repl_offset）。
+ *   - 从库发 PSYNC <replid> <offset>：replid 对得上、offset 还在积压环里，就回 +CONTINUE 把缺的那段补给它（部分同步）；
+ *     否则 +FULLRESYNC <replid> <offset>：Persistence fork 一个子进程写快照（和 BGSAVE 一样），fork 那一刻（拿着所有分片锁）
+ *     记下偏移量、开始给这个从库攒命令，快照写完用 sendfile 发过去（"$<长度>\r\n" + 文件内容），后面接着发攒下的命令。
+ *   - 从库的 socket 从 Reactor 上摘下来交给复制线程，写路径只往内存里追加，不碰 socket，慢从库拖不住主库；
+ *     某个从库攒下的没发出去的数据超过 --repl-output-limit 就断开它（重连以后部分同步或者全量同步）。
+ *   - 复制线程每 10 秒往流里插一个 PING，从库每秒回 REPLCONF ACK <offset>，超过 --repl-timeout 秒没消息就断开。
+ *
+ * 从库（REPLICAOF host port，或者启动参数 --replicaof "host port"）：
+ *   - 一个后台线程连主库：PING、REPLCONF、PSYNC；全量同步时把快照收进临时文件，清空数据再加载（加载期间别的命令回 -LOADING），
+ *     之后按顺序重放命令流（走命令表，和 AOF 重放一样），记下处理到的偏移量，断线重连时用它做部分同步。
+ *   - 客户端的写命令回 -READONLY；从库自己不再往下级从库复制（不支持级联）。
+ *   - REPLICAOF NO ONE 变回主库，换一个新的 replid。
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <random>
+#include <algorithm>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include "Config.h"
+#include "KVStore.h"
+#include "Aof.h"
+#include "Buffer.h"
+#include "RespParser.h"
+#include "Slice.h"
+#include "Stats.h"
+
+using namespace std;
+
+extern KVStore* g_store;
+extern Aof* g_aof;
+extern atomic<bool> stop_server;
+
+class Replication {
+public:
+    static constexpr const char* SNAPSHOT_PATH = "repl-snapshot.db"; // 主库：给从库全量同步写的快照
+    static constexpr const char* TRANSFER_PATH = "repl-transfer.tmp"; // 从库：收快照的临时文件
+    static const int PING_PERIOD = 10;       // 主库每隔几秒往流里插一个 PING
+    static const int ACK_PERIOD_MS = 1000;   // 从库多久回一次 REPLCONF ACK
+
+    Replication()
+        : replid_(NewReplid()), offset_(0), active_(false), wake_(false), wantSnapshot_(false), efd_(-1), feed_(nullptr),
+          replica_(false), loading_(false), linkUp_(false), syncing_(false), masterPort_(0), gen_(0), linkFd_(-1),
+          processed_(0), lastIo_(0), rewriteAof_(false), stop_(false) {}
+
+    ~Replication() { Shutdown(); }
+
+    // 起两个后台线程：主库这边发数据的，从库这边连主库的（没设主库时就等着）。
+    // feed 是第一次有从库要同步时装到 KVStore 上的 FeedFn（会调到 Feed），没有从库时写路径不用拼命令
+    void Start(ReplayFn replay, FeedFn feed) {
+        replay_ = replay;
+        feed_ = feed;
+        efd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (efd_ < 0) {
+            perror("eventfd");
+            exit(1);
+        }
+        for (int i = 0; i < g_store->ShardCount(); ++i) staging_.push_back(new Staging());
+        senderThread_ = thread([this]() { SenderLoop(); });
+        clientThread_ = thread([this]() { ClientLoop(); });
+    }
+
+    // 退出前：停掉两个线程，断开所有从库
+    void Shutdown() {
+        {
+            lock_guard<mutex> lock(clientMtx_);
+            if (stop_) return;
+            stop_ = true;
+            int fd = linkFd_.load();
+            if (fd >= 0) shutdown(fd, SHUT_RDWR);
+        }
+        clientCv_.notify_all();
+        WakeSender();
+        if (clientThread_.joinable()) clientThread_.join();
+        if (senderThread_.joinable()) senderThread_.join();
+        for (ReplicaLink* r : replicas_) Close(r);
+        replicas_.clear();
+        for (Staging* st : staging_) delete st;
+        staging_.clear();
+        if (efd_ >= 0) close(efd_);
+        efd_ = -1;
+    }
+
+    // ============================ 主库 ============================
+
+    // 在分片锁里调用（KVStore 的 FeedFn）。还没有从库连过来时积压环没开，直接返回，写路径上只多读一个原子变量；
+    // 开了就编码进这个分片的暂存区，不拿 mtx_，由复制线程搬进积压环
+    void Feed(int shard, const Slice* argv, int argc) {
+        if (!active_.load(memory_order_acquire)) return;
+        Staging* st = staging_[shard];
+        lock_guard<mutex> lock(st->mtx);
+        AppendCommand(&st->buf, argv, argc);
+        wake_.store(true, memory_order_release);
+    }
+
+    // Reactor 每轮循环末尾调一次：这一轮有新数据就叫醒复制线程（一轮最多一次 write，不是每条命令一次）
+    void Wake() {
+        if (wake_.load(memory_order_relaxed) && wake_.exchange(false, memory_order_acq_rel)) WakeSender();
+    }
+
+    /**
+     * PSYNC 之后 Reactor 把连接交过来：pending 是这个连接还没发出去的回复，先发；
+     * replid / offset 是从库带来的，能部分同步就部分同步，否则排队等下一次 fork。
+     */
+    void AttachReplica(int fd, string&& pending, const string& replid, const string& offset) {
+        int flags = fcntl(fd, F_GETFL);
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+        ReplicaLink* r = new ReplicaLink(fd, PeerName(fd));
+        r->sending = std::move(pending);
+        r->lastIo = time(nullptr);
+        char* end = nullptr;
+        long long want = strtoll(offset.c_str(), &end, 10);
+        {
+            lock_guard<mutex> lock(mtx_);
+            uint64_t first = offset_ - backlog_.histlen;
+            if (active_ && replid == replid_ && *end == '\0' && want >= 0 && static_cast<uint64_t>(want) >= first &&
+                static_cast<uint64_t>(want) <= offset_) {
+                r->sending += "+CONTINUE " + replid_ + "\r\n";
+                CopyBacklog(static_cast<uint64_t>(want), &r->sending);
+                r->state = ONLINE;
+                r->ackOffset = static_cast<uint64_t>(want);
+                cout << "[Replication] Partial resynchronization with " << r->addr << " from offset " << want
+                     << " (" << offset_ - want << " bytes)" << endl;
+            } else {
+                r->state = WAIT_FORK;
+                wantSnapshot_ = true;
+                cout << "[Replication] Full resynchronization requested by " << r->addr << endl;
+            }
+            replicas_.push_back(r);
+        }
+        WakeSender();
+    }
+
+    // Persistence::Cron 问：有从库在等全量同步的快照
+    bool WantSnapshot() const { return wantSnapshot_.load(memory_order_acquire); }
+
+    /**
+     * fork 前、拿着所有分片锁时调用（这时没有写操作在进行）：等着的从库从这个偏移量开始攒命令。
+     * 积压环也在这时候打开，保证 fork 之后的每个写都进了流
+     */
+    void SnapshotForked() {
+        lock_guard<mutex> lock(mtx_);
+        wantSnapshot_ = false;
+        DrainLocked(); // fork 之前的写都进流，offset_ 正好切在 fork 这一刻
+        if (!active_) {
+            backlog_.Resize(g_config.repl_backlog_size);
+            active_.store(true, memory_order_release);
+            g_store->SetFeed(feed_); // 拿着所有分片锁，换 feed 是安全的
+        }
+        for (ReplicaLink* r : replicas_) {
+            if (r->state != WAIT_FORK) continue;
+            r->state = WAIT_SNAPSHOT;
+            r->syncOffset = offset_;
+        }
+    }
+
+    // 快照子进程结束（或者 fork 失败）：成功就交给等着的从库发，失败就断开它们，让它们重连再来
+    void SnapshotDone(bool ok) {
+        int fd = ok ? open(SNAPSHOT_PATH, O_RDONLY | O_CLOEXEC) : -1;
+        struct stat st;
+        if (fd >= 0 && fstat(fd, &st) != 0) {
+            close(fd);
+            fd = -1;
+        }
+        unlink(SNAPSHOT_PATH); // 打开着的 fd 还能读
+        {
+            lock_guard<mutex> lock(mtx_);
+            for (ReplicaLink* r : replicas_) {
+                if (r->state != WAIT_SNAPSHOT) continue;
+                if (fd < 0) {
+                    r->kill = true;
+                    continue;
+                }
+                r->state = SEND_SNAPSHOT;
+                r->snapFd = dup(fd);
+                r->snapSize = st.st_size;
+                r->header = "+FULLRESYNC " + replid_ + " " + to_string(r->syncOffset) + "\r\n$" +
+                            to_string(st.st_size) + "\r\n";
+            }
+        }
+        if (fd >= 0) close(fd);
+        else cerr << "[Replication] Snapshot for full resynchronization failed" << endl;
+        WakeSender();
+    }
+
+    // ============================ 从库 ============================
+
+    bool IsReplica() const { return replica_.load(memory_order_relaxed); }
+    bool Loading() const { return loading_.load(memory_order_relaxed); }
+
+    // REPLICAOF host port：断开当前的主库（如果有），之后由后台线程去连新的。已经连着的下级从库全部断开
+    void ReplicaOf(const string& host, int port) {
+        {
+            lock_guard<mutex> lock(clientMtx_);
+            masterHost_ = host;
+            masterPort_ = port;
+            gen_++;
+            replica_ = true;
+            int fd = linkFd_.load();
+            if (fd >= 0) shutdown(fd, SHUT_RDWR);
+        }
+        {
+            lock_guard<mutex> lock(mtx_);
+            for (ReplicaLink* r : replicas_) r->kill = true;
+            active_ = false; // 不做级联复制，变回主库时再重新开
+            backlog_.Resize(0);
+        }
+        WakeSender();
+        clientCv_.notify_all();
+        cout << "[Replication] Replica of " << host << ":" << port << endl;
+    }
+
+    // REPLICAOF NO ONE：变回主库。新的 replid，之前同步过的从库都得全量同步
+    void ReplicaOfNoOne() {
+        {
+            lock_guard<mutex> lock(clientMtx_);
+            if (!replica_) return;
+            masterHost_.clear();
+            masterReplid_.clear(); // 当主库期间自己也有写，以后再当从库只能全量同步
+            gen_++;
+            replica_ = false;
+            int fd = linkFd_.load();
+            if (fd >= 0) shutdown(fd, SHUT_RDWR);
+        }
+        {
+            lock_guard<mutex> lock(mtx_);
+            replid_ = NewReplid();
+        }
+        clientCv_.notify_all();
+        cout << "[Replication] Promoted to master" << endl;
+    }
+
+    // 全量同步加载完以后 AOF 里还有清空前的数据，让 Persistence::Cron 安排一次重写
+    bool TakeAofRewriteRequest() { return rewriteAof_.exchange(false); }
+
+    // INFO replication
+    void Info(string* info) {
+        time_t now = time(nullptr);
+        if (IsReplica()) {
+            lock_guard<mutex> lock(clientMtx_);
+            *info += "role:slave\r\n";
+            *info += "master_host:" + masterHost_ + "\r\n";
+            *info += "master_port:" + to_string(masterPort_) + "\r\n";
+            *info += string("master_link_status:") + (linkUp_ ? "up" : "down") + "\r\n";
+            time_t last = lastIo_.load();
+            *info += "master_last_io_seconds_ago:" + to_string(linkUp_ && last ? now - last : -1) + "\r\n";
+            *info += string("master_sync_in_progress:") + (syncing_ ? "1" : "0") + "\r\n";
+            *info += "slave_repl_offset:" + to_string(processed_.load()) + "\r\n";
+            *info += "master_replid:" + masterReplid_ + "\r\n";
+            return;
+        }
+        lock_guard<mutex> lock(mtx_);
+        DrainLocked();
+        *info += "role:master\r\n";
+        *info += "connected_slaves:" + to_string(replicas_.size()) + "\r\n";
+        for (size_t i = 0; i < replicas_.size(); ++i) {
+            ReplicaLink* r = replicas_[i];
+            size_t colon = r->addr.rfind(':');
+            *info += "slave" + to_string(i) + ":ip=" + r->addr.substr(0, colon) + ",port=" + r->addr.substr(colon + 1) +
+                     ",state=" +
+                     StateName(r->state) + ",offset=" + to_string(r->ackOffset) + ",lag=" + to_string(now - r->lastAck) +
+                     "\r\n";
+        }
+        *info += "master_replid:" + replid_ + "\r\n";
+        *info += "master_repl_offset:" + to_string(offset_) + "\r\n";
+        *info += string("repl_backlog_active:") + (active_ ? "1" : "0") + "\r\n";
+        *info += "repl_backlog_size:" + to_string(g_config.repl_backlog_size) + "\r\n";
+        *info += "repl_backlog_first_byte_offset:" + to_string(offset_ - backlog_.histlen) + "\r\n";
+        *info += "repl_backlog_histlen:" + to_string(backlog_.histlen) + "\r\n";
+    }
+
+    // 一条命令编码成 RESP 数组（MIGRATE 发给目标节点也用它）
+    static void AppendCommand(string* out, const Slice* argv, int argc) {
+        char head[32];
+        out->append(head, snprintf(head, sizeof(head), "*%d\r\n", argc));
+        for (int i = 0; i < argc; ++i) {
+            out->append(head, snprintf(head, sizeof(head), "$%zu\r\n", argv[i].size()));
+            out->append(argv[i].data(), argv[i].size());
+            out->append("\r\n", 2);
+        }
+    }
+
+private:
+    // 一个从库在主库这边的状态
+    enum LinkState {
+        WAIT_FORK,     // 等下一次 fork（还没开始攒命令）
+        WAIT_SNAPSHOT, // 已经 fork 了，子进程在写快照，命令先攒着
+        SEND_SNAPSHOT, // 在发快照
+        ONLINE         // 快照发完了（或者部分同步），跟着命令流
+    };
+
+    static const char* StateName(LinkState s) {
+        switch (s) {
+        case WAIT_FORK:
+        case WAIT_SNAPSHOT: return "wait_bgsave";
+        case SEND_SNAPSHOT: return "send_bulk";
+        default: return "online";
+        }
+    }
+
+    struct ReplicaLink {
+        int fd;
+        string addr;
+        atomic<LinkState> state;  // 在 mtx_ 里改，复制线程不拿锁也会看一眼
+        atomic<bool> kill;        // 要断开（超过输出上限 / 快照失败 / 本机变成从库），由复制线程去关
+        uint64_t syncOffset = 0;  // 全量同步：fork 时的偏移量
+        uint64_t ackOffset = 0;   // 从库最近一次 ACK 的偏移量
+        time_t lastAck = 0;
+        string out;               // 写路径追加的命令（mtx_ 保护）
+        // 下面的只有复制线程碰（header / snapFd / snapSize 在交给复制线程之前由 SnapshotDone 在锁里设好）
+        string sending;           // 正在发的数据
+        size_t sendPos = 0;
+        string header;            // +FULLRESYNC ... $<len>
+        int snapFd = -1;
+        off_t snapPos = 0;
+        off_t snapSize = 0;
+        bool snapStarted = false;
+        time_t lastIo = 0;        // 最近一次收到从库的数据
+        Buffer in;
+        RespParser parser;
+
+        ReplicaLink(int f, const string& a) : fd(f), addr(a), state(WAIT_FORK), kill(false), in(1024) {}
+    };
+
+    // 一个分片的暂存区：Feed 在分片锁里往 buf 追加，复制线程拿 mtx_ 以后换走
+    struct Staging {
+        mutex mtx;
+        string buf;
+    };
+
+    // 复制积压环：最近 size 字节的命令流，偏移量 o 的字节在 data[o % size]
+    struct Backlog {
+        vector<char> data;
+        uint64_t histlen = 0;
+
+        void Resize(size_t size) {
+            vector<char>(size).swap(data);
+            histlen = 0;
+        }
+    };
+
+    // ---------------- 主库 ----------------
+
+    string replid_;             // 这条复制流的 id（40 个十六进制字符），变回主库时换一个
+    uint64_t offset_;           // master_repl_offset：流里一共写过多少字节
+    Backlog backlog_;
+    atomic<bool> active_;       // 积压环开着（有从库同步过），Feed 才干活
+    atomic<bool> wake_;         // 有新数据，复制线程该醒了
+    atomic<bool> wantSnapshot_;
+    mutex mtx_;                 // 保护上面这些和 replicas_（SnapshotForked 在分片锁里拿它，所以拿着它时不能再拿分片锁）
+    vector<ReplicaLink*> replicas_;
+    vector<Staging*> staging_;  // 每个分片一个（Start 时建好，之后不变）；锁顺序 分片锁 -> mtx_ -> Staging::mtx
+    string scratch_;
+    int efd_;                   // 叫醒复制线程的 eventfd
+    FeedFn feed_;
+    thread senderThread_;
+
+    // ---------------- 从库 ----------------
+
+    atomic<bool> replica_;
+    atomic<bool> loading_;
+    atomic<bool> linkUp_;
+    atomic<bool> syncing_;
+    mutex clientMtx_;           // 保护 masterHost_ / masterPort_ / gen_ / masterReplid_ / stop_
+    condition_variable clientCv_;
+    string masterHost_;
+    int masterPort_;
+    uint64_t gen_;              // 每次 REPLICAOF 加一，后台线程发现变了就断开重来
+    atomic<int> linkFd_;        // 连主库的 socket，REPLICAOF 时 shutdown 它把后台线程从 recv 里叫出来
+    string masterReplid_;       // 主库的 replid 和处理到的偏移量：断线重连时做部分同步
+    atomic<uint64_t> processed_;
+    atomic<time_t> lastIo_;
+    atomic<bool> rewriteAof_;
+    ReplayFn replay_;
+    thread clientThread_;
+    bool stop_;
+
+    static string NewReplid() {
+        random_device rd;
+        mt19937_64 rng((static_cast<uint64_t>(rd()) << 32) ^ rd() ^ static_cast<uint64_t>(time(nullptr)));
+        static const char* hex = "0123456789abcdef";
+        string id(40, '0');
+        for (char& c : id) c = hex[rng() & 15];
+        return id;
+    }
+
+    static string PeerName(int fd) {
+        struct sockaddr_in addr;
+        socklen_t len = sizeof(addr);
+        char ip[INET_ADDRSTRLEN] = "?";
+        if (getpeername(fd, reinterpret_cast<struct sockaddr*>(&addr), &len) == 0) {
+            inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+            return string(ip) + ":" + to_string(ntohs(addr.sin_port));
+        }
+        return "?:0";
+    }
+
+    // 拿着 mtx_：追加到积压环和每个在攒命令的从库，超过输出上限的从库标记断开
+    void AppendLocked(const string& s) {
+        size_t size = backlog_.data.size();
+        const char* p = s.data();
+        size_t n = s.size();
+        if (n > size) { // 一条命令比整个环还大：只留最后 size 字节
+            p += n - size;
+            offset_ += n - size;
+            n = size;
+        }
+        while (n > 0) {
+            size_t pos = offset_ % size;
+            size_t m = min(n, size - pos);
+            memcpy(&backlog_.data[pos], p, m);
+            p += m;
+            n -= m;
+            offset_ += m;
+        }
+        backlog_.histlen = min<uint64_t>(backlog_.histlen + s.size(), size);
+        for (ReplicaLink* r : replicas_) {
+            if (r->state == WAIT_FORK || r->kill) continue;
+            r->out += s;
+            if (r->out.size() > g_config.repl_output_limit) {
+                cerr << "[Replication] Replica " << r->addr << " exceeded the output buffer limit ("
+                     << g_config.repl_output_limit << " bytes), disconnecting" << endl;
+                r->kill = true;
+                string().swap(r->out);
+            }
+        }
+        wake_.store(true, memory_order_release);
+    }
+
+    // 拿着 mtx_：各分片暂存区里的命令按分片依次搬进流。换走暂存区也在 mtx_ 里，两次搬运不会交错。
+    // 积压环没开（本机变成了从库）就直接扔掉
+    void DrainLocked() {
+        for (Staging* st : staging_) {
+            {
+                lock_guard<mutex> lock(st->mtx);
+                if (st->buf.empty()) continue;
+                scratch_.clear();
+                scratch_.swap(st->buf); // 换回去的是清空的旧缓冲区，容量留着下次用
+            }
+            if (active_.load(memory_order_relaxed)) AppendLocked(scratch_);
+        }
+    }
+
+    // 拿着 mtx_：积压环里从偏移量 from 到最新的数据
+    void CopyBacklog(uint64_t from, string* out) {
+        size_t size = backlog_.data.size();
+        for (uint64_t o = from; o < offset_;) {
+            size_t pos = o % size;
+            size_t m = min<uint64_t>(offset_ - o, size - pos);
+            out->append(&backlog_.data[pos], m);
+            o += m;
+        }
+    }
+
+    void WakeSender() {
+        uint64_t one = 1;
+        ssize_t n = write(efd_, &one, sizeof(one));
+        (void)n;
+    }
+
+    void Close(ReplicaLink* r) {
+        if (r->snapFd >= 0) close(r->snapFd);
+        close(r->fd);
+        delete r;
+    }
+
+    /**
+     * 复制线程：poll 所有从库的 socket。能写就发（先发 sending，再发快照，再把 out 换过来发），
+     * 能读就收 REPLCONF ACK；被标记断开的、出错的、超时的关掉。写路径追加数据后通过 eventfd 叫醒它
+     */
+    void SenderLoop() {
+        time_t lastPing = time(nullptr);
+        vector<struct pollfd> fds;
+        vector<ReplicaLink*> links;
+        while (true) {
+            {
+                lock_guard<mutex> lock(clientMtx_);
+                if (stop_) return;
+            }
+            time_t now = time(nullptr);
+            if (now - lastPing >= PING_PERIOD) {
+                lastPing = now;
+                lock_guard<mutex> lock(mtx_);
+                DrainLocked();
+                if (active_ && !replicas_.empty()) {
+                    Slice ping("PING");
+                    scratch_.clear();
+                    AppendCommand(&scratch_, &ping, 1);
+                    AppendLocked(scratch_);
+                }
+            }
+            {
+                lock_guard<mutex> lock(mtx_);
+                DrainLocked();
+                links = replicas_;
+            }
+            fds.clear();
+            fds.push_back(pollfd{efd_, POLLIN, 0});
+            for (ReplicaLink* r : links) {
+                bool alive = !r->kill && Pump(r);
+                if (alive && r->state == ONLINE && now - r->lastIo > g_config.repl_timeout) {
+                    cerr << "[Replication] Replica " << r->addr << " timed out" << endl;
+                    alive = false;
+                }
+                if (!alive) {
+                    Drop(r);
+                    continue;
+                }
+                short ev = POLLIN;
+                if (r->sendPos < r->sending.size() || (r->snapStarted && r->snapFd >= 0)) ev |= POLLOUT;
+                fds.push_back(pollfd{r->fd, ev, 0});
+            }
+            CountSyscall();
+            int n = poll(fds.data(), fds.size(), 100);
+            if (n <= 0) continue;
+            if (fds[0].revents & POLLIN) {
+                uint64_t v;
+                ssize_t m = read(efd_, &v, sizeof(v));
+                (void)m;
+            }
+            for (size_t i = 1; i < fds.size(); ++i) {
+                if (!(fds[i].revents & (POLLIN | POLLERR | POLLHUP))) continue;
+                ReplicaLink* r = nullptr;
+                {
+                    lock_guard<mutex> lock(mtx_);
+                    for (ReplicaLink* x : replicas_) {
+                        if (x->fd == fds[i].fd) r = x;
+                    }
+                }
+                if (r && !ReadAcks(r)) Drop(r);
+            }
+        }
+    }
+
+    // 尽量往从库发数据，发到 EAGAIN 或者没东西可发为止。返回 false 表示连接出错
+    bool Pump(ReplicaLink* r) {
+        while (true) {
+            if (r->sendPos < r->sending.size()) {
+                CountSyscall();
+                ssize_t n = send(r->fd, r->sending.data() + r->sendPos, r->sending.size() - r->sendPos, MSG_NOSIGNAL);
+                if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+                r->sendPos += n;
+                continue;
+            }
+            r->sending.clear();
+            r->sendPos = 0;
+            if (r->snapStarted && r->snapFd >= 0) {
+                if (r->snapPos < r->snapSize) {
+                    CountSyscall();
+                    ssize_t n = sendfile(r->fd, r->snapFd, &r->snapPos, min<off_t>(r->snapSize - r->snapPos, 1 << 20));
+                    if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+                    if (n == 0) return false; // 文件比说好的短
+                    continue;
+                }
+                close(r->snapFd);
+                r->snapFd = -1;
+                r->lastIo = time(nullptr);
+                lock_guard<mutex> lock(mtx_);
+                r->state = ONLINE;
+                r->ackOffset = r->syncOffset;
+                r->lastAck = r->lastIo;
+                cout << "[Replication] Synchronization with replica " << r->addr << " succeeded" << endl;
+                continue;
+            }
+            lock_guard<mutex> lock(mtx_);
+            if (r->state == SEND_SNAPSHOT && !r->snapStarted) {
+                r->snapStarted = true;
+                r->sending.swap(r->header);
+                continue;
+            }
+            if (r->state != ONLINE || r->out.empty()) return true;
+            r->sending.swap(r->out);
+        }
+    }
+
+    // 从库发来的数据：只认 REPLCONF ACK <offset>，别的忽略。返回 false 表示对端关了 / 出错
+    bool ReadAcks(ReplicaLink* r) {
+        ssize_t n = r->in.ReadFd(r->fd);
+        if (n == 0) return false;
+        if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        r->lastIo = time(nullptr);
+        while (true) {
+            RespParser::Result res = r->parser.Parse(r->in);
+            if (res == RespParser::PARSE_ERROR) return false;
+            if (res != RespParser::PARSE_OK) break;
+            const vector<Slice>& a = r->parser.Args();
+            if (a.size() == 3 && ArgEquals(a[0], "replconf") && ArgEquals(a[1], "ack")) {
+                lock_guard<mutex> lock(mtx_);
+                r->ackOffset = strtoull(a[2].ToString().c_str(), nullptr, 10);
+                r->lastAck = r->lastIo;
+            }
+            r->parser.Next();
+            r->parser.Consume(r->in);
+        }
+        r->in.Shrink();
+        return true;
+    }
+
+    void Drop(ReplicaLink* r) {
+        {
+            lock_guard<mutex> lock(mtx_);
+            replicas_.erase(std::remove(replicas_.begin(), replicas_.end(), r), replicas_.end());
+        }
+        cout << "[Replication] Connection with replica " << r->addr << " lost" << endl;
+        Close(r);
+    }
+
+    static bool ArgEquals(const Slice& a, const char* s) {
+        size_t n = strlen(s);
+        return a.size() == n && strncasecmp(a.data(), s, n) == 0;
+    }
+
+    // ---------------- 从库 ----------------
+
+    // 后台线程：设了主库就一直连着，断了隔一秒重连；REPLICAOF 换主库 / NO ONE 时 gen_ 变了，断开重来
+    void ClientLoop() {
+        unique_lock<mutex> lock(clientMtx_);
+        while (!stop_) {
+            if (masterHost_.empty()) {
+                clientCv_.wait(lock);
+                continue;
+            }
+            string host = masterHost_;
+            int port = masterPort_;
+            uint64_t gen = gen_;
+            lock.unlock();
+            SyncWithMaster(host, port, gen);
+            linkUp_ = false;
+            syncing_ = false;
+            lock.lock();
+            if (!stop_ && gen == gen_) clientCv_.wait_for(lock, chrono::seconds(1));
+        }
+    }
+
+    bool Cancelled(uint64_t gen) {
+        lock_guard<mutex> lock(clientMtx_);
+        return stop_ || gen != gen_;
+    }
+
+    // 连主库：阻塞 socket，收发都设 1 秒超时，方便中途检查 gen / stop
+    int Connect(const string& host, int port) {
+        struct addrinfo hints, *res = nullptr;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(host.c_str(), to_string(port).c_str(), &hints, &res) != 0 || !res) return -1;
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+        freeaddrinfo(res);
+        if (fd < 0) return -1;
+        struct timeval tv = {1, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        return fd;
+    }
+
+    bool SendAll(int fd, const string& s) {
+        size_t off = 0;
+        while (off < s.size()) {
+            ssize_t n = send(fd, s.data() + off, s.size() - off, MSG_NOSIGNAL);
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) continue;
+            if (n <= 0) return false;
+            off += n;
+        }
+        return true;
+    }
+
+    bool SendCommand(int fd, const vector<string>& args) {
+        vector<Slice> argv(args.begin(), args.end());
+        string s;
+        AppendCommand(&s, argv.data(), static_cast<int>(argv.size()));
+        return SendAll(fd, s);
+    }
+
+    // 读一次 socket。超时（1 秒没数据）返回 0 并把 *timeout 置 true；对端关了 / 出错返回 -1
+    ssize_t ReadSome(int fd, Buffer& buf, bool* timeout) {
+        *timeout = false;
+        ssize_t n = buf.ReadFd(fd);
+        if (n > 0) {
+            lastIo_ = time(nullptr);
+            return n;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            *timeout = true;
+            return 0;
+        }
+        return -1;
+    }
+
+    // 握手阶段读一行回复（不带 \r\n），repl-timeout 秒内没读到算失败
+    bool ReadLine(int fd, Buffer& buf, uint64_t gen, string* line) {
+        time_t start = time(nullptr);
+        while (true) {
+            const char* p = buf.Peek();
+            const char* crlf = static_cast<const char*>(memmem(p, buf.ReadableBytes(), "\r\n", 2));
+            if (crlf) {
+                line->assign(p, crlf - p);
+                buf.Retrieve(crlf - p + 2);
+                return true;
+            }
+            bool timeout;
+            if (ReadSome(fd, buf, &timeout) < 0 || Cancelled(gen)) return false;
+            if (timeout && time(nullptr) - start > g_config.repl_timeout) return false;
+        }
+    }
+
+    // 全量同步：len 字节的快照收进临时文件（buf 里已经收到的先写），然后清空数据、加载
+    bool ReceiveSnapshot(int fd, Buffer& buf, uint64_t len, uint64_t gen) {
+        int out = open(TRANSFER_PATH, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (out < 0) {
+            cerr << "[Replication] Can't open " << TRANSFER_PATH << ": " << strerror(errno) << endl;
+            return false;
+        }
+        uint64_t got = 0;
+        time_t last = time(nullptr);
+        bool ok = true;
+        while (got < len) {
+            if (buf.ReadableBytes() > 0) {
+                size_t m = min<uint64_t>(buf.ReadableBytes(), len - got);
+                if (write(out, buf.Peek(), m) != static_cast<ssize_t>(m)) {
+                    ok = false;
+                    break;
+                }
+                buf.Retrieve(m);
+                got += m;
+                last = time(nullptr);
+                continue;
+            }
+            bool timeout;
+            buf.EnsureWritable(1024 * 1024);
+            if (ReadSome(fd, buf, &timeout) < 0 || Cancelled(gen) ||
+                (timeout && time(nullptr) - last > g_config.repl_timeout)) {
+                ok = false;
+                break;
+            }
+        }
+        if (close(out) != 0) ok = false;
+        if (!ok) {
+            unlink(TRANSFER_PATH);
+            return false;
+        }
+        auto start = chrono::steady_clock::now();
+        loading_ = true;
+        g_store->Clear();
+        g_store->LoadSnapshot(TRANSFER_PATH, true); // 后面还要重放主库的命令流
+        loading_ = false;
+        unlink(TRANSFER_PATH);
+        if (g_aof->Enabled()) rewriteAof_ = true;
+        long long ms = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+        cout << "[Replication] Loaded " << len << " bytes from master in " << ms << " ms" << endl;
+        return true;
+    }
+
+    // 连一次主库：握手、全量 / 部分同步、然后一直重放命令流，直到断开或者被取消
+    void SyncWithMaster(const string& host, int port, uint64_t gen) {
+        int fd = Connect(host, port);
+        if (fd < 0) {
+            cerr << "[Replication] Can't connect to master " << host << ":" << port << endl;
+            return;
+        }
+        linkFd_ = fd;
+        if (Cancelled(gen)) shutdown(fd, SHUT_RDWR); // 和 REPLICAOF 擦肩而过
+        RunLink(fd, gen);
+        {
+            lock_guard<mutex> lock(clientMtx_);
+            linkFd_ = -1;
+        }
+        close(fd);
+        if (!Cancelled(gen)) cerr << "[Replication] Connection with master lost" << endl;
+    }
+
+    void RunLink(int fd, uint64_t gen) {
+        Buffer buf;
+        string line, replid;
+        uint64_t offset;
+        {
+            lock_guard<mutex> lock(clientMtx_);
+            replid = masterReplid_;
+        }
+        offset = processed_.load();
+        if (!SendCommand(fd, {"PING"}) || !ReadLine(fd, buf, gen, &line)) return;
+        if (!SendCommand(fd, {"REPLCONF", "listening-port", to_string(g_config.port)}) ||
+            !ReadLine(fd, buf, gen, &line)) {
+            return;
+        }
+        if (!SendCommand(fd, {"PSYNC", replid.empty() ? "?" : replid, replid.empty() ? "-1" : to_string(offset)}) ||
+            !ReadLine(fd, buf, gen, &line)) {
+            return;
+        }
+        if (line.compare(0, 12, "+FULLRESYNC ") == 0) {
+            char id[64];
+            unsigned long long off = 0;
+            if (sscanf(line.c_str() + 12, "%63s %llu", id, &off) != 2) return;
+            if (!ReadLine(fd, buf, gen, &line) || line.empty() || line[0] != '$') return;
+            syncing_ = true;
+            cout << "[Replication] Full resynchronization from " << id << ":" << off << endl;
+            if (!ReceiveSnapshot(fd, buf, strtoull(line.c_str() + 1, nullptr, 10), gen)) return;
+            syncing_ = false;
+            {
+                lock_guard<mutex> lock(clientMtx_);
+                masterReplid_ = id;
+            }
+            processed_ = off;
+        } else if (line.compare(0, 9, "+CONTINUE") == 0) {
+            cout << "[Replication] Partial resynchronization from offset " << offset << endl;
+        } else {
+            cerr << "[Replication] Master rejected PSYNC: " << line << endl;
+            return;
+        }
+        linkUp_ = true;
+        cout << "[Replication] Master link up" << endl;
+        Stream(fd, buf, gen);
+    }
+
+    // 重放命令流。偏移量按处理完的完整命令算（最后一条收到一半的不算），每秒回一次 ACK
+    void Stream(int fd, Buffer& buf, uint64_t gen) {
+        RespParser parser;
+        uint64_t base = processed_.load();
+        uint64_t received = buf.ReadableBytes(); // 进了流的字节数（含还在 buf 里没处理的）
+        auto lastAck = chrono::steady_clock::now() - chrono::milliseconds(static_cast<int>(ACK_PERIOD_MS));
+        time_t last = time(nullptr);
+        while (!Cancelled(gen)) {
+            bool applied = false;
+            while (true) {
+                RespParser::Result r = parser.Parse(buf);
+                if (r == RespParser::PARSE_ERROR) {
+                    cerr << "[Replication] Bad stream from master: " << parser.Error() << endl;
+                    return;
+                }
+                if (r != RespParser::PARSE_OK) break;
+                replay_(parser); // 不是写命令（PING）就跳过，偏移量照样往前走
+                parser.Next();
+                parser.Consume(buf);
+                processed_ = base + received - buf.ReadableBytes();
+                applied = true;
+            }
+            if (applied) g_aof->Flush();
+            buf.Shrink();
+            auto now = chrono::steady_clock::now();
+            if (now - lastAck >= chrono::milliseconds(static_cast<int>(ACK_PERIOD_MS))) {
+                lastAck = now;
+                if (!SendCommand(fd, {"REPLCONF", "ACK", to_string(processed_.load())})) return;
+            }
+            ssize_t n;
+            bool timeout;
+            if (parser.WantsDirectRead()) {
+                size_t got = 0;
+                n = buf.ReadFd(fd, parser.DirectReadPtr(), parser.DirectReadLen(), &got);
+                parser.DirectReadDone(got);
+                if (n > 0) lastIo_ = time(nullptr);
+                timeout = n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+                if (timeout) n = 0;
+            } else {
+                n = ReadSome(fd, buf, &timeout);
+            }
+            if (n < 0 || (n == 0 && !timeout)) return;
+            if (n > 0) {
+                received += n;
+                last = time(nullptr);
+            } else if (time(nullptr) - last > g_config.repl_timeout) {
+                cerr << "[Replication] Timeout receiving from master" << endl;
+                return;
+            }
+        }
+    }
+};
+
+extern Replication* g_repl;
+
+#endif // REPLICATION_H
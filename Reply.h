@@ -0,0 +1,67 @@
+/**
+ * Reply.h
+ * 往连接的写缓冲区里追加各种 RESP 回复（+OK / -ERR / :1 / $3\r\nfoo\r\n / *2 ...）。
+ * 命令处理函数和 Connection 都用这一套，回复直接写进 OutputBuffer，不先拼成 string。
+ */
+
+#ifndef REPLY_H
+#define REPLY_H
+
+#include <cstdio>
+#include <string>
+#include "OutputBuffer.h"
+#include "Slice.h"
+
+// 原样追加（调用方自己保证是完整的 RESP）
+inline void AddReply(OutputBuffer& out, const Slice& s) { out.Append(s); }
+
+// -<msg>\r\n，msg 自带错误前缀（ERR / WRONGTYPE ...）
+inline void AddReplyError(OutputBuffer& out, const Slice& msg) {
+    out.Append("-", 1);
+    out.Append(msg);
+    out.Append("\r\n", 2);
+}
+
+inline void AddReplyInt(OutputBuffer& out, long long v) {
+    char buf[32];
+    int n = snprintf(buf, sizeof(buf), ":%lld\r\n", v);
+    out.Append(buf, n);
+}
+
+inline void AddReplyNil(OutputBuffer& out) { out.Append("$-1\r\n", 5); }
+
+// 空的数组回复（LPOP key count 时 key 不存在）
+inline void AddReplyNilArray(OutputBuffer& out) { out.Append("*-1\r\n", 5); }
+
+// 数组头 *<n>\r\n，后面跟 n 个回复
+inline void AddReplyArrayLen(OutputBuffer& out, long long n) {
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "*%lld\r\n", n);
+    out.Append(buf, len);
+}
+
+inline void AddReplyBulk(OutputBuffer& out, const Slice& val) {
+    char buf[32];
+    int n = snprintf(buf, sizeof(buf), "$%zu\r\n", val.size());
+    out.Append(buf, n);
+    out.Append(val);
+    out.Append("\r\n", 2);
+}
+
+// 大 value 直接 move 进写缓冲区，不再拷一遍
+inline void AddReplyBulk(OutputBuffer& out, std::string&& val) {
+    char buf[32];
+    int n = snprintf(buf, sizeof(buf), "$%zu\r\n", val.size());
+    out.Append(buf, n);
+    out.Append(std::move(val));
+    out.Append("\r\n", 2);
+}
+
+// 状态回复 +<s>\r\n
+inline void AddReplyStatus(OutputBuffer& out, const Slice& s) {
+    out.Append("+", 1);
+    out.Append(s);
+    out.Append("\r\n", 2);
+}
+
+#endif // REPLY_H
@@ -0,0 +1,319 @@
+/**
+ * RespParser.h
+ * 基于游标的增量 RESP 解析器。
+ * 还是原来的三个状态（读参数个数 *N / 读参数长度 $N / 读参数内容），区别是：
+ *   - 不再 substr 切缓冲区：只在缓冲区上挪一个游标 pos_，参数记成 (偏移, 长度)；
+ *   - 一条命令凑齐了才把偏移换成指向缓冲区的 Slice 交出去；Next() 接着往下解析下一条，
+ *     pipeline 的一批命令都执行完以后再一起 Consume，中间不挪缓冲区里的数据；
+ *   - 按长度取数据，内容里有 '\0' 也没关系（二进制安全）；
+ *   - 大参数（>= 32KB）不进缓冲区：先申请好最终大小的 string，后面 socket 的数据直接读进去，
+ *     业务层（比如 SET）可以把这个 string 直接 move 走，整个过程只落一次内存。
+ * 另外兼容 nc/telnet 手敲的 inline 命令（"SET name tesla\r\n"）。
+ *
+ * 找行尾不再每行 memchr 一次：用 RespScan.h 的 SIMD 扫描一次把一段里所有 '\n' 的位置找出来放进 lines_，
+ * 解析头部时从里面取；扫过的地方记在 scanned_，同一个字节不会扫第二遍（一行分好几次 read 到也一样）。
+ */
+
+#ifndef RESP_PARSER_H
+#define RESP_PARSER_H
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include "Buffer.h"
+#include "Slice.h"
+#include "RespScan.h"
+
+class RespParser {
+public:
+    enum Result {
+        PARSE_OK,    // 凑齐了一条命令，Args() 可用
+        PARSE_AGAIN, // 数据不够，等下次 read
+        PARSE_ERROR  // 协议错误，Error() 里是原因
+    };
+
+    static const size_t BIG_ARG = 32 * 1024;              // 超过这个长度的参数直接读进最终 string
+    static const long long MAX_BULK_LEN = 512LL << 20;    // 单个参数最大 512MB
+    static const long long MAX_MULTIBULK = 1024 * 1024;   // 一条命令最多 100 万个参数
+    static const size_t MAX_INLINE = 64 * 1024;           // inline 命令 / 头部一行的最大长度
+    static const size_t SCAN_CHUNK = 4096;                // 一次最多往前扫多少字节找行尾（大参数的内容不用整段扫）
+    static const size_t MAX_LINES = 64;                   // 一次扫描最多记多少个行尾
+    static const int MAX_PREALLOC_ARGS = 1024;            // *N 头部最多先预留这么多参数位，再多的边解析边长（防止一个 *1048576 就占几十 MB）
+
+    RespParser() { Reset(); }
+
+    /**
+     * 从 buf 的可读区继续往下解析。返回 PARSE_OK 时 Args() 里的 Slice
+     * 指向 buf（或者大参数自己的 string）：指向 buf 的在 Consume() 之前一直有效，
+     * 指向大参数的在 Next() 之前有效（调用方要留着的话先用 OwnedArg() move 走）。
+     */
+    Result Parse(Buffer& buf) {
+        const char* base = buf.Peek();
+        const size_t end = buf.ReadableBytes();
+
+        while (true) {
+            // ===================================================
+            // 状态 A: 读取参数个数 (*3)
+            // ===================================================
+            if (state_ == STATE_REQ_NUM) {
+                if (pos_ >= end) return PARSE_AGAIN;
+                if (base[pos_] != '*') {
+                    Result r = ParseInline(base, end);
+                    if (r == PARSE_OK && args_.empty()) { // 空行，直接吃掉
+                        cmdStart_ = pos_;
+                        continue;
+                    }
+                    return r;
+                }
+
+                long long n;
+                Result r = ParseHeaderLine(base, end, '*', MAX_MULTIBULK, &n);
+                if (r != PARSE_OK) return r;
+                if (n <= 0) { // "*0\r\n"：空命令，直接吃掉
+                    cmdStart_ = pos_;
+                    continue;
+                }
+                expectedArgs_ = static_cast<int>(n);
+                argPos_.reserve(expectedArgs_ < MAX_PREALLOC_ARGS ? expectedArgs_ : MAX_PREALLOC_ARGS);
+                state_ = STATE_ARG_LEN; // 去读下一行的长度
+            }
+
+            // ===================================================
+            // 状态 B: 读取参数长度 ($3)
+            // ===================================================
+            else if (state_ == STATE_ARG_LEN) {
+                long long n;
+                Result r = ParseHeaderLine(base, end, '$', MAX_BULK_LEN, &n);
+                if (r != PARSE_OK) return r;
+                expectedLen_ = static_cast<size_t>(n);
+
+                if (expectedLen_ >= BIG_ARG && end - pos_ < expectedLen_) {
+                    // 大参数还没到齐：申请最终大小的 string，已经到了的部分先搬过去，
+                    // 缓冲区退回到 pos_，之后的数据由 Connection 直接读进这个 string
+                    StartBigArg(buf, end);
+                    state_ = STATE_BIG_ARG;
+                    return PARSE_AGAIN;
+                }
+                state_ = STATE_ARG_DATA; // 去读具体数据
+            }
+
+            // ===================================================
+            // 状态 C: 读取参数内容 (SET / key / value)
+            // ===================================================
+            else if (state_ == STATE_ARG_DATA) {
+                // +2 是因为数据后面还有 \r\n
+                if (end - pos_ < expectedLen_ + 2) return PARSE_AGAIN;
+                if (base[pos_ + expectedLen_] != '\r' || base[pos_ + expectedLen_ + 1] != '\n') {
+                    return Fail("Protocol error: expected '\\r\\n' after bulk data");
+                }
+                argPos_.push_back(ArgPos{pos_, expectedLen_, -1});
+                pos_ += expectedLen_ + 2;
+                if (ArgDone()) return Finish(base);
+            }
+
+            // ===================================================
+            // 状态 D: 大参数的内容已经读满了，只差结尾的 \r\n
+            // ===================================================
+            else if (state_ == STATE_BIG_ARG) {
+                if (bigFilled_ < expectedLen_) return PARSE_AGAIN;
+                if (end - pos_ < 2) return PARSE_AGAIN;
+                if (base[pos_] != '\r' || base[pos_ + 1] != '\n') {
+                    return Fail("Protocol error: expected '\\r\\n' after bulk data");
+                }
+                argPos_.push_back(ArgPos{0, expectedLen_, static_cast<int>(bigArgs_.size() - 1)});
+                pos_ += 2;
+                if (ArgDone()) return Finish(base);
+            }
+        }
+    }
+
+    const std::vector<Slice>& Args() const { return args_; }
+
+    // 第 i 个参数如果是大参数，返回它的 string（调用方可以 move 走），否则返回 nullptr
+    std::string* OwnedArg(size_t i) {
+        if (i >= argPos_.size() || argPos_[i].owned < 0) return nullptr;
+        return &bigArgs_[argPos_[i].owned];
+    }
+
+    // 这条命令拿走了：游标停在原地，接着解析下一条（缓冲区里的数据先不删）
+    void Next() {
+        cmdStart_ = pos_;
+        ResetCommand();
+    }
+
+    // 已经 Next() 过的命令从缓冲区里删掉；解析到一半的命令保留，偏移跟着往前挪
+    void Consume(Buffer& buf) {
+        buf.Retrieve(cmdStart_);
+        pos_ -= cmdStart_;
+        for (ArgPos& a : argPos_) {
+            if (a.owned < 0) a.offset -= cmdStart_;
+        }
+        // 记下的行尾也跟着挪；pos_ 前面的已经用不上了，直接丢掉
+        while (lineHead_ < lineCount_ && lines_[lineHead_] < pos_ + cmdStart_) lineHead_++;
+        for (size_t i = lineHead_; i < lineCount_; ++i) lines_[i] -= cmdStart_;
+        scanned_ = scanned_ > cmdStart_ ? scanned_ - cmdStart_ : 0;
+        cmdStart_ = 0;
+    }
+
+    const std::string& Error() const { return error_; }
+
+    // 正在接收大参数时，socket 数据应该先读进这里
+    bool WantsDirectRead() const { return state_ == STATE_BIG_ARG && bigFilled_ < expectedLen_; }
+    char* DirectReadPtr() { return &bigArgs_.back()[bigFilled_]; }
+    size_t DirectReadLen() const { return expectedLen_ - bigFilled_; }
+    void DirectReadDone(size_t n) { bigFilled_ += n; }
+
+private:
+    enum State {
+        STATE_REQ_NUM,  // 状态 A: 读参数个数 (*3)
+        STATE_ARG_LEN,  // 状态 B: 读参数长度 ($3)
+        STATE_ARG_DATA, // 状态 C: 读参数数据 (SET)
+        STATE_BIG_ARG   // 状态 D: 大参数直接读进 bigArgs_
+    };
+
+    struct ArgPos {
+        size_t offset; // 相对缓冲区可读起点的偏移
+        size_t len;
+        int owned;     // >= 0 表示在 bigArgs_ 里
+    };
+
+    State state_;
+    size_t pos_;        // 游标：下一个要解析的字节（相对 buf.Peek()）
+    size_t cmdStart_;   // 当前这条命令的起点，前面的都是已经交出去的命令
+    int expectedArgs_;  // 还要读几个参数？ (对应 *3)
+    size_t expectedLen_; // 当前参数的长度是多少？ (对应 $3)
+    size_t bigFilled_;  // 大参数已经收到了多少字节
+    std::vector<ArgPos> argPos_;
+    std::vector<Slice> args_;
+    std::vector<std::string> bigArgs_;
+    std::string error_;
+    size_t lines_[MAX_LINES]; // 扫出来还没用到的 '\n' 的位置（相对 buf.Peek()），[lineHead_, lineCount_) 有效
+    size_t lineHead_;
+    size_t lineCount_;
+    size_t scanned_;          // [0, scanned_) 已经扫过了，里面的行尾要么在 lines_ 里，要么已经用过了
+
+    void Reset() {
+        pos_ = 0;
+        cmdStart_ = 0;
+        ClearLines(0);
+        ResetCommand();
+    }
+
+    void ClearLines(size_t from) {
+        lineHead_ = lineCount_ = 0;
+        scanned_ = from;
+    }
+
+    /**
+     * pos_ 之后第一个 '\n' 的位置，还没收到返回 end。
+     * 先用上次扫出来的；用完了再从 max(scanned_, pos_) 往后扫一段，这一段里的行尾一次全部记下。
+     * pos_ 前面的（比如 bulk 内容里的 \r\n）直接跳过。
+     */
+    size_t NextLine(const char* base, size_t end) {
+        while (lineHead_ < lineCount_ && lines_[lineHead_] < pos_) lineHead_++;
+        if (lineHead_ < lineCount_) return lines_[lineHead_];
+        size_t from = scanned_ > pos_ ? scanned_ : pos_;
+        while (from < end) {
+            size_t to = end - from > SCAN_CHUNK ? from + SCAN_CHUNK : end;
+            lineHead_ = 0;
+            lineCount_ = respscan::ScanLines(base, from, to, lines_, MAX_LINES);
+            scanned_ = lineCount_ == MAX_LINES ? lines_[MAX_LINES - 1] + 1 : to;
+            if (lineCount_ > 0) return lines_[0];
+            from = to;
+        }
+        return end;
+    }
+
+    void ResetCommand() {
+        state_ = STATE_REQ_NUM;
+        expectedArgs_ = 0;
+        expectedLen_ = 0;
+        bigFilled_ = 0;
+        argPos_.clear();
+        args_.clear();
+        bigArgs_.clear();
+    }
+
+    Result Fail(const char* msg) {
+        error_ = msg;
+        return PARSE_ERROR;
+    }
+
+    bool ArgDone() {
+        expectedArgs_--;
+        if (expectedArgs_ == 0) return true;
+        // 还没齐，继续去读下一个参数的长度
+        state_ = STATE_ARG_LEN;
+        return false;
+    }
+
+    // 偏移换成真正的 Slice
+    Result Finish(const char* base) {
+        args_.clear();
+        args_.reserve(argPos_.size());
+        for (const ArgPos& a : argPos_) {
+            if (a.owned >= 0) args_.push_back(Slice(bigArgs_[a.owned]));
+            else args_.push_back(Slice(base + a.offset, a.len));
+        }
+        return PARSE_OK;
+    }
+
+    /**
+     * 解析一行 "*123\r\n" / "$123\r\n"，只接受非负的十进制整数（不带符号和空格，最多 16 位），
+     * 超过 limit 算协议错误。成功时游标移到下一行开头。
+     */
+    Result ParseHeaderLine(const char* base, size_t end, char type, long long limit, long long* out) {
+        size_t nl = NextLine(base, end);
+        if (nl == end) {
+            if (end - pos_ > MAX_INLINE) return Fail("Protocol error: too big header line");
+            return PARSE_AGAIN;
+        }
+        const char* p = base + pos_;
+        if (*p != type) {
+            return Fail(type == '$' ? "Protocol error: expected '$'" : "Protocol error: expected '*'");
+        }
+        // 数字在 [pos_ + 1, nl - 1)，后面必须是 \r\n
+        if (nl < pos_ + 2 || base[nl - 1] != '\r' ||
+            !respscan::ParseLength(p + 1, nl - pos_ - 2, end - pos_ - 1, limit, out)) {
+            return Fail("Protocol error: invalid length");
+        }
+        pos_ = nl + 1;
+        return PARSE_OK;
+    }
+
+    // inline 命令：一整行按空格切开；空行返回 PARSE_OK 且 Args() 为空
+    Result ParseInline(const char* base, size_t end) {
+        size_t nlPos = NextLine(base, end);
+        if (nlPos == end) {
+            if (end - pos_ > MAX_INLINE) return Fail("Protocol error: too big inline request");
+            return PARSE_AGAIN;
+        }
+        const char* p = base + pos_;
+        const char* nl = base + nlPos;
+        const char* lineEnd = (nl > p && nl[-1] == '\r') ? nl - 1 : nl;
+        argPos_.clear();
+        const char* q = p;
+        while (q < lineEnd) {
+            while (q < lineEnd && (*q == ' ' || *q == '\t')) ++q;
+            const char* s = q;
+            while (q < lineEnd && *q != ' ' && *q != '\t') ++q;
+            if (q > s) argPos_.push_back(ArgPos{static_cast<size_t>(s - base), static_cast<size_t>(q - s), -1});
+        }
+        pos_ = static_cast<size_t>(nl - base) + 1;
+        return Finish(base);
+    }
+
+    void StartBigArg(Buffer& buf, size_t end) {
+        bigArgs_.push_back(std::string());
+        std::string& big = bigArgs_.back();
+        big.resize(expectedLen_);
+        size_t have = end - pos_; // 调用方保证 have < expectedLen_
+        memcpy(&big[0], buf.Peek() + pos_, have);
+        bigFilled_ = have;
+        // 搬走的字节正好是缓冲区末尾这一段，退掉；之后进缓冲区的是新数据，行尾从 pos_ 重新扫
+        buf.Unwrite(have);
+        ClearLines(pos_);
+    }
+};
+
+#endif // RESP_PARSER_H
@@ -0,0 +1,171 @@
+/**
+ * RespScan.h
+ * RESP 解析的两个热点：找行尾、把 "*N" / "$N" 里的数字转成整数。
+ *
+ * 找行尾：一次把一段缓冲区里所有 '\n' 的位置都找出来（不是每解析一行 memchr 一次），
+ * pipeline 的一批小命令一趟扫完，后面解析头部时直接从结果里取。
+ * 三种实现：AVX2 一次比 64 字节、SSE2 一次比 16 字节、逐字节的兜底；运行时检测一次 CPU，编译时不用加 -mavx2。
+ * 这里只找 '\n'：inline 命令允许只有 '\n' 的行尾，'\r' 由解析器自己检查。
+ *
+ * 转数字：数字先按右对齐塞进一个 8 字节的字（前面补 '0'），一次判断是不是全是数字，
+ * 再用三次乘法把 8 位数字合成一个整数（SWAR），不用每一位都判断一次。
+ */
+
+#ifndef RESP_SCAN_H
+#define RESP_SCAN_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace respscan {
+
+// 在 p[from, to) 里找 '\n'，位置（相对 p）依次写进 out，最多 max 个，返回找到几个。
+// 找满 max 个就停：后面的从 out[max-1] + 1 接着找
+typedef size_t (*ScanFn)(const char* p, size_t from, size_t to, size_t* out, size_t max);
+
+inline size_t ScanScalar(const char* p, size_t from, size_t to, size_t* out, size_t max) {
+    size_t k = 0;
+    for (size_t i = from; i < to; ++i) {
+        if (p[i] == '\n') {
+            out[k++] = i;
+            if (k == max) break;
+        }
+    }
+    return k;
+}
+
+#if defined(__x86_64__)
+// 把一块的比较结果（每个字节一位）展开成位置
+#define RESP_SCAN_EMIT(mask, base)                   \
+    while (mask) {                                   \
+        out[k++] = (base) + __builtin_ctzll(mask);   \
+        if (k == max) return k;                      \
+        mask &= mask - 1;                            \
+    }
+
+inline size_t ScanSse2(const char* p, size_t from, size_t to, size_t* out, size_t max) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    size_t k = 0;
+    size_t i = from;
+    for (; i + 16 <= to; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        uint64_t m = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)));
+        RESP_SCAN_EMIT(m, i);
+    }
+    return k + ScanScalar(p, i, to, out + k, max - k);
+}
+
+__attribute__((target("avx2")))
+inline size_t ScanAvx2(const char* p, size_t from, size_t to, size_t* out, size_t max) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    size_t k = 0;
+    size_t i = from;
+    for (; i + 64 <= to; i += 64) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i + 32));
+        uint64_t lo = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, nl)));
+        uint64_t hi = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(b, nl)));
+        uint64_t m = lo | (hi << 32);
+        RESP_SCAN_EMIT(m, i);
+    }
+    return k + ScanSse2(p, i, to, out + k, max - k);
+}
+
+#undef RESP_SCAN_EMIT
+#endif
+
+inline ScanFn DetectScan() {
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("avx2")) return ScanAvx2;
+    return ScanSse2; // x86_64 一定有 SSE2
+#else
+    return ScanScalar;
+#endif
+}
+
+// 当前用的实现（压测可以直接改它来对比）
+inline ScanFn& ScanImpl() {
+    static ScanFn fn = DetectScan();
+    return fn;
+}
+
+inline const char* ScanName(ScanFn fn) {
+#if defined(__x86_64__)
+    if (fn == ScanAvx2) return "avx2";
+    if (fn == ScanSse2) return "sse2";
+#endif
+    return "scalar";
+}
+
+inline size_t ScanLines(const char* p, size_t from, size_t to, size_t* out, size_t max) {
+    return ScanImpl()(p, from, to, out, max);
+}
+
+// 8 个 ASCII 数字（第一个在最低字节）合成一个整数；调用方保证每个字节都是 '0'..'9'
+inline uint64_t ParseEight(uint64_t w) {
+    w -= 0x3030303030303030ULL;
+    w = (w * 10 + (w >> 8)) & 0x00FF00FF00FF00FFULL;                          // 两位一组
+    w = (w * 100 + (w >> 16)) & 0x0000FFFF0000FFFFULL;                        // 四位一组
+    return static_cast<uint32_t>(w * 10000 + (w >> 32));                      // 八位
+}
+
+// 8 个字节是不是都在 '0'..'9'：减 '0' 不借位、加 (0x7f - '9') 不进到最高位
+inline bool AllDigits(uint64_t w) {
+    return (((w - 0x3030303030303030ULL) | (w + 0x4646464646464646ULL)) & 0x8080808080808080ULL) == 0;
+}
+
+// s[0, n) 右对齐放进一个 8 字节的字（n <= 8），前面补 '0'：每个字节移进来一次，没有分支
+inline uint64_t LoadDigits(const char* s, size_t n) {
+    uint64_t w = 0x3030303030303030ULL;
+    for (size_t i = 0; i < n; ++i) w = (w >> 8) | (static_cast<uint64_t>(static_cast<uint8_t>(s[i])) << 56);
+    return w;
+}
+
+/**
+ * 把 s[0, n) 当成非负十进制整数解析，最多 16 位：空串、有非数字（包括 '-' '+' 空格）、超过 limit 都返回 false。
+ * avail 是从 s 开始能读多少字节（>= n）：够 8 个就直接读一个字，移位去掉后面多读的、前面补 '0'，没有按位数走的循环；
+ * 超过 8 位的拆成前面的高位和最后 8 位两个字，合法性只在最后判断一次。
+ */
+inline bool ParseLength(const char* s, size_t n, size_t avail, long long limit, long long* out) {
+    if (n - 1 >= 16) return false; // n == 0 也在这里（无符号回绕）
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t v;
+    if (n <= 8) {
+        uint64_t w;
+        if (avail >= 8) {
+            memcpy(&w, s, 8);
+            unsigned shift = static_cast<unsigned>(8 - n) * 8; // 0..56
+            w = (w << shift) | (0x3030303030303030ULL >> (63 - shift) >> 1);
+        } else {
+            w = LoadDigits(s, n);
+        }
+        if (!AllDigits(w)) return false;
+        v = ParseEight(w);
+    } else {
+        uint64_t hi = LoadDigits(s, n - 8);
+        uint64_t lo;
+        memcpy(&lo, s + n - 8, 8);
+        if (!AllDigits(hi) || !AllDigits(lo)) return false;
+        v = ParseEight(hi) * 100000000ULL + ParseEight(lo);
+    }
+#else
+    (void)avail;
+    uint64_t v = 0;
+    for (size_t i = 0; i < n; ++i) {
+        unsigned d = static_cast<unsigned char>(s[i]) - '0';
+        if (d > 9) return false;
+        v = v * 10 + d;
+    }
+#endif
+    if (v > static_cast<uint64_t>(limit)) return false;
+    *out = static_cast<long long>(v);
+    return true;
+}
+
+} // namespace respscan
+
+#endif // RESP_SCAN_H
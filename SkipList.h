@@ -15,26 +15,35 @@
 #include <mutex>
 #include <iostream>
 #include <functional>
+#include "Arena.h"
 
 using namespace std;
 
 /**
  * SkipNode: 跳表的节点结构体
  * 每个节点就像一栋“楼”，里面存着 key、value 和好多层的指针。
+ * 节点和它的 forward 数组是同一块内存：forward 声明成长度 1 的数组，
+ * 实际分配时按层数多给 (level-1) 个指针的空间（LevelDB 的 Node 也是这么干的）。
+ * 这样一个节点只有一次分配，往下一层走也少一次指针跳转。
  */
 template <typename K, typename V>
 struct SkipNode {
     K key;
     V value;
-    
+    int level;
+
     // forward 数组存的是每一层的下一个节点的指针
     // 比如 forward[0] 就是最底层的 next 指针（普通链表）
     // forward[i] 就是第 i 层的跳跃指针
-    vector<SkipNode*> forward;
+    SkipNode* forward[1];
+
+    // 构造函数：只初始化键值和层数，forward 由分配方按层数清零
+    SkipNode(const K& k, const V& v, int lvl) : key(k), value(v), level(lvl) {}
 
-    // 构造函数：初始化键值，并根据层数分配好指针数组
-    SkipNode(K k, V v, int level) 
-        : key(k), value(v), forward(level, nullptr) {}
+    // 一个 level 层的节点一共要多少字节
+    static size_t AllocSize(int level) {
+        return sizeof(SkipNode) + sizeof(SkipNode*) * (level - 1);
+    }
 };
 
 /**
@@ -44,14 +53,20 @@ struct SkipNode {
 template <typename K, typename V>
 class SkipList {
 public:
+    typedef SkipNode<K, V> Node;
+
     // 构造函数：初始化随机数种子，创建哨兵节点
     SkipList() {
-        srand(time(nullptr)); // 随机种子，保证每次运行抛硬币结果不一样
+        // 随机种子，保证每次运行抛硬币结果不一样
+        // 每个跳表自己维护随机状态：多分片多线程时不用去抢 rand() 里面的全局锁
+        seed_ = static_cast<unsigned int>(time(nullptr)) ^ static_cast<unsigned int>(reinterpret_cast<size_t>(this));
+        if (seed_ == 0) seed_ = 2463534242u;
         level_ = 0;           // 一开始层数为0
+        tailValid_ = false;
         
         // 创建头节点（哨兵），把它建到最高（16层），方便以后连线
         // Key 和 Value 随便填个默认值就行，反正不用
-        head_ = new SkipNode<K, V>(K(), V(), MAX_LEVEL);
+        head_ = newNode(K(), V(), MAX_LEVEL);
     }
 
     // 析构函数：清理内存，防止泄漏
@@ -61,8 +76,8 @@ public:
         while (curr) {
             // 先记下后面是谁
             SkipNode<K, V>* next = curr->forward[0];
-            // 删掉当前节点
-            delete curr;
+            // 删掉当前节点（析构 key/value，内存由 arena_ 统一释放）
+            curr->~SkipNode<K, V>();
             // 往后走
             curr = next;
         }
@@ -73,10 +88,20 @@ public:
      逻辑：先查一遍，记录每层走到了哪里；如果 Key 存在就更新，不存在就插入新节点。
      */
     void insert(const K& key, const V& value) {
+        insertNode(key, value);
+    }
+
+    /**
+     * 和 insert 一样，但把 key 所在的节点返回出去（KVStore 的哈希索引要记住它）
+     * 节点从 arena 里分配，地址在删除之前一直不变
+     */
+    SkipNode<K, V>* insertNode(const K& key, const V& value) {
         //lock_guard<mutex> lock(mtx_); // 单线程暂时不需要大锁
-        
+        tailValid_ = false;
+
         // update 数组用来记录每一层“在该插在谁后面”（前驱节点）
-        vector<SkipNode<K, V>*> update(MAX_LEVEL, nullptr);
+        // 放在栈上就行，不用每次插入都去堆上要一个 vector
+        SkipNode<K, V>* update[MAX_LEVEL];
         SkipNode<K, V>* curr = head_;
 
         // 1. 从最高层往下找插入位置
@@ -95,7 +120,7 @@ public:
         // 如果 key 已经存在，直接更新 value，不用盖新楼了
         if (curr && curr->key == key) {
             curr->value = value;
-            return;
+            return curr;
         }
 
         // 3. 如果不存在，准备盖新楼
@@ -113,7 +138,7 @@ public:
         }
 
         // 4. 创建新节点
-        SkipNode<K, V>* new_node = new SkipNode<K, V>(key, value, new_level);
+        SkipNode<K, V>* new_node = newNode(key, value, new_level);
 
         // 5. 缝合指针（把每一层都连起来）
         // 就像普通链表插入一样：新节点指向后继，前驱指向新节点
@@ -121,13 +146,40 @@ public:
             new_node->forward[i] = update[i]->forward[i];
             update[i]->forward[i] = new_node;
         }
+        return new_node;
+    }
+
+    /**
+     * 批量加载用：按 key 从小到大依次追加，调用方保证 key 比表里现有的都大。
+     * 不比较 key，直接挂到每一层的末尾（每层最后一个节点缓存在 tail_ 里），O(1)。
+     */
+    SkipNode<K, V>* appendNode(const K& key, const V& value) {
+        if (!tailValid_) {
+            // 中间插入/删除过：从头找一遍每一层的最后一个节点
+            SkipNode<K, V>* curr = head_;
+            for (int i = MAX_LEVEL - 1; i >= 0; i--) {
+                while (curr->forward[i]) curr = curr->forward[i];
+                tail_[i] = curr;
+            }
+            tailValid_ = true;
+        }
+        int new_level = randomLevel();
+        if (new_level > level_) level_ = new_level;
+        SkipNode<K, V>* new_node = newNode(key, value, new_level);
+        for (int i = 0; i < new_level; i++) {
+            tail_[i]->forward[i] = new_node;
+            tail_[i] = new_node;
+        }
+        return new_node;
     }
 
     /**
      * 查找数据
      * 如果找到了返回 true，并把值赋给 value_out
      */
-    bool search(const K& key, V& value_out) {
+    // key 可以是 K，也可以是能和 K 比较大小的类型（比如 Slice），省一次拷贝
+    template <typename Key>
+    bool search(const Key& key, V& value_out) {
         //lock_guard<mutex> lock(mtx_);
         SkipNode<K, V>* curr = head_;
 
@@ -149,13 +201,82 @@ public:
         return false; // 没找到
     }
 
+    static const size_t BATCH = 16; // searchBatch 一轮同时走几个 key
+
+    /**
+     * 批量查找（MGET 用）：found[i] 表示 keys[i] 在不在，在的话值放进 values[i]。
+     * 一次 search 从上往下走十几二十个节点，每一步都要等下一个节点的 cache miss，而且只能一个一个等。
+     * 这里每 BATCH 个 key 一轮，大家齐头并进：每个 key 每次只往前走一步，顺手把它下一步要看的节点预取了，
+     * 轮到它的时候节点多半已经在缓存里了，BATCH 个 key 的 miss 叠在一起等（group prefetch）。
+     */
+    template <typename Key>
+    void searchBatch(const Key* keys, size_t n, V* values, bool* found) {
+        for (size_t base = 0; base < n; base += BATCH) {
+            size_t m = n - base < BATCH ? n - base : BATCH;
+            SkipNode<K, V>* curr[BATCH];
+            int lvl[BATCH];
+            size_t active = 0;
+            for (size_t j = 0; j < m; ++j) {
+                curr[j] = head_;
+                lvl[j] = level_ - 1;
+                found[base + j] = false;
+                if (lvl[j] >= 0) {
+                    __builtin_prefetch(head_->forward[lvl[j]]);
+                    active++;
+                }
+            }
+            while (active) {
+                for (size_t j = 0; j < m; ++j) {
+                    if (lvl[j] < 0) continue;
+                    const Key& key = keys[base + j];
+                    SkipNode<K, V>* next = curr[j]->forward[lvl[j]];
+                    if (next && next->key < key) {
+                        curr[j] = next; // 同一层往右走一步
+                    } else if (--lvl[j] < 0) {
+                        // 走到底了：next 就是第 0 层第一个 >= key 的节点
+                        if (next && next->key == key) {
+                            values[base + j] = next->value;
+                            found[base + j] = true;
+                        }
+                        active--;
+                        continue;
+                    }
+                    __builtin_prefetch(curr[j]->forward[lvl[j]]);
+                }
+            }
+        }
+    }
+
+    /**
+     * 有序遍历其中一段：从第一个 >= from（exclusive 时是 > from）的节点开始往后走，
+     * 每个节点调一次 func(key, value)，func 返回 false 就停下。
+     * 定位和 search 一样是 O(logN)，之后每个节点 O(1)；SCAN / RANGE 每次只走一小段，下次从停下的 key 接着走。
+     * func 里不能改这个跳表
+     */
+    template <typename Key, typename F>
+    void scan(const Key& from, bool exclusive, F func) {
+        SkipNode<K, V>* curr = head_;
+        for (int i = level_ - 1; i >= 0; i--) {
+            while (curr->forward[i] && curr->forward[i]->key < from) {
+                curr = curr->forward[i];
+            }
+        }
+        curr = curr->forward[0];
+        if (exclusive && curr && curr->key == from) curr = curr->forward[0];
+        while (curr) {
+            if (!func(curr->key, curr->value)) return;
+            curr = curr->forward[0];
+        }
+    }
+
     /**
      * 删除数据
      * 逻辑：找到每一层的前驱，断开连接，释放内存。
      */
     bool remove(const K& key) {
         lock_guard<mutex> lock(mtx_);
-        vector<SkipNode<K, V>*> update(MAX_LEVEL, nullptr);
+        tailValid_ = false;
+        SkipNode<K, V>* update[MAX_LEVEL];
         SkipNode<K, V>* curr = head_;
 
         // 先找一遍，记录每一层的前驱
@@ -181,7 +302,7 @@ public:
             update[i]->forward[i] = curr->forward[i];
         }
 
-        delete curr; // 释放内存
+        freeNode(curr); // 释放内存（还给 arena 的空闲链表）
 
         // 如果删掉的是最高层的节点，可能导致总层数降低
         // 比如最高层只有这一个节点，删了之后层数就要减一
@@ -210,14 +331,42 @@ private:
     static const int MAX_LEVEL = 16;
     
     SkipNode<K, V>* head_; // 哨兵头节点
+    NodeArena arena_;      // 所有节点都从这里切
     int level_;            // 当前跳表实际的最高层数
     mutex mtx_;            // 互斥锁
+    unsigned int seed_;    // xorshift 随机状态
+    SkipNode<K, V>* tail_[MAX_LEVEL]; // appendNode 用：每一层的最后一个节点
+    bool tailValid_;       // insert / remove 之后 tail_ 就不可信了
+
+    // 从 arena 里切一块，原地构造节点；尺寸档就用层数
+    SkipNode<K, V>* newNode(const K& key, const V& value, int level) {
+        void* mem = arena_.Allocate(SkipNode<K, V>::AllocSize(level), level);
+        SkipNode<K, V>* node = new (mem) SkipNode<K, V>(key, value, level);
+        for (int i = 0; i < level; i++) {
+            node->forward[i] = nullptr;
+        }
+        return node;
+    }
+
+    void freeNode(SkipNode<K, V>* node) {
+        int level = node->level;
+        node->~SkipNode<K, V>();
+        arena_.Deallocate(node, level);
+    }
+
+    // xorshift32：比 rand() 快，而且不带锁
+    unsigned int nextRandom() {
+        seed_ ^= seed_ << 13;
+        seed_ ^= seed_ >> 17;
+        seed_ ^= seed_ << 5;
+        return seed_;
+    }
 
     // 抛硬币函数：50% 概率长高一层
     // 用来模拟跳表的概率平衡特性
     int randomLevel() {
         int lvl = 1;
-        while ((rand() % 2) == 1 && lvl < MAX_LEVEL) {
+        while ((nextRandom() % 2) == 1 && lvl < MAX_LEVEL) {
             lvl++;
         }
         return lvl;
@@ -0,0 +1,55 @@
+/**
+ * Slice.h
+ * 一段不拥有内存的字节区间（指针 + 长度），相当于 C++17 的 string_view。
+ * 协议解析出来的参数都是指向读缓冲区的 Slice，交给业务层之前不做任何拷贝；
+ * 内容里可以有 '\0'，完全二进制安全。
+ * 注意：Slice 只在它指向的缓冲区没被改动之前有效。
+ */
+
+#ifndef SLICE_H
+#define SLICE_H
+
+#include <cstring>
+#include <string>
+
+class Slice {
+public:
+    Slice() : data_(""), size_(0) {}
+    Slice(const char* d, size_t n) : data_(d), size_(n) {}
+    Slice(const std::string& s) : data_(s.data()), size_(s.size()) {}
+    Slice(const char* s) : data_(s), size_(strlen(s)) {}
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    char operator[](size_t i) const { return data_[i]; }
+
+    std::string ToString() const { return std::string(data_, size_); }
+
+    // <0 / 0 / >0，和 std::string::compare 的语义一样（按无符号字节比较）
+    int compare(const Slice& b) const {
+        size_t n = size_ < b.size_ ? size_ : b.size_;
+        int r = memcmp(data_, b.data_, n);
+        if (r == 0) {
+            if (size_ < b.size_) r = -1;
+            else if (size_ > b.size_) r = 1;
+        }
+        return r;
+    }
+
+    bool starts_with(const Slice& x) const {
+        return size_ >= x.size_ && memcmp(data_, x.data_, x.size_) == 0;
+    }
+
+private:
+    const char* data_;
+    size_t size_;
+};
+
+inline bool operator==(const Slice& a, const Slice& b) {
+    return a.size() == b.size() && memcmp(a.data(), b.data(), a.size()) == 0;
+}
+inline bool operator!=(const Slice& a, const Slice& b) { return !(a == b); }
+inline bool operator<(const Slice& a, const Slice& b) { return a.compare(b) < 0; }
+
+#endif // SLICE_H
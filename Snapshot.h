@@ -0,0 +1,430 @@
+/**
+ * Snapshot.h
+ * 二进制快照文件（data.db）的读写。原来的文本格式 "type key value" 遇到带空格/换行的 key、value 就坏了，
+ * 加载时 iostream 一个个 >> 也慢，所以换成下面这种带校验、可以 mmap 直接解析的格式：
+ *
+ *   +--------------------------------------------------+
+ *   | Header (32B): magic "KVSNAPSH" | version | flags | 创建时间(ms) | 保留 |
+ *   +--------------------------------------------------+
+ *   | Block 0: len(4) | records(4) | crc32c(4) | payload(len) |
+ *   | Block 1: ...                                      |   每块攒到 64KB 左右就落盘
+ *   +--------------------------------------------------+
+ *   | Index: 每块一项 offset(8) | len(4) | records(4)     |
+ *   +--------------------------------------------------+
+ *   | Trailer (32B): index 偏移(8) | 总记录数(8) | 块数(4) | index 的 crc32c(4) | magic "KVSNAPFT" |
+ *   +--------------------------------------------------+
+ *
+ * payload 里是一条条记录，长度都用 varint 前缀（二进制安全）：
+ *   REC_STRING: type(1) | keylen | key | vallen | val
+ *   REC_LIST:   type(1) | keylen | key | count | (len | item) * count
+ * 带过期时间的 key 在记录前面多一个前缀（和 RDB 的 EXPIRETIME_MS 一样）：
+ *   REC_EXPIRE_MS(1) | 过期时间(8，unix 毫秒) | 后面紧跟一条正常的记录
+ * 整数都是小端（只考虑 x86 / ARM 小端机器）。
+ *
+ * 写：先写到 <path>.tmp，fsync 后 rename 过去，中途崩溃不会把旧快照写坏。
+ * 读：整个文件 mmap 进来，先校验 header / trailer / index，每读一块校验一次 crc，
+ *     记录里的 key / value 都是指向 mmap 内存的 Slice，由调用方决定怎么建数据。
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "Crc32c.h"
+#include "Slice.h"
+
+namespace snapshot {
+
+const char HEADER_MAGIC[8] = {'K', 'V', 'S', 'N', 'A', 'P', 'S', 'H'};
+const char TRAILER_MAGIC[8] = {'K', 'V', 'S', 'N', 'A', 'P', 'F', 'T'};
+const uint32_t VERSION = 1;
+const size_t HEADER_SIZE = 32;
+const size_t TRAILER_SIZE = 32;
+const size_t BLOCK_HEADER_SIZE = 12;
+const size_t INDEX_ENTRY_SIZE = 16;
+const size_t BLOCK_SIZE = 64 * 1024; // 攒够这么多就切一块
+
+// 记录类型
+enum RecordType {
+    REC_STRING = 0,
+    REC_LIST   = 1,
+    REC_EXPIRE_MS = 0xFC  // 前缀，不单独算一条记录
+};
+
+inline void PutFixed32(std::string& dst, uint32_t v) { dst.append(reinterpret_cast<const char*>(&v), 4); }
+inline void PutFixed64(std::string& dst, uint64_t v) { dst.append(reinterpret_cast<const char*>(&v), 8); }
+
+inline uint32_t DecodeFixed32(const char* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+inline uint64_t DecodeFixed64(const char* p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+// LEB128：每字节 7 位，最高位表示后面还有
+inline void PutVarint(std::string& dst, uint64_t v) {
+    char buf[10];
+    int n = 0;
+    while (v >= 0x80) {
+        buf[n++] = static_cast<char>(v | 0x80);
+        v >>= 7;
+    }
+    buf[n++] = static_cast<char>(v);
+    dst.append(buf, n);
+}
+
+// 解析失败（越界或者超过 10 字节）返回 nullptr
+inline const char* GetVarint(const char* p, const char* limit, uint64_t* v) {
+    uint64_t result = 0;
+    for (int shift = 0; shift <= 63 && p < limit; shift += 7) {
+        uint64_t byte = static_cast<uint8_t>(*p++);
+        result |= (byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *v = result;
+            return p;
+        }
+    }
+    return nullptr;
+}
+
+inline void PutLengthPrefixed(std::string& dst, const Slice& s) {
+    PutVarint(dst, s.size());
+    dst.append(s.data(), s.size());
+}
+
+inline const char* GetLengthPrefixed(const char* p, const char* limit, Slice* out) {
+    uint64_t len;
+    p = GetVarint(p, limit, &len);
+    if (!p || len > static_cast<uint64_t>(limit - p)) return nullptr;
+    *out = Slice(p, static_cast<size_t>(len));
+    return p + len;
+}
+
+} // namespace snapshot
+
+/**
+ * SnapshotWriter: 一条条 Add，最后 Finish 才真正替换掉旧文件
+ */
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(const std::string& path)
+        : path_(path), tmpPath_(path + ".tmp"), fd_(-1), offset_(0), blockRecords_(0), records_(0) {}
+
+    ~SnapshotWriter() {
+        // 没 Finish 就析构（出错了）：临时文件删掉，旧快照保持原样
+        if (fd_ != -1) {
+            close(fd_);
+            unlink(tmpPath_.c_str());
+        }
+    }
+
+    bool Open() {
+        fd_ = open(tmpPath_.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd_ < 0) {
+            perror("open snapshot");
+            return false;
+        }
+        std::string header(snapshot::HEADER_MAGIC, 8);
+        snapshot::PutFixed32(header, snapshot::VERSION);
+        snapshot::PutFixed32(header, 0); // flags
+        snapshot::PutFixed64(header, NowMs());
+        snapshot::PutFixed64(header, 0); // 保留
+        return WriteAll(header);
+    }
+
+    // expire：过期时间（unix 毫秒），0 表示不过期
+    bool AddString(const Slice& key, const Slice& value, int64_t expire = 0) {
+        PutExpire(expire);
+        block_.push_back(static_cast<char>(snapshot::REC_STRING));
+        snapshot::PutLengthPrefixed(block_, key);
+        snapshot::PutLengthPrefixed(block_, value);
+        return RecordAdded();
+    }
+
+    // items 是能 range-for 出 Slice 的容器（QuickList、vector<string> 都行）
+    template <typename List>
+    bool AddList(const Slice& key, const List& items, int64_t expire = 0) {
+        PutExpire(expire);
+        block_.push_back(static_cast<char>(snapshot::REC_LIST));
+        snapshot::PutLengthPrefixed(block_, key);
+        snapshot::PutVarint(block_, items.size());
+        for (Slice s : items) snapshot::PutLengthPrefixed(block_, s);
+        return RecordAdded();
+    }
+
+    // 写完最后一块、index 和 trailer，fsync 后 rename 成正式文件
+    bool Finish() {
+        if (!FlushBlock()) return false;
+        uint64_t indexOffset = offset_;
+        if (!WriteAll(index_)) return false;
+
+        std::string trailer;
+        snapshot::PutFixed64(trailer, indexOffset);
+        snapshot::PutFixed64(trailer, records_);
+        snapshot::PutFixed32(trailer, static_cast<uint32_t>(index_.size() / snapshot::INDEX_ENTRY_SIZE));
+        snapshot::PutFixed32(trailer, crc32c::Value(index_.data(), index_.size()));
+        trailer.append(snapshot::TRAILER_MAGIC, 8);
+        if (!WriteAll(trailer)) return false;
+
+        if (fsync(fd_) != 0) {
+            perror("fsync snapshot");
+            return false;
+        }
+        close(fd_);
+        fd_ = -1;
+        if (rename(tmpPath_.c_str(), path_.c_str()) != 0) {
+            perror("rename snapshot");
+            unlink(tmpPath_.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    uint64_t Records() const { return records_; }
+    uint64_t Bytes() const { return offset_; }
+
+private:
+    std::string path_;
+    std::string tmpPath_;
+    int fd_;
+    uint64_t offset_;       // 已经写进文件的字节数
+    std::string block_;     // 正在攒的这一块
+    uint32_t blockRecords_;
+    uint64_t records_;
+    std::string index_;
+
+    static uint64_t NowMs() {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+    }
+
+    void PutExpire(int64_t expire) {
+        if (expire == 0) return;
+        block_.push_back(static_cast<char>(snapshot::REC_EXPIRE_MS));
+        snapshot::PutFixed64(block_, static_cast<uint64_t>(expire));
+    }
+
+    bool RecordAdded() {
+        blockRecords_++;
+        records_++;
+        if (block_.size() >= snapshot::BLOCK_SIZE) return FlushBlock();
+        return true;
+    }
+
+    bool FlushBlock() {
+        if (blockRecords_ == 0) return true;
+        snapshot::PutFixed64(index_, offset_);
+        snapshot::PutFixed32(index_, static_cast<uint32_t>(block_.size()));
+        snapshot::PutFixed32(index_, blockRecords_);
+
+        std::string head;
+        snapshot::PutFixed32(head, static_cast<uint32_t>(block_.size()));
+        snapshot::PutFixed32(head, blockRecords_);
+        snapshot::PutFixed32(head, crc32c::Value(block_.data(), block_.size()));
+        if (!WriteAll(head) || !WriteAll(block_)) return false;
+        block_.clear();
+        blockRecords_ = 0;
+        return true;
+    }
+
+    bool WriteAll(const std::string& data) {
+        const char* p = data.data();
+        size_t left = data.size();
+        while (left > 0) {
+            ssize_t n = write(fd_, p, left);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                perror("write snapshot");
+                return false;
+            }
+            p += n;
+            left -= n;
+        }
+        offset_ += data.size();
+        return true;
+    }
+};
+
+// 读出来的一条记录，Slice 都指向 mmap 的内存，Reader 关闭前有效
+struct SnapshotRecord {
+    int type;
+    int64_t expire;            // 0 表示不过期
+    Slice key;
+    Slice value;               // REC_STRING
+    std::vector<Slice> items;  // REC_LIST
+};
+
+/**
+ * SnapshotReader: Open 之后反复 Next 直到返回 false，再看 Error() 是不是空的
+ */
+class SnapshotReader {
+public:
+    enum OpenResult {
+        OPEN_OK,
+        OPEN_NOT_FOUND,    // 文件不存在
+        OPEN_NOT_SNAPSHOT, // 不是二进制快照（老的文本格式）
+        OPEN_CORRUPT       // 是快照但是坏了，Error() 里是原因
+    };
+
+    SnapshotReader() : base_(nullptr), size_(0), index_(nullptr), indexOffset_(0), blockCount_(0), records_(0),
+                       nextBlock_(0), cur_(nullptr), limit_(nullptr), blockLeft_(0) {}
+
+    ~SnapshotReader() {
+        if (base_) munmap(const_cast<char*>(base_), size_);
+    }
+
+    OpenResult Open(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return OPEN_NOT_FOUND;
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            return Corrupt("fstat failed");
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ < 8) {
+            close(fd);
+            return OPEN_NOT_SNAPSHOT;
+        }
+        void* p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) {
+            size_ = 0;
+            return Corrupt("mmap failed");
+        }
+        base_ = static_cast<const char*>(p);
+        // 顺序读，让内核多预读一些
+        madvise(p, size_, MADV_SEQUENTIAL);
+
+        if (memcmp(base_, snapshot::HEADER_MAGIC, 8) != 0) return OPEN_NOT_SNAPSHOT;
+        if (size_ < snapshot::HEADER_SIZE + snapshot::TRAILER_SIZE) return Corrupt("file too short");
+        uint32_t version = snapshot::DecodeFixed32(base_ + 8);
+        if (version > snapshot::VERSION) return Corrupt("unsupported snapshot version");
+
+        const char* t = base_ + size_ - snapshot::TRAILER_SIZE;
+        if (memcmp(t + 24, snapshot::TRAILER_MAGIC, 8) != 0) return Corrupt("bad trailer (truncated file?)");
+        uint64_t indexOffset = snapshot::DecodeFixed64(t);
+        records_ = snapshot::DecodeFixed64(t + 8);
+        blockCount_ = snapshot::DecodeFixed32(t + 16);
+        uint32_t indexCrc = snapshot::DecodeFixed32(t + 20);
+        if (indexOffset < snapshot::HEADER_SIZE ||
+            indexOffset + static_cast<uint64_t>(blockCount_) * snapshot::INDEX_ENTRY_SIZE != size_ - snapshot::TRAILER_SIZE) {
+            return Corrupt("bad index offset");
+        }
+        index_ = base_ + indexOffset;
+        if (crc32c::Value(index_, blockCount_ * snapshot::INDEX_ENTRY_SIZE) != indexCrc) {
+            return Corrupt("index checksum mismatch");
+        }
+        indexOffset_ = indexOffset;
+        return OPEN_OK;
+    }
+
+    // 读下一条记录；读完或者出错都返回 false
+    bool Next(SnapshotRecord* rec) {
+        while (blockLeft_ == 0) {
+            if (cur_ != limit_) return Fail("block has trailing bytes");
+            if (nextBlock_ >= blockCount_) return false;
+            if (!OpenBlock(nextBlock_++)) return false;
+        }
+        if (cur_ >= limit_) return Fail("block record count mismatch");
+        int type = static_cast<uint8_t>(*cur_++);
+        rec->expire = 0;
+        if (type == snapshot::REC_EXPIRE_MS) {
+            if (limit_ - cur_ < 9) return Fail("bad expire");
+            rec->expire = static_cast<int64_t>(snapshot::DecodeFixed64(cur_));
+            cur_ += 8;
+            type = static_cast<uint8_t>(*cur_++);
+        }
+        const char* p = snapshot::GetLengthPrefixed(cur_, limit_, &rec->key);
+        if (!p) return Fail("bad record key");
+        rec->type = type;
+        rec->items.clear();
+        if (type == snapshot::REC_STRING) {
+            p = snapshot::GetLengthPrefixed(p, limit_, &rec->value);
+            if (!p) return Fail("bad string value");
+        } else if (type == snapshot::REC_LIST) {
+            uint64_t count;
+            p = snapshot::GetVarint(p, limit_, &count);
+            if (!p || count > static_cast<uint64_t>(limit_ - p)) return Fail("bad list length");
+            rec->items.reserve(count);
+            for (uint64_t i = 0; i < count; ++i) {
+                Slice item;
+                p = snapshot::GetLengthPrefixed(p, limit_, &item);
+                if (!p) return Fail("bad list item");
+                rec->items.push_back(item);
+            }
+        } else {
+            return Fail("unknown record type");
+        }
+        cur_ = p;
+        blockLeft_--;
+        return true;
+    }
+
+    // footer 里记的总记录数（加载前可以先按这个预留哈希表）
+    uint64_t Records() const { return records_; }
+    const std::string& Error() const { return error_; }
+
+private:
+    const char* base_;
+    size_t size_;
+    const char* index_;     // footer 里的块索引
+    uint64_t indexOffset_;
+    uint32_t blockCount_;
+    uint64_t records_;
+    uint32_t nextBlock_;
+    const char* cur_;   // 当前块里的解析位置
+    const char* limit_; // 当前块的结尾
+    uint32_t blockLeft_; // 当前块还剩几条记录
+    std::string error_;
+
+    OpenResult Corrupt(const char* msg) {
+        error_ = msg;
+        return OPEN_CORRUPT;
+    }
+
+    bool Fail(const char* msg) {
+        error_ = msg;
+        return false;
+    }
+
+    bool OpenBlock(uint32_t i) {
+        const char* e = index_ + i * snapshot::INDEX_ENTRY_SIZE;
+        uint64_t off = snapshot::DecodeFixed64(e);
+        uint32_t len = snapshot::DecodeFixed32(e + 8);
+        uint32_t count = snapshot::DecodeFixed32(e + 12);
+        if (off < snapshot::HEADER_SIZE || off + snapshot::BLOCK_HEADER_SIZE + len > indexOffset_) {
+            return Fail("block out of range");
+        }
+        const char* b = base_ + off;
+        if (snapshot::DecodeFixed32(b) != len || snapshot::DecodeFixed32(b + 4) != count) {
+            return Fail("block header does not match index");
+        }
+        const char* payload = b + snapshot::BLOCK_HEADER_SIZE;
+        if (crc32c::Value(payload, len) != snapshot::DecodeFixed32(b + 8)) {
+            return Fail("block checksum mismatch");
+        }
+        cur_ = payload;
+        limit_ = payload + len;
+        blockLeft_ = count;
+        return true;
+    }
+};
+
+#endif // SNAPSHOT_H
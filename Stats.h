@@ -0,0 +1,330 @@
+/**
+ * Stats.h
+ * 运行时统计（INFO / SLOWLOG / LATENCY 的数据都从这里来）。
+ *
+ * 每个线程一份计数器，只有这个线程自己写：写的时候是 relaxed 的 load + store（普通的 mov，没有 lock 前缀），
+ * 线程之间不抢同一条 cache line；读的时候（INFO）把所有线程的加起来。线程退出时把自己的数加到 retired 里，总数不会少。
+ * 计数器只增不减，清零（LATENCY RESET）是记一个基线，读的时候减掉，不用去改别的线程的计数器。
+ *
+ * 每条命令的耗时用 CycleClock（x86 上是 rdtsc）记成 tick，按命令分别攒进对数分段的直方图（每段 8 个桶，误差 12.5%），
+ * 读的时候才换算成微秒。超过 slowlog-log-slower-than 的命令记进 SlowLog（全局一个环，带锁，只有慢命令才碰它）。
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "Histogram.h"
+#include "Slice.h"
+
+// 命令计时用的时钟：x86 上直接读 TSC（二十来个周期，比 steady_clock 走 vDSO 便宜），别的平台退回 steady_clock。
+// tick 换算成纳秒的比例第一次用的时候对着 steady_clock 标定（要 10ms），main 里先调一次
+class CycleClock {
+public:
+    static uint64_t Now() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return SteadyNs();
+#endif
+    }
+
+    static double NsPerTick() {
+        static const double ratio = Calibrate();
+        return ratio;
+    }
+
+private:
+    static uint64_t SteadyNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static double Calibrate() {
+#if defined(__x86_64__) || defined(__i386__)
+        uint64_t ns0 = SteadyNs();
+        uint64_t t0 = __rdtsc();
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        uint64_t ns1 = SteadyNs();
+        uint64_t t1 = __rdtsc();
+        if (t1 <= t0) return 1.0;
+        return static_cast<double>(ns1 - ns0) / static_cast<double>(t1 - t0);
+#else
+        return 1.0;
+#endif
+    }
+};
+
+// 每条命令的耗时直方图：每段 8 个桶，一条命令 496 个桶
+typedef BasicHistogram<3> LatencyHistogram;
+
+// 线程计数器：前面是几个全局计数，后面每条命令一段（调用次数、总 tick、直方图的桶）
+enum StatCounter {
+    STAT_SYSCALLS,       // 网络相关的系统调用（epoll_wait / epoll_ctl / accept / readv / writev / io_uring_enter ...）
+    STAT_NET_INPUT,      // 从客户端读进来的字节数
+    STAT_NET_OUTPUT,     // 发给客户端的字节数
+    STAT_ACCEPTED,       // 接受的连接数
+    STAT_CLOSED,         // 关掉的连接数（当前连接数 = 接受 - 关掉）
+    STAT_LOOP_CYCLES,    // 事件循环转了几圈
+    STAT_LOOP_WAKEUPS,   // 其中 epoll_wait / io_uring_enter 带着事件回来的圈数（剩下的是超时醒的）
+    STAT_LOOP_EVENTS,    // 一共处理了多少个就绪事件 / 完成事件
+    STAT_LOOP_BUSY,      // 醒着干活的 tick 数（不算等事件的时间）
+    STAT_COUNTERS
+};
+
+class ThreadStats {
+public:
+    static const int MAX_COMMANDS = 64; // 命令表最多这么多行（Command.h 里有 static_assert）
+    static const size_t CMD_SLOTS = 2 + LatencyHistogram::BUCKETS;
+    static const size_t TOTAL = STAT_COUNTERS + MAX_COMMANDS * CMD_SLOTS;
+
+    static size_t CmdCalls(int cmd) { return STAT_COUNTERS + cmd * CMD_SLOTS; }
+    static size_t CmdTicks(int cmd) { return CmdCalls(cmd) + 1; }
+    static size_t CmdBucket(int cmd, size_t b) { return CmdCalls(cmd) + 2 + b; }
+
+    ThreadStats() {
+        for (size_t i = 0; i < TOTAL; ++i) v_[i].store(0, std::memory_order_relaxed);
+    }
+
+    // 只有自己这个线程调
+    void Add(size_t i, uint64_t n) {
+        v_[i].store(v_[i].load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    uint64_t Get(size_t i) const { return v_[i].load(std::memory_order_relaxed); }
+
+    // 一条命令执行完：次数、耗时、直方图
+    void RecordCommand(int cmd, uint64_t ticks) {
+        Add(CmdCalls(cmd), 1);
+        Add(CmdTicks(cmd), ticks);
+        Add(CmdBucket(cmd, LatencyHistogram::Index(ticks)), 1);
+    }
+
+private:
+    std::atomic<uint64_t> v_[TOTAL];
+};
+
+class StatsRegistry {
+public:
+    static const int SAMPLES = 16;               // 瞬时值取最近 16 次采样的平均
+    static const int SAMPLE_INTERVAL_MS = 100;
+
+    static StatsRegistry& Instance() {
+        static StatsRegistry r;
+        return r;
+    }
+
+    void Register(ThreadStats* s) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        live_.push_back(s);
+    }
+
+    void Unregister(ThreadStats* s) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        live_.erase(std::remove(live_.begin(), live_.end(), s), live_.end());
+        for (size_t i = 0; i < ThreadStats::TOTAL; ++i) retired_[i] += s->Get(i);
+    }
+
+    // 某一个计数器所有线程加起来（不减基线）
+    uint64_t Sum(size_t i) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return SumLocked(i);
+    }
+
+    uint64_t Syscalls() { return Sum(STAT_SYSCALLS); }
+
+    // 所有计数器的当前值，命令那部分减掉 LATENCY RESET 时记下的基线
+    std::vector<uint64_t> Snapshot() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        std::vector<uint64_t> out(retired_);
+        for (ThreadStats* s : live_) {
+            for (size_t i = 0; i < ThreadStats::TOTAL; ++i) out[i] += s->Get(i);
+        }
+        for (size_t i = STAT_COUNTERS; i < ThreadStats::TOTAL; ++i) out[i] -= baseline_[i];
+        return out;
+    }
+
+    // LATENCY RESET：命令次数、耗时、直方图从现在开始重新算
+    void ResetCommandStats() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        for (size_t i = STAT_COUNTERS; i < ThreadStats::TOTAL; ++i) baseline_[i] = SumLocked(i);
+    }
+
+    /**
+     * 每 100ms 由 0 号 Reactor 调一次：记下命令总数和收发的字节数，
+     * 算出 instantaneous_ops_per_sec / input_kbps / output_kbps（最近 16 次的平均，和 Redis 一样）
+     */
+    void Sample(int maxCommands) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        auto now = std::chrono::steady_clock::now();
+        uint64_t ops = 0;
+        for (int c = 0; c < maxCommands; ++c) ops += SumLocked(ThreadStats::CmdCalls(c));
+        uint64_t in = SumLocked(STAT_NET_INPUT);
+        uint64_t out = SumLocked(STAT_NET_OUTPUT);
+        if (sampled_) {
+            double sec = std::chrono::duration<double>(now - lastSample_).count();
+            if (sec <= 0) return;
+            opsSamples_[sampleIdx_] = (ops - lastOps_) / sec;
+            inSamples_[sampleIdx_] = (in - lastIn_) / sec / 1024;
+            outSamples_[sampleIdx_] = (out - lastOut_) / sec / 1024;
+            sampleIdx_ = (sampleIdx_ + 1) % SAMPLES;
+        }
+        sampled_ = true;
+        lastSample_ = now;
+        lastOps_ = ops;
+        lastIn_ = in;
+        lastOut_ = out;
+    }
+
+    void Instantaneous(double* ops, double* inKbps, double* outKbps) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        *ops = *inKbps = *outKbps = 0;
+        for (int i = 0; i < SAMPLES; ++i) {
+            *ops += opsSamples_[i];
+            *inKbps += inSamples_[i];
+            *outKbps += outSamples_[i];
+        }
+        *ops /= SAMPLES;
+        *inKbps /= SAMPLES;
+        *outKbps /= SAMPLES;
+    }
+
+    time_t StartTime() const { return startTime_; }
+
+private:
+    StatsRegistry()
+        : retired_(ThreadStats::TOTAL, 0), baseline_(ThreadStats::TOTAL, 0), startTime_(time(nullptr)),
+          sampled_(false), sampleIdx_(0), lastOps_(0), lastIn_(0), lastOut_(0) {
+        for (int i = 0; i < SAMPLES; ++i) opsSamples_[i] = inSamples_[i] = outSamples_[i] = 0;
+    }
+
+    uint64_t SumLocked(size_t i) const {
+        uint64_t n = retired_[i];
+        for (ThreadStats* s : live_) n += s->Get(i);
+        return n;
+    }
+
+    std::mutex mtx_;
+    std::vector<ThreadStats*> live_;
+    std::vector<uint64_t> retired_;
+    std::vector<uint64_t> baseline_;
+    time_t startTime_;
+
+    bool sampled_;
+    int sampleIdx_;
+    std::chrono::steady_clock::time_point lastSample_;
+    uint64_t lastOps_, lastIn_, lastOut_;
+    double opsSamples_[SAMPLES], inSamples_[SAMPLES], outSamples_[SAMPLES];
+};
+
+// 当前线程的计数器，第一次用的时候登记（比较大，放堆上）
+inline ThreadStats& LocalStats() {
+    struct Holder {
+        ThreadStats* stats;
+        Holder() : stats(new ThreadStats()) { StatsRegistry::Instance().Register(stats); }
+        ~Holder() {
+            StatsRegistry::Instance().Unregister(stats);
+            delete stats;
+        }
+    };
+    thread_local Holder h;
+    return *h.stats;
+}
+
+inline void CountStat(StatCounter c, uint64_t n = 1) { LocalStats().Add(c, n); }
+inline void CountSyscall(uint64_t n = 1) { CountStat(STAT_SYSCALLS, n); }
+
+/**
+ * 慢查询日志：执行时间超过 slowlog-log-slower-than 微秒的命令，最多留 slowlog-max-len 条，新的在前。
+ * 参数最多记 32 个、每个最多 128 字节（和 Redis 一样），多出来的写成 "... (N more arguments)" / "... (N more bytes)"。
+ */
+struct SlowLogEntry {
+    uint64_t id;
+    int64_t time;      // unix 秒
+    uint64_t duration; // 微秒
+    std::vector<std::string> args;
+};
+
+class SlowLog {
+public:
+    static const size_t MAX_ARGS = 32;
+    static const size_t MAX_ARG_LEN = 128;
+
+    static SlowLog& Instance() {
+        static SlowLog log;
+        return log;
+    }
+
+    // 启动时设一次；slowerThanUs < 0 表示不记
+    void Configure(long long slowerThanUs, size_t maxLen) {
+        double nsPerTick = CycleClock::NsPerTick();
+        std::lock_guard<std::mutex> lock(mtx_);
+        maxLen_ = maxLen;
+        if (slowerThanUs < 0) thresholdTicks_ = UINT64_MAX;
+        else thresholdTicks_ = static_cast<uint64_t>(slowerThanUs * 1000.0 / nsPerTick);
+    }
+
+    // 热路径上只比较一下
+    bool IsSlow(uint64_t ticks) const { return ticks >= thresholdTicks_; }
+
+    void Add(const Slice* argv, size_t argc, uint64_t ticks) {
+        SlowLogEntry e;
+        e.time = ::time(nullptr);
+        e.duration = static_cast<uint64_t>(ticks * CycleClock::NsPerTick() / 1000);
+        size_t n = std::min(argc, static_cast<size_t>(MAX_ARGS));
+        for (size_t i = 0; i < n; ++i) {
+            if (i == MAX_ARGS - 1 && argc > MAX_ARGS) {
+                e.args.push_back("... (" + std::to_string(argc - MAX_ARGS + 1) + " more arguments)");
+            } else if (argv[i].size() > MAX_ARG_LEN) {
+                e.args.push_back(std::string(argv[i].data(), MAX_ARG_LEN) + "... (" +
+                                 std::to_string(argv[i].size() - MAX_ARG_LEN) + " more bytes)");
+            } else {
+                e.args.push_back(argv[i].ToString());
+            }
+        }
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (maxLen_ == 0) return;
+        e.id = nextId_++;
+        entries_.push_front(std::move(e));
+        while (entries_.size() > maxLen_) entries_.pop_back();
+    }
+
+    std::vector<SlowLogEntry> Get(size_t count) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        count = std::min(count, entries_.size());
+        return std::vector<SlowLogEntry>(entries_.begin(), entries_.begin() + count);
+    }
+
+    size_t Len() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return entries_.size();
+    }
+
+    void Reset() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        entries_.clear();
+    }
+
+private:
+    SlowLog() : thresholdTicks_(UINT64_MAX), maxLen_(128), nextId_(0) {}
+
+    std::mutex mtx_;
+    uint64_t thresholdTicks_;
+    size_t maxLen_;
+    uint64_t nextId_;
+    std::deque<SlowLogEntry> entries_;
+};
+
+#endif // STATS_H
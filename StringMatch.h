@@ -0,0 +1,114 @@
+/**
+ * StringMatch.h
+ * SCAN MATCH 用的 glob 匹配，语法和 Redis 一样：
+ *   *       任意长度（可以是 0）
+ *   ?       任意一个字节
+ *   [abc]   其中一个，[^abc] 不是其中任何一个，[a-z] 范围
+ *   \x      x 本身（转义上面这些特殊字符）
+ * Redis 的 stringmatchlen 碰到 * 是递归的，"a*a*a*a*...b" 这种模式会指数爆炸；
+ * 这里只记最后一个 * 的位置回溯（通配符匹配的经典做法），最坏 O(模式长度 × 字符串长度)。
+ */
+
+#ifndef STRING_MATCH_H
+#define STRING_MATCH_H
+
+#include <cstddef>
+#include <string>
+#include "Slice.h"
+
+namespace strmatch {
+
+// p 指向 '['：看 c 在不在这个字符类里，*end 设成 ']' 后面（没有 ']' 就是模式末尾）
+inline bool MatchClass(const char* p, const char* pend, char c, const char** end) {
+    p++;
+    bool negate = false;
+    if (p < pend && *p == '^') {
+        negate = true;
+        p++;
+    }
+    bool hit = false;
+    while (p < pend && *p != ']') {
+        if (*p == '\\' && p + 1 < pend) {
+            p++;
+            if (*p == c) hit = true;
+            p++;
+        } else if (p + 2 < pend && p[1] == '-' && p[2] != ']') {
+            unsigned char lo = static_cast<unsigned char>(p[0]), hi = static_cast<unsigned char>(p[2]);
+            if (lo > hi) {
+                unsigned char t = lo;
+                lo = hi;
+                hi = t;
+            }
+            unsigned char uc = static_cast<unsigned char>(c);
+            if (uc >= lo && uc <= hi) hit = true;
+            p += 3;
+        } else {
+            if (*p == c) hit = true;
+            p++;
+        }
+    }
+    *end = p < pend ? p + 1 : p;
+    return hit != negate;
+}
+
+} // namespace strmatch
+
+inline bool StringMatch(const Slice& pattern, const Slice& str) {
+    const char* p = pattern.data();
+    const char* pend = p + pattern.size();
+    const char* s = str.data();
+    const char* send = s + str.size();
+    const char* starP = nullptr; // 最后一个 * 后面的位置
+    const char* starS = nullptr; // 那个 * 目前吃到了哪里
+    while (s < send) {
+        if (p < pend && *p == '*') {
+            while (p < pend && *p == '*') p++;
+            if (p == pend) return true;
+            starP = p;
+            starS = s;
+            continue;
+        }
+        if (p < pend) {
+            const char* next = p + 1;
+            bool ok;
+            if (*p == '?') {
+                ok = true;
+            } else if (*p == '[') {
+                ok = strmatch::MatchClass(p, pend, *s, &next);
+            } else if (*p == '\\' && p + 1 < pend) {
+                ok = p[1] == *s;
+                next = p + 2;
+            } else {
+                ok = *p == *s;
+            }
+            if (ok) {
+                p = next;
+                s++;
+                continue;
+            }
+        }
+        // 失配：让上一个 * 多吃一个字节再试，没有 * 就是不匹配
+        if (!starP) return false;
+        p = starP;
+        s = ++starS;
+    }
+    while (p < pend && *p == '*') p++;
+    return p == pend;
+}
+
+// 模式开头不含通配符的那一段（"user:1*" -> "user:1"）：匹配的 key 一定以它开头，SCAN 可以直接跳过去
+inline std::string GlobPrefix(const Slice& pattern) {
+    std::string prefix;
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        char c = pattern[i];
+        if (c == '*' || c == '?' || c == '[') break;
+        if (c == '\\') {
+            if (++i == pattern.size()) break;
+            c = pattern[i];
+        }
+        prefix.push_back(c);
+    }
+    return prefix;
+}
+
+#endif // STRING_MATCH_H
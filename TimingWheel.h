@@ -0,0 +1,89 @@
+/**
+ * TimingWheel.h
+ * 空闲连接超时用的哈希时间轮：一圈 SLOTS 个格子，一格 1 秒，连接按“到期的那一秒”挂到对应格子的双向链表上。
+ *   - 连接有读写（Touch）：从原来的格子摘下来挂到新格子上，O(1)；同一秒里的多次 Touch 格子不变，什么都不做；
+ *   - 每轮事件循环 Advance 到当前这一秒：只看这中间转过的几个格子，里面的连接都到期了。
+ * 所以每轮的开销只和“这一秒到期的连接数”有关，和总连接数、空闲连接数都无关。
+ * 超时时间必须小于 SLOTS 秒，这样同一个格子里的连接到期时间都一样。
+ */
+
+#ifndef TIMING_WHEEL_H
+#define TIMING_WHEEL_H
+
+#include <ctime>
+
+// 挂在时间轮上的节点，Connection 继承它
+struct TimerNode {
+    TimerNode* prev;
+    TimerNode* next;
+    time_t deadline; // 到这一秒就超时，0 表示不在轮子上
+    TimerNode() : prev(nullptr), next(nullptr), deadline(0) {}
+};
+
+class TimingWheel {
+public:
+    static const int SLOTS = 64; // 2 的幂
+
+    // timeout 秒没有动静就算超时：最后一次活动在第 t 秒，第 t + timeout + 1 秒到期
+    explicit TimingWheel(int timeout) : timeout_(timeout), current_(time(nullptr)) {
+        static_assert((SLOTS & (SLOTS - 1)) == 0, "SLOTS must be a power of 2");
+        for (int i = 0; i < SLOTS; ++i) {
+            heads_[i].prev = heads_[i].next = &heads_[i];
+        }
+    }
+
+    TimingWheel(const TimingWheel&) = delete;
+    TimingWheel& operator=(const TimingWheel&) = delete;
+
+    // 第 lastActive 秒有活动：挂到它到期那一秒的格子上（新节点也用这个）
+    void Touch(TimerNode* n, time_t lastActive) {
+        time_t deadline = lastActive + timeout_ + 1;
+        if (n->deadline == deadline) return;
+        if (n->deadline) Unlink(n);
+        n->deadline = deadline;
+        TimerNode* head = &heads_[deadline & (SLOTS - 1)];
+        n->prev = head->prev;
+        n->next = head;
+        head->prev->next = n;
+        head->prev = n;
+    }
+
+    void Remove(TimerNode* n) {
+        if (n->deadline) Unlink(n);
+        n->deadline = 0;
+    }
+
+    // 转到第 now 秒：到期的节点先从轮子上摘下来，再交给 onExpire（里面可以直接把连接关掉）
+    template <typename F>
+    void Advance(time_t now, F onExpire) {
+        // 卡住太久（比如被调试器停了）也最多转一圈
+        if (now - current_ > SLOTS) current_ = now - SLOTS;
+        while (current_ < now) {
+            ++current_;
+            TimerNode* head = &heads_[current_ & (SLOTS - 1)];
+            TimerNode* n = head->next;
+            while (n != head) {
+                TimerNode* next = n->next;
+                // 转了一整圈才回来的情况下，同一格里可能还有没到期的，留着
+                if (n->deadline <= now) {
+                    Remove(n);
+                    onExpire(n);
+                }
+                n = next;
+            }
+        }
+    }
+
+private:
+    int timeout_;
+    time_t current_;          // 已经处理到哪一秒了
+    TimerNode heads_[SLOTS];  // 每个格子一个带哨兵的双向循环链表
+
+    static void Unlink(TimerNode* n) {
+        n->prev->next = n->next;
+        n->next->prev = n->prev;
+        n->prev = n->next = nullptr;
+    }
+};
+
+#endif // TIMING_WHEEL_H
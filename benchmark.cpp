@@ -1,30 +1,95 @@
 /**
- * 专用压测工具
- * 编译命令: g++ benchmark.cpp -o benchmark -pthread -std=c++11
+ * 压测工具（负载生成器）
+ * 编译命令: g++ benchmark.cpp -o benchmark -pthread -std=c++11 -O2
+ *
+ * 每个线程用一个 epoll 管自己那份连接（非阻塞），每个连接上最多 --pipeline 条请求在路上。两种模式：
+ *   - 闭环（默认）：一个连接上的回复都回来了才发下一批（一批 pipeline 条），和 redis-benchmark 一样；
+ *   - 开环（--rate R）：不管服务端快慢，按固定节奏发（所有连接合计每秒 R 条）。
+ *     延迟从“本该发出去的时间”算起：服务端卡住的时候没能按时发出去的请求，等的时间也算进延迟里
+ *     （coordinated omission 修正，不然卡顿期间“没发”的请求就把尾延迟掩盖掉了）。
+ * 延迟按命令分开记在 HDR 风格的直方图里（Histogram.h），输出 p50 / p99 / p99.9 / max；
+ * --json 另外输出一份，给回归对比用。压测前后各发一次 INFO io，打出服务端平均每条命令的系统调用次数。
+ *
+ * --cluster yes：服务端是多个开了集群模式的进程。先向 --host/--port 要 CLUSTER SLOTS，连接轮流分给各个节点，
+ * 每个连接只发 slot 归自己那个节点的 key（按 --key-dist 抽 key，不归它的重抽），正常情况下一次重定向都没有；
+ * 拓扑变了（迁移中）收到的 -MOVED / -ASK 单独计数，不跟着跳。系统调用次数是所有节点加起来的。
+ *
+ * 用法: ./benchmark [选项]
+ *   --host H / --port P      服务端地址（默认 127.0.0.1:8080）
+ *   --connections C          连接数（默认 50）
+ *   --threads T              客户端线程数（默认 min(C, 4)）
+ *   --requests N             总请求数（默认 1000000）
+ *   --duration S             最多跑几秒（只给 --duration 时不限请求数）
+ *   --pipeline N             每个连接最多 N 条在路上（默认 1）
+ *   --mix set=1,get=1        命令比例，可以用 set / get / incr / del
+ *   --keyspace K             key 的个数（默认 100000），key 长这样：key:000000000042
+ *   --key-dist D             key 的分布：uniform（默认）/ zipf / hotspot
+ *   --zipf-theta X           zipf 的偏斜度，0 < X < 1（默认 0.99，和 YCSB 一样）
+ *   --hotspot F:P            hotspot：F 比例的 key 拿走 P 比例的访问（默认 0.01:0.9）
+ *   --value-size N|MIN-MAX   SET 的 value 长度，固定或者在区间里均匀分布（默认 16）
+ *   --rate R                 开环的目标速率（条/秒），不给就是闭环
+ *   --json FILE              结果写成 JSON（- 表示标准输出）
+ *   --cluster yes|no         集群模式，--host/--port 是随便哪个节点
  */
 
 #include <iostream>
 #include <string>
 #include <vector>
+#include <deque>
 #include <thread>
 #include <atomic>
 #include <chrono>
+#include <random>
+#include <cmath>
+#include <cstdio>
 #include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <algorithm>
 #include <unistd.h>
+#include <fcntl.h>
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
 #include <csignal>
+#include "Histogram.h"
+#include "Crc16.h"
 
 using namespace std;
 
-// ================= 配置区域 =================
-const string SERVER_IP = "127.0.0.1";
-const int SERVER_PORT = 8080;
-const int THREAD_COUNT = 50;        // 并发线程数
-const int REQUESTS_PER_THREAD = 10000; 
-// ===========================================
+enum BenchCmd { BENCH_SET, BENCH_GET, BENCH_INCR, BENCH_DEL, BENCH_CMD_COUNT };
+const char* BENCH_CMD_NAMES[BENCH_CMD_COUNT] = {"set", "get", "incr", "del"};
 
-atomic<int> success_count(0);
+// ================= 配置区域（都可以用命令行改） =================
+struct Options {
+    string host = "127.0.0.1";
+    int port = 8080;
+    int connections = 50;
+    int threads = 0;                 // 0：min(connections, 4)
+    uint64_t requests = 1000000;
+    bool requestsGiven = false;
+    double duration = 0;             // 秒，0 表示不限时
+    int pipeline = 1;
+    string mixText = "set=1,get=1";
+    double mix[BENCH_CMD_COUNT] = {1, 1, 0, 0};
+    uint64_t keyspace = 100000;
+    string keyDist = "uniform";
+    double zipfTheta = 0.99;
+    double hotFraction = 0.01;
+    double hotProb = 0.9;
+    size_t valueMin = 16;
+    size_t valueMax = 16;
+    double rate = 0;                 // 条/秒，0 表示闭环
+    string jsonPath;
+    bool cluster = false;
+};
+Options opt;
+// ===========================================================
+
+static inline uint64_t NowNs() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
 
 //改成redis的输入格式
 string ToResp(const vector<string>& args) {
@@ -35,76 +100,682 @@ string ToResp(const vector<string>& args) {
     return res;
 }
 
-void client_thread_func(int id) {
-    try {
-        int sock = socket(AF_INET, SOCK_STREAM, 0);
-        if (sock < 0) return;
+// p 开头一个完整回复的长度，还没收全返回 0（数组会递归数里面的元素）
+size_t ReplyLength(const char* p, size_t n) {
+    const char* eol = static_cast<const char*>(memchr(p, '\n', n));
+    if (!eol) return 0;
+    size_t head = eol - p + 1;
+    if (p[0] == '$') {
+        long long len = atoll(p + 1);
+        if (len < 0) return head;
+        if (head + len + 2 > n) return 0; // 内容还没收全
+        return head + len + 2;
+    }
+    if (p[0] == '*') {
+        long long cnt = atoll(p + 1);
+        size_t off = head;
+        for (long long i = 0; i < cnt; ++i) {
+            size_t m = ReplyLength(p + off, n - off);
+            if (m == 0) return 0;
+            off += m;
+        }
+        return off;
+    }
+    return head; // + - :
+}
+
+/**
+ * YCSB 用的 Zipfian 生成器（Gray 等人 "Quickly Generating Billion-Record Synthetic Databases"）：
+ * 预先算好 zeta(n)，之后每次抽样 O(1)。返回排名，0 最热。
+ */
+class ZipfGenerator {
+public:
+    ZipfGenerator(uint64_t n, double theta) : n_(n), theta_(theta) {
+        zetan_ = Zeta(n, theta);
+        alpha_ = 1.0 / (1.0 - theta);
+        eta_ = (1 - pow(2.0 / n, 1 - theta)) / (1 - Zeta(2, theta) / zetan_);
+        half_ = 1 + pow(0.5, theta);
+    }
+
+    // u 是 [0, 1) 里均匀分布的随机数
+    uint64_t Next(double u) const {
+        double uz = u * zetan_;
+        if (uz < 1.0) return 0;
+        if (uz < half_) return 1;
+        uint64_t r = static_cast<uint64_t>(n_ * pow(eta_ * u - eta_ + 1, alpha_));
+        return r < n_ ? r : n_ - 1;
+    }
+
+private:
+    static double Zeta(uint64_t n, double theta) {
+        double sum = 0;
+        for (uint64_t i = 1; i <= n; ++i) sum += 1.0 / pow(static_cast<double>(i), theta);
+        return sum;
+    }
+
+    uint64_t n_;
+    double theta_;
+    double zetan_;
+    double alpha_;
+    double eta_;
+    double half_;
+};
 
-        struct sockaddr_in serv_addr;
-        memset(&serv_addr, 0, sizeof(serv_addr));
-        serv_addr.sin_family = AF_INET;
-        serv_addr.sin_port = htons(SERVER_PORT);
-        inet_pton(AF_INET, SERVER_IP.c_str(), &serv_addr.sin_addr);
+ZipfGenerator* g_zipf = nullptr;
+string g_value;                  // 最长的 value，用的时候截一段
 
-        if (connect(sock, (struct sockaddr*)&serv_addr, sizeof(serv_addr)) < 0) {
-            close(sock);
+// 集群模式：节点列表和 slot -> 节点下标（非集群模式只有一个节点，就是 --host/--port）
+struct ClusterNode {
+    string host;
+    int port;
+};
+vector<ClusterNode> g_nodes;
+vector<int> g_slotNode;
+
+struct Pending {
+    uint64_t intended;           // 本该发出去的时间（闭环就是真正发出去的时间）
+    uint8_t cmd;
+};
+
+struct Conn {
+    int fd = -1;
+    string out;                  // 还没发出去的请求
+    size_t outPos = 0;
+    string in;                   // 收到还没解析的回复
+    size_t inPos = 0;
+    deque<Pending> inflight;     // 已经排上队、还没收到回复的请求（按顺序）
+    uint64_t quota = 0;          // 这个连接一共要发多少条
+    uint64_t sent = 0;
+    uint64_t nextDue = 0;        // 开环：下一条本该发出去的时间
+    uint64_t interval = 0;       // 开环：这个连接上两条之间隔多少纳秒
+    int node = 0;                // 连的是 g_nodes 里的哪个
+    bool wantWrite = false;      // 在 epoll 里挂了 EPOLLOUT
+    bool done = false;
+};
+
+struct Worker {
+    vector<Conn> conns;
+    Histogram hist[BENCH_CMD_COUNT];
+    uint64_t completed = 0;
+    uint64_t errors = 0;
+    uint64_t redirects = 0;      // 集群模式：-MOVED / -ASK（也算在 errors 里）
+    bool broken = false;         // 有连接断了
+    mt19937_64 rng;
+    int epfd = -1;
+
+    double Uniform() { return (rng() >> 11) * (1.0 / 9007199254740992.0); }
+
+    uint64_t PickKey() {
+        if (opt.keyDist == "zipf") return g_zipf->Next(Uniform());
+        if (opt.keyDist == "hotspot") {
+            uint64_t hot = max<uint64_t>(1, static_cast<uint64_t>(opt.keyspace * opt.hotFraction));
+            if (hot >= opt.keyspace || Uniform() < opt.hotProb) return rng() % hot;
+            return hot + rng() % (opt.keyspace - hot);
+        }
+        return rng() % opt.keyspace;
+    }
+
+    int PickCommand() {
+        double total = 0;
+        for (int i = 0; i < BENCH_CMD_COUNT; ++i) total += opt.mix[i];
+        double u = Uniform() * total;
+        for (int i = 0; i < BENCH_CMD_COUNT; ++i) {
+            if (u < opt.mix[i]) return i;
+            u -= opt.mix[i];
+        }
+        return BENCH_SET;
+    }
+
+    // 往 c.out 后面拼一条请求。集群模式下 key 不归这个连接的节点就重抽（平均抽节点数那么多次），
+    // 抽了很多次都不行（keyspace 太小，这个节点一个 key 都没有）就用最后一个，收到重定向
+    void AppendCommand(Conn& c, int cmd) {
+        char key[32];
+        int klen = 0;
+        for (int tries = 0; tries < 1000; ++tries) {
+            klen = snprintf(key, sizeof(key), cmd == BENCH_INCR ? "counter:%012llu" : "key:%012llu",
+                            static_cast<unsigned long long>(PickKey()));
+            if (!opt.cluster || g_slotNode[crc16::KeyHashSlot(key, klen)] == c.node) break;
+        }
+        char head[64];
+        switch (cmd) {
+        case BENCH_SET: {
+            size_t vlen = opt.valueMin + rng() % (opt.valueMax - opt.valueMin + 1);
+            c.out += "*3\r\n$3\r\nSET\r\n";
+            snprintf(head, sizeof(head), "$%d\r\n", klen);
+            c.out += head;
+            c.out.append(key, klen);
+            snprintf(head, sizeof(head), "\r\n$%zu\r\n", vlen);
+            c.out += head;
+            c.out.append(g_value.data(), vlen);
+            c.out += "\r\n";
             return;
         }
+        case BENCH_GET: c.out += "*2\r\n$3\r\nGET\r\n"; break;
+        case BENCH_INCR: c.out += "*2\r\n$4\r\nINCR\r\n"; break;
+        default: c.out += "*2\r\n$3\r\nDEL\r\n"; break;
+        }
+        snprintf(head, sizeof(head), "$%d\r\n", klen);
+        c.out += head;
+        c.out.append(key, klen);
+        c.out += "\r\n";
+    }
+
+    void Issue(Conn& c, uint64_t intended) {
+        int cmd = PickCommand();
+        AppendCommand(c, cmd);
+        c.inflight.push_back(Pending{intended, static_cast<uint8_t>(cmd)});
+        c.sent++;
+    }
+
+    // 该发的发掉：闭环是回复都回来了再发一批，开环是到点的都发（在路上的不超过 pipeline 条）
+    void IssueDue(Conn& c, uint64_t now) {
+        if (opt.rate <= 0) {
+            if (!c.inflight.empty()) return;
+            for (int i = 0; i < opt.pipeline && c.sent < c.quota; ++i) Issue(c, now);
+        } else {
+            while (c.sent < c.quota && c.inflight.size() < static_cast<size_t>(opt.pipeline) && c.nextDue <= now) {
+                Issue(c, c.nextDue);
+                c.nextDue += c.interval;
+            }
+        }
+    }
 
-        char buffer[1024];
-        string key = "key_" + to_string(id);
-        string value = "value_" + to_string(id);
+    bool Flush(Conn& c) {
+        while (c.outPos < c.out.size()) {
+            ssize_t n = send(c.fd, c.out.data() + c.outPos, c.out.size() - c.outPos, MSG_NOSIGNAL);
+            if (n > 0) {
+                c.outPos += n;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            return false;
+        }
+        bool pending = c.outPos < c.out.size();
+        if (!pending) {
+            c.out.clear();
+            c.outPos = 0;
+        }
+        if (pending != c.wantWrite) {
+            struct epoll_event ev;
+            ev.events = pending ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+            ev.data.u32 = static_cast<uint32_t>(&c - &conns[0]);
+            epoll_ctl(epfd, EPOLL_CTL_MOD, c.fd, &ev);
+            c.wantWrite = pending;
+        }
+        return true;
+    }
 
-        // 提前生成好命令字符串，避免在循环里反复拼接浪费 CPU
-        vector<string> set_args = {"SET", key, value};
-        string set_cmd = ToResp(set_args);
-        vector<string> get_args = {"GET", key};
-        string get_cmd = ToResp(get_args);
+    // 读到 EAGAIN，数出完整的回复，按本该发出的时间记延迟
+    bool Read(Conn& c, uint64_t now) {
+        char buffer[65536];
+        while (true) {
+            ssize_t n = read(c.fd, buffer, sizeof(buffer));
+            if (n > 0) {
+                c.in.append(buffer, n);
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            return false; // 对端关了或者出错
+        }
+        while (c.inPos < c.in.size()) {
+            size_t m = ReplyLength(c.in.data() + c.inPos, c.in.size() - c.inPos);
+            if (m == 0) break;
+            if (c.inflight.empty()) return false; // 多出来的回复，不应该发生
+            if (c.in[c.inPos] == '-') {
+                errors++;
+                if (m > 4 && (memcmp(c.in.data() + c.inPos, "-MOVED", 6) == 0 || memcmp(c.in.data() + c.inPos, "-ASK", 4) == 0)) {
+                    redirects++;
+                }
+            }
+            const Pending& p = c.inflight.front();
+            hist[p.cmd].Record(now > p.intended ? now - p.intended : 0);
+            c.inflight.pop_front();
+            completed++;
+            c.inPos += m;
+        }
+        if (c.inPos == c.in.size()) {
+            c.in.clear();
+            c.inPos = 0;
+        } else if (c.inPos > 65536) {
+            c.in.erase(0, c.inPos);
+            c.inPos = 0;
+        }
+        return true;
+    }
 
-        for (int i = 0; i < REQUESTS_PER_THREAD; ++i) {
-            // 1. 发送 SET
-            if (send(sock, set_cmd.c_str(), set_cmd.length(), 0) < 0) break;
-            if (read(sock, buffer, 1024) <= 0) break; 
+    void Run(uint64_t deadline) {
+        epfd = epoll_create1(0);
+        for (size_t i = 0; i < conns.size(); ++i) {
+            struct epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.u32 = static_cast<uint32_t>(i);
+            epoll_ctl(epfd, EPOLL_CTL_ADD, conns[i].fd, &ev);
+        }
+        size_t active = conns.size();
+        struct epoll_event events[64];
+        while (active > 0) {
+            uint64_t now = NowNs();
+            bool timeUp = deadline && now >= deadline;
+            uint64_t wake = deadline && !timeUp ? deadline : UINT64_MAX;
+            for (Conn& c : conns) {
+                if (c.done) continue;
+                if (timeUp) c.quota = c.sent; // 时间到了：不再发新的，等在路上的回来
+                IssueDue(c, now);
+                if (!Flush(c)) {
+                    broken = true;
+                    c.done = true;
+                    active--;
+                    continue;
+                }
+                if (c.sent == c.quota && c.inflight.empty()) {
+                    c.done = true;
+                    active--;
+                    continue;
+                }
+                if (opt.rate > 0 && c.sent < c.quota && c.inflight.size() < static_cast<size_t>(opt.pipeline)) {
+                    wake = min(wake, c.nextDue);
+                }
+            }
+            if (active == 0) break;
 
-            // 2. 发送 GET
-            if (send(sock, get_cmd.c_str(), get_cmd.length(), 0) < 0) break;
-            if (read(sock, buffer, 1024) > 0) {
-                success_count++;
-            } else {
-                break;
+            // 开环要按纳秒醒过来发下一条，epoll_pwait2 的超时是 timespec
+            struct timespec ts;
+            struct timespec* tsp = nullptr;
+            if (wake != UINT64_MAX) {
+                uint64_t wait = wake > now ? wake - now : 0;
+                ts.tv_sec = wait / 1000000000ULL;
+                ts.tv_nsec = wait % 1000000000ULL;
+                tsp = &ts;
+            }
+            int n = epoll_pwait2(epfd, events, 64, tsp, nullptr);
+            now = NowNs();
+            for (int i = 0; i < n; ++i) {
+                Conn& c = conns[events[i].data.u32];
+                if (c.done) continue;
+                bool ok = true;
+                if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) ok = Read(c, now);
+                if (ok && (events[i].events & EPOLLOUT)) ok = Flush(c);
+                if (!ok) {
+                    broken = true;
+                    c.done = true;
+                    active--;
+                }
             }
         }
+        for (Conn& c : conns) close(c.fd);
+        close(epfd);
+    }
+};
+
+int ConnectServer(const string& host, int port) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) return -1;
+
+    struct sockaddr_in serv_addr;
+    memset(&serv_addr, 0, sizeof(serv_addr));
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_port = htons(port);
+    inet_pton(AF_INET, host.c_str(), &serv_addr.sin_addr);
+
+    if (connect(sock, (struct sockaddr*)&serv_addr, sizeof(serv_addr)) < 0) {
         close(sock);
-    } catch (...) {}
+        return -1;
+    }
+    return sock;
+}
+
+// 发一条命令，收一个完整的回复（阻塞），连不上 / 断了返回空串
+string Query(const string& host, int port, const vector<string>& args) {
+    int sock = ConnectServer(host, port);
+    if (sock < 0) return "";
+    string cmd = ToResp(args);
+    string in;
+    if (send(sock, cmd.c_str(), cmd.length(), MSG_NOSIGNAL) > 0) {
+        char buffer[4096];
+        while (in.empty() || ReplyLength(in.data(), in.size()) == 0) {
+            ssize_t n = read(sock, buffer, sizeof(buffer));
+            if (n <= 0) break;
+            in.append(buffer, n);
+        }
+    }
+    close(sock);
+    return in;
+}
+
+// 发一次 INFO io，取出 field 的值；取不到（比如老版本的服务端）返回空串
+string QueryInfo(const ClusterNode& node, const string& field) {
+    string in = Query(node.host, node.port, {"INFO", "io"});
+    size_t p = in.find(field + ":");
+    if (p == string::npos) return "";
+    p += field.size() + 1;
+    return in.substr(p, in.find("\r\n", p) - p);
 }
 
-int main() {
+// 所有节点的 io_syscalls 加起来，有一个取不到就是 -1
+double TotalSyscalls() {
+    double total = 0;
+    for (const ClusterNode& node : g_nodes) {
+        string v = QueryInfo(node, "io_syscalls");
+        if (v.empty()) return -1;
+        total += strtod(v.c_str(), nullptr);
+    }
+    return total;
+}
+
+// 读 p 开头的一行（不含 \r\n），p 挪到下一行
+string ReadLine(const char*& p, const char* end) {
+    const char* eol = static_cast<const char*>(memmem(p, end - p, "\r\n", 2));
+    if (!eol) eol = end;
+    string line(p, eol);
+    p = eol + 2 > end ? end : eol + 2;
+    return line;
+}
+
+// 数组头 "*N" 返回 N，不是数组返回 -1
+long long ReadArrayLen(const char*& p, const char* end) {
+    string line = ReadLine(p, end);
+    return !line.empty() && line[0] == '*' ? atoll(line.c_str() + 1) : -1;
+}
+
+// 跳过一个完整的回复
+void SkipReply(const char*& p, const char* end) {
+    size_t m = ReplyLength(p, end - p);
+    p = m ? p + m : end;
+}
+
+/**
+ * 向种子节点要 CLUSTER SLOTS，填 g_nodes / g_slotNode。
+ * 回复是若干段 [start, end, [host, port, id], 从库...]，只用主节点；有 slot 没人负责就失败
+ */
+bool LoadClusterSlots() {
+    string in = Query(opt.host, opt.port, {"CLUSTER", "SLOTS"});
+    const char* p = in.data();
+    const char* end = p + in.size();
+    long long ranges = ReadArrayLen(p, end);
+    if (ranges <= 0) {
+        // 连不上是空串，没开集群模式是 -ERR ...，没分配 slot 是空数组
+        cerr << "CLUSTER SLOTS on " << opt.host << ":" << opt.port << " failed: " << in.substr(0, in.find("\r\n")) << endl;
+        return false;
+    }
+    g_slotNode.assign(crc16::SLOTS, -1);
+    for (long long r = 0; r < ranges; ++r) {
+        long long fields = ReadArrayLen(p, end);
+        if (fields < 3) return false;
+        int start = atoi(ReadLine(p, end).c_str() + 1);
+        int stop = atoi(ReadLine(p, end).c_str() + 1);
+        long long nodeFields = ReadArrayLen(p, end);
+        if (nodeFields < 2) return false;
+        ReadLine(p, end);                        // $len
+        string host = ReadLine(p, end);
+        int port = atoi(ReadLine(p, end).c_str() + 1);
+        for (long long i = 2; i < nodeFields; ++i) SkipReply(p, end);
+        for (long long i = 3; i < fields; ++i) SkipReply(p, end); // 从库
+        int idx = -1;
+        for (size_t i = 0; i < g_nodes.size(); ++i) {
+            if (g_nodes[i].host == host && g_nodes[i].port == port) idx = static_cast<int>(i);
+        }
+        if (idx < 0) {
+            idx = static_cast<int>(g_nodes.size());
+            g_nodes.push_back(ClusterNode{host, port});
+        }
+        for (int s = max(start, 0); s <= stop && s < crc16::SLOTS; ++s) g_slotNode[s] = idx;
+    }
+    for (int s = 0; s < crc16::SLOTS; ++s) {
+        if (g_slotNode[s] < 0) {
+            cerr << "slot " << s << " is not served by any node" << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ParseMix(const string& text) {
+    double mix[BENCH_CMD_COUNT] = {0, 0, 0, 0};
+    double total = 0;
+    size_t start = 0;
+    while (start <= text.size()) {
+        size_t end = text.find(',', start);
+        if (end == string::npos) end = text.size();
+        string item = text.substr(start, end - start);
+        size_t eq = item.find('=');
+        if (eq == string::npos) return false;
+        string name = item.substr(0, eq);
+        double w = atof(item.c_str() + eq + 1);
+        int idx = -1;
+        for (int i = 0; i < BENCH_CMD_COUNT; ++i) {
+            if (name == BENCH_CMD_NAMES[i]) idx = i;
+        }
+        if (idx < 0 || w < 0) return false;
+        mix[idx] = w;
+        total += w;
+        start = end + 1;
+    }
+    if (total <= 0) return false;
+    memcpy(opt.mix, mix, sizeof(mix));
+    opt.mixText = text;
+    return true;
+}
+
+bool ParseArgs(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        string a = argv[i];
+        if (i + 1 >= argc) return false;
+        string v = argv[++i];
+        if (a == "--host") opt.host = v;
+        else if (a == "--port") opt.port = atoi(v.c_str());
+        else if (a == "--connections") opt.connections = atoi(v.c_str());
+        else if (a == "--threads") opt.threads = atoi(v.c_str());
+        else if (a == "--requests") {
+            opt.requests = strtoull(v.c_str(), nullptr, 10);
+            opt.requestsGiven = true;
+        }
+        else if (a == "--duration") opt.duration = atof(v.c_str());
+        else if (a == "--pipeline") opt.pipeline = atoi(v.c_str());
+        else if (a == "--mix") {
+            if (!ParseMix(v)) return false;
+        }
+        else if (a == "--keyspace") opt.keyspace = strtoull(v.c_str(), nullptr, 10);
+        else if (a == "--key-dist") opt.keyDist = v;
+        else if (a == "--zipf-theta") opt.zipfTheta = atof(v.c_str());
+        else if (a == "--hotspot") {
+            if (sscanf(v.c_str(), "%lf:%lf", &opt.hotFraction, &opt.hotProb) != 2) return false;
+        }
+        else if (a == "--value-size") {
+            unsigned long lo = 0, hi = 0;
+            int got = sscanf(v.c_str(), "%lu-%lu", &lo, &hi);
+            if (got == 1) hi = lo;
+            if (got < 1 || lo == 0 || hi < lo) return false;
+            opt.valueMin = lo;
+            opt.valueMax = hi;
+        }
+        else if (a == "--rate") opt.rate = atof(v.c_str());
+        else if (a == "--json") opt.jsonPath = v;
+        else if (a == "--cluster" && (v == "yes" || v == "no")) opt.cluster = v == "yes";
+        else return false;
+    }
+    if (opt.connections < 1 || opt.pipeline < 1 || opt.keyspace < 1) return false;
+    if (opt.keyDist != "uniform" && opt.keyDist != "zipf" && opt.keyDist != "hotspot") return false;
+    if (opt.keyDist == "zipf" && !(opt.zipfTheta > 0 && opt.zipfTheta < 1)) return false;
+    if (opt.keyDist == "hotspot" && !(opt.hotFraction > 0 && opt.hotFraction <= 1 && opt.hotProb >= 0 && opt.hotProb <= 1)) {
+        return false;
+    }
+    if (opt.threads < 1) opt.threads = min(opt.connections, 4);
+    if (opt.threads > opt.connections) opt.threads = opt.connections;
+    if (opt.duration > 0 && !opt.requestsGiven) opt.requests = UINT64_MAX;
+    return true;
+}
+
+void PrintUsage(const char* prog) {
+    cerr << "Usage: " << prog << " [--host H] [--port P] [--connections C] [--threads T] [--requests N] [--duration S]\n"
+         << "       [--pipeline N] [--mix set=1,get=1] [--keyspace K] [--key-dist uniform|zipf|hotspot]\n"
+         << "       [--zipf-theta X] [--hotspot F:P] [--value-size N|MIN-MAX] [--rate R] [--json FILE]\n"
+         << "       [--cluster yes|no]" << endl;
+}
+
+// 一行延迟统计的 JSON（单位微秒）
+string LatencyJson(const Histogram& h) {
+    char buf[256];
+    snprintf(buf, sizeof(buf),
+             "{\"count\": %llu, \"mean\": %.1f, \"p50\": %.1f, \"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f}",
+             static_cast<unsigned long long>(h.Count()), h.Mean() / 1e3, h.Percentile(50) / 1e3,
+             h.Percentile(99) / 1e3, h.Percentile(99.9) / 1e3, h.Max() / 1e3);
+    return buf;
+}
+
+int main(int argc, char* argv[]) {
     signal(SIGPIPE, SIG_IGN);
 
-    cout << "准备开始压测" << endl;
-    cout << "线程数: " << THREAD_COUNT << ", 每线程请求: " << REQUESTS_PER_THREAD << endl;
+    if (!ParseArgs(argc, argv)) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    g_value.assign(opt.valueMax, 'x');
+    if (opt.keyDist == "zipf") g_zipf = new ZipfGenerator(opt.keyspace, opt.zipfTheta);
+    if (opt.cluster) {
+        if (!LoadClusterSlots()) return 1;
+    } else {
+        g_nodes.push_back(ClusterNode{opt.host, opt.port});
+    }
 
-    vector<thread> threads;
-    auto start_time = chrono::high_resolution_clock::now();
+    cout << "准备开始压测" << endl;
+    cout << "连接数: " << opt.connections << ", 线程数: " << opt.threads << ", pipeline: " << opt.pipeline
+         << ", 命令: " << opt.mixText << ", key: " << opt.keyspace << " 个 / " << opt.keyDist
+         << ", 模式: " << (opt.rate > 0 ? "开环 " + to_string(static_cast<long long>(opt.rate)) + " 条/秒" : string("闭环"))
+         << endl;
+    if (opt.cluster) {
+        cout << "集群: " << g_nodes.size() << " 个节点";
+        for (const ClusterNode& node : g_nodes) cout << " " << node.host << ":" << node.port;
+        cout << endl;
+    }
 
-    for (int i = 0; i < THREAD_COUNT; ++i) {
-        threads.emplace_back(client_thread_func, i);
+    // 连接都建好再开始计时；请求数平均分给各个连接，连接轮流分给各个节点
+    vector<Worker> workers(opt.threads);
+    for (int i = 0; i < opt.connections; ++i) {
+        Conn c;
+        c.node = i % static_cast<int>(g_nodes.size());
+        const ClusterNode& node = g_nodes[c.node];
+        c.fd = ConnectServer(node.host, node.port);
+        if (c.fd < 0) {
+            cerr << "connect " << node.host << ":" << node.port << " failed" << endl;
+            return 1;
+        }
+        int one = 1;
+        setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        fcntl(c.fd, F_SETFL, fcntl(c.fd, F_GETFL) | O_NONBLOCK);
+        if (opt.requests == UINT64_MAX) c.quota = UINT64_MAX;
+        else c.quota = opt.requests / opt.connections + (static_cast<uint64_t>(i) < opt.requests % opt.connections ? 1 : 0);
+        workers[i % opt.threads].conns.push_back(std::move(c));
     }
 
+    string backend = QueryInfo(g_nodes[0], "io_backend");
+    double syscalls_before = TotalSyscalls();
+
+    uint64_t start = NowNs();
+    uint64_t deadline = opt.duration > 0 ? start + static_cast<uint64_t>(opt.duration * 1e9) : 0;
+    if (opt.rate > 0) {
+        // 开环：每个连接每隔 connections / rate 秒一条，各连接的起点错开，合起来是均匀的 rate 条/秒
+        uint64_t interval = max<uint64_t>(1, static_cast<uint64_t>(opt.connections * 1e9 / opt.rate));
+        int idx = 0;
+        for (int i = 0; i < opt.connections; ++i) {
+            Conn& c = workers[i % opt.threads].conns[i / opt.threads];
+            c.interval = interval;
+            c.nextDue = start + static_cast<uint64_t>(idx++ * 1e9 / opt.rate);
+        }
+    }
+    vector<thread> threads;
+    for (int i = 0; i < opt.threads; ++i) {
+        workers[i].rng.seed(12345 + i);
+        threads.emplace_back([&workers, i, deadline]() { workers[i].Run(deadline); });
+    }
     for (auto& t : threads) {
-        if(t.joinable()) t.join();
+        if (t.joinable()) t.join();
     }
+    double seconds = (NowNs() - start) / 1e9;
 
-    auto end_time = chrono::high_resolution_clock::now();
-    auto duration = chrono::duration_cast<chrono::milliseconds>(end_time - start_time).count();
-    
-    double seconds = (duration == 0) ? 0.001 : duration / 1000.0;
-    double qps = success_count / seconds;
+    Histogram all;
+    Histogram perCmd[BENCH_CMD_COUNT];
+    uint64_t completed = 0, errors = 0, redirects = 0;
+    bool broken = false;
+    for (Worker& w : workers) {
+        for (int i = 0; i < BENCH_CMD_COUNT; ++i) {
+            perCmd[i].Merge(w.hist[i]);
+            all.Merge(w.hist[i]);
+        }
+        completed += w.completed;
+        errors += w.errors;
+        redirects += w.redirects;
+        broken = broken || w.broken;
+    }
+    double qps = completed / seconds;
 
     cout << "\n✅ 压测完成!" << endl;
-    cout << "成功请求数: " << success_count << endl;
+    if (broken) cout << "⚠️ 有连接中途断开" << endl;
+    cout << "成功请求数: " << completed << "（其中错误回复 " << errors << "）" << endl;
+    if (opt.cluster) cout << "重定向（-MOVED / -ASK）: " << redirects << endl;
     cout << "总耗时: " << seconds << " 秒" << endl;
     cout << "QPS: " << qps << " (次/秒)" << endl;
 
-    return 0;
-}
\ No newline at end of file
+    printf("\n%-6s %10s %10s %10s %10s %10s %10s\n", "cmd", "count", "p50(us)", "p99(us)", "p99.9(us)", "max(us)", "mean(us)");
+    auto row = [](const char* name, const Histogram& h) {
+        printf("%-6s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f\n", name, static_cast<unsigned long long>(h.Count()),
+               h.Percentile(50) / 1e3, h.Percentile(99) / 1e3, h.Percentile(99.9) / 1e3, h.Max() / 1e3, h.Mean() / 1e3);
+    };
+    for (int i = 0; i < BENCH_CMD_COUNT; ++i) {
+        if (perCmd[i].Count() > 0) row(BENCH_CMD_NAMES[i], perCmd[i]);
+    }
+    row("all", all);
+    fflush(stdout);
+
+    double syscalls_after = TotalSyscalls();
+    double per_op = -1;
+    if (syscalls_before >= 0 && syscalls_after >= 0 && completed > 0) {
+        // 前后两次 INFO 自己的几次系统调用忽略不计
+        per_op = (syscalls_after - syscalls_before) / completed;
+        cout << "服务端 I/O 后端: " << backend << ", 系统调用/命令: " << per_op << endl;
+    }
+
+    if (!opt.jsonPath.empty()) {
+        string json = "{\n";
+        char buf[512];
+        snprintf(buf, sizeof(buf),
+                 "  \"config\": {\"host\": \"%s\", \"port\": %d, \"connections\": %d, \"threads\": %d, \"pipeline\": %d, "
+                 "\"mix\": \"%s\", \"keyspace\": %llu, \"key_dist\": \"%s\", \"zipf_theta\": %g, "
+                 "\"hotspot\": \"%g:%g\", \"value_size\": \"%zu-%zu\", \"rate\": %g, \"duration\": %g, "
+                 "\"cluster_nodes\": %d},\n",
+                 opt.host.c_str(), opt.port, opt.connections, opt.threads, opt.pipeline, opt.mixText.c_str(),
+                 static_cast<unsigned long long>(opt.keyspace), opt.keyDist.c_str(), opt.zipfTheta, opt.hotFraction,
+                 opt.hotProb, opt.valueMin, opt.valueMax, opt.rate, opt.duration,
+                 opt.cluster ? static_cast<int>(g_nodes.size()) : 0);
+        json += buf;
+        snprintf(buf, sizeof(buf), "  \"seconds\": %.3f,\n  \"requests\": %llu,\n  \"errors\": %llu,\n  \"redirects\": %llu,\n"
+                 "  \"broken\": %s,\n  \"ops_per_sec\": %.1f,\n",
+                 seconds, static_cast<unsigned long long>(completed), static_cast<unsigned long long>(errors),
+                 static_cast<unsigned long long>(redirects), broken ? "true" : "false", qps);
+        json += buf;
+        json += "  \"latency_us\": {\n    \"all\": " + LatencyJson(all);
+        for (int i = 0; i < BENCH_CMD_COUNT; ++i) {
+            if (perCmd[i].Count() > 0) json += string(",\n    \"") + BENCH_CMD_NAMES[i] + "\": " + LatencyJson(perCmd[i]);
+        }
+        json += "\n  }";
+        if (per_op >= 0) {
+            snprintf(buf, sizeof(buf), ",\n  \"server\": {\"io_backend\": \"%s\", \"syscalls_per_op\": %.4f}",
+                     backend.c_str(), per_op);
+            json += buf;
+        }
+        json += "\n}\n";
+        if (opt.jsonPath == "-") {
+            cout << json;
+        } else {
+            FILE* f = fopen(opt.jsonPath.c_str(), "w");
+            if (!f) {
+                perror("fopen");
+                return 1;
+            }
+            fputs(json.c_str(), f);
+            fclose(f);
+        }
+    }
+    return broken ? 1 : 0;
+}
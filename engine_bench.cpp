@@ -0,0 +1,287 @@
+/**
+ * 存储引擎压测（不走网络，直接调 SkipList / KVStore / 快照）
+ * 改引擎（跳表、哈希索引、对象编码、快照格式）之前先跑一遍留个基线，改完再跑一遍对比，用数字说话。
+ *
+ * 每种 key 数量 × key 顺序（sequential：按 key 从小到大，random：打乱）× value 长度跑一遍：
+ *   skiplist insert / search   SkipList<string, size_t> 本身（和 value 长度无关，只跑一次）
+ *   kv set / get               KVStore::Set / Get（单分片，没有锁竞争）
+ *   kv lpush / lrange          每个列表 100 个元素，LPUSH 一次推一个；LRANGE 0 -1 一次取整个列表（按调用次数算）
+ *   snapshot save / load       kv set 之后的数据写快照 / 读回一个新的 KVStore
+ * 每行输出 ns/op、allocs/op（malloc + new 的次数）、bytes/key（堆上多占的内存；save 是快照文件大小），
+ * 能拿到 PMU 的话再加 cache miss / branch miss（perf_event_open，拿不到打 n/a）。
+ *
+ * 编译命令: g++ engine_bench.cpp -o engine_bench -std=c++11 -O3
+ * 运行: ./engine_bench [key 数量，逗号分隔，默认 1000,100000,1000000] [value 长度，逗号分隔，默认 16,256]
+ *      比如 ./engine_bench 1000,1000000,100000000 16（1 亿个 key 要 20G 左右的内存）
+ * 数字要稳的话绑个核跑：taskset -c 2 ./engine_bench
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <random>
+#include <malloc.h>
+#include <sys/stat.h>
+#include "KVStore.h"
+#include "PerfCounter.h"
+
+using namespace std;
+
+// ================= 分配计数 =================
+// 引擎里既有 new 也有直接 malloc 的（对象、列表节点、哈希索引），干脆把 malloc 家族整个接过来数，
+// new 最后也是走的 malloc。压测是单线程的，普通计数就够了
+static size_t g_alloc_count = 0;
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* p, size_t size);
+
+void* malloc(size_t size) {
+    g_alloc_count++;
+    return __libc_malloc(size);
+}
+void* calloc(size_t n, size_t size) {
+    g_alloc_count++;
+    return __libc_calloc(n, size);
+}
+void* realloc(void* p, size_t size) {
+    g_alloc_count++;
+    return __libc_realloc(p, size);
+}
+}
+
+// 堆上正在用的字节数（小块 + 直接 mmap 的大块）
+static size_t HeapInUse() {
+    struct mallinfo2 mi = mallinfo2();
+    return mi.uordblks + mi.hblkhd;
+}
+// ===========================================
+
+static const size_t LIST_LEN = 100;  // kv lpush / lrange 里每个列表的长度
+static const int READ_ROUNDS = 3;     // 只读的阶段跑几遍取最快的
+static const char* SNAPSHOT_PATH = "engine_bench.db";
+
+struct Result {
+    double ns_per_op = 0;
+    double allocs_per_op = 0;
+    double bytes_per_key = -1;  // < 0：这一项不适用
+    double misses_per_op = -1;  // < 0：拿不到硬件计数器
+    double branch_misses_per_op = -1;
+};
+
+// 测一段代码：ops 是这段里做了多少次操作
+class Probe {
+public:
+    Probe() : misses_(PERF_COUNT_HW_CACHE_MISSES), branches_(PERF_COUNT_HW_BRANCH_MISSES) {}
+
+    void Start() {
+        allocs_ = g_alloc_count;
+        misses_.Start();
+        branches_.Start();
+        t0_ = chrono::steady_clock::now();
+    }
+
+    Result Stop(size_t ops) {
+        auto t1 = chrono::steady_clock::now();
+        uint64_t b = branches_.Stop();
+        uint64_t m = misses_.Stop();
+        Result r;
+        r.ns_per_op = chrono::duration<double, nano>(t1 - t0_).count() / ops;
+        r.allocs_per_op = double(g_alloc_count - allocs_) / ops;
+        if (misses_.Available()) r.misses_per_op = double(m) / ops;
+        if (branches_.Available()) r.branch_misses_per_op = double(b) / ops;
+        return r;
+    }
+
+private:
+    PerfCounter misses_;
+    PerfCounter branches_;
+    size_t allocs_ = 0;
+    chrono::steady_clock::time_point t0_;
+};
+
+// 只读的阶段：跑 READ_ROUNDS 遍，留最快的一遍
+template <typename F>
+static Result BestOf(size_t ops, F f) {
+    Result best;
+    for (int i = 0; i < READ_ROUNDS; ++i) {
+        Probe p;
+        p.Start();
+        f();
+        Result r = p.Stop(ops);
+        if (i == 0 || r.ns_per_op < best.ns_per_op) best = r;
+    }
+    return best;
+}
+
+static string Fmt(double v, const char* fmt) {
+    if (v < 0) return "n/a";
+    char buf[32];
+    snprintf(buf, sizeof(buf), fmt, v);
+    return buf;
+}
+
+static void PrintRow(const char* bench, size_t n, const char* order, const string& value, const Result& r) {
+    string bytes = r.bytes_per_key < 0 ? string("-") : Fmt(r.bytes_per_key, "%.1f");
+    printf("%-16s %11zu %-10s %6s %10.1f %10.2f %10s %14s %14s\n", bench, n, order, value.c_str(), r.ns_per_op,
+           r.allocs_per_op, bytes.c_str(), Fmt(r.misses_per_op, "%.2f").c_str(),
+           Fmt(r.branch_misses_per_op, "%.2f").c_str());
+    fflush(stdout);
+}
+
+static void BenchSkipList(const vector<string>& keys, const vector<size_t>& order, const char* orderName) {
+    size_t n = keys.size();
+    SkipList<string, size_t>* list = new SkipList<string, size_t>();
+    size_t heap = HeapInUse();
+    Probe p;
+    p.Start();
+    for (size_t i = 0; i < n; ++i) list->insert(keys[order[i]], i);
+    Result r = p.Stop(n);
+    r.bytes_per_key = (double(HeapInUse()) - heap) / n;
+    PrintRow("skiplist insert", n, orderName, "-", r);
+
+    size_t found = 0;
+    r = BestOf(n, [&]() {
+        size_t v = 0;
+        found = 0;
+        for (size_t i = 0; i < n; ++i) found += list->search(keys[order[i]], v);
+    });
+    PrintRow("skiplist search", n, orderName, "-", r);
+    if (found != n) cerr << "skiplist search miss: " << n - found << endl;
+    delete list;
+}
+
+static void BenchKVStore(const vector<string>& keys, const vector<size_t>& order, const char* orderName, size_t vlen) {
+    size_t n = keys.size();
+    string value(vlen, 'x');
+    string vname = to_string(vlen);
+
+    // set / get
+    KVStore* store = new KVStore("", 1, false);
+    size_t heap = HeapInUse();
+    Probe p;
+    p.Start();
+    for (size_t i = 0; i < n; ++i) store->Set(keys[order[i]], value);
+    Result r = p.Stop(n);
+    r.bytes_per_key = (double(HeapInUse()) - heap) / n;
+    PrintRow("kv set", n, orderName, vname, r);
+
+    size_t found = 0;
+    string out;
+    r = BestOf(n, [&]() {
+        found = 0;
+        for (size_t i = 0; i < n; ++i) found += store->Get(keys[order[i]], &out) == 1;
+    });
+    PrintRow("kv get", n, orderName, vname, r);
+    if (found != n) cerr << "kv get miss: " << n - found << endl;
+
+    // snapshot save / load
+    uint64_t records = 0;
+    p.Start();
+    bool ok = store->WriteSnapshot(SNAPSHOT_PATH, &records);
+    r = p.Stop(n);
+    struct stat st;
+    if (ok && stat(SNAPSHOT_PATH, &st) == 0) r.bytes_per_key = double(st.st_size) / n;
+    PrintRow("snapshot save", n, orderName, vname, r);
+    if (!ok || records != n) cerr << "snapshot save failed: " << records << " of " << n << endl;
+    delete store;
+
+    store = new KVStore("", 1, false);
+    heap = HeapInUse();
+    // 读快照会打一行 "Loaded N records"，和表格混在一起，先关掉
+    streambuf* saved = cout.rdbuf(nullptr);
+    p.Start();
+    store->LoadSnapshot(SNAPSHOT_PATH);
+    r = p.Stop(n);
+    cout.rdbuf(saved);
+    r.bytes_per_key = (double(HeapInUse()) - heap) / n;
+    PrintRow("snapshot load", n, orderName, vname, r);
+    found = 0;
+    for (size_t i = 0; i < n; ++i) found += store->Get(keys[i], &out) == 1;
+    if (found != n) cerr << "snapshot load miss: " << n - found << endl;
+    delete store;
+    remove(SNAPSHOT_PATH);
+
+    // lpush / lrange：n 个元素分到 n / LIST_LEN 个列表里
+    size_t lists = max<size_t>(1, n / LIST_LEN);
+    store = new KVStore("", 1, false);
+    Slice item(value);
+    heap = HeapInUse();
+    p.Start();
+    for (size_t round = 0; round < LIST_LEN; ++round) {
+        for (size_t i = 0; i < lists; ++i) {
+            const string& k = keys[order[i]];
+            store->Push(k, HashKey(k), true, &item, 1);
+        }
+    }
+    r = p.Stop(lists * LIST_LEN);
+    r.bytes_per_key = (double(HeapInUse()) - heap) / lists;
+    PrintRow("kv lpush", n, orderName, vname, r);
+
+    size_t items = 0;
+    r = BestOf(lists, [&]() {
+        items = 0;
+        for (size_t i = 0; i < lists; ++i) {
+            const string& k = keys[order[i]];
+            store->LRange(k, HashKey(k), 0, -1, [](size_t) {}, [&](const Slice& s) { items += s.size() > 0; });
+        }
+    });
+    PrintRow("kv lrange", n, orderName, vname, r);
+    if (items != lists * LIST_LEN) cerr << "kv lrange got " << items << " of " << lists * LIST_LEN << endl;
+    delete store;
+}
+
+static vector<size_t> ParseList(const char* s) {
+    vector<size_t> out;
+    while (*s) {
+        char* end;
+        size_t v = strtoull(s, &end, 10);
+        if (end == s) break;
+        if (v > 0) out.push_back(v);
+        s = *end == ',' ? end + 1 : end;
+    }
+    return out;
+}
+
+int main(int argc, char* argv[]) {
+    vector<size_t> sizes = ParseList(argc > 1 ? argv[1] : "1000,100000,1000000");
+    vector<size_t> values = ParseList(argc > 2 ? argv[2] : "16,256");
+    if (sizes.empty() || values.empty()) {
+        cerr << "Usage: " << argv[0] << " [keys,keys,...] [value,value,...]" << endl;
+        return 1;
+    }
+
+    PerfCounter probe(PERF_COUNT_HW_CACHE_MISSES);
+    cout << "硬件计数器: " << (probe.Available() ? "可用" : "拿不到（虚拟机 / 容器里常见），cache / branch miss 打 n/a") << endl;
+    cout << "kv lpush 每个列表 " << LIST_LEN << " 个元素，bytes/key 按列表个数算；kv lrange 每次取整个列表" << endl;
+    printf("%-16s %11s %-10s %6s %10s %10s %10s %14s %14s\n", "bench", "keys", "order", "value", "ns/op", "allocs/op",
+           "bytes/key", "cache-miss/op", "branch-miss/op");
+
+    for (size_t n : sizes) {
+        // key 固定 14 字节，落在 std::string 的 SSO 里，排除 key 自身的堆分配干扰
+        vector<string> keys;
+        keys.reserve(n);
+        char buf[32];
+        for (size_t i = 0; i < n; ++i) {
+            snprintf(buf, sizeof(buf), "key_%010zu", i);
+            keys.push_back(buf);
+        }
+        vector<size_t> sequential(n);
+        for (size_t i = 0; i < n; ++i) sequential[i] = i;
+        vector<size_t> shuffled = sequential;
+        shuffle(shuffled.begin(), shuffled.end(), mt19937_64(42));
+
+        BenchSkipList(keys, sequential, "sequential");
+        BenchSkipList(keys, shuffled, "random");
+        for (size_t v : values) {
+            BenchKVStore(keys, sequential, "sequential", v);
+            BenchKVStore(keys, shuffled, "random", v);
+        }
+    }
+    return 0;
+}
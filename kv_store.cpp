@@ -1,153 +1,251 @@
 
 #include <iostream>     // cout, endl
-#include <cstring>      // memset
+#include <cstring>      // strcmp
+#include <strings.h>    // strcasecmp
+#include <cstdlib>      // atoi
 #include <csignal>      // signal, SIGINT
-#include <map>          // fdmap
-#include <unistd.h>     // close
-#include <fcntl.h>      // fcntl, O_NONBLOCK
-#include <sys/socket.h> // socket, bind, listen, accept
-#include <netinet/in.h> // sockaddr_in
-#include <arpa/inet.h>  // htons
-#include <netinet/tcp.h>
-#include "Epoller.h"
-#include "Connection.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "Config.h"
+#include "Reactor.h"
 #include "KVStore.h"
+#include "Persistence.h"
+#include "Aof.h"
+#include "Replication.h"
+#include "Cluster.h"
+#include "Command.h"
 
 using namespace std;
 //服务端
-#define PORT 8080
-#define MAX_EVENTS 1000
-bool stop_server = false;
+ServerConfig g_config;
+atomic<bool> stop_server(false);
 // 信号处理函数
 void handle_signal(int sig) {
     //cout << "\n[Server] Caught signal " << sig << ", shutting down..." << endl;
-    stop_server = true; 
+    stop_server = true;
 }
 
-KVStore g_store("data.db");
-map<int, Connection*> fdmap; 
-const int TIMEOUT = 10; 
+KVStore* g_store = nullptr;
+Persistence* g_persistence = nullptr;
+Aof* g_aof = nullptr;
+Replication* g_repl = nullptr;
+Cluster* g_cluster = nullptr;
 
-void set_nodelay(int sock) {
-    int opt = 1;
-    // 禁用 Nagle 算法，有数据立刻发，不等待
-    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+// KVStore 的 FeedFn：写操作交给 AOF（开了的话）和复制（积压环没开时直接返回）
+void FeedAll(int shard, const Slice* argv, int argc) {
+    if (g_config.appendonly) g_aof->Feed(argv, argc);
+    g_repl->Feed(shard, argv, argc);
 }
-// 工具函数：把 Socket 设置为“非阻塞”
-void set_nonblocking(int sock) {
-    int opts = fcntl(sock, F_GETFL);
-    if (opts < 0) {
-        perror("fcntl(F_GETFL)");
-        return;
-    } 
-    opts = opts | O_NONBLOCK;
-    if (fcntl(sock, F_SETFL, opts) < 0) {
-        perror("fcntl(F_SETFL)");
-        return;
+
+// --save "3600 1 300 100"：每两个数一组；空串表示关掉自动保存
+bool parse_save(const char* s) {
+    g_config.save_params.clear();
+    char* end;
+    while (true) {
+        while (*s == ' ') s++;
+        if (*s == '\0') return true;
+        long seconds = strtol(s, &end, 10);
+        if (end == s || seconds < 0) return false;
+        s = end;
+        long changes = strtol(s, &end, 10);
+        if (end == s || changes < 0) return false;
+        s = end;
+        g_config.save_params.push_back(SaveParam{static_cast<int>(seconds), static_cast<int>(changes)});
     }
 }
-int main() {
-    // 1. 创建监听 Socket
-    signal(SIGINT, handle_signal);
-    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    
-    struct sockaddr_in address;
-    memset(&address, 0, sizeof(address));
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(PORT);
-
-    // 端口复用
-    int opt = 1;
-    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
 
-    ::bind(server_fd, (struct sockaddr*)&address, sizeof(address));
-    listen(server_fd, 100); 
+// --maxmemory 100mb：可以带 kb / mb / gb（1024 进制），不带就是字节
+bool parse_memory(const char* s, size_t* out) {
+    char* end;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (end == s) return false;
+    unsigned long long mul = 1;
+    if (strcasecmp(end, "kb") == 0 || strcasecmp(end, "k") == 0) mul = 1024ull;
+    else if (strcasecmp(end, "mb") == 0 || strcasecmp(end, "m") == 0) mul = 1024ull * 1024;
+    else if (strcasecmp(end, "gb") == 0 || strcasecmp(end, "g") == 0) mul = 1024ull * 1024 * 1024;
+    else if (*end != '\0' && strcasecmp(end, "b") != 0) return false;
+    *out = static_cast<size_t>(v * mul);
+    return true;
+}
 
-    cout << "Epoll Server started on port " << PORT << endl;
+bool parse_policy(const char* s) {
+    static const struct { const char* name; MaxmemoryPolicy policy; } kPolicies[] = {
+        {"noeviction", MAXMEMORY_NOEVICTION},
+        {"allkeys-lru", MAXMEMORY_ALLKEYS_LRU},
+        {"allkeys-lfu", MAXMEMORY_ALLKEYS_LFU},
+        {"volatile-ttl", MAXMEMORY_VOLATILE_TTL},
+    };
+    for (const auto& p : kPolicies) {
+        if (strcmp(s, p.name) == 0) {
+            g_config.maxmemory_policy = p.policy;
+            return true;
+        }
+    }
+    return false;
+}
 
-    //创建 Epoll 对象
-    Epoller epoller;
-     // 监控EPOLLIN
-     epoller.AddFd(server_fd,EPOLLIN);
+// 解析命令行：./kv_store [--port P] [--threads N] [--io-backend epoll|io_uring] [--output-hwm BYTES] [--save "SECONDS CHANGES ..."]
+//                        [--appendonly yes|no] [--appendfsync always|everysec|no]
+//                        [--maxmemory BYTES] [--maxmemory-policy POLICY] [--maxmemory-samples N]
+//                        [--slowlog-log-slower-than MICROSECONDS] [--slowlog-max-len N]
+//                        [--replicaof "HOST PORT"] [--repl-backlog-size BYTES] [--repl-output-limit BYTES] [--repl-timeout SECONDS]
+//                        [--cluster-enabled yes|no] [--cluster-nodes "HOST:PORT=SLOTS ..."] [--cluster-announce-ip IP]
+void parse_args(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            g_config.threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            g_config.port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--io-backend") == 0 && i + 1 < argc && strcmp(argv[i + 1], "epoll") == 0) {
+            g_config.io_backend = IO_BACKEND_EPOLL;
+            ++i;
+        } else if (strcmp(argv[i], "--io-backend") == 0 && i + 1 < argc && strcmp(argv[i + 1], "io_uring") == 0) {
+            g_config.io_backend = IO_BACKEND_IO_URING;
+            ++i;
+        } else if (strcmp(argv[i], "--output-hwm") == 0 && i + 1 < argc) {
+            g_config.output_hwm = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc && parse_save(argv[i + 1])) {
+            ++i;
+        } else if (strcmp(argv[i], "--appendonly") == 0 && i + 1 < argc &&
+                   (strcmp(argv[i + 1], "yes") == 0 || strcmp(argv[i + 1], "no") == 0)) {
+            g_config.appendonly = strcmp(argv[++i], "yes") == 0;
+        } else if (strcmp(argv[i], "--appendfsync") == 0 && i + 1 < argc && strcmp(argv[i + 1], "always") == 0) {
+            g_config.appendfsync = FSYNC_ALWAYS;
+            ++i;
+        } else if (strcmp(argv[i], "--appendfsync") == 0 && i + 1 < argc && strcmp(argv[i + 1], "everysec") == 0) {
+            g_config.appendfsync = FSYNC_EVERYSEC;
+            ++i;
+        } else if (strcmp(argv[i], "--appendfsync") == 0 && i + 1 < argc && strcmp(argv[i + 1], "no") == 0) {
+            g_config.appendfsync = FSYNC_NO;
+            ++i;
+        } else if (strcmp(argv[i], "--maxmemory") == 0 && i + 1 < argc && parse_memory(argv[i + 1], &g_config.maxmemory)) {
+            ++i;
+        } else if (strcmp(argv[i], "--maxmemory-policy") == 0 && i + 1 < argc && parse_policy(argv[i + 1])) {
+            ++i;
+        } else if (strcmp(argv[i], "--maxmemory-samples") == 0 && i + 1 < argc) {
+            g_config.maxmemory_samples = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--slowlog-log-slower-than") == 0 && i + 1 < argc) {
+            g_config.slowlog_log_slower_than = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "--slowlog-max-len") == 0 && i + 1 < argc) {
+            g_config.slowlog_max_len = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--replicaof") == 0 && i + 1 < argc) {
+            g_config.replicaof = argv[++i];
+        } else if (strcmp(argv[i], "--repl-backlog-size") == 0 && i + 1 < argc &&
+                   parse_memory(argv[i + 1], &g_config.repl_backlog_size)) {
+            ++i;
+        } else if (strcmp(argv[i], "--repl-output-limit") == 0 && i + 1 < argc &&
+                   parse_memory(argv[i + 1], &g_config.repl_output_limit)) {
+            ++i;
+        } else if (strcmp(argv[i], "--repl-timeout") == 0 && i + 1 < argc) {
+            g_config.repl_timeout = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--cluster-enabled") == 0 && i + 1 < argc &&
+                   (strcmp(argv[i + 1], "yes") == 0 || strcmp(argv[i + 1], "no") == 0)) {
+            g_config.cluster_enabled = strcmp(argv[++i], "yes") == 0;
+        } else if (strcmp(argv[i], "--cluster-nodes") == 0 && i + 1 < argc) {
+            g_config.cluster_nodes = argv[++i];
+        } else if (strcmp(argv[i], "--cluster-announce-ip") == 0 && i + 1 < argc) {
+            g_config.cluster_announce_ip = argv[++i];
+        } else {
+            cerr << "Usage: " << argv[0] << " [--port P] [--threads N] [--io-backend epoll|io_uring] [--output-hwm BYTES]"
+                 << " [--save \"SECONDS CHANGES ...\"] [--appendonly yes|no]"
+                 << " [--appendfsync always|everysec|no] [--maxmemory BYTES]"
+                 << " [--maxmemory-policy noeviction|allkeys-lru|allkeys-lfu|volatile-ttl]"
+                 << " [--maxmemory-samples N] [--slowlog-log-slower-than MICROSECONDS] [--slowlog-max-len N]"
+                 << " [--replicaof \"HOST PORT\"] [--repl-backlog-size BYTES] [--repl-output-limit BYTES]"
+                 << " [--repl-timeout SECONDS] [--cluster-enabled yes|no] [--cluster-nodes \"HOST:PORT=SLOTS ...\"]"
+                 << " [--cluster-announce-ip IP]" << endl;
+            exit(1);
+        }
+    }
+    if (g_config.threads < 1) g_config.threads = 1;
+    if (g_config.output_hwm == 0) g_config.output_hwm = 1;
+    if (g_config.repl_backlog_size < 16 * 1024) g_config.repl_backlog_size = 16 * 1024;
+    if (g_config.repl_timeout < 1) g_config.repl_timeout = 1;
+}
 
-    // =====================================================================
-    // 4. 事件循环 (Event Loop)
-    // =====================================================================
-    while (!stop_server) {
-        // nfds: 返回有多少个 socket 有事发生了
-        int nfds = epoller.Wait(500);//五百毫秒去检查一次僵尸连接
+int main(int argc, char* argv[]) {
+    parse_args(argc, argv);
+    // 拓扑先定下来：没开集群模式时 g_cluster 也在，Enabled() 是 false，命令不检查 slot
+    g_cluster = new Cluster();
+    if (g_config.cluster_enabled) {
+        string err;
+        if (!g_cluster->Init(g_config.cluster_announce_ip, g_config.port, g_config.cluster_nodes, &err)) {
+            cerr << "Bad cluster config: " << err << endl;
+            return 1;
+        }
+    }
+    signal(SIGINT, handle_signal);
+    signal(SIGPIPE, SIG_IGN); // 对端已关闭时 send 不要把整个进程带走
+    // 先把 tick 和纳秒的比例标定好（要 10ms），SLOWLOG 的阈值要换成 tick
+    SlowLog::Instance().Configure(g_config.slowlog_log_slower_than, g_config.slowlog_max_len);
 
-        // 遍历所有有事的 Socket
-        for (int i = 0; i < nfds; ++i) {
-            
-            // 情况 A: 如果是 server_fd 有事，说明有新的客户
-            if (epoller.GetEventFd(i) == server_fd) {
-                struct sockaddr_in client_addr;
-                socklen_t client_len = sizeof(client_addr);
-                int client_sock = accept(server_fd, (struct sockaddr*)&client_addr, &client_len);
+    // 分片数和线程数一致
+    // 开了 AOF 并且已经有 AOF 文件：数据以 AOF 为准（base + incr），不读 data.db
+    bool fromAof = g_config.appendonly && Aof::HasManifest();
+    g_store = new KVStore("data.db", g_config.threads, !fromAof);
+    g_aof = new Aof();
+    if (g_config.appendonly) g_aof->Start(ReplayCommand);
+    g_repl = new Replication();
+    g_repl->Start(ReplayCommand, FeedAll);
+    // 没开 AOF 的话等第一个从库来了再装（Replication::SnapshotForked）
+    if (g_config.appendonly) g_store->SetFeed(FeedAll);
+    if (!g_config.replicaof.empty()) {
+        char host[256];
+        int port;
+        if (sscanf(g_config.replicaof.c_str(), "%255s %d", host, &port) != 2) {
+            cerr << "Bad --replicaof, expected \"HOST PORT\"" << endl;
+            return 1;
+        }
+        g_repl->ReplicaOf(host, port);
+    }
+    // 加载完再打开 maxmemory：加载出来的数据超了也先全留着，之后的写命令再慢慢淘汰
+    g_store->SetMaxmemory(g_config.maxmemory, g_config.maxmemory_policy, g_config.maxmemory_samples);
+    g_persistence = new Persistence();
 
-                
-                if (client_sock > 0) {
-                    //cout << "New Client Connected: " << client_sock << endl;
-                    
-                    // 关键：把新来的 client_sock 设为非阻塞
-                    set_nonblocking(client_sock);
-                    set_nodelay(client_sock);
+    // 内核没有 io_uring（太老 / 被 seccomp、io_uring_disabled 禁了）就退回 epoll
+    if (g_config.io_backend == IO_BACKEND_IO_URING && !Reactor::UringSupported()) {
+        cerr << "io_uring is not available, falling back to epoll" << endl;
+        g_config.io_backend = IO_BACKEND_EPOLL;
+    }
 
-                    // 关键：把新来的 client_sock 也拉进 Epoll 群里监控
-                    epoller.AddFd(client_sock,EPOLLIN);
-                    Connection *conn = new Connection(client_sock);
-                    fdmap[client_sock] = conn;
-                }
-            }
-            // 情况 B: 如果是其他 fd 有事，说明有数据
-            else if (epoller.GetEvents(i) & EPOLLIN) {
-                int sockfd = epoller.GetEventFd(i);
-                Connection *cur = fdmap[sockfd];
-                ssize_t n = cur->Read();
-                if(n>0)
-                {
-                    cur->Process();
-                }
-                else 
-                {
-                    // valread == 0 表示客户端断开了连接
-                    // valread < 0 表示出错
-                    //cout << "Client " << sockfd << " disconnected." << endl;
-                    
-                    //从 Epoll 群里踢出去
-                    epoller.DelFd(sockfd);
-                    //关闭 Socket
-                    delete fdmap[sockfd];
-                    fdmap.erase(sockfd);
-                }
-            }
-        }
-        time_t now = time(nullptr); // 获取当前时间
-        for (auto it = fdmap.begin(); it != fdmap.end(); ) {
-            Connection* conn = it->second;
-            
-            // 检查：(当前时间 - 最后活跃时间) 是否超过 10秒
-            if (now - conn->GetLastActiveTime() > TIMEOUT) {
-                //cout << "[Timeout] Kicking client: " <<  conn->GetFd() << endl;
-                
-                //踢出 Epoll (不再监控)
-                epoller.DelFd(conn->GetFd());
-                
-                //销毁对象 (析构函数会自动 close socket)
-                delete conn;
-                
-                //从 map 移除，并让迭代器指向下一个
-                // erase 会返回下一个有效的迭代器，这样就不会崩
-                it = fdmap.erase(it); 
-            } else {
-                // 没超时，手动指向下一个
-                it++;
-            }
+    // 1. 每个线程一个 Reactor，各自创建监听 Socket（SO_REUSEPORT）
+    vector<Reactor*> reactors;
+    for (int i = 0; i < g_config.threads; ++i) {
+        Reactor* r = new Reactor(i, g_config.port);
+        if (!r->Listen()) {
+            delete r;
+            for (Reactor* x : reactors) delete x;
+            delete g_store;
+            return 1;
         }
+        reactors.push_back(r);
     }
 
-    close(server_fd);
+    cout << (g_config.io_backend == IO_BACKEND_IO_URING ? "io_uring" : "Epoll")
+         << " Server started on port " << g_config.port
+         << " with " << g_config.threads << " reactor thread(s)" << endl;
+
+    // 2. 每个 Reactor 跑在自己的线程里，主线程等它们退出
+    vector<thread> workers;
+    for (Reactor* r : reactors) {
+        workers.emplace_back([r]() { r->Loop(); });
+    }
+    for (auto& t : workers) {
+        if (t.joinable()) t.join();
+    }
+
+    for (Reactor* r : reactors) delete r;
+    // 复制线程可能在往 KVStore 里重放，先停掉它
+    g_repl->Shutdown();
+    // 后台保存还没写完就不等了，下面的前台保存会写一份更新的
+    g_persistence->Shutdown();
+    delete g_persistence;
+    g_store->SetFeed(nullptr);
+    delete g_repl;
+    delete g_aof; // 写完、落盘
+    // 析构时触发快照保存
+    delete g_store;
+    delete g_cluster;
     return 0;
-}
\ No newline at end of file
+}
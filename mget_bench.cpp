@@ -0,0 +1,140 @@
+/**
+ * 批量查找压测（MGET 的底层）
+ * 对比“一个一个查”和“一批齐头并进 + 预取”（SkipList::searchBatch / HashIndex::FindBatch）的每个 key 的开销。
+ * key 随机取、每次 fanout 个一批（对应一条 MGET 里的 key 数），key 数量越大，数据越装不进缓存，差距越明显。
+ * 编译命令: g++ mget_bench.cpp -o mget_bench -std=c++11 -O3
+ * 运行: ./mget_bench [fanout，默认 100] [key 数量 ...，默认 1000000 10000000]
+ *      比如 ./mget_bench 100 1000000 10000000 100000000（1 亿个 key 要 20G 左右的内存）
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <random>
+#include <memory>
+#include "SkipList.h"
+#include "HashIndex.h"
+#include "PerfCounter.h"
+
+using namespace std;
+
+typedef SkipList<string, size_t> List;
+typedef List::Node Node;
+
+static const size_t LOOKUPS = 2000000; // 每种方式一共查多少个 key
+
+struct Result {
+    double ns_per_key;
+    double misses_per_key; // < 0 表示拿不到硬件计数器
+};
+
+// 跑 LOOKUPS 个 key，每 fanout 个调一次 f(第一个 key 的下标, 个数)，返回找到的个数（不对就是实现有问题）
+template <typename F>
+static size_t measure(size_t fanout, Result* r, F f) {
+    PerfCounter misses(PERF_COUNT_HW_CACHE_MISSES);
+    size_t found = 0;
+    misses.Start();
+    auto t0 = chrono::steady_clock::now();
+    for (size_t i = 0; i + fanout <= LOOKUPS; i += fanout) found += f(i, fanout);
+    auto t1 = chrono::steady_clock::now();
+    uint64_t m = misses.Stop();
+    size_t n = LOOKUPS / fanout * fanout;
+    r->ns_per_key = chrono::duration<double, nano>(t1 - t0).count() / n;
+    r->misses_per_key = misses.Available() ? double(m) / n : -1;
+    return found;
+}
+
+static void print_row(size_t n, const char* index, const char* mode, const Result& r, double base) {
+    char misses[32];
+    if (r.misses_per_key < 0) snprintf(misses, sizeof(misses), "n/a");
+    else snprintf(misses, sizeof(misses), "%.2f", r.misses_per_key);
+    printf("%-11zu %-9s %-10s %10.1f %14s %8.2fx\n", n, index, mode, r.ns_per_key, misses, base / r.ns_per_key);
+}
+
+static void run(size_t n, size_t fanout) {
+    char buf[32];
+    vector<string> keys;
+    keys.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        snprintf(buf, sizeof(buf), "key_%010zu", i);
+        keys.push_back(buf);
+    }
+    // 按随机顺序插入，节点在内存里是打散的（和线上一样，不是按 key 顺序排好的）
+    vector<size_t> order(n);
+    for (size_t i = 0; i < n; ++i) order[i] = i;
+    shuffle(order.begin(), order.end(), mt19937_64(42));
+    List* list = new List();
+    HashIndex<Node>* index = new HashIndex<Node>();
+    index->Reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        const string& k = keys[order[i]];
+        index->Insert(list->insertNode(k, order[i]), HashKey(k));
+    }
+
+    // 要查的 key 提前抽好、哈希提前算好，计时里只有查找本身
+    mt19937_64 rng(7);
+    vector<Slice> probe(LOOKUPS);
+    vector<uint64_t> hashes(LOOKUPS);
+    for (size_t i = 0; i < LOOKUPS; ++i) {
+        probe[i] = Slice(keys[rng() % n]);
+        hashes[i] = HashKey(probe[i]);
+    }
+    vector<size_t> values(fanout);
+    unique_ptr<bool[]> found(new bool[fanout]);
+    vector<Node*> nodes(fanout);
+    Result seq, batch;
+    size_t expect = LOOKUPS / fanout * fanout;
+
+    size_t got = measure(fanout, &seq, [&](size_t from, size_t m) {
+        size_t hit = 0;
+        for (size_t j = 0; j < m; ++j) hit += list->search(probe[from + j], values[j]);
+        return hit;
+    });
+    if (got != expect) cerr << "skiplist search miss: " << expect - got << endl;
+    got = measure(fanout, &batch, [&](size_t from, size_t m) {
+        list->searchBatch(&probe[from], m, values.data(), found.get());
+        size_t hit = 0;
+        for (size_t j = 0; j < m; ++j) hit += found[j];
+        return hit;
+    });
+    if (got != expect) cerr << "skiplist searchBatch miss: " << expect - got << endl;
+    print_row(n, "skiplist", "sequential", seq, seq.ns_per_key);
+    print_row(n, "skiplist", "batched", batch, seq.ns_per_key);
+
+    got = measure(fanout, &seq, [&](size_t from, size_t m) {
+        size_t hit = 0;
+        for (size_t j = 0; j < m; ++j) hit += index->Find(probe[from + j], hashes[from + j]) != nullptr;
+        return hit;
+    });
+    if (got != expect) cerr << "hash Find miss: " << expect - got << endl;
+    got = measure(fanout, &batch, [&](size_t from, size_t m) {
+        index->FindBatch(&probe[from], &hashes[from], m, nodes.data());
+        size_t hit = 0;
+        for (size_t j = 0; j < m; ++j) hit += nodes[j] != nullptr;
+        return hit;
+    });
+    if (got != expect) cerr << "hash FindBatch miss: " << expect - got << endl;
+    print_row(n, "hash", "sequential", seq, seq.ns_per_key);
+    print_row(n, "hash", "batched", batch, seq.ns_per_key);
+
+    delete index;
+    delete list;
+}
+
+int main(int argc, char* argv[]) {
+    size_t fanout = 100;
+    if (argc > 1) fanout = strtoull(argv[1], nullptr, 10);
+    if (fanout < 1) fanout = 1;
+    vector<size_t> sizes;
+    for (int i = 2; i < argc; ++i) sizes.push_back(strtoull(argv[i], nullptr, 10));
+    if (sizes.empty()) sizes = {1000000, 10000000};
+
+    cout << "每批 " << fanout << " 个 key，每种方式查 " << LOOKUPS << " 个" << endl;
+    printf("%-11s %-9s %-10s %10s %14s %9s\n", "keys", "index", "mode", "ns/key", "cache-miss/key", "speedup");
+    for (size_t n : sizes) run(n, fanout);
+    return 0;
+}
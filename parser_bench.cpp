@@ -0,0 +1,200 @@
+/**
+ * RESP 解析压测（不走网络，只测 RespParser 本身）
+ * 1. 找行尾：同一段 pipeline 数据，用各个实现（逐字节 / memchr / SSE2 / AVX2）把所有 '\n' 找出来，看 GB/s；
+ * 2. 转长度："$N" 里的数字，逐位循环 vs SWAR（RespScan.h 的 ParseLength），看每个多少 ns；
+ * 3. 整体：模拟一次 read 16KB 喂给 RespParser，解析完一批 Consume 一次，看每条命令多少 ns。
+ * 命令是 redis-benchmark 那种 SET / GET 对半的小命令。
+ * 编译命令: g++ parser_bench.cpp -o parser_bench -std=c++11 -O3
+ * 运行: ./parser_bench [value 长度，默认 16] [命令条数，默认 1000000]
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include "RespParser.h"
+
+using namespace std;
+
+static const size_t READ_SIZE = 16 * 1024; // 模拟一次 read 读到的字节数
+static const int ROUNDS = 5;               // 每项跑几遍取最快的
+
+// 之前的做法：memchr 一个一个找
+static size_t ScanMemchr(const char* p, size_t from, size_t to, size_t* out, size_t max) {
+    size_t k = 0;
+    while (from < to) {
+        const char* nl = static_cast<const char*>(memchr(p + from, '\n', to - from));
+        if (!nl) break;
+        out[k++] = nl - p;
+        if (k == max) break;
+        from = nl - p + 1;
+    }
+    return k;
+}
+
+// 之前的长度解析：逐位循环，每位判断一次
+static bool ParseLengthLoop(const char* s, size_t n, long long limit, long long* out) {
+    if (n == 0) return false;
+    long long v = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (s[i] < '0' || s[i] > '9') return false;
+        v = v * 10 + (s[i] - '0');
+        if (v > limit) return false;
+    }
+    *out = v;
+    return true;
+}
+
+static string MakePipeline(size_t commands, size_t valueSize) {
+    string out;
+    string value(valueSize, 'x');
+    char key[32];
+    char head[64];
+    for (size_t i = 0; i < commands; ++i) {
+        int klen = snprintf(key, sizeof(key), "key:%012zu", i % 100000);
+        if (i % 2 == 0) {
+            snprintf(head, sizeof(head), "*3\r\n$3\r\nSET\r\n$%d\r\n", klen);
+            out += head;
+            out.append(key, klen);
+            snprintf(head, sizeof(head), "\r\n$%zu\r\n", valueSize);
+            out += head;
+            out += value;
+            out += "\r\n";
+        } else {
+            snprintf(head, sizeof(head), "*2\r\n$3\r\nGET\r\n$%d\r\n", klen);
+            out += head;
+            out.append(key, klen);
+            out += "\r\n";
+        }
+    }
+    return out;
+}
+
+template <typename F>
+static double BestOf(F f) {
+    double best = 1e100;
+    for (int r = 0; r < ROUNDS; ++r) {
+        auto t0 = chrono::steady_clock::now();
+        f();
+        auto t1 = chrono::steady_clock::now();
+        double ns = chrono::duration<double, nano>(t1 - t0).count();
+        if (ns < best) best = ns;
+    }
+    return best;
+}
+
+struct Kernel {
+    const char* name;
+    respscan::ScanFn fn;
+};
+
+static vector<Kernel> Kernels() {
+    vector<Kernel> ks;
+    ks.push_back(Kernel{"scalar", respscan::ScanScalar});
+    ks.push_back(Kernel{"memchr", ScanMemchr});
+#if defined(__x86_64__)
+    ks.push_back(Kernel{"sse2", respscan::ScanSse2});
+    if (__builtin_cpu_supports("avx2")) ks.push_back(Kernel{"avx2", respscan::ScanAvx2});
+#endif
+    return ks;
+}
+
+static void BenchScan(const string& data) {
+    printf("\n[找行尾] %zu 字节\n", data.size());
+    printf("%-8s %10s %10s\n", "kernel", "GB/s", "ns/line");
+    size_t out[64];
+    for (const Kernel& k : Kernels()) {
+        size_t lines = 0;
+        double ns = BestOf([&]() {
+            lines = 0;
+            size_t from = 0;
+            while (from < data.size()) {
+                size_t n = k.fn(data.data(), from, data.size(), out, 64);
+                lines += n;
+                if (n < 64) break;
+                from = out[63] + 1;
+            }
+        });
+        printf("%-8s %10.2f %10.2f\n", k.name, data.size() / ns, ns / lines);
+    }
+}
+
+static void BenchLength() {
+    const size_t N = 1 << 20;
+    // 长度的分布大致照着真实请求：大多是 1~3 位，偶尔有大的
+    mt19937_64 rng(1);
+    // 数字连续放在一块内存里（和在读缓冲区里一样），计时里只有解析
+    string text;
+    vector<uint32_t> offs(N + 1);
+    for (size_t i = 0; i < N; ++i) {
+        int digits = rng() % 10 < 8 ? 1 + rng() % 3 : 4 + rng() % 6;
+        long long v = 1;
+        for (int d = 1; d < digits; ++d) v *= 10;
+        offs[i] = text.size();
+        text += to_string(v + rng() % (v * 9));
+        text += "\r\n";
+    }
+    offs[N] = text.size();
+    printf("\n[转长度] %zu 个\n", N);
+    printf("%-8s %10s\n", "impl", "ns/op");
+    long long sum = 0;
+    double ns = BestOf([&]() {
+        for (size_t i = 0; i < N; ++i) {
+            long long v = 0;
+            ParseLengthLoop(&text[offs[i]], offs[i + 1] - offs[i] - 2, RespParser::MAX_BULK_LEN, &v);
+            sum += v;
+        }
+    });
+    printf("%-8s %10.2f\n", "loop", ns / N);
+    long long sum2 = 0;
+    ns = BestOf([&]() {
+        for (size_t i = 0; i < N; ++i) {
+            long long v = 0;
+            respscan::ParseLength(&text[offs[i]], offs[i + 1] - offs[i] - 2, text.size() - offs[i], RespParser::MAX_BULK_LEN, &v);
+            sum2 += v;
+        }
+    });
+    printf("%-8s %10.2f\n", "swar", ns / N);
+    if (sum != sum2) cerr << "ParseLength mismatch" << endl;
+}
+
+static void BenchParser(const string& data, size_t commands) {
+    printf("\n[整体解析] %zu 条命令，每次喂 %zu 字节\n", commands, READ_SIZE);
+    printf("%-8s %10s %10s\n", "kernel", "ns/cmd", "Mcmd/s");
+    respscan::ScanFn saved = respscan::ScanImpl();
+    for (const Kernel& k : Kernels()) {
+        respscan::ScanImpl() = k.fn;
+        size_t parsed = 0;
+        double ns = BestOf([&]() {
+            Buffer buf;
+            RespParser parser;
+            parsed = 0;
+            for (size_t off = 0; off < data.size(); off += READ_SIZE) {
+                buf.Append(data.data() + off, min(READ_SIZE, data.size() - off));
+                while (parser.Parse(buf) == RespParser::PARSE_OK) {
+                    parsed++;
+                    parser.Next();
+                }
+                parser.Consume(buf);
+            }
+        });
+        if (parsed != commands) cerr << k.name << ": parsed " << parsed << " of " << commands << endl;
+        printf("%-8s %10.2f %10.2f\n", k.name, ns / commands, commands / ns * 1e3);
+    }
+    respscan::ScanImpl() = saved;
+}
+
+int main(int argc, char* argv[]) {
+    size_t valueSize = argc > 1 ? strtoull(argv[1], nullptr, 10) : 16;
+    size_t commands = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1000000;
+    string data = MakePipeline(commands, valueSize);
+    cout << "运行时选中的实现: " << respscan::ScanName(respscan::ScanImpl()) << endl;
+    BenchScan(data);
+    BenchLength();
+    BenchParser(data, commands);
+    return 0;
+}
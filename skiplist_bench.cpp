@@ -0,0 +1,267 @@
+/**
+ * 跳表内存布局压测
+ * 对比老版节点（vector<SkipNode*> forward + 堆上的 update 数组）和
+ * 新版节点（arena 分配 + forward 数组内联在节点里）的插入/查找开销。
+ * 另外对比“加锁的普通跳表”和“无锁跳表”在有写者时多线程读的吞吐。
+ * 编译命令: g++ skiplist_bench.cpp -o skiplist_bench -std=c++11 -O3 -pthread
+ * 运行: ./skiplist_bench [key 数量，默认 10000000] [读线程数，默认 CPU 核数]
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <random>
+#include <new>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include "SkipList.h"
+#include "ConcurrentSkipList.h"
+#include "PerfCounter.h"
+
+using namespace std;
+
+// ================= 分配计数 =================
+// 重载全局 operator new，统计这段代码一共向堆要了几次内存
+static size_t g_alloc_count = 0;
+
+// operator new 里用的就是 malloc，这里 free 是配对的，关掉 GCC 的误报
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+void* operator new(size_t size) {
+    g_alloc_count++;
+    void* p = malloc(size);
+    if (!p) throw bad_alloc();
+    return p;
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+// ===========================================
+
+/**
+ * LegacySkipList: 改造前的跳表，原样保留在这里当对照组
+ */
+template <typename K, typename V>
+struct LegacyNode {
+    K key;
+    V value;
+    vector<LegacyNode*> forward;
+    LegacyNode(K k, V v, int level) : key(k), value(v), forward(level, nullptr) {}
+};
+
+template <typename K, typename V>
+class LegacySkipList {
+public:
+    LegacySkipList() : level_(0), seed_(2463534242u) {
+        head_ = new LegacyNode<K, V>(K(), V(), MAX_LEVEL);
+    }
+    ~LegacySkipList() {
+        LegacyNode<K, V>* curr = head_;
+        while (curr) {
+            LegacyNode<K, V>* next = curr->forward[0];
+            delete curr;
+            curr = next;
+        }
+    }
+    void insert(const K& key, const V& value) {
+        vector<LegacyNode<K, V>*> update(MAX_LEVEL, nullptr);
+        LegacyNode<K, V>* curr = head_;
+        for (int i = level_ - 1; i >= 0; i--) {
+            while (curr->forward[i] && curr->forward[i]->key < key) curr = curr->forward[i];
+            update[i] = curr;
+        }
+        curr = curr->forward[0];
+        if (curr && curr->key == key) {
+            curr->value = value;
+            return;
+        }
+        int new_level = randomLevel();
+        if (new_level > level_) {
+            for (int i = level_; i < new_level; i++) update[i] = head_;
+            level_ = new_level;
+        }
+        LegacyNode<K, V>* node = new LegacyNode<K, V>(key, value, new_level);
+        for (int i = 0; i < new_level; i++) {
+            node->forward[i] = update[i]->forward[i];
+            update[i]->forward[i] = node;
+        }
+    }
+    bool search(const K& key, V& value_out) {
+        LegacyNode<K, V>* curr = head_;
+        for (int i = level_ - 1; i >= 0; i--) {
+            while (curr->forward[i] && curr->forward[i]->key < key) curr = curr->forward[i];
+        }
+        curr = curr->forward[0];
+        if (curr && curr->key == key) {
+            value_out = curr->value;
+            return true;
+        }
+        return false;
+    }
+
+private:
+    static const int MAX_LEVEL = 16;
+    LegacyNode<K, V>* head_;
+    int level_;
+    unsigned int seed_;
+    int randomLevel() {
+        int lvl = 1;
+        while (lvl < MAX_LEVEL) {
+            seed_ ^= seed_ << 13;
+            seed_ ^= seed_ >> 17;
+            seed_ ^= seed_ << 5;
+            if ((seed_ % 2) == 0) break;
+            lvl++;
+        }
+        return lvl;
+    }
+};
+
+// 每个阶段的统计结果
+struct PhaseResult {
+    double ns_per_op;
+    double allocs_per_op;
+    double misses_per_op; // < 0 表示拿不到硬件计数器
+};
+
+static void print_row(const char* impl, const char* phase, const PhaseResult& r) {
+    char misses[32];
+    if (r.misses_per_op < 0) snprintf(misses, sizeof(misses), "n/a");
+    else snprintf(misses, sizeof(misses), "%.2f", r.misses_per_op);
+    printf("%-8s %-8s %10.1f %12.3f %14s\n", impl, phase, r.ns_per_op, r.allocs_per_op, misses);
+}
+
+template <typename List>
+static void run(const char* impl, const vector<string>& keys, const vector<size_t>& order) {
+    PerfCounter misses(PERF_COUNT_HW_CACHE_MISSES);
+    size_t n = keys.size();
+    PhaseResult r;
+
+    List* list = new List();
+
+    // 1. 插入
+    size_t allocs = g_alloc_count;
+    misses.Start();
+    auto t0 = chrono::steady_clock::now();
+    for (size_t i = 0; i < n; ++i) {
+        list->insert(keys[order[i]], i);
+    }
+    auto t1 = chrono::steady_clock::now();
+    uint64_t m = misses.Stop();
+    r.ns_per_op = chrono::duration<double, nano>(t1 - t0).count() / n;
+    r.allocs_per_op = double(g_alloc_count - allocs) / n;
+    r.misses_per_op = misses.Available() ? double(m) / n : -1;
+    print_row(impl, "insert", r);
+
+    // 2. 随机查找
+    allocs = g_alloc_count;
+    size_t found = 0;
+    size_t v = 0;
+    misses.Start();
+    t0 = chrono::steady_clock::now();
+    for (size_t i = 0; i < n; ++i) {
+        if (list->search(keys[order[n - 1 - i]], v)) found++;
+    }
+    t1 = chrono::steady_clock::now();
+    m = misses.Stop();
+    r.ns_per_op = chrono::duration<double, nano>(t1 - t0).count() / n;
+    r.allocs_per_op = double(g_alloc_count - allocs) / n;
+    r.misses_per_op = misses.Available() ? double(m) / n : -1;
+    print_row(impl, "search", r);
+    if (found != n) cerr << "search miss: " << (n - found) << endl;
+
+    delete list;
+}
+
+// 普通跳表 + 一把大锁，当并发对照组
+template <typename K, typename V>
+class LockedSkipList {
+public:
+    void insert(const K& key, const V& value) {
+        lock_guard<mutex> lock(mtx_);
+        list_.insert(key, value);
+    }
+    bool search(const K& key, V& value_out) {
+        lock_guard<mutex> lock(mtx_);
+        return list_.search(key, value_out);
+    }
+
+private:
+    SkipList<K, V> list_;
+    mutex mtx_;
+};
+
+// readers 个线程随机读，同时 1 个线程不停地覆盖写，跑 seconds 秒，返回读 QPS
+template <typename List>
+static void run_concurrent(const char* impl, const vector<string>& keys, int readers, int seconds) {
+    List* list = new List();
+    size_t n = keys.size();
+    for (size_t i = 0; i < n; ++i) list->insert(keys[i], i);
+
+    atomic<bool> stop(false);
+    atomic<size_t> reads(0), writes(0), hits(0);
+    vector<thread> threads;
+    for (int t = 0; t < readers; ++t) {
+        threads.emplace_back([&, t]() {
+            mt19937_64 rng(t + 1);
+            size_t local = 0, found = 0, v = 0;
+            while (!stop.load(memory_order_relaxed)) {
+                // 结果要用起来，不然编译器会把整个查找优化掉
+                found += list->search(keys[rng() % n], v);
+                local++;
+            }
+            reads += local;
+            hits += found;
+        });
+    }
+    threads.emplace_back([&]() {
+        mt19937_64 rng(12345);
+        size_t local = 0;
+        while (!stop.load(memory_order_relaxed)) {
+            list->insert(keys[rng() % n], local);
+            local++;
+        }
+        writes += local;
+    });
+    this_thread::sleep_for(chrono::seconds(seconds));
+    stop = true;
+    for (auto& t : threads) t.join();
+    if (hits != reads) cerr << "search miss: " << (reads - hits) << endl;
+    printf("%-10s readers=%-3d read/s=%12.0f write/s=%12.0f\n", impl, readers,
+           double(reads) / seconds, double(writes) / seconds);
+    delete list;
+}
+
+int main(int argc, char* argv[]) {
+    size_t n = 10000000;
+    if (argc > 1) n = strtoull(argv[1], nullptr, 10);
+    int readers = static_cast<int>(thread::hardware_concurrency());
+    if (argc > 2) readers = atoi(argv[2]);
+    if (readers < 1) readers = 1;
+
+    // key 固定 14 字节，落在 std::string 的 SSO 里，排除 key 自身的堆分配干扰
+    vector<string> keys;
+    keys.reserve(n);
+    char buf[32];
+    for (size_t i = 0; i < n; ++i) {
+        snprintf(buf, sizeof(buf), "key_%010zu", i);
+        keys.push_back(buf);
+    }
+    vector<size_t> order(n);
+    for (size_t i = 0; i < n; ++i) order[i] = i;
+    shuffle(order.begin(), order.end(), mt19937_64(42));
+
+    cout << "key 数量: " << n << endl;
+    printf("%-8s %-8s %10s %12s %14s\n", "impl", "phase", "ns/op", "allocs/op", "cache-miss/op");
+    run<LegacySkipList<string, size_t>>("legacy", keys, order);
+    run<SkipList<string, size_t>>("arena", keys, order);
+
+    cout << "\n并发读写（" << readers << " 个读线程 + 1 个写线程）" << endl;
+    run_concurrent<LockedSkipList<string, size_t>>("mutex", keys, readers, 3);
+    run_concurrent<ConcurrentSkipList<string, size_t>>("lockfree", keys, readers, 3);
+    return 0;
+}
@@ -0,0 +1,472 @@
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+/**
+ * TestUtil.h
+ * 端到端测试用的小工具：起 / 停 kv_store 进程、一个阻塞的 RESP 客户端、CHECK 宏和用例注册。
+ *
+ * tests 下每个 xxx_test.cpp 编成一个可执行文件，第一个参数是 kv_store 的路径（CMakeLists.txt 里用 $<TARGET_FILE:kv_store> 传进来），
+ * 由 ctest 跑。每个用例自己建临时目录，服务器在那个目录里起（data.db、AOF 文件都写在那），用完删掉。
+ * 端口每个测试文件用一段不重叠的（BASE_PORT 开始），ctest -j 并行跑也不会撞。
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <stdexcept>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+using namespace std;
+
+// ============================ 用例注册和检查 ============================
+
+struct TestCase {
+    const char* name;
+    void (*fn)();
+};
+
+inline vector<TestCase>& TestCases() {
+    static vector<TestCase> cases;
+    return cases;
+}
+
+struct TestRegistrar {
+    TestRegistrar(const char* name, void (*fn)()) { TestCases().push_back({name, fn}); }
+};
+
+// TEST(Name) { ... }：按定义顺序执行
+#define TEST(name)                                                \
+    static void name();                                           \
+    static TestRegistrar name##_registrar(#name, name);           \
+    static void name()
+
+inline int& TestFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+// 检查失败记一笔接着跑；REQUIRE 失败直接结束这个用例（后面的检查没意义了，比如服务器没起来）
+struct TestAbort : runtime_error {
+    explicit TestAbort(const string& what) : runtime_error(what) {}
+};
+
+#define CHECK(cond)                                                                        \
+    do {                                                                                   \
+        if (!(cond)) {                                                                     \
+            ++TestFailures();                                                              \
+            cerr << __FILE__ << ":" << __LINE__ << ": CHECK failed: " #cond << endl;       \
+        }                                                                                  \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                                     \
+    do {                                                                                   \
+        auto _va = (a);                                                                    \
+        auto _vb = (b);                                                                    \
+        if (!(_va == _vb)) {                                                               \
+            ++TestFailures();                                                              \
+            cerr << __FILE__ << ":" << __LINE__ << ": CHECK_EQ failed: " #a " == " #b     \
+                 << " (" << _va << " vs " << _vb << ")" << endl;                           \
+        }                                                                                  \
+    } while (0)
+
+#define REQUIRE(cond)                                                                      \
+    do {                                                                                   \
+        if (!(cond)) throw TestAbort(string(__FILE__) + ":" + to_string(__LINE__) + ": REQUIRE failed: " #cond); \
+    } while (0)
+
+inline string& ServerBinary() {
+    static string path;
+    return path;
+}
+
+// 每个测试文件的 main 就是 return RunTests(argc, argv);
+inline int RunTests(int argc, char* argv[]) {
+    if (argc < 2) {
+        cerr << "Usage: " << argv[0] << " <path to kv_store>" << endl;
+        return 2;
+    }
+    // 服务器在临时目录里起，相对路径要先变成绝对路径
+    char* path = realpath(argv[1], nullptr);
+    if (!path) {
+        cerr << argv[1] << ": " << strerror(errno) << endl;
+        return 2;
+    }
+    ServerBinary() = path;
+    free(path);
+    signal(SIGPIPE, SIG_IGN);
+    int failed = 0;
+    for (const TestCase& t : TestCases()) {
+        cout << "[ RUN      ] " << t.name << endl;
+        int before = TestFailures();
+        try {
+            t.fn();
+        } catch (const exception& e) {
+            ++TestFailures();
+            cerr << e.what() << endl;
+        }
+        bool ok = TestFailures() == before;
+        if (!ok) ++failed;
+        cout << (ok ? "[       OK ] " : "[  FAILED  ] ") << t.name << endl;
+    }
+    cout << TestCases().size() - failed << "/" << TestCases().size() << " tests passed" << endl;
+    return failed ? 1 : 0;
+}
+
+inline void SleepMs(int ms) { this_thread::sleep_for(chrono::milliseconds(ms)); }
+
+// 每 10ms 问一次 cond，timeoutMs 之内成立返回 true
+template <typename F>
+bool WaitUntil(F cond, int timeoutMs) {
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeoutMs);
+    while (!cond()) {
+        if (chrono::steady_clock::now() >= deadline) return false;
+        SleepMs(10);
+    }
+    return true;
+}
+
+// ============================ 临时目录 ============================
+
+class TempDir {
+public:
+    TempDir() {
+        char tmpl[] = "/tmp/kv_test.XXXXXX";
+        if (!mkdtemp(tmpl)) throw TestAbort(string("mkdtemp: ") + strerror(errno));
+        path_ = tmpl;
+    }
+
+    ~TempDir() {
+        nftw(path_.c_str(), [](const char* p, const struct stat*, int, struct FTW*) { return remove(p); }, 16,
+             FTW_DEPTH | FTW_PHYS);
+    }
+
+    const string& Path() const { return path_; }
+    string File(const string& name) const { return path_ + "/" + name; }
+
+private:
+    TempDir(const TempDir&);
+    TempDir& operator=(const TempDir&);
+
+    string path_;
+};
+
+// ============================ RESP 客户端 ============================
+
+// 一条回复：type 是 RESP 的首字节（+ - : $ *），nil（$-1 / *-1）记成 '_'
+struct Reply {
+    char type = 0;
+    string str;              // + - $ 的内容
+    long long integer = 0;   // :
+    vector<Reply> elems;     // *
+
+    bool IsNil() const { return type == '_'; }
+    bool IsError() const { return type == '-'; }
+};
+
+class TestClient {
+public:
+    TestClient() : fd_(-1) {}
+    explicit TestClient(int port) : fd_(-1) {
+        if (!Connect(port)) throw TestAbort("can't connect to port " + to_string(port));
+    }
+    ~TestClient() { Close(); }
+
+    bool Connect(int port) {
+        Close();
+        fd_ = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd_ < 0) return false;
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (connect(fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+            Close();
+            return false;
+        }
+        int one = 1;
+        setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        // 服务器卡住不回复也别让测试挂死
+        struct timeval tv = {10, 0};
+        setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        buf_.clear();
+        pos_ = 0;
+        return true;
+    }
+
+    void Close() {
+        if (fd_ >= 0) close(fd_);
+        fd_ = -1;
+    }
+
+    // 发一条命令等回复
+    Reply Cmd(const vector<string>& argv) {
+        Send(argv);
+        return Read();
+    }
+
+    // 一次发一批，再按顺序读回来（pipeline）
+    vector<Reply> Pipeline(const vector<vector<string>>& cmds) {
+        string req;
+        for (const vector<string>& argv : cmds) Encode(argv, &req);
+        SendRaw(req);
+        vector<Reply> replies;
+        for (size_t i = 0; i < cmds.size(); ++i) replies.push_back(Read());
+        return replies;
+    }
+
+    void Send(const vector<string>& argv) {
+        string req;
+        Encode(argv, &req);
+        SendRaw(req);
+    }
+
+    void SendRaw(const string& data) {
+        size_t off = 0;
+        while (off < data.size()) {
+            ssize_t n = send(fd_, data.data() + off, data.size() - off, 0);
+            if (n <= 0) throw TestAbort(string("send: ") + strerror(errno));
+            off += static_cast<size_t>(n);
+        }
+    }
+
+    Reply Read() {
+        Reply r;
+        string line = ReadLine();
+        if (line.empty()) throw TestAbort("empty reply line");
+        r.type = line[0];
+        string rest = line.substr(1);
+        switch (r.type) {
+        case '+':
+        case '-':
+            r.str = rest;
+            break;
+        case ':':
+            r.integer = atoll(rest.c_str());
+            break;
+        case '$': {
+            long long len = atoll(rest.c_str());
+            if (len < 0) {
+                r.type = '_';
+                break;
+            }
+            r.str = ReadBytes(static_cast<size_t>(len));
+            if (ReadBytes(2) != "\r\n") throw TestAbort("bulk string not terminated by CRLF");
+            break;
+        }
+        case '*': {
+            long long n = atoll(rest.c_str());
+            if (n < 0) {
+                r.type = '_';
+                break;
+            }
+            for (long long i = 0; i < n; ++i) r.elems.push_back(Read());
+            break;
+        }
+        default:
+            throw TestAbort("bad reply type: " + line);
+        }
+        return r;
+    }
+
+    // 一行（不带 \r\n）；复制流这种不是请求-回复的场景直接读
+    string ReadLine() {
+        for (;;) {
+            size_t eol = buf_.find("\r\n", pos_);
+            if (eol != string::npos) {
+                string line = buf_.substr(pos_, eol - pos_);
+                pos_ = eol + 2;
+                return line;
+            }
+            Fill();
+        }
+    }
+
+    string ReadBytes(size_t n) {
+        while (buf_.size() - pos_ < n) Fill();
+        string s = buf_.substr(pos_, n);
+        pos_ += n;
+        return s;
+    }
+
+    // 等 timeoutMs 看有没有更多数据过来（不消费）；用来确认对端没有多发东西
+    bool HasPending(int timeoutMs) {
+        if (pos_ < buf_.size()) return true;
+        struct timeval tv = {timeoutMs / 1000, (timeoutMs % 1000) * 1000};
+        setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        char tmp[4096];
+        ssize_t n = recv(fd_, tmp, sizeof(tmp), 0);
+        tv.tv_sec = 10;
+        tv.tv_usec = 0;
+        setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        if (n > 0) buf_.append(tmp, static_cast<size_t>(n));
+        return n > 0;
+    }
+
+    static void Encode(const vector<string>& argv, string* out) {
+        *out += "*" + to_string(argv.size()) + "\r\n";
+        for (const string& a : argv) *out += "$" + to_string(a.size()) + "\r\n" + a + "\r\n";
+    }
+
+private:
+    TestClient(const TestClient&);
+    TestClient& operator=(const TestClient&);
+
+    void Fill() {
+        if (pos_ > 0 && pos_ == buf_.size()) {
+            buf_.clear();
+            pos_ = 0;
+        }
+        char tmp[16384];
+        ssize_t n = recv(fd_, tmp, sizeof(tmp), 0);
+        if (n == 0) throw TestAbort("connection closed by server");
+        if (n < 0) throw TestAbort(string("recv: ") + strerror(errno));
+        buf_.append(tmp, static_cast<size_t>(n));
+    }
+
+    int fd_;
+    string buf_;
+    size_t pos_ = 0;
+};
+
+// ============================ 服务器进程 ============================
+
+/**
+ * 在 dir 里起一个 kv_store --port port args...，输出写到 dir/server.log。
+ * Start 等到端口能连上才返回；Stop 发 SIGINT 正常退出（会存快照），Kill 发 SIGKILL 模拟崩溃。析构时还活着就 Kill
+ */
+class TestServer {
+public:
+    TestServer(const string& dir, int port, const vector<string>& args) : dir_(dir), port_(port), args_(args), pid_(-1) {}
+    ~TestServer() { Kill(); }
+
+    int Port() const { return port_; }
+
+    void Start() {
+        REQUIRE(pid_ < 0);
+        pid_ = fork();
+        REQUIRE(pid_ >= 0);
+        if (pid_ == 0) {
+            if (chdir(dir_.c_str()) != 0) _exit(127);
+            int log = open("server.log", O_WRONLY | O_CREAT | O_APPEND, 0644);
+            if (log >= 0) {
+                dup2(log, STDOUT_FILENO);
+                dup2(log, STDERR_FILENO);
+                close(log);
+            }
+            vector<string> all = {ServerBinary(), "--port", to_string(port_)};
+            all.insert(all.end(), args_.begin(), args_.end());
+            vector<char*> argv;
+            for (string& a : all) argv.push_back(&a[0]);
+            argv.push_back(nullptr);
+            execv(argv[0], argv.data());
+            _exit(127);
+        }
+        bool up = WaitUntil([this] {
+            if (Exited()) return true;
+            TestClient c;
+            return c.Connect(port_);
+        }, 10000);
+        if (!up || pid_ < 0) throw TestAbort("kv_store on port " + to_string(port_) + " didn't start, see " + dir_ + "/server.log");
+    }
+
+    // SIGINT：Reactor 退出、存快照、关 AOF，等进程结束
+    void Stop() {
+        if (pid_ < 0) return;
+        kill(pid_, SIGINT);
+        Wait();
+    }
+
+    void Kill() {
+        if (pid_ < 0) return;
+        kill(pid_, SIGKILL);
+        Wait();
+    }
+
+    void Restart() {
+        Stop();
+        Start();
+    }
+
+    // 发别的信号，比如 SIGSTOP / SIGCONT 模拟进程卡住一阵
+    void Signal(int sig) {
+        if (pid_ > 0) kill(pid_, sig);
+    }
+
+    // 到目前为止的 server.log（看服务器自己打的日志，比如走的是部分同步还是全量同步）
+    string Log() const {
+        FILE* f = fopen((dir_ + "/server.log").c_str(), "r");
+        if (!f) return "";
+        string log;
+        char buf[4096];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), f)) > 0) log.append(buf, n);
+        fclose(f);
+        return log;
+    }
+
+private:
+    bool Exited() {
+        int status;
+        if (pid_ > 0 && waitpid(pid_, &status, WNOHANG) == pid_) pid_ = -1;
+        return pid_ < 0;
+    }
+
+    void Wait() {
+        int status;
+        while (waitpid(pid_, &status, 0) < 0 && errno == EINTR) {
+        }
+        pid_ = -1;
+    }
+
+    string dir_;
+    int port_;
+    vector<string> args_;
+    pid_t pid_;
+};
+
+// ============================ 常用查询 ============================
+
+// INFO 里某个字段的值，没有返回空串
+inline string InfoField(TestClient& c, const string& section, const string& field) {
+    Reply r = c.Cmd({"INFO", section});
+    string key = field + ":";
+    size_t pos = r.str.find("\r\n" + key);
+    if (pos == string::npos) {
+        if (r.str.compare(0, key.size(), key) != 0) return "";
+        pos = 0;
+    } else {
+        pos += 2;
+    }
+    pos += key.size();
+    return r.str.substr(pos, r.str.find("\r\n", pos) - pos);
+}
+
+// INFO keyspace 里的 key 数（db0:keys=N,...），一个都没有时 INFO 不输出这行，返回 0
+inline long long KeyCount(TestClient& c) {
+    string db = InfoField(c, "keyspace", "db0");
+    return db.empty() ? 0 : atoll(db.c_str() + strlen("keys="));
+}
+
+inline vector<string> Strings(const Reply& r) {
+    vector<string> out;
+    for (const Reply& e : r.elems) out.push_back(e.str);
+    return out;
+}
+
+#endif // TEST_UTIL_H
@@ -0,0 +1,191 @@
+/**
+ * aof_test.cpp
+ * AOF 的来回：每种写命令的效果 kill -9 以后都能从 AOF 重放回来；BGREWRITEAOF（包括重写期间的写）之后也一样；
+ * 最后一个 incr 末尾写了一半的命令被截掉，前面的照常加载。
+ */
+
+#include <map>
+#include <fstream>
+#include "TestUtil.h"
+
+static const int BASE_PORT = 17200;
+
+// 测试这边记一份期望的数据，重启以后逐个对
+struct Model {
+    map<string, string> strings;
+    map<string, vector<string>> lists;
+
+    void Check(TestClient& c) const {
+        for (const auto& p : strings) {
+            Reply r = c.Cmd({"GET", p.first});
+            CHECK_EQ(r.type, '$');
+            CHECK_EQ(r.str, p.second);
+        }
+        for (const auto& p : lists) CHECK(Strings(c.Cmd({"LRANGE", p.first, "0", "-1"})) == p.second);
+        CHECK_EQ(KeyCount(c), static_cast<long long>(strings.size() + lists.size()));
+    }
+};
+
+// 各种写命令都来一遍
+static void WriteMixed(TestClient& c, Model* m, const string& prefix) {
+    for (int i = 0; i < 200; ++i) {
+        string k = prefix + "str:" + to_string(i);
+        c.Cmd({"SET", k, "v" + to_string(i)});
+        m->strings[k] = "v" + to_string(i);
+    }
+    for (int i = 0; i < 200; i += 3) {
+        string k = prefix + "str:" + to_string(i);
+        CHECK_EQ(c.Cmd({"DEL", k}).integer, 1LL);
+        m->strings.erase(k);
+    }
+    c.Cmd({"MSET", prefix + "m1", "a", prefix + "m2", "b"});
+    m->strings[prefix + "m1"] = "a";
+    m->strings[prefix + "m2"] = "b";
+    c.Cmd({"SET", prefix + "n", "10"});
+    c.Cmd({"INCRBY", prefix + "n", "32"});
+    c.Cmd({"DECR", prefix + "n"});
+    m->strings[prefix + "n"] = "41";
+    vector<string>& list = m->lists[prefix + "list"];
+    for (int i = 0; i < 500; ++i) {
+        c.Cmd({"RPUSH", prefix + "list", "r" + to_string(i)});
+        list.push_back("r" + to_string(i));
+    }
+    c.Cmd({"LPUSH", prefix + "list", "l0", "l1"});
+    list.insert(list.begin(), {"l1", "l0"});
+    c.Cmd({"LPOP", prefix + "list"});
+    c.Cmd({"RPOP", prefix + "list"});
+    list.erase(list.begin());
+    list.pop_back();
+    c.Cmd({"LTRIM", prefix + "list", "0", "99"});
+    list.resize(100);
+    // 过期：长的留着，短的等它过期（过期删除也记进 AOF）
+    c.Cmd({"SET", prefix + "ttl", "v", "EX", "1000"});
+    m->strings[prefix + "ttl"] = "v";
+    c.Cmd({"SET", prefix + "persisted", "v", "PX", "200"});
+    CHECK_EQ(c.Cmd({"PERSIST", prefix + "persisted"}).integer, 1LL);
+    m->strings[prefix + "persisted"] = "v";
+    c.Cmd({"SET", prefix + "gone", "v", "PX", "50"});
+    SleepMs(100);
+    CHECK(c.Cmd({"GET", prefix + "gone"}).IsNil());
+}
+
+TEST(ReplayAfterCrash) {
+    TempDir dir;
+    TestServer server(dir.Path(), BASE_PORT, {"--save", "", "--appendonly", "yes", "--appendfsync", "always"});
+    server.Start();
+    Model m;
+    {
+        TestClient c(BASE_PORT);
+        WriteMixed(c, &m, "");
+    }
+    server.Kill();
+    server.Start();
+    TestClient c(BASE_PORT);
+    m.Check(c);
+    long long ttl = c.Cmd({"TTL", "ttl"}).integer;
+    CHECK(ttl > 990 && ttl <= 1000);
+    CHECK_EQ(c.Cmd({"TTL", "persisted"}).integer, -1LL);
+}
+
+// 重写期间也在写（多个线程、多个分片），重写完再写一点，kill -9 以后都要在
+TEST(RewriteKeepsEverything) {
+    TempDir dir;
+    TestServer server(dir.Path(), BASE_PORT + 1,
+                      {"--save", "", "--appendonly", "yes", "--appendfsync", "everysec", "--threads", "4"});
+    server.Start();
+    Model m;
+    {
+        TestClient c(BASE_PORT + 1);
+        WriteMixed(c, &m, "a:");
+        vector<vector<string>> sets;
+        for (int i = 0; i < 20000; ++i) {
+            sets.push_back({"SET", "bulk:" + to_string(i), to_string(i)});
+            m.strings["bulk:" + to_string(i)] = to_string(i);
+        }
+        c.Pipeline(sets);
+        CHECK_EQ(c.Cmd({"BGREWRITEAOF"}).str, string("Background append only file rewriting started"));
+        WriteMixed(c, &m, "b:");
+        CHECK(WaitUntil([&] { return InfoField(c, "persistence", "aof_rewrite_in_progress") == "0"; }, 10000));
+        WriteMixed(c, &m, "c:");
+        // everysec：等一秒多让后台线程刷盘（kill -9 只丢没 write 的，进了内核的不会丢，这里保险起见）
+        SleepMs(1200);
+    }
+    server.Kill();
+    ifstream manifest(dir.File("appendonly.aof.manifest"));
+    string line, lines;
+    while (getline(manifest, line)) lines += line + ";";
+    CHECK(lines.compare(0, 5, "base ") == 0); // 重写过，有 base 了
+    server.Start();
+    TestClient c(BASE_PORT + 1);
+    m.Check(c);
+}
+
+// 命令是在 key 还没过期时执行的：重启时已经过了原来的过期时间，重放 SET ... PXAT + PERSIST 也要留下这个 key；
+// 重写时 base 里带着过期时间、PERSIST 在新 incr 里也一样
+TEST(ReplayIgnoresClock) {
+    TempDir dir;
+    TestServer server(dir.Path(), BASE_PORT + 3, {"--save", "", "--appendonly", "yes", "--appendfsync", "always"});
+    server.Start();
+    {
+        TestClient c(BASE_PORT + 3);
+        c.Cmd({"SET", "in-incr", "v", "PX", "300"});
+        c.Cmd({"SET", "in-base", "v", "PX", "300"});
+        c.Cmd({"RPUSH", "list", "a", "b"});
+        c.Cmd({"PEXPIRE", "list", "300"});
+        CHECK_EQ(c.Cmd({"PERSIST", "in-incr"}).integer, 1LL);
+        CHECK_EQ(c.Cmd({"BGREWRITEAOF"}).str, string("Background append only file rewriting started"));
+        CHECK(WaitUntil([&] { return InfoField(c, "persistence", "aof_rewrite_in_progress") == "0"; }, 10000));
+        CHECK_EQ(c.Cmd({"PERSIST", "in-base"}).integer, 1LL);
+        CHECK_EQ(c.Cmd({"RPUSH", "list", "c"}).integer, 3LL);
+        CHECK_EQ(c.Cmd({"PERSIST", "list"}).integer, 1LL);
+        c.Cmd({"SET", "expired", "v", "PX", "300"});
+    }
+    server.Kill();
+    SleepMs(400);
+    server.Start();
+    TestClient c(BASE_PORT + 3);
+    CHECK_EQ(c.Cmd({"GET", "in-incr"}).str, string("v"));
+    CHECK_EQ(c.Cmd({"GET", "in-base"}).str, string("v"));
+    CHECK_EQ(c.Cmd({"TTL", "in-base"}).integer, -1LL);
+    CHECK(Strings(c.Cmd({"LRANGE", "list", "0", "-1"})) == vector<string>({"a", "b", "c"}));
+    // 真过期了的（没人 PERSIST）加载完照常过期
+    CHECK(c.Cmd({"GET", "expired"}).IsNil());
+    CHECK_EQ(KeyCount(c), 3LL);
+}
+
+TEST(TruncatedTail) {
+    TempDir dir;
+    TestServer server(dir.Path(), BASE_PORT + 2, {"--save", "", "--appendonly", "yes", "--appendfsync", "always"});
+    server.Start();
+    Model m;
+    {
+        TestClient c(BASE_PORT + 2);
+        WriteMixed(c, &m, "");
+    }
+    server.Kill();
+    // 清单里最后一个 incr 末尾接半条命令，模拟写到一半宕机
+    ifstream manifest(dir.File("appendonly.aof.manifest"));
+    string type, seq, last;
+    while (manifest >> type >> seq) {
+        if (type == "incr") last = seq;
+    }
+    REQUIRE(!last.empty());
+    {
+        ofstream incr(dir.File("appendonly.aof." + last + ".incr.aof"), ios::app | ios::binary);
+        incr << "*3\r\n$3\r\nSET\r\n$4\r\nhalf\r\n$10\r\nonly";
+    }
+    server.Start();
+    TestClient c(BASE_PORT + 2);
+    m.Check(c);
+    CHECK(c.Cmd({"GET", "half"}).IsNil());
+    // 截掉以后接着写，再重启一次也正常
+    CHECK_EQ(c.Cmd({"SET", "after", "v"}).str, string("OK"));
+    m.strings["after"] = "v";
+    c.Close();
+    server.Kill();
+    server.Start();
+    TestClient c2(BASE_PORT + 2);
+    m.Check(c2);
+}
+
+int main(int argc, char* argv[]) { return RunTests(argc, argv); }
@@ -0,0 +1,255 @@
+/**
+ * cluster_test.cpp
+ * 集群：两个节点各管一半 slot。
+ *   - 不归自己的 key 回 -MOVED，跨 slot 回 -CROSSSLOT，CLUSTER KEYSLOT 和客户端算的一样；
+ *   - 迁移一个 slot：迁走了的 key 源节点回 -ASK，目标节点不带 ASKING 回 -MOVED、带了就执行，一部分迁走了的多 key 命令回 -TRYAGAIN；
+ *   - 迁移期间另一个连接一直按重定向读写：每次读到的都是自己最后写的值，迁完以后数据全在目标节点上；
+ *   - MIGRATE 的 COPY / REPLACE / NOKEY，以及迁给自己被拒绝。
+ */
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include "Crc16.h"
+#include "TestUtil.h"
+
+static const int BASE_PORT = 17600;
+
+static int Slot(const string& key) { return crc16::KeyHashSlot(key.data(), key.size()); }
+
+static string Addr(int port) { return "127.0.0.1:" + to_string(port); }
+
+// 两个节点：A（BASE_PORT + base）管 0-8191，B 管 8192-16383
+struct TwoNodes {
+    TempDir dirA, dirB;
+    int portA, portB;
+    TestServer a, b;
+
+    explicit TwoNodes(int base)
+        : portA(BASE_PORT + base), portB(BASE_PORT + base + 1),
+          a(dirA.Path(), portA, Args(portA, portB)), b(dirB.Path(), portB, Args(portA, portB)) {
+        a.Start();
+        b.Start();
+    }
+
+    static vector<string> Args(int portA, int portB) {
+        return {"--save", "", "--threads", "2", "--cluster-enabled", "yes", "--cluster-nodes",
+                Addr(portA) + "=0-8191 " + Addr(portB) + "=8192-16383"};
+    }
+};
+
+// 在 A 的 slot 里找一个 hash tag：{tN}
+static string TagOnA() {
+    for (int i = 0;; ++i) {
+        string tag = "{t" + to_string(i) + "}";
+        if (Slot(tag) < 8192) return tag;
+    }
+}
+
+TEST(Redirects) {
+    TwoNodes nodes(0);
+    TestClient a(nodes.portA), b(nodes.portB);
+    CHECK_EQ(a.Cmd({"CLUSTER", "KEYSLOT", "foo"}).integer, 12182LL);
+    CHECK_EQ(a.Cmd({"CLUSTER", "KEYSLOT", "{user1000}.following"}).integer,
+             static_cast<long long>(Slot("{user1000}.followers")));
+
+    // foo 在 B 上
+    CHECK_EQ(a.Cmd({"SET", "foo", "bar"}).str, "MOVED 12182 " + Addr(nodes.portB));
+    CHECK_EQ(a.Cmd({"GET", "foo"}).str, "MOVED 12182 " + Addr(nodes.portB));
+    CHECK_EQ(b.Cmd({"SET", "foo", "bar"}).str, string("OK"));
+    CHECK_EQ(b.Cmd({"GET", "foo"}).str, string("bar"));
+
+    string tag = TagOnA();
+    CHECK_EQ(a.Cmd({"MSET", tag + "1", "x", tag + "2", "y"}).str, string("OK"));
+    CHECK(Strings(a.Cmd({"MGET", tag + "1", tag + "2"})) == vector<string>({"x", "y"}));
+    CHECK(a.Cmd({"MGET", tag + "1", "foo"}).str.compare(0, 9, "CROSSSLOT") == 0);
+    CHECK(b.Cmd({"GET", tag + "1"}).str.compare(0, 6, "MOVED ") == 0);
+    // 不带 key 的命令在哪都能执行
+    CHECK_EQ(a.Cmd({"PING"}).str, string("PONG"));
+    Reply slots = a.Cmd({"CLUSTER", "SLOTS"});
+    CHECK_EQ(slots.elems.size(), static_cast<size_t>(2));
+}
+
+// 跟着 -MOVED / -ASK 走的一条命令；连接按端口缓存
+struct Router {
+    map<int, unique_ptr<TestClient>> conns;
+    int owner;
+    int moved = 0, asked = 0;
+
+    explicit Router(int port) : owner(port) {}
+
+    TestClient& Conn(int port) {
+        unique_ptr<TestClient>& c = conns[port];
+        if (!c) c.reset(new TestClient(port));
+        return *c;
+    }
+
+    Reply Cmd(const vector<string>& argv) {
+        int port = owner;
+        bool asking = false;
+        for (int tries = 0; tries < 20; ++tries) {
+            TestClient& c = Conn(port);
+            Reply r = asking ? c.Pipeline({{"ASKING"}, argv})[1] : c.Cmd(argv);
+            if (r.IsError() && r.str.compare(0, 6, "MOVED ") == 0) {
+                port = owner = atoi(r.str.c_str() + r.str.rfind(':') + 1);
+                asking = false;
+                moved++;
+            } else if (r.IsError() && r.str.compare(0, 4, "ASK ") == 0) {
+                port = atoi(r.str.c_str() + r.str.rfind(':') + 1);
+                asking = true;
+                asked++;
+            } else if (r.IsError() && r.str.compare(0, 8, "TRYAGAIN") == 0) {
+                SleepMs(5);
+            } else {
+                return r;
+            }
+        }
+        throw TestAbort("too many redirects for " + argv[0]);
+    }
+};
+
+TEST(MigrateSlot) {
+    TwoNodes nodes(2);
+    TestClient a(nodes.portA), b(nodes.portB);
+    string tag = TagOnA();
+    string slot = to_string(Slot(tag));
+    vector<vector<string>> sets;
+    for (int i = 0; i < 200; ++i) sets.push_back({"SET", tag + to_string(i), "v" + to_string(i)});
+    a.Pipeline(sets);
+    a.Cmd({"RPUSH", tag + "list", "a", "b", "c"});
+    a.Cmd({"PEXPIRE", tag + "list", "100000"});
+
+    CHECK_EQ(b.Cmd({"CLUSTER", "SETSLOT", slot, "IMPORTING", Addr(nodes.portA)}).str, string("OK"));
+    CHECK_EQ(a.Cmd({"CLUSTER", "SETSLOT", slot, "MIGRATING", Addr(nodes.portB)}).str, string("OK"));
+
+    // 先迁前 100 个和列表
+    vector<string> migrate = {"MIGRATE", "127.0.0.1", to_string(nodes.portB), "", "0", "5000", "KEYS", tag + "list"};
+    for (int i = 0; i < 100; ++i) migrate.push_back(tag + to_string(i));
+    CHECK_EQ(a.Cmd(migrate).str, string("OK"));
+    CHECK_EQ(a.Cmd({"CLUSTER", "COUNTKEYSINSLOT", slot}).integer, 100LL);
+
+    // 迁走了的：A 回 ASK；B 不带 ASKING 回 MOVED（slot 还归 A），带了就执行
+    CHECK_EQ(a.Cmd({"GET", tag + "0"}).str, "ASK " + slot + " " + Addr(nodes.portB));
+    CHECK_EQ(b.Cmd({"GET", tag + "0"}).str, "MOVED " + slot + " " + Addr(nodes.portA));
+    CHECK_EQ(b.Pipeline({{"ASKING"}, {"GET", tag + "0"}})[1].str, string("v0"));
+    // ASKING 只管紧跟着的一条
+    CHECK(b.Cmd({"GET", tag + "0"}).str.compare(0, 6, "MOVED ") == 0);
+    // 过期时间跟着过去了
+    long long ttl = b.Pipeline({{"ASKING"}, {"TTL", tag + "list"}})[1].integer;
+    CHECK(ttl > 90 && ttl <= 100);
+    // 还没迁的照常在 A 上读写
+    CHECK_EQ(a.Cmd({"GET", tag + "150"}).str, string("v150"));
+    CHECK_EQ(a.Cmd({"SET", tag + "150", "changed"}).str, string("OK"));
+    // 新 key（A 上没有）：ASK 去 B 建
+    CHECK(a.Cmd({"SET", tag + "new", "v"}).str.compare(0, 4, "ASK ") == 0);
+    // 一部分迁走了：TRYAGAIN
+    CHECK(a.Cmd({"MGET", tag + "0", tag + "150"}).str.compare(0, 8, "TRYAGAIN") == 0);
+
+    // 剩下的迁完，切归属
+    for (;;) {
+        Reply keys = a.Cmd({"CLUSTER", "GETKEYSINSLOT", slot, "30"});
+        if (keys.elems.empty()) break;
+        vector<string> cmd = {"MIGRATE", "127.0.0.1", to_string(nodes.portB), "", "0", "5000", "KEYS"};
+        for (const Reply& k : keys.elems) cmd.push_back(k.str);
+        REQUIRE(a.Cmd(cmd).str == "OK");
+    }
+    CHECK_EQ(a.Cmd({"CLUSTER", "SETSLOT", slot, "NODE", Addr(nodes.portB)}).str, string("OK"));
+    CHECK_EQ(b.Cmd({"CLUSTER", "SETSLOT", slot, "NODE", Addr(nodes.portB)}).str, string("OK"));
+    CHECK_EQ(a.Cmd({"GET", tag + "0"}).str, "MOVED " + slot + " " + Addr(nodes.portB));
+    CHECK_EQ(b.Cmd({"GET", tag + "0"}).str, string("v0"));
+    CHECK_EQ(b.Cmd({"GET", tag + "150"}).str, string("changed"));
+    CHECK(Strings(b.Cmd({"LRANGE", tag + "list", "0", "-1"})) == vector<string>({"a", "b", "c"}));
+    CHECK_EQ(b.Cmd({"CLUSTER", "COUNTKEYSINSLOT", slot}).integer, 201LL);
+    CHECK_EQ(a.Cmd({"CLUSTER", "COUNTKEYSINSLOT", slot}).integer, 0LL);
+}
+
+// 迁移期间另一个连接一直在写、读：每个 key 读到的都是自己最后写进去的值，迁完一个不丢
+TEST(MigrateUnderLoad) {
+    TwoNodes nodes(4);
+    TestClient a(nodes.portA), b(nodes.portB);
+    string tag = TagOnA();
+    string slot = to_string(Slot(tag));
+    const int N = 1000;
+    vector<vector<string>> sets;
+    for (int i = 0; i < N; ++i) sets.push_back({"SET", tag + to_string(i), "0"});
+    a.Pipeline(sets);
+
+    atomic<bool> stop(false);
+    atomic<int> bad(0), ops(0), asked(0);
+    vector<string> last(N, "0");
+    thread worker([&] {
+        Router r(nodes.portA);
+        unsigned seed = 1;
+        for (int n = 0; !stop; ++n) {
+            seed = seed * 1103515245 + 12345;
+            int i = static_cast<int>((seed >> 8) % N);
+            string key = tag + to_string(i);
+            string v = to_string(n + 1);
+            if (r.Cmd({"SET", key, v}).str != "OK") bad++;
+            last[i] = v;
+            if (r.Cmd({"GET", key}).str != v) bad++;
+            ops++;
+        }
+        asked = r.asked;
+    });
+    CHECK(WaitUntil([&] { return ops > 200; }, 5000));
+    b.Cmd({"CLUSTER", "SETSLOT", slot, "IMPORTING", Addr(nodes.portA)});
+    a.Cmd({"CLUSTER", "SETSLOT", slot, "MIGRATING", Addr(nodes.portB)});
+    for (;;) {
+        Reply keys = a.Cmd({"CLUSTER", "GETKEYSINSLOT", slot, "20"});
+        if (keys.elems.empty()) break;
+        vector<string> cmd = {"MIGRATE", "127.0.0.1", to_string(nodes.portB), "", "0", "5000", "KEYS"};
+        for (const Reply& k : keys.elems) cmd.push_back(k.str);
+        Reply r = a.Cmd(cmd);
+        REQUIRE(r.str == "OK" || r.str == "NOKEY");
+        SleepMs(2);
+    }
+    a.Cmd({"CLUSTER", "SETSLOT", slot, "NODE", Addr(nodes.portB)});
+    b.Cmd({"CLUSTER", "SETSLOT", slot, "NODE", Addr(nodes.portB)});
+    int before = ops;
+    CHECK(WaitUntil([&] { return ops > before + 200; }, 5000)); // 切完以后也接着跑一会儿
+    stop = true;
+    worker.join();
+    CHECK_EQ(bad.load(), 0);
+    CHECK(asked > 0);
+    CHECK_EQ(a.Cmd({"CLUSTER", "COUNTKEYSINSLOT", slot}).integer, 0LL);
+    CHECK_EQ(b.Cmd({"CLUSTER", "COUNTKEYSINSLOT", slot}).integer, static_cast<long long>(N));
+    int mismatched = 0;
+    for (int i = 0; i < N; ++i) mismatched += b.Cmd({"GET", tag + to_string(i)}).str != last[i];
+    CHECK_EQ(mismatched, 0);
+}
+
+TEST(MigrateOptions) {
+    TempDir dirA, dirB;
+    // 不开集群：MIGRATE 就是把 key 搬到另一个实例
+    TestServer a(dirA.Path(), BASE_PORT + 6, {"--save", ""});
+    TestServer b(dirB.Path(), BASE_PORT + 7, {"--save", ""});
+    a.Start();
+    b.Start();
+    TestClient ca(BASE_PORT + 6), cb(BASE_PORT + 7);
+    string port = to_string(BASE_PORT + 7);
+    ca.Cmd({"SET", "k", "v1"});
+    CHECK_EQ(ca.Cmd({"MIGRATE", "127.0.0.1", port, "k", "0", "5000", "COPY"}).str, string("OK"));
+    CHECK_EQ(ca.Cmd({"GET", "k"}).str, string("v1")); // COPY 不删
+    CHECK_EQ(cb.Cmd({"GET", "k"}).str, string("v1"));
+    ca.Cmd({"SET", "k", "v2"});
+    // 目标已经有了：不带 REPLACE 报错，源节点上的不动
+    CHECK(ca.Cmd({"MIGRATE", "127.0.0.1", port, "k", "0", "5000"}).str.find("BUSYKEY") != string::npos);
+    CHECK_EQ(ca.Cmd({"GET", "k"}).str, string("v2"));
+    CHECK_EQ(ca.Cmd({"MIGRATE", "127.0.0.1", port, "k", "0", "5000", "REPLACE"}).str, string("OK"));
+    CHECK(ca.Cmd({"GET", "k"}).IsNil());
+    CHECK_EQ(cb.Cmd({"GET", "k"}).str, string("v2"));
+    CHECK_EQ(ca.Cmd({"MIGRATE", "127.0.0.1", port, "k", "0", "5000"}).str, string("NOKEY"));
+    // 迁给自己：不管用什么地址写，都拒绝，key 还在
+    ca.Cmd({"SET", "self", "v"});
+    for (const char* host : {"127.0.0.1", "localhost", "127.0.0.2"}) {
+        Reply r = ca.Cmd({"MIGRATE", host, to_string(BASE_PORT + 6), "self", "0", "1000"});
+        CHECK(r.IsError());
+    }
+    CHECK_EQ(ca.Cmd({"GET", "self"}).str, string("v"));
+    // 连不上
+    CHECK(ca.Cmd({"MIGRATE", "127.0.0.1", to_string(BASE_PORT + 9), "self", "0", "1000"}).str.compare(0, 5, "IOERR") == 0);
+    CHECK_EQ(ca.Cmd({"GET", "self"}).str, string("v"));
+}
+
+int main(int argc, char* argv[]) { return RunTests(argc, argv); }
@@ -0,0 +1,105 @@
+/**
+ * expire_test.cpp
+ * 过期：SET EX / PX、EXPIRE 一族、TTL / PTTL / PERSIST 的返回值，过期后读不到（惰性删除），
+ * 没人再碰的 key 也会被主动过期回收（INFO keyspace 的计数降到 0）。
+ */
+
+#include "TestUtil.h"
+
+static const int BASE_PORT = 17300;
+
+TEST(TtlCommands) {
+    TempDir dir;
+    TestServer server(dir.Path(), BASE_PORT, {"--save", ""});
+    server.Start();
+    TestClient c(BASE_PORT);
+    CHECK_EQ(c.Cmd({"TTL", "missing"}).integer, -2LL);
+    CHECK_EQ(c.Cmd({"PTTL", "missing"}).integer, -2LL);
+    CHECK_EQ(c.Cmd({"EXPIRE", "missing", "100"}).integer, 0LL);
+
+    CHECK_EQ(c.Cmd({"SET", "k", "v"}).str, string("OK"));
+    CHECK_EQ(c.Cmd({"TTL", "k"}).integer, -1LL);
+    CHECK_EQ(c.Cmd({"PERSIST", "k"}).integer, 0LL);
+    CHECK_EQ(c.Cmd({"EXPIRE", "k", "100"}).integer, 1LL);
+    long long pttl = c.Cmd({"PTTL", "k"}).integer;
+    CHECK(pttl > 99000 && pttl <= 100000);
+    CHECK_EQ(c.Cmd({"PERSIST", "k"}).integer, 1LL);
+    CHECK_EQ(c.Cmd({"TTL", "k"}).integer, -1LL);
+
+    // SET 不带过期时间会清掉原来的，INCR / LPUSH 这种改值的命令保留
+    c.Cmd({"SET", "k", "1", "EX", "100"});
+    CHECK_EQ(c.Cmd({"INCR", "k"}).integer, 2LL);
+    CHECK_EQ(c.Cmd({"TTL", "k"}).integer, 100LL);
+    c.Cmd({"SET", "k", "v"});
+    CHECK_EQ(c.Cmd({"TTL", "k"}).integer, -1LL);
+    c.Cmd({"RPUSH", "list", "a"});
+    CHECK_EQ(c.Cmd({"PEXPIRE", "list", "100000"}).integer, 1LL);
+    c.Cmd({"LPUSH", "list", "b"});
+    CHECK_EQ(c.Cmd({"TTL", "list"}).integer, 100LL);
+
+    // 绝对时间
+    long long future = static_cast<long long>(time(nullptr)) + 500;
+    CHECK_EQ(c.Cmd({"EXPIREAT", "k", to_string(future)}).integer, 1LL);
+    long long ttl = c.Cmd({"TTL", "k"}).integer;
+    CHECK(ttl > 490 && ttl <= 500);
+    c.Cmd({"SET", "k", "v", "PXAT", to_string(future * 1000)});
+    ttl = c.Cmd({"TTL", "k"}).integer;
+    CHECK(ttl > 490 && ttl <= 500);
+
+    // 过去的时间 / 负数：立刻删掉
+    CHECK_EQ(c.Cmd({"EXPIRE", "k", "-1"}).integer, 1LL);
+    CHECK(c.Cmd({"GET", "k"}).IsNil());
+    c.Cmd({"SET", "k", "v"});
+    CHECK_EQ(c.Cmd({"PEXPIREAT", "k", "1"}).integer, 1LL);
+    CHECK_EQ(c.Cmd({"TTL", "k"}).integer, -2LL);
+
+    CHECK(c.Cmd({"SET", "k", "v", "EX", "0"}).IsError());
+    CHECK(c.Cmd({"SET", "k", "v", "EX", "abc"}).IsError());
+    CHECK(c.Cmd({"EXPIRE", "list", "abc"}).IsError());
+}
+
+// 到点以后读不到，不管是哪个命令先碰到
+TEST(LazyExpire) {
+    TempDir dir;
+    TestServer server(dir.Path(), BASE_PORT + 1, {"--save", ""});
+    server.Start();
+    TestClient c(BASE_PORT + 1);
+    c.Cmd({"SET", "str", "v", "PX", "100"});
+    c.Cmd({"SET", "counter", "5", "PX", "100"});
+    c.Cmd({"RPUSH", "list", "a", "b"});
+    c.Cmd({"PEXPIRE", "list", "100"});
+    c.Cmd({"SET", "kept", "v", "EX", "100"});
+    CHECK_EQ(c.Cmd({"GET", "str"}).str, string("v"));
+    SleepMs(150);
+    CHECK(c.Cmd({"GET", "str"}).IsNil());
+    CHECK_EQ(c.Cmd({"TTL", "str"}).integer, -2LL);
+    // 过期的计数器当成不存在，从 0 开始加
+    CHECK_EQ(c.Cmd({"INCR", "counter"}).integer, 1LL);
+    CHECK_EQ(c.Cmd({"TTL", "counter"}).integer, -1LL);
+    CHECK_EQ(c.Cmd({"LLEN", "list"}).integer, 0LL);
+    CHECK_EQ(c.Cmd({"RPUSH", "list", "c"}).integer, 1LL);
+    CHECK(Strings(c.Cmd({"LRANGE", "list", "0", "-1"})) == vector<string>({"c"}));
+    Reply mget = c.Cmd({"MGET", "str", "kept", "counter"});
+    REQUIRE(mget.elems.size() == 3);
+    CHECK(mget.elems[0].IsNil());
+    CHECK_EQ(mget.elems[1].str, string("v"));
+    CHECK_EQ(mget.elems[2].str, string("1"));
+    CHECK_EQ(c.Cmd({"DEL", "str"}).integer, 0LL);
+}
+
+// 没人再碰的 key：主动过期一轮轮抽样删掉，多个分片都要清干净；不过期的留着
+TEST(ActiveExpire) {
+    TempDir dir;
+    TestServer server(dir.Path(), BASE_PORT + 2, {"--save", "", "--threads", "4"});
+    server.Start();
+    TestClient c(BASE_PORT + 2);
+    vector<vector<string>> sets;
+    for (int i = 0; i < 20000; ++i) sets.push_back({"SET", "volatile:" + to_string(i), "v", "PX", "200"});
+    for (int i = 0; i < 100; ++i) sets.push_back({"SET", "stable:" + to_string(i), "v"});
+    c.Pipeline(sets);
+    CHECK_EQ(KeyCount(c), 20100LL);
+    CHECK(WaitUntil([&] { return KeyCount(c) == 100; }, 10000));
+    CHECK_EQ(InfoField(c, "keyspace", "db0"), string("keys=100,expires=0"));
+}
+
+int main(int argc, char* argv[]) { return RunTests(argc, argv); }
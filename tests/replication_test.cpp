@@ -0,0 +1,206 @@
+/**
+ * replication_test.cpp
+ * 主从复制：
+ *   - 直接按协议扮演从库：PSYNC ? -1 走全量同步（+FULLRESYNC + 快照 + 之后的命令流），
+ *     断开后带着 replid / offset 重连走部分同步，补回来的正好是断开期间的写；replid 不对、落后超过积压环走全量同步；
+ *   - 真的起一个从库：全量同步、之后的写跟上、从库只读；从库卡住被主库断开，恢复后部分同步补齐。
+ */
+
+#include <algorithm>
+#include "TestUtil.h"
+
+static const int BASE_PORT = 17500;
+
+// 复制流里的下一条命令（跳过主库插的 PING），*offset 加上这条命令的字节数
+static vector<string> NextCommand(TestClient& link, uint64_t* offset) {
+    for (;;) {
+        Reply r = link.Read();
+        REQUIRE(r.type == '*');
+        vector<string> argv = Strings(r);
+        string encoded;
+        TestClient::Encode(argv, &encoded);
+        *offset += encoded.size();
+        if (!(argv.size() == 1 && argv[0] == "PING")) return argv;
+    }
+}
+
+// 接下来的 n 条命令，按 key 排好序返回：不同分片的写在流里谁先谁后不一定（同一个 key 的顺序是保证的）
+static vector<vector<string>> NextCommands(TestClient& link, uint64_t* offset, size_t n) {
+    vector<vector<string>> cmds;
+    for (size_t i = 0; i < n; ++i) cmds.push_back(NextCommand(link, offset));
+    sort(cmds.begin(), cmds.end(), [](const vector<string>& x, const vector<string>& y) { return x[1] < y[1]; });
+    return cmds;
+}
+
+// PSYNC 以后读到 +FULLRESYNC 和后面的快照，返回 replid，*offset 是快照对应的偏移量
+static string ReadFullSync(TestClient& link, uint64_t* offset) {
+    string line = link.ReadLine();
+    REQUIRE(line.compare(0, 12, "+FULLRESYNC ") == 0);
+    size_t sp = line.find(' ', 12);
+    REQUIRE(sp != string::npos);
+    *offset = strtoull(line.c_str() + sp + 1, nullptr, 10);
+    string len = link.ReadLine();
+    REQUIRE(len[0] == '$');
+    string snapshot = link.ReadBytes(strtoull(len.c_str() + 1, nullptr, 10));
+    CHECK(!snapshot.empty());
+    return line.substr(12, sp - 12);
+}
+
+TEST(PsyncProtocol) {
+    TempDir dir;
+    TestServer master(dir.Path(), BASE_PORT, {"--save", "", "--threads", "2"});
+    master.Start();
+    TestClient c(BASE_PORT);
+    c.Cmd({"SET", "before", "1"});
+
+    // 全量同步
+    TestClient link(BASE_PORT);
+    link.Send({"PSYNC", "?", "-1"});
+    uint64_t offset = 0;
+    string replid = ReadFullSync(link, &offset);
+    CHECK_EQ(replid.size(), static_cast<size_t>(40));
+
+    // 之后的写都进流，同一个 key 按执行顺序；偏移量和主库的 master_repl_offset 对得上
+    c.Cmd({"SET", "a", "1"});
+    c.Cmd({"RPUSH", "list", "x", "y"});
+    c.Cmd({"RPUSH", "list", "z"});
+    c.Cmd({"SET", "ttl", "v", "EX", "100"});
+    vector<vector<string>> cmds = NextCommands(link, &offset, 4);
+    CHECK(cmds[0] == vector<string>({"SET", "a", "1"}));
+    CHECK(cmds[1] == vector<string>({"RPUSH", "list", "x", "y"}));
+    CHECK(cmds[2] == vector<string>({"RPUSH", "list", "z"}));
+    REQUIRE(cmds[3].size() == 5); // 过期时间换成了绝对时间
+    CHECK_EQ(cmds[3][3], string("PXAT"));
+    CHECK(WaitUntil([&] { return InfoField(c, "replication", "master_repl_offset") == to_string(offset); }, 5000));
+    CHECK_EQ(InfoField(c, "replication", "connected_slaves"), string("1"));
+    link.Close();
+
+    // 断开期间的写，重连时部分同步补回来，一条不多一条不少
+    c.Cmd({"SET", "b", "2"});
+    c.Cmd({"DEL", "a"});
+    c.Cmd({"INCR", "counter"});
+    TestClient again(BASE_PORT);
+    again.Send({"PSYNC", replid, to_string(offset)});
+    CHECK_EQ(again.ReadLine(), "+CONTINUE " + replid);
+    cmds = NextCommands(again, &offset, 3);
+    CHECK(cmds[0] == vector<string>({"DEL", "a"}));
+    CHECK(cmds[1] == vector<string>({"SET", "b", "2"}));
+    CHECK(cmds[2] == vector<string>({"SET", "counter", "1"})); // 记的是效果，不是命令本身
+    CHECK(!again.HasPending(200));
+    CHECK_EQ(InfoField(c, "replication", "master_repl_offset"), to_string(offset));
+    again.Close();
+
+    // replid 对不上（比如主库换过）：全量同步
+    TestClient wrongId(BASE_PORT);
+    wrongId.Send({"PSYNC", string(40, '0'), to_string(offset)});
+    uint64_t fullOffset = 0;
+    CHECK_EQ(ReadFullSync(wrongId, &fullOffset), replid);
+    CHECK_EQ(fullOffset, offset);
+    wrongId.Close();
+
+    // 从积压环后面要（还没写到的偏移量）：也只能全量同步
+    TestClient ahead(BASE_PORT);
+    ahead.Send({"PSYNC", replid, to_string(offset + 1000)});
+    CHECK_EQ(ReadFullSync(ahead, &fullOffset), replid);
+}
+
+// 断开以后写了超过积压环大小的数据：缺的那段已经被覆盖了，只能全量同步
+TEST(BacklogOverrun) {
+    TempDir dir;
+    TestServer master(dir.Path(), BASE_PORT + 1, {"--save", "", "--repl-backlog-size", "16384"});
+    master.Start();
+    TestClient c(BASE_PORT + 1);
+    uint64_t offset = 0;
+    string replid;
+    {
+        TestClient link(BASE_PORT + 1);
+        link.Send({"PSYNC", "?", "-1"});
+        replid = ReadFullSync(link, &offset);
+    }
+    // 还在积压环里：部分同步
+    c.Cmd({"SET", "small", string(1000, 'x')});
+    {
+        TestClient link(BASE_PORT + 1);
+        link.Send({"PSYNC", replid, to_string(offset)});
+        CHECK_EQ(link.ReadLine(), "+CONTINUE " + replid);
+        uint64_t o = offset;
+        CHECK(NextCommand(link, &o) == vector<string>({"SET", "small", string(1000, 'x')}));
+    }
+    for (int i = 0; i < 40; ++i) c.Cmd({"SET", "big:" + to_string(i), string(1000, 'x')});
+    TestClient link(BASE_PORT + 1);
+    link.Send({"PSYNC", replid, to_string(offset)});
+    uint64_t fullOffset = 0;
+    CHECK_EQ(ReadFullSync(link, &fullOffset), replid);
+    CHECK(fullOffset > offset + 16384);
+}
+
+// 两边的数据逐个 key 比
+static void CheckSameData(TestClient& master, TestClient& replica, const vector<string>& strings,
+                          const vector<string>& lists) {
+    for (const string& k : strings) {
+        Reply m = master.Cmd({"GET", k});
+        Reply r = replica.Cmd({"GET", k});
+        CHECK_EQ(r.type, m.type);
+        CHECK_EQ(r.str, m.str);
+    }
+    for (const string& k : lists) {
+        CHECK(Strings(replica.Cmd({"LRANGE", k, "0", "-1"})) == Strings(master.Cmd({"LRANGE", k, "0", "-1"})));
+    }
+    CHECK_EQ(KeyCount(replica), KeyCount(master));
+}
+
+static bool CaughtUp(TestClient& master, TestClient& replica) {
+    string offset = InfoField(master, "replication", "master_repl_offset");
+    return InfoField(replica, "replication", "master_link_status") == "up" &&
+           InfoField(replica, "replication", "slave_repl_offset") == offset;
+}
+
+TEST(RealReplica) {
+    TempDir masterDir, replicaDir;
+    // 主库 2 秒收不到 ACK 就断开从库，下面用 SIGSTOP 卡住从库来触发
+    TestServer master(masterDir.Path(), BASE_PORT + 2, {"--save", "", "--threads", "2", "--repl-timeout", "2"});
+    master.Start();
+    TestClient m(BASE_PORT + 2);
+    vector<string> strings, lists = {"list"};
+    vector<vector<string>> sets;
+    for (int i = 0; i < 5000; ++i) {
+        strings.push_back("key:" + to_string(i));
+        sets.push_back({"SET", strings.back(), "v" + to_string(i)});
+    }
+    m.Pipeline(sets);
+    m.Cmd({"RPUSH", "list", "a", "b", "c"});
+    m.Cmd({"SET", "persisted", "v", "PX", "300"});
+    m.Cmd({"PERSIST", "persisted"});
+    strings.push_back("persisted");
+
+    TestServer replica(replicaDir.Path(), BASE_PORT + 3,
+                       {"--save", "", "--replicaof", "127.0.0.1 " + to_string(BASE_PORT + 2)});
+    replica.Start();
+    TestClient r(BASE_PORT + 3);
+    CHECK(WaitUntil([&] { return CaughtUp(m, r); }, 10000));
+    CheckSameData(m, r, strings, lists);
+    CHECK_EQ(InfoField(r, "replication", "role"), string("slave"));
+    CHECK(r.Cmd({"SET", "x", "y"}).str.compare(0, 8, "READONLY") == 0);
+
+    // 全量同步之后的写跟上来
+    for (int i = 0; i < 5000; i += 7) m.Cmd({"DEL", "key:" + to_string(i)});
+    m.Cmd({"LPOP", "list"});
+    m.Cmd({"INCRBY", "counter", "5"});
+    strings.push_back("counter");
+    CHECK(WaitUntil([&] { return CaughtUp(m, r); }, 10000));
+    CheckSameData(m, r, strings, lists);
+    CHECK(master.Log().find("Full resynchronization requested") != string::npos);
+
+    // 从库卡住：主库超时断开它，期间的写在积压环里；恢复后从库重连，部分同步补齐
+    replica.Signal(SIGSTOP);
+    CHECK(WaitUntil([&] { return InfoField(m, "replication", "connected_slaves") == "0"; }, 10000));
+    for (int i = 1; i < 5000; i += 7) m.Cmd({"SET", "key:" + to_string(i), "changed"});
+    m.Cmd({"RPUSH", "list", "d"});
+    replica.Signal(SIGCONT);
+    CHECK(WaitUntil([&] { return CaughtUp(m, r); }, 10000));
+    CheckSameData(m, r, strings, lists);
+    CHECK(master.Log().find("Partial resynchronization with") != string::npos);
+    CHECK(replica.Log().find("Partial resynchronization from offset") != string::npos);
+}
+
+int main(int argc, char* argv[]) { return RunTests(argc, argv); }
@@ -0,0 +1,149 @@
+/**
+ * scan_test.cpp
+ * SCAN 的完整性：从 0 走到游标回到 0，从头到尾都在的 key 每个至少返回一次（可以重复）；
+ * 走的过程中另一个连接在大量插入（表会扩容好几次）和删除也一样。MATCH / TYPE 过滤，RANGE 按序返回。
+ */
+
+#include <set>
+#include <atomic>
+#include "TestUtil.h"
+
+static const int BASE_PORT = 17400;
+
+// 走完一整轮 SCAN，返回所有返回过的 key（去重前的个数放进 *returned）
+static set<string> ScanAll(TestClient& c, const vector<string>& options, size_t* returned = nullptr) {
+    set<string> seen;
+    string cursor = "0";
+    size_t total = 0;
+    int calls = 0;
+    do {
+        vector<string> cmd = {"SCAN", cursor};
+        cmd.insert(cmd.end(), options.begin(), options.end());
+        Reply r = c.Cmd(cmd);
+        REQUIRE(r.type == '*' && r.elems.size() == 2);
+        cursor = r.elems[0].str;
+        for (const Reply& k : r.elems[1].elems) seen.insert(k.str);
+        total += r.elems[1].elems.size();
+        REQUIRE(++calls < 1000000); // 游标一直回不到 0 就是死循环了
+    } while (cursor != "0");
+    if (returned) *returned = total;
+    return seen;
+}
+
+static void Fill(TestClient& c, const string& prefix, int n) {
+    vector<vector<string>> sets;
+    for (int i = 0; i < n; ++i) sets.push_back({"SET", prefix + to_string(i), "v"});
+    c.Pipeline(sets);
+}
+
+TEST(FullIteration) {
+    TempDir dir;
+    TestServer server(dir.Path(), BASE_PORT, {"--save", "", "--threads", "4"});
+    server.Start();
+    TestClient c(BASE_PORT);
+    // 空库：一次就回到 0
+    Reply empty = c.Cmd({"SCAN", "0"});
+    CHECK_EQ(empty.elems[0].str, string("0"));
+    CHECK(empty.elems[1].elems.empty());
+
+    Fill(c, "key:", 10000);
+    for (const char* count : {"1", "10", "1000", "100000"}) {
+        size_t returned = 0;
+        set<string> seen = ScanAll(c, {"COUNT", count}, &returned);
+        CHECK_EQ(seen.size(), static_cast<size_t>(10000));
+        // 没有并发修改时重复应该很少
+        CHECK(returned < 10000 + 100);
+    }
+    CHECK(c.Cmd({"SCAN", "-1"}).IsError());
+    CHECK(c.Cmd({"SCAN", "abc"}).IsError());
+    CHECK(c.Cmd({"SCAN", "0", "COUNT", "0"}).IsError());
+}
+
+TEST(MatchAndType) {
+    TempDir dir;
+    TestServer server(dir.Path(), BASE_PORT + 1, {"--save", "", "--threads", "2"});
+    server.Start();
+    TestClient c(BASE_PORT + 1);
+    Fill(c, "user:", 3000);
+    Fill(c, "order:", 3000);
+    for (int i = 0; i < 50; ++i) c.Cmd({"RPUSH", "queue:" + to_string(i), "x"});
+
+    set<string> users = ScanAll(c, {"MATCH", "user:*", "COUNT", "100"});
+    CHECK_EQ(users.size(), static_cast<size_t>(3000));
+    for (const string& k : users) CHECK(k.compare(0, 5, "user:") == 0);
+    set<string> tens = ScanAll(c, {"MATCH", "order:?0", "COUNT", "50"});
+    CHECK_EQ(tens.size(), static_cast<size_t>(9)); // order:10 ... order:90
+    set<string> lists = ScanAll(c, {"TYPE", "list"});
+    CHECK_EQ(lists.size(), static_cast<size_t>(50));
+    set<string> strings = ScanAll(c, {"TYPE", "string", "MATCH", "*:1??"});
+    CHECK_EQ(strings.size(), static_cast<size_t>(200)); // user:100..199, order:100..199
+    CHECK(ScanAll(c, {"MATCH", "nothing:*"}).empty());
+}
+
+// 另一个连接一边插一边删：一直在的 key 一个不能少，返回的 key 都是真存在过的
+TEST(ConcurrentWrites) {
+    TempDir dir;
+    TestServer server(dir.Path(), BASE_PORT + 2, {"--save", "", "--threads", "4"});
+    server.Start();
+    TestClient c(BASE_PORT + 2);
+    Fill(c, "stable:", 5000);
+    Fill(c, "victim:", 5000);
+    atomic<bool> stop(false);
+    atomic<int> inserted(0);
+    thread writer([&] {
+        TestClient w(BASE_PORT + 2);
+        for (int batch = 0; !stop && batch < 100; ++batch) {
+            vector<vector<string>> cmds;
+            for (int i = 0; i < 1000; ++i) cmds.push_back({"SET", "new:" + to_string(batch * 1000 + i), "v"});
+            for (int i = 0; i < 50; ++i) cmds.push_back({"DEL", "victim:" + to_string(batch * 50 + i)});
+            w.Pipeline(cmds);
+            inserted = (batch + 1) * 1000;
+        }
+    });
+    size_t rounds = 0;
+    bool complete = true, valid = true;
+    // 写的过程中至少完整走几轮
+    while (rounds < 3 || inserted < 100000) {
+        set<string> seen = ScanAll(c, {"COUNT", "20"});
+        for (int i = 0; i < 5000; ++i) complete &= seen.count("stable:" + to_string(i)) == 1;
+        for (const string& k : seen) {
+            valid &= k.compare(0, 7, "stable:") == 0 || k.compare(0, 7, "victim:") == 0 || k.compare(0, 4, "new:") == 0;
+        }
+        ++rounds;
+        if (rounds > 1000) break;
+    }
+    stop = true;
+    writer.join();
+    CHECK(complete);
+    CHECK(valid);
+    CHECK_EQ(KeyCount(c), 5000LL + 100000LL);
+    CHECK_EQ(ScanAll(c, {"COUNT", "500"}).size(), static_cast<size_t>(105000));
+}
+
+TEST(OrderedRange) {
+    TempDir dir;
+    TestServer server(dir.Path(), BASE_PORT + 3, {"--save", "", "--threads", "4"});
+    server.Start();
+    TestClient c(BASE_PORT + 3);
+    vector<vector<string>> sets;
+    for (int i = 0; i < 1000; ++i) {
+        char key[32];
+        snprintf(key, sizeof(key), "item:%04d", i);
+        sets.push_back({"SET", key, "v"});
+    }
+    sets.push_back({"SET", "item;", "v"});
+    sets.push_back({"SET", "iten", "v"});
+    c.Pipeline(sets);
+    // 前缀查询：分片之间要归并成一个有序结果
+    vector<string> all = Strings(c.Cmd({"RANGE", "[item:", "(item;", "LIMIT", "5000"}));
+    CHECK_EQ(all.size(), static_cast<size_t>(1000));
+    for (size_t i = 1; i < all.size(); ++i) CHECK(all[i - 1] < all[i]);
+    CHECK(Strings(c.Cmd({"RANGE", "(item:0010", "[item:0013"})) ==
+          vector<string>({"item:0011", "item:0012", "item:0013"}));
+    CHECK_EQ(c.Cmd({"RANGE", "-", "+"}).elems.size(), static_cast<size_t>(100)); // 默认 LIMIT
+    CHECK(Strings(c.Cmd({"RANGE", "[item;", "+"})) == vector<string>({"item;", "iten"}));
+    CHECK(c.Cmd({"RANGE", "+", "-"}).elems.empty());
+    CHECK(c.Cmd({"RANGE", "item", "+"}).IsError());
+}
+
+int main(int argc, char* argv[]) { return RunTests(argc, argv); }
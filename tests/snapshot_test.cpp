@@ -0,0 +1,140 @@
+/**
+ * snapshot_test.cpp
+ * 快照（data.db）的来回：SAVE / BGSAVE / 正常退出写下去的数据，重启以后一模一样读回来，
+ * 各种编码（整数、embstr、长字符串、二进制、多个节点的 list）和过期时间都在。
+ */
+
+#include "TestUtil.h"
+
+static const int BASE_PORT = 17100;
+
+// 各种编码的值都来一份，返回写进去的 key -> 期望的 GET 结果
+static vector<pair<string, string>> WriteStrings(TestClient& c) {
+    vector<pair<string, string>> kv = {
+        {"int", "12345"},
+        {"negative", "-9223372036854775808"},
+        {"short", "hello"},
+        {"long", string(5000, 'x')},
+        {"binary", string("a\0b\r\nc\xff", 7)},
+        {"empty", ""},
+    };
+    for (const auto& p : kv) CHECK_EQ(c.Cmd({"SET", p.first, p.second}).str, string("OK"));
+    CHECK_EQ(c.Cmd({"INCR", "counter"}).integer, 1LL);
+    kv.push_back({"counter", "1"});
+    return kv;
+}
+
+static void CheckStrings(TestClient& c, const vector<pair<string, string>>& kv) {
+    for (const auto& p : kv) {
+        Reply r = c.Cmd({"GET", p.first});
+        CHECK_EQ(r.type, '$');
+        CHECK_EQ(r.str, p.second);
+    }
+}
+
+// 2000 个元素的 list，够 quicklist 分好几个节点
+static vector<string> WriteList(TestClient& c, const string& key) {
+    vector<string> items;
+    vector<string> cmd = {"RPUSH", key};
+    for (int i = 0; i < 2000; ++i) {
+        items.push_back("item:" + to_string(i));
+        cmd.push_back(items.back());
+    }
+    CHECK_EQ(c.Cmd(cmd).integer, 2000LL);
+    return items;
+}
+
+TEST(SaveAndReload) {
+    TempDir dir;
+    TestServer server(dir.Path(), BASE_PORT, {"--save", ""});
+    server.Start();
+    vector<pair<string, string>> kv;
+    vector<string> items;
+    {
+        TestClient c(BASE_PORT);
+        kv = WriteStrings(c);
+        items = WriteList(c, "list");
+        CHECK_EQ(c.Cmd({"SET", "ttl", "v", "EX", "1000"}).str, string("OK"));
+        CHECK_EQ(c.Cmd({"SAVE"}).str, string("OK"));
+        // SAVE 之后的写不在快照里：kill -9 以后应该没有
+        CHECK_EQ(c.Cmd({"SET", "after-save", "v"}).str, string("OK"));
+    }
+    server.Kill();
+    server.Start();
+    TestClient c(BASE_PORT);
+    CheckStrings(c, kv);
+    CHECK(Strings(c.Cmd({"LRANGE", "list", "0", "-1"})) == items);
+    long long ttl = c.Cmd({"TTL", "ttl"}).integer;
+    CHECK(ttl > 990 && ttl <= 1000);
+    CHECK(c.Cmd({"GET", "after-save"}).IsNil());
+    CHECK_EQ(KeyCount(c), static_cast<long long>(kv.size() + 2));
+}
+
+TEST(BgsaveAndReload) {
+    TempDir dir;
+    TestServer server(dir.Path(), BASE_PORT + 1, {"--save", ""});
+    server.Start();
+    vector<pair<string, string>> kv;
+    {
+        TestClient c(BASE_PORT + 1);
+        kv = WriteStrings(c);
+        for (int i = 0; i < 10000; ++i) kv.push_back({"key:" + to_string(i), "value:" + to_string(i)});
+        vector<vector<string>> sets;
+        for (size_t i = kv.size() - 10000; i < kv.size(); ++i) sets.push_back({"SET", kv[i].first, kv[i].second});
+        c.Pipeline(sets);
+        CHECK_EQ(c.Cmd({"BGSAVE"}).str, string("Background saving started"));
+        CHECK(WaitUntil([&] { return InfoField(c, "persistence", "rdb_bgsave_in_progress") == "0"; }, 10000));
+        CHECK_EQ(InfoField(c, "persistence", "rdb_last_bgsave_status"), string("ok"));
+        CHECK_EQ(InfoField(c, "persistence", "rdb_changes_since_last_save"), string("0"));
+    }
+    server.Kill();
+    server.Start();
+    TestClient c(BASE_PORT + 1);
+    CHECK_EQ(KeyCount(c), static_cast<long long>(kv.size()));
+    CheckStrings(c, kv);
+}
+
+// 没配 save 也一样：SIGINT 正常退出时前台存一份
+TEST(ShutdownSaves) {
+    TempDir dir;
+    TestServer server(dir.Path(), BASE_PORT + 2, {"--save", "", "--threads", "4"});
+    server.Start();
+    vector<pair<string, string>> kv;
+    vector<string> items;
+    {
+        TestClient c(BASE_PORT + 2);
+        kv = WriteStrings(c);
+        items = WriteList(c, "list");
+        CHECK_EQ(c.Cmd({"DEL", "short"}).integer, 1LL);
+    }
+    kv.erase(kv.begin() + 2);
+    server.Stop();
+    // 分片数跟着线程数变，换个线程数加载也要对
+    TestServer reloaded(dir.Path(), BASE_PORT + 2, {"--save", "", "--threads", "2"});
+    reloaded.Start();
+    TestClient c(BASE_PORT + 2);
+    CheckStrings(c, kv);
+    CHECK(c.Cmd({"GET", "short"}).IsNil());
+    CHECK(Strings(c.Cmd({"LRANGE", "list", "0", "-1"})) == items);
+}
+
+// 存的是绝对过期时间：停机期间过期的 key 加载时就扔掉
+TEST(ExpiredWhileDown) {
+    TempDir dir;
+    TestServer server(dir.Path(), BASE_PORT + 3, {"--save", ""});
+    server.Start();
+    {
+        TestClient c(BASE_PORT + 3);
+        CHECK_EQ(c.Cmd({"SET", "short-lived", "v", "PX", "300"}).str, string("OK"));
+        CHECK_EQ(c.Cmd({"SET", "kept", "v"}).str, string("OK"));
+    }
+    server.Stop();
+    SleepMs(400);
+    server.Start();
+    TestClient c(BASE_PORT + 3);
+    CHECK(c.Cmd({"GET", "short-lived"}).IsNil());
+    CHECK_EQ(c.Cmd({"GET", "kept"}).str, string("v"));
+    CHECK_EQ(KeyCount(c), 1LL);
+}
+
+int main(int argc, char* argv[]) { return RunTests(argc, argv); }